@@ -0,0 +1,829 @@
+/*
+ *  usbserial_linux.c
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ *  libusb-1.0 implementation of the USB transport. Bulk transfers use the
+ *  asynchronous API: each reader owns one Bulk-OUT and one Bulk-IN transfer
+ *  which are re-submitted for every message, and the calling thread runs
+ *  the libusb event loop until its own transfer completes. ExchangeUSB()
+ *  submits the Bulk-IN transfer before the Bulk-OUT one.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "global.h"
+#include <wintypes.h>
+#include "pcscdefines.h"
+#include "usbserial.h"
+#include "Transport.h"
+#include "CCID.h"
+
+#include "usbserial_linux.h"
+#include "tools.h"
+
+#define USBMAX_READERS  (PCSCLITE_MAX_CHANNELS)
+//+++ Should be included from a pcscd header file
+#define PCSCLITE_HP_BASE_PORT       0x200000
+#define PCSCLITE_HP_IFACECLASSKEY_NAME    "ifdInterfaceClass"
+#define PCSCLITE_HP_IFACESUBCLASSKEY_NAME "ifdInterfaceSubClass"
+#define PCSCLITE_HP_IFACEPROTOCOLKEY_NAME "ifdInterfaceProtocol"
+
+// Used when the bundle does not restrict the interface: CCID class
+#define USB_CCID_INTERFACE_CLASS    0x0B
+
+// Write time out in milliseconds
+#define WRITE_TIMEOUT   5000
+
+// Read time out in milliseconds (default value)
+unsigned long ReadTimeOut = 60000;
+
+
+static int                      iInitialized = FALSE;
+static libusb_context           *usbContext = NULL;
+
+static intrFace intFace[USBMAX_READERS];
+
+
+// Local helper functions
+static void LIBUSB_CALL TransferDone(struct libusb_transfer *transfer);
+static TrRv SubmitTransfer(struct libusb_transfer *transfer, int *piCompleted);
+static TrRv WaitTransfer(DWORD rdrLun, struct libusb_transfer *transfer,
+                         int *piCompleted, DWORD *transferred);
+static void CancelTransfer(struct libusb_transfer *transfer, int *piCompleted);
+static TrRv SubmitAndWait(DWORD rdrLun, struct libusb_transfer *transfer,
+                          int *piCompleted, DWORD *transferred);
+static UInt8 ParseInfoPlistByte(const char *keyName, UInt8 defaultValue);
+
+
+TrRv OpenUSB( DWORD lun, DWORD Channel)
+{
+    libusb_device           **devs;
+    libusb_device           *dev;
+    struct libusb_device_descriptor     devDesc;
+    struct libusb_config_descriptor     *confDesc;
+    const struct libusb_interface_descriptor  *ifDesc;
+    ssize_t                 cnt, d;
+    int                     r, c, i, a;
+    DWORD                   rdrLun, j;
+    UInt8                   class, subClass, protocol;
+    UInt32                  usbAddr, targetusbAddress;
+    short                   iFound;
+    const char*             cStringValue;
+
+    LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "Entering OpenUSB");
+
+    rdrLun = lun >> 16;
+
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+
+    // The Linux bundle may not restrict the interface, use CCID by default
+    class    = ParseInfoPlistByte(PCSCLITE_HP_IFACECLASSKEY_NAME, USB_CCID_INTERFACE_CLASS);
+    subClass = ParseInfoPlistByte(PCSCLITE_HP_IFACESUBCLASSKEY_NAME, 0x00);
+    protocol = ParseInfoPlistByte(PCSCLITE_HP_IFACEPROTOCOLKEY_NAME, 0x00);
+
+    cStringValue =  ParseInfoPlist(BUNDLE_IDENTIFIER, "ifdReadTimeOut");
+    if ( cStringValue == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                    "OpenUSB warning: ifdReadTimeOut not found, use default: %ld ms",
+                    ReadTimeOut);
+    }
+    else
+    {
+       ReadTimeOut = strtoul(cStringValue, 0, 10);
+    }
+    LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                "Driver configured to detect Interface class=%02X, subClass=%02X, protocol=%02X",
+                class, subClass, protocol);
+
+    if ( iInitialized == FALSE )
+    {
+        r = libusb_init(&usbContext);
+        if ( r != LIBUSB_SUCCESS )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                        "libusb_init failed: %s", libusb_error_name(r));
+            return TrRv_ERR;
+        }
+        bzero(intFace, sizeof(intFace));
+        iInitialized = TRUE;
+    }
+    if ( (intFace[rdrLun]).used )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun already used: %08X", lun);
+        return TrRv_ERR;
+    }
+
+    // Compute target usb Address from Channel ID: (bus << 8) | address
+    // 0 means "first free CCID interface"
+    targetusbAddress = Channel - PCSCLITE_HP_BASE_PORT;
+
+    cnt = libusb_get_device_list(usbContext, &devs);
+    if ( cnt < 0 )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "libusb_get_device_list failed: %s", libusb_error_name((int) cnt));
+        return TrRv_ERR;
+    }
+
+    iFound = FALSE;
+    for (d = 0; (d < cnt) && !iFound; d++)
+    {
+        dev = devs[d];
+        usbAddr = (libusb_get_bus_number(dev) << 8) | libusb_get_device_address(dev);
+        if ( targetusbAddress && (usbAddr != targetusbAddress) )
+        {
+            continue;
+        }
+        // Skip devices already handled by another Lun
+        for (j = 0; j < USBMAX_READERS; j++)
+        {
+            if ( (intFace[j]).used && ((intFace[j]).usbAddr == usbAddr) )
+            {
+                break;
+            }
+        }
+        if ( j < USBMAX_READERS )
+        {
+            continue;
+        }
+        if ( libusb_get_device_descriptor(dev, &devDesc) != LIBUSB_SUCCESS )
+        {
+            continue;
+        }
+        for (c = 0; (c < devDesc.bNumConfigurations) && !iFound; c++)
+        {
+            if ( libusb_get_config_descriptor(dev, c, &confDesc) != LIBUSB_SUCCESS )
+            {
+                continue;
+            }
+            //+++ We do not support a device with 2 CCID interfaces on it as
+            //++ pcscd does not support it either
+            for (i = 0; (i < confDesc->bNumInterfaces) && !iFound; i++)
+            {
+                for (a = 0; a < confDesc->interface[i].num_altsetting; a++)
+                {
+                    ifDesc = &(confDesc->interface[i].altsetting[a]);
+                    if ( (ifDesc->bInterfaceClass == class)
+                         && (ifDesc->bInterfaceSubClass == subClass)
+                         && (ifDesc->bInterfaceProtocol == protocol) )
+                    {
+                        (intFace[rdrLun]).interfaceNb = ifDesc->bInterfaceNumber;
+                        iFound = TRUE;
+                        break;
+                    }
+                }
+            }
+            libusb_free_config_descriptor(confDesc);
+        }
+        if ( !iFound )
+        {
+            continue;
+        }
+        r = libusb_open(dev, &((intFace[rdrLun]).handle));
+        if ( r != LIBUSB_SUCCESS )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                        "unable to open device at %04X: %s", usbAddr, libusb_error_name(r));
+            iFound = FALSE;
+            continue;
+        }
+        (intFace[rdrLun]).dev = libusb_ref_device(dev);
+        (intFace[rdrLun]).usbAddr = usbAddr;
+        (intFace[rdrLun]).vendorID = devDesc.idVendor;
+        (intFace[rdrLun]).productID = devDesc.idProduct;
+        (intFace[rdrLun]).class = class;
+        (intFace[rdrLun]).subClass = subClass;
+        (intFace[rdrLun]).protocol = protocol;
+        (intFace[rdrLun]).used = 1;
+    }
+    libusb_free_device_list(devs, 1);
+
+    if ( !iFound )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: no matching reader found for channel %08X", Channel);
+        return TrRv_ERR;
+    }
+    LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                "Found reader %04X:%04X at USB address %04X",
+                (intFace[rdrLun]).vendorID, (intFace[rdrLun]).productID,
+                (intFace[rdrLun]).usbAddr);
+    return TrRv_OK;
+}
+
+
+TrRv GetConfigDescNumberUSB( DWORD lun, BYTE* pcconfigDescNb )
+{
+    DWORD		rdrLun;
+    struct libusb_device_descriptor devDesc;
+    int r;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+
+    // Check if a USB connection is set-up for this lun
+    if ( ! (intFace[rdrLun]).used )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to get class desc: usb not opened for lun %d", lun);
+        return TrRv_ERR;
+    }
+    r = libusb_get_device_descriptor((intFace[rdrLun]).dev, &devDesc);
+    if ( (r != LIBUSB_SUCCESS) || !devDesc.bNumConfigurations )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to obtain the number of configurations. ret = %d\n", r);
+        return TrRv_ERR;
+    }
+    *pcconfigDescNb = devDesc.bNumConfigurations;
+    return TrRv_OK;
+}
+
+TrRv GetVendorAndProductIDUSB( DWORD lun, DWORD *vendorID, DWORD *productID )
+{
+    DWORD		rdrLun;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+
+    // Check if a USB connection is set-up for this lun
+    if ( ! (intFace[rdrLun]).used )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to get vendor or product ID: usb not opened for lun %d", lun);
+        return TrRv_ERR;
+    }
+    *vendorID  = (intFace[rdrLun]).vendorID;
+    *productID = (intFace[rdrLun]).productID;
+    return TrRv_OK;
+}
+
+
+TrRv GetClassDescUSB( DWORD lun, BYTE configDescNb, BYTE bdescType,
+                      BYTE *pcdesc, BYTE *pcdescLength)
+{
+    DWORD		rdrLun;
+    struct libusb_config_descriptor     *confDesc;
+    const struct libusb_interface_descriptor  *ifDesc = NULL;
+    const unsigned char *ptr = NULL;
+    const unsigned char *extra;
+    int extraLength, offset, i, e;
+    UInt8 targetDescLength;
+    int r;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+
+    // Check if a USB connection is set-up for this lun
+    if ( ! (intFace[rdrLun]).used )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to get class desc: usb not opened for lun %d", lun);
+        return TrRv_ERR;
+    }
+    r = libusb_get_config_descriptor((intFace[rdrLun]).dev, configDescNb, &confDesc);
+    if ( r != LIBUSB_SUCCESS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to get config descriptor for index %d\n", configDescNb);
+        return TrRv_ERR;
+    }
+    for (i = 0; i < confDesc->bNumInterfaces; i++)
+    {
+        if ( confDesc->interface[i].num_altsetting
+             && (confDesc->interface[i].altsetting[0].bInterfaceNumber
+                 == (intFace[rdrLun]).interfaceNb) )
+        {
+            ifDesc = &(confDesc->interface[i].altsetting[0]);
+            break;
+        }
+    }
+    // libusb splits the raw configuration descriptor: the class
+    // descriptor is normally in the interface "extra" bytes but some
+    // readers put it after the end points
+    for (e = -1; ifDesc && (e < ifDesc->bNumEndpoints) && (ptr == NULL); e++)
+    {
+        if ( e < 0 )
+        {
+            extra = ifDesc->extra;
+            extraLength = ifDesc->extra_length;
+        }
+        else
+        {
+            extra = ifDesc->endpoint[e].extra;
+            extraLength = ifDesc->endpoint[e].extra_length;
+        }
+        for (offset = 0; (offset + 1 < extraLength) && extra[offset]; offset += extra[offset])
+        {
+            if ( extra[offset+1] == bdescType )
+            {
+                ptr = extra + offset;
+                break;
+            }
+        }
+    }
+    if ( ptr == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, " unable to find target conf desc %02X\n", bdescType);
+        libusb_free_config_descriptor(confDesc);
+        return TrRv_ERR;
+    }
+    targetDescLength = ptr[0];
+    // Check if called to find out length or to return value
+    if ( pcdesc == NULL )
+    {
+        *pcdescLength = targetDescLength;
+        libusb_free_config_descriptor(confDesc);
+        return TrRv_OK;
+    }
+    // Set length to minimal of buffer or real value
+    if ( *pcdescLength > targetDescLength )
+    {
+        *pcdescLength = targetDescLength;
+    }
+    bcopy(ptr, pcdesc, *pcdescLength);
+    libusb_free_config_descriptor(confDesc);
+    return TrRv_OK;
+}
+
+TrRv SetupConnectionsUSB( DWORD lun, BYTE ConfigDescNb, BYTE interruptPipe)
+{
+    DWORD                               rdrLun;
+    struct libusb_config_descriptor     *confDesc;
+    const struct libusb_interface_descriptor  *ifDesc = NULL;
+    const struct libusb_endpoint_descriptor   *epDesc;
+    int                                 r, i, current;
+    UInt8                               bConfigurationValue;
+
+    // Check if a USB connection is set-up for this lun
+    rdrLun = lun >> 16;
+
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+    if ( ! (intFace[rdrLun]).used )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to get set-up connections: usb not opened for lun %d", lun);
+        return TrRv_ERR;
+    }
+
+    r = libusb_get_config_descriptor((intFace[rdrLun]).dev, ConfigDescNb, &confDesc);
+    if ( r != LIBUSB_SUCCESS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "ERR: unable to get the configuration: %s\n", libusb_error_name(r));
+        return TrRv_ERR;
+    }
+    bConfigurationValue = confDesc->bConfigurationValue;
+
+    // Only change the configuration if needed: doing it on an already
+    // configured device would reset the other interfaces
+    if ( (libusb_get_configuration((intFace[rdrLun]).handle, &current) != LIBUSB_SUCCESS)
+         || (current != bConfigurationValue) )
+    {
+        r = libusb_set_configuration((intFace[rdrLun]).handle, bConfigurationValue);
+        if ( r != LIBUSB_SUCCESS )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                        "ERR: unable to set the configuration: %s\n", libusb_error_name(r));
+            libusb_free_config_descriptor(confDesc);
+            return TrRv_ERR;
+        }
+    }
+
+    libusb_set_auto_detach_kernel_driver((intFace[rdrLun]).handle, 1);
+    r = libusb_claim_interface((intFace[rdrLun]).handle, (intFace[rdrLun]).interfaceNb);
+    if ( r != LIBUSB_SUCCESS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to claim interface %d: %s", (intFace[rdrLun]).interfaceNb,
+                    libusb_error_name(r));
+        libusb_free_config_descriptor(confDesc);
+        return TrRv_ERR;
+    }
+    (intFace[rdrLun]).claimed = 1;
+
+    for (i = 0; i < confDesc->bNumInterfaces; i++)
+    {
+        if ( confDesc->interface[i].num_altsetting
+             && (confDesc->interface[i].altsetting[0].bInterfaceNumber
+                 == (intFace[rdrLun]).interfaceNb) )
+        {
+            ifDesc = &(confDesc->interface[i].altsetting[0]);
+            break;
+        }
+    }
+    for (i = 0; ifDesc && (i < ifDesc->bNumEndpoints); i++)
+    {
+        epDesc = &(ifDesc->endpoint[i]);
+        if ( (epDesc->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == LIBUSB_TRANSFER_TYPE_INTERRUPT )
+        {
+            if ( !((intFace[rdrLun]).intPipeRef)
+                 && ((epDesc->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN) )
+            {
+                (intFace[rdrLun]).intPipeRef = epDesc->bEndpointAddress;
+            }
+            continue;
+        }
+        if ( (epDesc->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_BULK )
+        {
+            continue;
+        }
+        if ( ((epDesc->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN)
+             && !((intFace[rdrLun]).inPipeRef) )
+        {
+            (intFace[rdrLun]).inPipeRef = epDesc->bEndpointAddress;
+        }
+        if ( ((epDesc->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT)
+             && !((intFace[rdrLun]).outPipeRef) )
+        {
+            (intFace[rdrLun]).outPipeRef = epDesc->bEndpointAddress;
+        }
+    }
+    libusb_free_config_descriptor(confDesc);
+
+    if ( interruptPipe && !((intFace[rdrLun]).intPipeRef) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelImportant,
+                    "no interrupt pipe, slot changes will be polled");
+    }
+    if ( !((intFace[rdrLun]).outPipeRef) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "unable to get outPipe");
+        CloseUSB(lun);
+        return TrRv_ERR;
+    }
+
+    if (!( (intFace[rdrLun]).inPipeRef))
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "unable to get inPipe");
+        CloseUSB(lun);
+        return TrRv_ERR;
+    }
+
+    (intFace[rdrLun]).outTransfer = libusb_alloc_transfer(0);
+    (intFace[rdrLun]).inTransfer = libusb_alloc_transfer(0);
+    (intFace[rdrLun]).outCompleted = 1;
+    (intFace[rdrLun]).inCompleted = 1;
+    if ( !((intFace[rdrLun]).outTransfer) || !((intFace[rdrLun]).inTransfer) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "unable to allocate transfers");
+        CloseUSB(lun);
+        return TrRv_ERR;
+    }
+    LogMessage( __FILE__,  __LINE__, LogLevelImportant,
+                "New reader fully set-up at USB address: %08X\n",
+                (intFace[rdrLun]).usbAddr);
+    (intFace[rdrLun]).ready = 1;
+    return TrRv_OK;
+}
+
+
+static void LIBUSB_CALL TransferDone(struct libusb_transfer *transfer)
+{
+    *((int *) transfer->user_data) = 1;
+}
+
+// Submits a transfer prepared with libusb_fill_bulk_transfer()
+// *piCompleted is set by TransferDone() once the transfer is over
+static TrRv SubmitTransfer(struct libusb_transfer *transfer, int *piCompleted)
+{
+    int r;
+
+    *piCompleted = 0;
+    transfer->user_data = piCompleted;
+    transfer->callback = TransferDone;
+
+    r = libusb_submit_transfer(transfer);
+    if ( r != LIBUSB_SUCCESS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to submit transfer: %s", libusb_error_name(r));
+        return TrRv_ERR;
+    }
+    return TrRv_OK;
+}
+
+// Runs the event loop until a submitted transfer completes
+static TrRv WaitTransfer(DWORD rdrLun, struct libusb_transfer *transfer,
+                         int *piCompleted, DWORD *transferred)
+{
+    int r;
+
+    while ( !*piCompleted )
+    {
+        r = libusb_handle_events_completed(usbContext, piCompleted);
+        if ( (r != LIBUSB_SUCCESS) && (r != LIBUSB_ERROR_INTERRUPTED) )
+        {
+            // Cancel and wait for the callback so the transfer can be reused
+            CancelTransfer(transfer, piCompleted);
+        }
+    }
+    if ( transfer->status == LIBUSB_TRANSFER_STALL )
+    {
+        libusb_clear_halt((intFace[rdrLun]).handle, transfer->endpoint);
+    }
+    if ( transfer->status != LIBUSB_TRANSFER_COMPLETED )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "USB transfer on end point %02X failed, status %d",
+                    transfer->endpoint, transfer->status);
+        return TrRv_ERR;
+    }
+    *transferred = transfer->actual_length;
+    return TrRv_OK;
+}
+
+static void CancelTransfer(struct libusb_transfer *transfer, int *piCompleted)
+{
+    libusb_cancel_transfer(transfer);
+    while ( !*piCompleted )
+    {
+        libusb_handle_events_completed(usbContext, piCompleted);
+    }
+}
+
+static TrRv SubmitAndWait(DWORD rdrLun, struct libusb_transfer *transfer,
+                          int *piCompleted, DWORD *transferred)
+{
+    if ( SubmitTransfer(transfer, piCompleted) != TrRv_OK )
+    {
+        *piCompleted = 1;
+        return TrRv_ERR;
+    }
+    return WaitTransfer(rdrLun, transfer, piCompleted, transferred);
+}
+
+
+TrRv WriteUSB( DWORD lun, DWORD length, unsigned char *buffer )
+{
+    DWORD		rdrLun;
+    DWORD       sentLen;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+    if ( ! (intFace[rdrLun]).ready )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to write to USB: set-up not completed for lun %d", lun);
+        return TrRv_ERR;
+    }
+
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, buffer, length,
+                 "Attempt to write: ");
+
+    libusb_fill_bulk_transfer((intFace[rdrLun]).outTransfer, (intFace[rdrLun]).handle,
+                              (intFace[rdrLun]).outPipeRef, buffer, length,
+                              TransferDone, NULL, WRITE_TIMEOUT);
+    if ( SubmitAndWait(rdrLun, (intFace[rdrLun]).outTransfer,
+                       &((intFace[rdrLun]).outCompleted), &sentLen) != TrRv_OK )
+    {
+        return TrRv_ERR;
+    }
+    if ( sentLen != length )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Short write: %ld bytes instead of %ld", sentLen, length);
+        return TrRv_ERR;
+    }
+    return TrRv_OK;
+}
+
+TrRv ReadUSB( DWORD lun, DWORD *length, unsigned char *buffer )
+{
+    DWORD		rdrLun;
+    DWORD       recvLen;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+    if ( ! (intFace[rdrLun]).ready )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to write to USB: set-up not completed for lun %d", lun);
+        return TrRv_ERR;
+    }
+
+    LogMessage( __FILE__,  __LINE__, LogLevelVeryVerbose,
+                "Attempt to read %ld bytes", *length);
+
+    libusb_fill_bulk_transfer((intFace[rdrLun]).inTransfer, (intFace[rdrLun]).handle,
+                              (intFace[rdrLun]).inPipeRef, buffer, *length,
+                              TransferDone, NULL, ReadTimeOut);
+    if ( SubmitAndWait(rdrLun, (intFace[rdrLun]).inTransfer,
+                       &((intFace[rdrLun]).inCompleted), &recvLen) != TrRv_OK )
+    {
+        return TrRv_ERR;
+    }
+
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, buffer, recvLen, "received: ");
+
+    *length = recvLen;
+    return TrRv_OK;
+}
+
+TrRv ExchangeUSB( DWORD lun, DWORD sendLength, unsigned char *sendBuffer,
+                  DWORD *recvLength, unsigned char *recvBuffer )
+{
+    DWORD		rdrLun;
+    DWORD       sentLen, recvLen;
+    int         *piOutCompleted, *piInCompleted;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+    if ( ! (intFace[rdrLun]).ready )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to exchange with USB: set-up not completed for lun %d", lun);
+        return TrRv_ERR;
+    }
+
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, sendBuffer, sendLength,
+                 "Attempt to write: ");
+
+    piOutCompleted = &((intFace[rdrLun]).outCompleted);
+    piInCompleted = &((intFace[rdrLun]).inCompleted);
+
+    // Post the Bulk-IN read first so that the answer is picked up
+    // as soon as the reader sends it
+    libusb_fill_bulk_transfer((intFace[rdrLun]).inTransfer, (intFace[rdrLun]).handle,
+                              (intFace[rdrLun]).inPipeRef, recvBuffer, *recvLength,
+                              TransferDone, NULL, ReadTimeOut);
+    libusb_fill_bulk_transfer((intFace[rdrLun]).outTransfer, (intFace[rdrLun]).handle,
+                              (intFace[rdrLun]).outPipeRef, sendBuffer, sendLength,
+                              TransferDone, NULL, WRITE_TIMEOUT);
+    if ( SubmitTransfer((intFace[rdrLun]).inTransfer, piInCompleted) != TrRv_OK )
+    {
+        *piInCompleted = 1;
+        return TrRv_ERR;
+    }
+    if ( SubmitTransfer((intFace[rdrLun]).outTransfer, piOutCompleted) != TrRv_OK )
+    {
+        *piOutCompleted = 1;
+        CancelTransfer((intFace[rdrLun]).inTransfer, piInCompleted);
+        return TrRv_ERR;
+    }
+    if ( (WaitTransfer(rdrLun, (intFace[rdrLun]).outTransfer, piOutCompleted, &sentLen) != TrRv_OK)
+         || (sentLen != sendLength) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Bulk-OUT write failed");
+        CancelTransfer((intFace[rdrLun]).inTransfer, piInCompleted);
+        return TrRv_ERR;
+    }
+    if ( WaitTransfer(rdrLun, (intFace[rdrLun]).inTransfer, piInCompleted, &recvLen) != TrRv_OK )
+    {
+        return TrRv_ERR;
+    }
+
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, recvBuffer, recvLen, "received: ");
+
+    *recvLength = recvLen;
+    return TrRv_OK;
+}
+
+TrRv ReadInterruptUSB( DWORD lun, DWORD *length, unsigned char *buffer, DWORD timeout )
+{
+    DWORD		rdrLun;
+    int         r, transferred;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+    if ( !(intFace[rdrLun]).ready || !(intFace[rdrLun]).intPipeRef )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "no interrupt pipe for lun %d", lun);
+        return TrRv_ERR;
+    }
+    // Runs on its own thread: the synchronous API shares the libusb
+    // event handling with the bulk transfers
+    r = libusb_interrupt_transfer((intFace[rdrLun]).handle, (intFace[rdrLun]).intPipeRef,
+                                  buffer, *length, &transferred, timeout);
+    if ( r == LIBUSB_ERROR_TIMEOUT )
+    {
+        *length = 0;
+        return TrRv_OK;
+    }
+    if ( r != LIBUSB_SUCCESS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "interrupt transfer failed: %s", libusb_error_name(r));
+        return TrRv_ERR;
+    }
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, buffer, transferred, "interrupt: ");
+    *length = transferred;
+    return TrRv_OK;
+}
+
+TrRv CloseUSB( DWORD lun )
+{
+    DWORD rdrLun;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "CloseUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+
+    // No new transfer may be submitted from now on
+    (intFace[rdrLun]).ready = 0;
+    // libusb_free_transfer() must not be called on a transfer that is still
+    // in flight: cancel it and run the event loop until its callback fired
+    if ( (intFace[rdrLun]).outTransfer )
+    {
+        if ( !(intFace[rdrLun]).outCompleted )
+        {
+            CancelTransfer((intFace[rdrLun]).outTransfer, &((intFace[rdrLun]).outCompleted));
+        }
+        libusb_free_transfer((intFace[rdrLun]).outTransfer);
+    }
+    if ( (intFace[rdrLun]).inTransfer )
+    {
+        if ( !(intFace[rdrLun]).inCompleted )
+        {
+            CancelTransfer((intFace[rdrLun]).inTransfer, &((intFace[rdrLun]).inCompleted));
+        }
+        libusb_free_transfer((intFace[rdrLun]).inTransfer);
+    }
+    if ( (intFace[rdrLun]).handle )
+    {
+        if ( (intFace[rdrLun]).claimed )
+        {
+            libusb_release_interface((intFace[rdrLun]).handle, (intFace[rdrLun]).interfaceNb);
+        }
+        libusb_close((intFace[rdrLun]).handle);
+    }
+    if ( (intFace[rdrLun]).dev )
+    {
+        libusb_unref_device((intFace[rdrLun]).dev);
+    }
+    // Reset struct
+    bzero(&(intFace[rdrLun]), sizeof(intrFace));
+    return TrRv_OK;
+}
+
+
+static UInt8 ParseInfoPlistByte(const char *keyName, UInt8 defaultValue)
+{
+    const char* cStringValue;
+
+    cStringValue =  ParseInfoPlist(BUNDLE_IDENTIFIER, keyName);
+    if ( cStringValue == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                    "OpenUSB warning: %s not found, use default: %02X", keyName, defaultValue);
+        return defaultValue;
+    }
+    return (UInt8) strtoul(cStringValue, 0, 16);
+}
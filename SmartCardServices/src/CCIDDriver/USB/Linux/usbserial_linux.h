@@ -0,0 +1,40 @@
+/*
+ *  usbserial_linux.h
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ */
+
+#ifndef _USBSERIAL_LINUX_H_
+#define _USBSERIAL_LINUX_H_
+
+#include <libusb.h>
+
+typedef struct _intFace {
+    libusb_device_handle        *handle;
+    libusb_device               *dev;
+    // Transfers are allocated once in SetupConnectionsUSB()
+    // and re-submitted for every Write/Read
+    struct libusb_transfer      *outTransfer;
+    struct libusb_transfer      *inTransfer;
+    // Cleared on submission and set by the completion callback, so that
+    // CloseUSB() can tell which transfers are still in flight
+    int                         outCompleted;
+    int                         inCompleted;
+    UInt32                      usbAddr;
+    UInt8                       interfaceNb;
+    UInt8                       inPipeRef;
+    UInt8                       outPipeRef;
+    UInt8                       intPipeRef;
+    UInt8                       used;
+    UInt8                       ready;
+    UInt8                       claimed;
+    UInt16                      vendorID;
+    UInt16                      productID;
+    UInt8                       class;
+    UInt8                       subClass;
+    UInt8                       protocol;
+} intrFace, *pIntrFace;
+
+#endif
@@ -649,7 +649,6 @@ TrRv GetClassDescUSB( DWORD lun, BYTE configDescNb, BYTE bdescType,
     return TrRv_OK;
 }
 
-//+++ NEED TO ADD and interruptPipe management
 TrRv SetupConnectionsUSB( DWORD lun, BYTE ConfigDescNb, BYTE interruptPipe)
 {
     kern_return_t                       kr;
@@ -792,6 +791,12 @@ TrRv SetupConnectionsUSB( DWORD lun, BYTE ConfigDescNb, BYTE interruptPipe)
                         "unable to get pipe properties: 0x%08X", kr);
             return TrRv_ERR;
         }
+        if ((transferType == kUSBInterrupt) && (direction == kUSBIn)
+            && interruptPipe && !((intFace[rdrLun]).intPipeRef))
+        {
+            (intFace[rdrLun]).intPipeRef = i;
+            continue;
+        }
         if (transferType != kUSBBulk)
         {
             continue;
@@ -804,8 +809,11 @@ TrRv SetupConnectionsUSB( DWORD lun, BYTE ConfigDescNb, BYTE interruptPipe)
         {
             (intFace[rdrLun]).outPipeRef = i;
         }
-        //+++ Need to add optional management of interrupt pipe
-
+    }
+    if ( interruptPipe && !((intFace[rdrLun]).intPipeRef) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelImportant,
+                    "no interrupt pipe, slot changes will be polled");
     }
 
 
@@ -929,6 +937,47 @@ TrRv ReadUSB( DWORD lun, DWORD *length, unsigned char *buffer )
     return TrRv_OK;
 }
 
+TrRv ReadInterruptUSB( DWORD lun, DWORD *length, unsigned char *buffer, DWORD timeout )
+{
+    IOReturn	iorv;
+    UInt32		recvLen;
+    DWORD		rdrLun;
+
+    rdrLun = lun >> 16;
+    if ( rdrLun >= USBMAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "OpenUSB error: lun too large: %08X", lun);
+        return TrRv_ERR;
+    }
+    if ( !(intFace[rdrLun]).ready || !(intFace[rdrLun]).intPipeRef )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "no interrupt pipe for lun %d", lun);
+        return TrRv_ERR;
+    }
+
+    recvLen = *length;
+    iorv = (*(intFace[rdrLun]).iface)->ReadPipeTO( (intFace[rdrLun]).iface,
+                                                    (intFace[rdrLun]).intPipeRef,
+                                                    buffer, &recvLen, timeout, timeout);
+    if ( iorv == kIOUSBTransactionTimeout )
+    {
+        // Time-outs leave the pipe stalled
+        (*(intFace[rdrLun]).iface)->ClearPipeStallBothEnds((intFace[rdrLun]).iface,
+                                                           (intFace[rdrLun]).intPipeRef);
+        *length = 0;
+        return TrRv_OK;
+    }
+    if ( iorv != kIOReturnSuccess )
+    {
+        return TrRv_ERR;
+    }
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, buffer, recvLen, "interrupt: ");
+    *length = recvLen;
+    return TrRv_OK;
+}
+
 TrRv CloseUSB( DWORD lun )
 {
     IOReturn iorv;
@@ -946,6 +995,7 @@ TrRv CloseUSB( DWORD lun )
     (intFace[rdrLun]).usbAddr = 0;
     (intFace[rdrLun]).outPipeRef = 0;
     (intFace[rdrLun]).inPipeRef = 0;
+    (intFace[rdrLun]).intPipeRef = 0;
     (intFace[rdrLun]).used = 0;
     (intFace[rdrLun]).ready = 0;
     (intFace[rdrLun]).class = 0;
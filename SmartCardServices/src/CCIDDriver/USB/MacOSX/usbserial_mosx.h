@@ -17,6 +17,7 @@ typedef struct _intFace {
     UInt32 						usbAddr;
     UInt8						inPipeRef;
     UInt8						outPipeRef;
+    UInt8						intPipeRef;
     UInt8 						used;
     UInt8 						ready;
     UInt16	 					vendorID;
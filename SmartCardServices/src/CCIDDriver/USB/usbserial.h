@@ -29,6 +29,13 @@ TrRv SetupUSB( DWORD lun,  void* pBuffer, DWORD * pLength);
 TrRv WriteUSB( DWORD lun, DWORD length, BYTE *Buffer );
 TrRv ReadUSB( DWORD lun, DWORD *length, BYTE *Buffer );
 TrRv CloseUSB( DWORD lun );
+// Write followed by Read with the Bulk-IN transfer posted first
+// (not available on Mac OS X)
+TrRv ExchangeUSB( DWORD lun, DWORD sendLength, BYTE *sendBuffer,
+                  DWORD *recvLength, BYTE *recvBuffer );
+// Waits up to timeout ms for a message on the interrupt pipe
+// (*length set to 0 on time out)
+TrRv ReadInterruptUSB( DWORD lun, DWORD *length, BYTE *buffer, DWORD timeout );
 
 #endif
 
@@ -0,0 +1,1242 @@
+/*
+ *  virtualreader.c
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ *  Script format (one statement per line, '#' starts a comment,
+ *  hex bytes may be separated by spaces):
+ *
+ *      ATR      3B 02 14 50
+ *      SLOTS    4 4                   (number of slots, max busy slots)
+ *      TPDU     T1                    (TPDU-level reader, T=0 or T=1 card)
+ *      T1FAULTS 7 1                   (garble every 7th T=1 block, ask for WTX)
+ *      PARAMS   MANUAL                (no automatic configuration from the ATR)
+ *      LATENCY  250                   (card processing time in microseconds)
+ *      00 A4 04 00 = 6A 82            (APDU prefix = response incl. SW)
+ *      00 CA       = 01 02 90 00
+ *
+ *  APDUs that match no rule are answered with 6D 00.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "global.h"
+#include <wintypes.h>
+#include "pcscdefines.h"
+#include "Transport.h"
+#include "CCID.h"
+#include "tools.h"
+#include "virtualreader.h"
+
+#define VIRTUAL_MAX_READERS         (PCSCLITE_MAX_CHANNELS)
+#define VIRTUAL_MAX_SLOTS           8
+// Short APDU exchange level: header + 261 bytes of data
+#define VIRTUAL_MAX_DATA_LENGTH     261
+#define VIRTUAL_MAX_MESSAGE_LENGTH  (sizeof(CCIDMessageBulkIn) + VIRTUAL_MAX_DATA_LENGTH)
+#define VIRTUAL_SCRIPT_ENV          "CCID_VIRTUAL_SCRIPT"
+#define VIRTUAL_VENDOR_ID           0xFFFF
+#define VIRTUAL_PRODUCT_ID          0x0001
+#define VIRTUAL_T0_PARAMETERS_SIZE  5
+
+typedef struct _virtualRule {
+    BYTE                *pbCmdPrefix;
+    DWORD               dwCmdPrefixLength;
+    BYTE                *pbResp;
+    DWORD               dwRespLength;
+    struct _virtualRule *pNext;
+} virtualRule;
+
+// Bulk-IN message waiting to be read
+typedef struct {
+    BYTE                pcMessage[VIRTUAL_MAX_MESSAGE_LENGTH];
+    DWORD               dwLength;
+    // When the card is done processing the command
+    struct timeval      tvReady;
+} virtualResponse;
+
+// T=1 side of a card on a TPDU-level reader
+typedef struct {
+    // bIFSC: what the card accepts, bIFSD: what the host accepts,
+    // bNs: N(S) of the next I-block of the card, bNr: N(S) expected from the host
+    CCIDT1State         state;
+    BYTE                pbCmd[VIRTUAL_MAX_DATA_LENGTH];
+    DWORD               dwCmdLength;
+    BYTE                pbResp[VIRTUAL_MAX_DATA_LENGTH];
+    DWORD               dwRespLength;
+    // Bytes of pbResp acknowledged by the host / sent in the last I-block
+    DWORD               dwRespSent;
+    DWORD               dwRespChunk;
+    // An I-block of the card waits for its acknowledgement
+    BYTE                bAwaitAck;
+    BYTE                bWTXPending;
+    // Sent again when the host asks for it
+    BYTE                pbLastBlock[T1_MAX_BLOCK_SIZE];
+    DWORD               dwLastBlockLength;
+} virtualT1Card;
+
+typedef struct {
+    BYTE                used;
+    BYTE                ready;
+    // SetupConnections asked for the interrupt pipe
+    BYTE                interruptPipe;
+    BYTE                scripted;
+    BYTE                bSlotCount;
+    BYTE                bMaxBusySlots;
+    BYTE                bPresent[VIRTUAL_MAX_SLOTS];
+    BYTE                bPowered[VIRTUAL_MAX_SLOTS];
+    BYTE                pcATR[MAX_ATR_SIZE];
+    DWORD               dwATRLength;
+    virtualRule         *pRules;
+    virtualRule         *pLastRule;
+    VirtualCardHandler  handler;
+    void                *pContext;
+    DWORD               dwLatencyUs;
+    // Bulk-OUT messages received since the last reset
+    DWORD               dwMessageCount;
+    BYTE                bTPDU;
+    BYTE                bT1;
+    BYTE                bT1WTX;
+    DWORD               dwT1CorruptEvery;
+    DWORD               dwT1BlockCount;
+    virtualT1Card       t1Cards[VIRTUAL_MAX_SLOTS];
+    // Without CCID_CLASS_FEAT_AUTO_CONF_ATR the slots stay at T=0 after power on
+    // and only talk T=1 once PC_to_RDR_SetParameters selected it
+    BYTE                bManualParams;
+    BYTE                bProtocol[VIRTUAL_MAX_SLOTS];
+    BYTE                pbParams[VIRTUAL_MAX_SLOTS][T1_PARAMETERS_SIZE];
+    DWORD               dwParamsLength[VIRTUAL_MAX_SLOTS];
+    // Responses in the order the commands were received; one per
+    // busy slot at most
+    virtualResponse     responses[VIRTUAL_MAX_SLOTS];
+    WORD                wResponseHead;
+    WORD                wResponseCount;
+    // Card insertions/removals not reported yet on the interrupt pipe
+    BYTE                bSlotChanged[VIRTUAL_MAX_SLOTS];
+    BYTE                bNotifyPending;
+    pthread_cond_t      interruptCond;
+    // Write and Read may be called from different threads when
+    // several slots are busy
+    pthread_mutex_t     mutex;
+} virtualReader;
+
+static virtualReader VirtualReaders[VIRTUAL_MAX_READERS];
+static int           iInitialized = FALSE;
+
+// Plain T=0 ATR used when none is scripted
+static const BYTE DefaultATR[] = { 0x3B, 0x02, 0x14, 0x50 };
+// Parameters of a slot after power on: T=0, Fi = 372, Di = 1, WI = 10
+static const BYTE DefaultT0Parameters[VIRTUAL_T0_PARAMETERS_SIZE] =
+    { 0x11, 0x00, 0x00, 0x0A, 0x00 };
+
+
+static void VirtualInit()
+{
+    DWORD i, j;
+
+    if ( iInitialized )
+    {
+        return;
+    }
+    bzero(VirtualReaders, sizeof(VirtualReaders));
+    for (i = 0; i < VIRTUAL_MAX_READERS; i++)
+    {
+        bcopy(DefaultATR, VirtualReaders[i].pcATR, sizeof(DefaultATR));
+        VirtualReaders[i].dwATRLength = sizeof(DefaultATR);
+        VirtualReaders[i].bSlotCount = 1;
+        VirtualReaders[i].bMaxBusySlots = 1;
+        for (j = 0; j < VIRTUAL_MAX_SLOTS; j++)
+        {
+            VirtualReaders[i].bPresent[j] = 1;
+        }
+        pthread_mutex_init(&(VirtualReaders[i].mutex), NULL);
+        pthread_cond_init(&(VirtualReaders[i].interruptCond), NULL);
+    }
+    iInitialized = TRUE;
+}
+
+static virtualReader *VirtualGetReader( DWORD rdrLun )
+{
+    if ( rdrLun >= VIRTUAL_MAX_READERS )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Virtual reader error: reader lun too large: %08X", rdrLun);
+        return NULL;
+    }
+    VirtualInit();
+    return &VirtualReaders[rdrLun];
+}
+
+// The descriptor fields are not aligned: store them byte-wise
+static void VirtualPutWord( BYTE *pcField, UInt16 wValue )
+{
+    memcpy(pcField, &wValue, sizeof(wValue));
+}
+
+static void VirtualPutLong( BYTE *pcField, UInt32 dwValue )
+{
+    memcpy(pcField, &dwValue, sizeof(dwValue));
+}
+
+// Builds the class descriptor of the emulated reader in USB byte order
+static void VirtualBuildClassDesc( virtualReader *pReader, BYTE *pcDesc )
+{
+    bzero(pcDesc, CCID_DESC_SIZE);
+    pcDesc[OFFSET_bLength] = CCID_DESC_SIZE;
+    pcDesc[OFFSET_bDescriptorType] = CCID_DESC_TYPE;
+    VirtualPutWord(pcDesc + OFFSET_bcdCCID, HostToCCIDWord(0x0100));
+    pcDesc[OFFSET_bMaxSlotIndex] = pReader->bSlotCount - 1;
+    pcDesc[OFFSET_bVoltageSupport] = 0x07;
+    // CCID_CLASS_FEAT_AUTO_CONF_ATR is left out when the parameters are manual
+    VirtualPutLong(pcDesc + OFFSET_dwProtocols,
+                   HostToCCIDLong(CCID_CLASS_PROTOCOL_T0 | CCID_CLASS_PROTOCOL_T1));
+    VirtualPutLong(pcDesc + OFFSET_dwDefaultClock, HostToCCIDLong(4000));
+    VirtualPutLong(pcDesc + OFFSET_dwMaximumClock, HostToCCIDLong(4000));
+    VirtualPutLong(pcDesc + OFFSET_dwDataRate, HostToCCIDLong(10752));
+    VirtualPutLong(pcDesc + OFFSET_dwMaxDataRate, HostToCCIDLong(10752));
+    VirtualPutLong(pcDesc + OFFSET_dwMaxIFSD, HostToCCIDLong(254));
+    VirtualPutLong(pcDesc + OFFSET_dwFeatures,
+                   HostToCCIDLong((pReader->bManualParams ? 0 : CCID_CLASS_FEAT_AUTO_CONF_ATR) |
+                                  CCID_CLASS_FEAT_AUTO_ACT |
+                                  CCID_CLASS_FEAT_AUTO_VOLT | CCID_CLASS_FEAT_AUTO_CLOCK |
+                                  CCID_CLASS_FEAT_AUTO_BAUD | CCID_CLASS_FEAT_AUTO_PPS_CUR |
+                                  (pReader->bTPDU ? CCID_CLASS_FEAT_EXC_LEVEL_TPDU
+                                   : (CCID_CLASS_FEAT_AUTO_IFSD | CCID_CLASS_FEAT_EXC_LEVEL_SAPDU))));
+    VirtualPutLong(pcDesc + OFFSET_dwMaxCCIDMessageLength,
+                   HostToCCIDLong(VIRTUAL_MAX_MESSAGE_LENGTH));
+    pcDesc[OFFSET_bClassGetResponse] = 0xFF;
+    pcDesc[OFFSET_bClassEnvelope] = 0xFF;
+    pcDesc[OFFSET_bMaxCCIDBusySlots] = pReader->bMaxBusySlots;
+}
+
+// Back to the parameters a slot has after power on
+static void VirtualResetParameters( virtualReader *pReader, BYTE bSlot )
+{
+    pReader->bProtocol[bSlot] = CCID_PROTOCOL_T0;
+    bcopy(DefaultT0Parameters, pReader->pbParams[bSlot], sizeof(DefaultT0Parameters));
+    pReader->dwParamsLength[bSlot] = sizeof(DefaultT0Parameters);
+}
+
+// Runs one APDU through the handler, then the rules
+static void VirtualProcessAPDU( virtualReader *pReader, DWORD lun,
+                                BYTE *pbCmd, DWORD dwCmdLength,
+                                BYTE *pbResp, DWORD *pdwRespLength )
+{
+    virtualRule *pRule;
+    DWORD dwRespLength;
+
+    if ( pReader->handler != NULL )
+    {
+        dwRespLength = *pdwRespLength;
+        if ( pReader->handler(pReader->pContext, lun, pbCmd, dwCmdLength,
+                              pbResp, &dwRespLength) == TrRv_OK )
+        {
+            *pdwRespLength = dwRespLength;
+            return;
+        }
+    }
+    for (pRule = pReader->pRules; pRule != NULL; pRule = pRule->pNext)
+    {
+        if ( (pRule->dwCmdPrefixLength <= dwCmdLength)
+             && !memcmp(pRule->pbCmdPrefix, pbCmd, pRule->dwCmdPrefixLength) )
+        {
+            dwRespLength = pRule->dwRespLength;
+            if ( dwRespLength > *pdwRespLength )
+            {
+                dwRespLength = *pdwRespLength;
+            }
+            bcopy(pRule->pbResp, pbResp, dwRespLength);
+            *pdwRespLength = dwRespLength;
+            return;
+        }
+    }
+    // INS not supported
+    pbResp[0] = 0x6D;
+    pbResp[1] = 0x00;
+    *pdwRespLength = 2;
+}
+
+// Queues a block of the card and keeps it in case the host asks for it again
+static void VirtualT1SendBlock( virtualT1Card *pCard, BYTE bPCB, BYTE *pbINF, BYTE bLength )
+{
+    pCard->dwLastBlockLength = T1BuildBlock(pCard->pbLastBlock, 0, bPCB, pbINF, bLength,
+                                            pCard->state.bEDC);
+}
+
+// Sends the part of the response following what the host acknowledged
+static void VirtualT1SendResponse( virtualT1Card *pCard )
+{
+    BYTE bMore;
+
+    pCard->dwRespChunk = pCard->dwRespLength - pCard->dwRespSent;
+    if ( pCard->dwRespChunk > pCard->state.bIFSD )
+    {
+        pCard->dwRespChunk = pCard->state.bIFSD;
+    }
+    bMore = (pCard->dwRespSent + pCard->dwRespChunk < pCard->dwRespLength);
+    VirtualT1SendBlock(pCard, T1_I_BLOCK | (pCard->state.bNs ? T1_I_NS : 0)
+                       | (bMore ? T1_I_MORE : 0),
+                       pCard->pbResp + pCard->dwRespSent, (BYTE) pCard->dwRespChunk);
+    pCard->bAwaitAck = 1;
+}
+
+// Card side of the T=1 protocol: answers one block of the host
+static void VirtualProcessT1Block( virtualReader *pReader, DWORD lun, virtualT1Card *pCard,
+                                   BYTE *pbBlock, DWORD dwLength,
+                                   BYTE *pbOut, DWORD *pdwOutLength )
+{
+    BYTE bPCB, bLength;
+    BYTE bErrorPCB = 0;
+    BYTE bMore;
+
+    bPCB = (dwLength > T1_OFFSET_PCB) ? pbBlock[T1_OFFSET_PCB] : 0;
+    if ( !T1CheckBlock(pbBlock, dwLength, pCard->state.bEDC,
+                       T1_IS_I_BLOCK(bPCB) ? pCard->state.bIFSC : 1) )
+    {
+        bErrorPCB = T1_R_ERR_EDC;
+    }
+    else if ( T1_IS_I_BLOCK(bPCB) )
+    {
+        bLength = pbBlock[T1_OFFSET_LEN];
+        if ( T1_GET_NS(bPCB) != pCard->state.bNr )
+        {
+            // Our answer got lost, the host sent its block again
+        }
+        else if ( pCard->dwCmdLength + bLength > sizeof(pCard->pbCmd) )
+        {
+            bErrorPCB = T1_R_ERR_OTHER;
+        }
+        else
+        {
+            if ( pCard->bAwaitAck )
+            {
+                // New command: our last answer made it
+                pCard->state.bNs ^= 1;
+                pCard->bAwaitAck = 0;
+            }
+            pCard->state.bNr ^= 1;
+            bcopy(pbBlock + T1_OFFSET_INF, pCard->pbCmd + pCard->dwCmdLength, bLength);
+            pCard->dwCmdLength += bLength;
+            if ( bPCB & T1_I_MORE )
+            {
+                VirtualT1SendBlock(pCard, T1_R_BLOCK | (pCard->state.bNr ? T1_R_NR : 0),
+                                   NULL, 0);
+            }
+            else
+            {
+                pCard->dwRespLength = sizeof(pCard->pbResp);
+                VirtualProcessAPDU(pReader, lun, pCard->pbCmd, pCard->dwCmdLength,
+                                   pCard->pbResp, &(pCard->dwRespLength));
+                pCard->dwCmdLength = 0;
+                pCard->dwRespSent = 0;
+                if ( pReader->bT1WTX )
+                {
+                    bLength = 1;
+                    pCard->bWTXPending = 1;
+                    VirtualT1SendBlock(pCard, T1_S_BLOCK | T1_S_WTX, &bLength, 1);
+                }
+                else
+                {
+                    VirtualT1SendResponse(pCard);
+                }
+            }
+        }
+    }
+    else if ( T1_IS_R_BLOCK(bPCB) )
+    {
+        bMore = (pCard->dwRespSent + pCard->dwRespChunk < pCard->dwRespLength);
+        if ( pCard->bAwaitAck && bMore && (T1_GET_NR(bPCB) != pCard->state.bNs) )
+        {
+            // Host wants the next part of the response
+            pCard->state.bNs ^= 1;
+            pCard->dwRespSent += pCard->dwRespChunk;
+            VirtualT1SendResponse(pCard);
+        }
+        // Otherwise the last block is sent again
+    }
+    else
+    {
+        bLength = pbBlock[T1_OFFSET_LEN];
+        switch ( bPCB )
+        {
+            case T1_S_BLOCK | T1_S_IFS:
+                if ( (bLength != 1) || (pbBlock[T1_OFFSET_INF] == 0x00)
+                     || (pbBlock[T1_OFFSET_INF] == 0xFF) )
+                {
+                    bErrorPCB = T1_R_ERR_OTHER;
+                    break;
+                }
+                pCard->state.bIFSD = pbBlock[T1_OFFSET_INF];
+                VirtualT1SendBlock(pCard, bPCB | T1_S_RESPONSE, pbBlock + T1_OFFSET_INF, 1);
+                break;
+            case T1_S_BLOCK | T1_S_RESYNCH:
+            case T1_S_BLOCK | T1_S_ABORT:
+                if ( bPCB == (T1_S_BLOCK | T1_S_RESYNCH) )
+                {
+                    pCard->state.bNs = 0;
+                    pCard->state.bNr = 0;
+                    pCard->state.bIFSD = T1_DEFAULT_IFS;
+                }
+                pCard->dwCmdLength = 0;
+                pCard->dwRespLength = 0;
+                pCard->dwRespSent = 0;
+                pCard->dwRespChunk = 0;
+                pCard->bAwaitAck = 0;
+                pCard->bWTXPending = 0;
+                VirtualT1SendBlock(pCard, bPCB | T1_S_RESPONSE, NULL, 0);
+                break;
+            case T1_S_BLOCK | T1_S_RESPONSE | T1_S_WTX:
+                if ( pCard->bWTXPending )
+                {
+                    pCard->bWTXPending = 0;
+                    VirtualT1SendResponse(pCard);
+                }
+                break;
+            default:
+                bErrorPCB = T1_R_ERR_OTHER;
+                break;
+        }
+    }
+
+    if ( bErrorPCB )
+    {
+        // Error blocks are not sent again: the host answers with its last block
+        *pdwOutLength = T1BuildBlock(pbOut, 0,
+                                     T1_R_BLOCK | (pCard->state.bNr ? T1_R_NR : 0) | bErrorPCB,
+                                     NULL, 0, pCard->state.bEDC);
+    }
+    else
+    {
+        bcopy(pCard->pbLastBlock, pbOut, pCard->dwLastBlockLength);
+        *pdwOutLength = pCard->dwLastBlockLength;
+    }
+    pReader->dwT1BlockCount++;
+    if ( pReader->dwT1CorruptEvery
+         && ((pReader->dwT1BlockCount % pReader->dwT1CorruptEvery) == 0) )
+    {
+        pbOut[*pdwOutLength - 1] ^= 0xFF;
+    }
+}
+
+// Parses hex bytes from pcText, returns the number of bytes or -1
+static long VirtualParseHex( const char *pcText, BYTE *pbOut, DWORD dwOutSize )
+{
+    DWORD dwLength = 0;
+    int iNibble = -1;
+    int iValue;
+
+    for (; *pcText; pcText++)
+    {
+        if ( isspace((unsigned char) *pcText) )
+        {
+            continue;
+        }
+        if ( !isxdigit((unsigned char) *pcText) )
+        {
+            return -1;
+        }
+        iValue = isdigit((unsigned char) *pcText) ? (*pcText - '0')
+            : (tolower((unsigned char) *pcText) - 'a' + 10);
+        if ( iNibble < 0 )
+        {
+            iNibble = iValue;
+            continue;
+        }
+        if ( dwLength >= dwOutSize )
+        {
+            return -1;
+        }
+        pbOut[dwLength++] = (BYTE)((iNibble << 4) | iValue);
+        iNibble = -1;
+    }
+    if ( iNibble >= 0 )
+    {
+        return -1;
+    }
+    return dwLength;
+}
+
+
+TrRv OpenVirtual( DWORD lun, DWORD channel )
+{
+    DWORD rdrLun;
+    virtualReader *pReader;
+    const char *pcScript;
+
+    LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "Entering OpenVirtual");
+
+    rdrLun = LunToReaderLun(lun);
+    pReader = VirtualGetReader(rdrLun);
+    if ( pReader == NULL )
+    {
+        return TrRv_ERR;
+    }
+    if ( pReader->used )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Virtual reader already opened for lun %08X", lun);
+        return TrRv_ERR;
+    }
+    // Pick up a script from the environment unless the emulator
+    // was already set-up in-process
+    pcScript = getenv(VIRTUAL_SCRIPT_ENV);
+    if ( (pcScript != NULL) && !pReader->scripted && (pReader->handler == NULL) )
+    {
+        if ( VirtualReaderLoadScript(rdrLun, pcScript) != TrRv_OK )
+        {
+            return TrRv_ERR;
+        }
+    }
+    pReader->used = 1;
+    bzero(pReader->bPowered, sizeof(pReader->bPowered));
+    pReader->wResponseHead = 0;
+    pReader->wResponseCount = 0;
+    LogMessage( __FILE__,  __LINE__, LogLevelImportant,
+                "Virtual reader opened on channel %08X", channel);
+    return TrRv_OK;
+}
+
+TrRv GetConfigDescNumberVirtual( DWORD lun, BYTE* pcconfigDescNb )
+{
+    virtualReader *pReader = VirtualGetReader(LunToReaderLun(lun));
+
+    if ( (pReader == NULL) || !pReader->used )
+    {
+        return TrRv_ERR;
+    }
+    *pcconfigDescNb = 1;
+    return TrRv_OK;
+}
+
+TrRv GetVendorAndProductIDVirtual( DWORD lun, DWORD *vendorID, DWORD *productID )
+{
+    virtualReader *pReader = VirtualGetReader(LunToReaderLun(lun));
+
+    if ( (pReader == NULL) || !pReader->used )
+    {
+        return TrRv_ERR;
+    }
+    *vendorID  = VIRTUAL_VENDOR_ID;
+    *productID = VIRTUAL_PRODUCT_ID;
+    return TrRv_OK;
+}
+
+TrRv GetClassDescVirtual( DWORD lun, BYTE configDescNb, BYTE bdescType,
+                          BYTE *pcdesc, BYTE *pcdescLength)
+{
+    virtualReader *pReader = VirtualGetReader(LunToReaderLun(lun));
+    BYTE pcClassDesc[CCID_DESC_SIZE];
+
+    if ( (pReader == NULL) || !pReader->used )
+    {
+        return TrRv_ERR;
+    }
+    if ( (configDescNb != 0) || (bdescType != CCID_DESC_TYPE) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to find target conf desc %02X\n", bdescType);
+        return TrRv_ERR;
+    }
+    // Check if called to find out length or to return value
+    if ( pcdesc == NULL )
+    {
+        *pcdescLength = CCID_DESC_SIZE;
+        return TrRv_OK;
+    }
+    if ( *pcdescLength > CCID_DESC_SIZE )
+    {
+        *pcdescLength = CCID_DESC_SIZE;
+    }
+    VirtualBuildClassDesc(pReader, pcClassDesc);
+    bcopy(pcClassDesc, pcdesc, *pcdescLength);
+    return TrRv_OK;
+}
+
+TrRv SetupConnectionsVirtual( DWORD lun, BYTE ConfigDescNb, BYTE interruptPipe)
+{
+    virtualReader *pReader = VirtualGetReader(LunToReaderLun(lun));
+
+    if ( (pReader == NULL) || !pReader->used )
+    {
+        return TrRv_ERR;
+    }
+    // Only one configuration is offered (see GetClassDescVirtual)
+    if ( ConfigDescNb != 0 )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to find target conf desc %02X\n", ConfigDescNb);
+        return TrRv_ERR;
+    }
+    pReader->interruptPipe = interruptPipe ? 1 : 0;
+    pReader->ready = 1;
+    return TrRv_OK;
+}
+
+TrRv WriteVirtual( DWORD lun, DWORD length, BYTE *buffer )
+{
+    DWORD rdrLun = LunToReaderLun(lun);
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+    virtualResponse *pResponse;
+    CCIDMessageBulkOut *pstmessage;
+    CCIDMessageBulkIn  *pstresponse;
+    BYTE *pbData;
+    DWORD dwDataLength;
+    BYTE bSlot;
+    BYTE bICCStatus;
+    BYTE bProtocolNum;
+    // Set with the error code when the command fails
+    BYTE bFailed = FALSE, bFailError = 0;
+
+    if ( (pReader == NULL) || !pReader->ready )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to write to virtual reader: set-up not completed for lun %d", lun);
+        return TrRv_ERR;
+    }
+    if ( length < sizeof(CCIDMessageBulkOut) )
+    {
+        return TrRv_ERR;
+    }
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, buffer, length,
+                 "Attempt to write: ");
+
+    pstmessage = (CCIDMessageBulkOut *) buffer;
+    dwDataLength = CCIDToHostLong(pstmessage->dwLength);
+    if ( dwDataLength != length - sizeof(CCIDMessageBulkOut) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Virtual reader: inconsistent dwLength %d", dwDataLength);
+        return TrRv_ERR;
+    }
+
+    pthread_mutex_lock(&(pReader->mutex));
+    if ( pReader->wResponseCount >= pReader->bMaxBusySlots )
+    {
+        // The driver must not exceed bMaxCCIDBusySlots
+        pthread_mutex_unlock(&(pReader->mutex));
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Virtual reader: too many commands in flight");
+        return TrRv_ERR;
+    }
+    pResponse = &(pReader->responses[(pReader->wResponseHead + pReader->wResponseCount)
+                                     % VIRTUAL_MAX_SLOTS]);
+    bzero(pResponse->pcMessage, sizeof(CCIDMessageBulkIn));
+    pstresponse = (CCIDMessageBulkIn *) pResponse->pcMessage;
+    pbData = pResponse->pcMessage + sizeof(CCIDMessageBulkIn);
+    bSlot = pstmessage->bSlot;
+    pstresponse->bSlot = bSlot;
+    pstresponse->bSeq = pstmessage->bSeq;
+    dwDataLength = 0;
+
+    if ( bSlot >= pReader->bSlotCount )
+    {
+        pstresponse->bMessageType = RDR_to_PC_SlotStatus;
+        pstresponse->bStatus = (CCID_CMD_STATUS_FAILED << OFFSET_COMMAND_STATUS)
+            | CCID_ICC_STATUS_ABSENT;
+        pstresponse->bError = CCID_ERR_5;
+    }
+    else
+    {
+        switch ( pstmessage->bMessageType )
+        {
+            case PC_to_RDR_IccPowerOn:
+                pstresponse->bMessageType = RDR_to_PC_DataBlock;
+                if ( pReader->bPresent[bSlot] )
+                {
+                    pReader->bPowered[bSlot] = 1;
+                    dwDataLength = pReader->dwATRLength;
+                    bcopy(pReader->pcATR, pbData, dwDataLength);
+                    VirtualResetParameters(pReader, bSlot);
+                    bzero(&(pReader->t1Cards[bSlot]), sizeof(virtualT1Card));
+                    T1Init(&(pReader->t1Cards[bSlot].state), pReader->pcATR,
+                           pReader->dwATRLength);
+                }
+                break;
+            case PC_to_RDR_IccPowerOff:
+                pReader->bPowered[bSlot] = 0;
+                pstresponse->bMessageType = RDR_to_PC_SlotStatus;
+                break;
+            case PC_to_RDR_XfrBlock:
+                pstresponse->bMessageType = RDR_to_PC_DataBlock;
+                if ( pReader->bPresent[bSlot] && pReader->bPowered[bSlot] && pReader->bT1
+                     && pReader->bManualParams && (pReader->bProtocol[bSlot] != CCID_PROTOCOL_T1) )
+                {
+                    // Still at T=0 timings: the card does not understand the reader
+                    bFailed = TRUE;
+                    bFailError = CCID_ERR_ICC_MUTE;
+                }
+                else if ( pReader->bPresent[bSlot] && pReader->bPowered[bSlot] && pReader->bT1 )
+                {
+                    VirtualProcessT1Block(pReader, (rdrLun << 16) | bSlot,
+                                          &(pReader->t1Cards[bSlot]),
+                                          buffer + sizeof(CCIDMessageBulkOut),
+                                          length - sizeof(CCIDMessageBulkOut),
+                                          pbData, &dwDataLength);
+                }
+                else if ( pReader->bPresent[bSlot] && pReader->bPowered[bSlot] )
+                {
+                    dwDataLength = VIRTUAL_MAX_DATA_LENGTH;
+                    VirtualProcessAPDU(pReader, (rdrLun << 16) | bSlot,
+                                       buffer + sizeof(CCIDMessageBulkOut),
+                                       length - sizeof(CCIDMessageBulkOut),
+                                       pbData, &dwDataLength);
+                }
+                break;
+            case PC_to_RDR_SetParameter:
+                bProtocolNum = pstmessage->bMessageSpecific1;
+                dwDataLength = length - sizeof(CCIDMessageBulkOut);
+                if ( ((bProtocolNum == CCID_PROTOCOL_T0)
+                      && (dwDataLength == VIRTUAL_T0_PARAMETERS_SIZE))
+                     || ((bProtocolNum == CCID_PROTOCOL_T1)
+                         && (dwDataLength == T1_PARAMETERS_SIZE) && pReader->bT1) )
+                {
+                    pReader->bProtocol[bSlot] = bProtocolNum;
+                    bcopy(buffer + sizeof(CCIDMessageBulkOut), pReader->pbParams[bSlot],
+                          dwDataLength);
+                    pReader->dwParamsLength[bSlot] = dwDataLength;
+                }
+                else
+                {
+                    // Offset of bProtocolNum
+                    bFailed = TRUE;
+                    bFailError = CCID_ERR_7;
+                }
+                // Fall through to report the current parameters
+            case PC_to_RDR_GetParameters:
+            case PC_to_RDR_ResetParameters:
+                if ( pstmessage->bMessageType == PC_to_RDR_ResetParameters )
+                {
+                    VirtualResetParameters(pReader, bSlot);
+                }
+                if ( pReader->dwParamsLength[bSlot] == 0 )
+                {
+                    // Never powered
+                    VirtualResetParameters(pReader, bSlot);
+                }
+                pstresponse->bMessageType = RDR_to_PC_Parameters;
+                pstresponse->bMessageSpecific = pReader->bProtocol[bSlot];
+                dwDataLength = pReader->dwParamsLength[bSlot];
+                bcopy(pReader->pbParams[bSlot], pbData, dwDataLength);
+                break;
+            case PC_to_RDR_GetSlotStatus:
+            default:
+                pstresponse->bMessageType = RDR_to_PC_SlotStatus;
+                break;
+        }
+
+        bICCStatus = !pReader->bPresent[bSlot] ? CCID_ICC_STATUS_ABSENT
+            : (pReader->bPowered[bSlot] ? CCID_ICC_STATUS_ACTIVE : CCID_ICC_STATUS_INACTIVE);
+        pstresponse->bStatus = bICCStatus;
+        if ( (pstmessage->bMessageType != PC_to_RDR_GetSlotStatus)
+             && (pstmessage->bMessageType != PC_to_RDR_IccPowerOff) )
+        {
+            if ( !pReader->bPresent[bSlot] )
+            {
+                pstresponse->bStatus |= (CCID_CMD_STATUS_FAILED << OFFSET_COMMAND_STATUS);
+                pstresponse->bError = CCID_ERR_ICC_MUTE;
+            }
+            else if ( bFailed )
+            {
+                pstresponse->bStatus |= (CCID_CMD_STATUS_FAILED << OFFSET_COMMAND_STATUS);
+                pstresponse->bError = bFailError;
+            }
+            else if ( (pstresponse->bMessageType == RDR_to_PC_SlotStatus)
+                      || ((pstmessage->bMessageType == PC_to_RDR_XfrBlock)
+                          && !pReader->bPowered[bSlot]) )
+            {
+                // Unknown command or card not powered
+                pstresponse->bStatus |= (CCID_CMD_STATUS_FAILED << OFFSET_COMMAND_STATUS);
+                pstresponse->bError = pReader->bPowered[bSlot] ? CCID_ERR_0 : CCID_ERR_HW_ERROR;
+            }
+        }
+    }
+    pstresponse->dwLength = HostToCCIDLong(dwDataLength);
+    pResponse->dwLength = sizeof(CCIDMessageBulkIn) + dwDataLength;
+    // The slots process their commands in parallel
+    gettimeofday(&(pResponse->tvReady), NULL);
+    pResponse->tvReady.tv_usec += pReader->dwLatencyUs;
+    pResponse->tvReady.tv_sec += pResponse->tvReady.tv_usec / 1000000;
+    pResponse->tvReady.tv_usec %= 1000000;
+    pReader->wResponseCount++;
+    pReader->dwMessageCount++;
+    pthread_mutex_unlock(&(pReader->mutex));
+    return TrRv_OK;
+}
+
+TrRv ReadVirtual( DWORD lun, DWORD *length, BYTE *buffer )
+{
+    virtualReader *pReader = VirtualGetReader(LunToReaderLun(lun));
+    virtualResponse *pResponse;
+    struct timeval tvNow;
+    long lWaitUs;
+    DWORD dwLength;
+
+    if ( (pReader == NULL) || !pReader->ready )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "unable to read from virtual reader: set-up not completed for lun %d", lun);
+        return TrRv_ERR;
+    }
+    pthread_mutex_lock(&(pReader->mutex));
+    if ( pReader->wResponseCount == 0 )
+    {
+        pthread_mutex_unlock(&(pReader->mutex));
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Virtual reader: read without pending command");
+        return TrRv_ERR;
+    }
+    pResponse = &(pReader->responses[pReader->wResponseHead]);
+    pthread_mutex_unlock(&(pReader->mutex));
+
+    // Wait until the card is done with the oldest command
+    gettimeofday(&tvNow, NULL);
+    lWaitUs = (pResponse->tvReady.tv_sec - tvNow.tv_sec) * 1000000
+        + (pResponse->tvReady.tv_usec - tvNow.tv_usec);
+    if ( lWaitUs > 0 )
+    {
+        usleep(lWaitUs);
+    }
+    dwLength = pResponse->dwLength;
+    if ( dwLength > *length )
+    {
+        dwLength = *length;
+    }
+    bcopy(pResponse->pcMessage, buffer, dwLength);
+
+    pthread_mutex_lock(&(pReader->mutex));
+    pReader->wResponseHead = (pReader->wResponseHead + 1) % VIRTUAL_MAX_SLOTS;
+    pReader->wResponseCount--;
+    pthread_mutex_unlock(&(pReader->mutex));
+
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, buffer, dwLength, "received: ");
+    *length = dwLength;
+    return TrRv_OK;
+}
+
+TrRv ReadInterruptVirtual( DWORD lun, DWORD *length, BYTE *buffer, DWORD timeout )
+{
+    virtualReader *pReader = VirtualGetReader(LunToReaderLun(lun));
+    struct timeval tvNow;
+    struct timespec tsLimit;
+    DWORD dwLength;
+    WORD i;
+
+    if ( (pReader == NULL) || !pReader->ready || !pReader->interruptPipe )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "no interrupt pipe for lun %d", lun);
+        return TrRv_ERR;
+    }
+    gettimeofday(&tvNow, NULL);
+    tsLimit.tv_sec = tvNow.tv_sec + timeout / 1000;
+    tsLimit.tv_nsec = (tvNow.tv_usec + (timeout % 1000) * 1000) * 1000;
+    if ( tsLimit.tv_nsec >= 1000000000 )
+    {
+        tsLimit.tv_sec++;
+        tsLimit.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&(pReader->mutex));
+    while ( pReader->ready && !pReader->bNotifyPending )
+    {
+        if ( pthread_cond_timedwait(&(pReader->interruptCond), &(pReader->mutex),
+                                    &tsLimit) != 0 )
+        {
+            break;
+        }
+    }
+    if ( !pReader->bNotifyPending )
+    {
+        pthread_mutex_unlock(&(pReader->mutex));
+        *length = 0;
+        return pReader->ready ? TrRv_OK : TrRv_ERR;
+    }
+    // RDR_to_PC_NotifySlotChange: two bits per slot, present and changed
+    dwLength = 1 + (pReader->bSlotCount + 3) / 4;
+    if ( *length < dwLength )
+    {
+        pthread_mutex_unlock(&(pReader->mutex));
+        return TrRv_ERR;
+    }
+    bzero(buffer, dwLength);
+    buffer[0] = RDR_to_PC_NotifySlotChange;
+    for (i = 0; i < pReader->bSlotCount; i++)
+    {
+        buffer[1 + i / 4] |= (pReader->bPresent[i] ? 0x01 : 0x00) << (2 * (i % 4));
+        buffer[1 + i / 4] |= (pReader->bSlotChanged[i] ? 0x02 : 0x00) << (2 * (i % 4));
+        pReader->bSlotChanged[i] = 0;
+    }
+    pReader->bNotifyPending = 0;
+    pthread_mutex_unlock(&(pReader->mutex));
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVeryVerbose, buffer, dwLength, "interrupt: ");
+    *length = dwLength;
+    return TrRv_OK;
+}
+
+TrRv CloseVirtual( DWORD lun )
+{
+    virtualReader *pReader = VirtualGetReader(LunToReaderLun(lun));
+
+    if ( pReader == NULL )
+    {
+        return TrRv_ERR;
+    }
+    // Keep the script so that the reader can be re-opened
+    pthread_mutex_lock(&(pReader->mutex));
+    pReader->used = 0;
+    pReader->ready = 0;
+    bzero(pReader->bPowered, sizeof(pReader->bPowered));
+    bzero(pReader->bSlotChanged, sizeof(pReader->bSlotChanged));
+    pReader->bNotifyPending = 0;
+    pReader->wResponseHead = 0;
+    pReader->wResponseCount = 0;
+    pthread_cond_broadcast(&(pReader->interruptCond));
+    pthread_mutex_unlock(&(pReader->mutex));
+    return TrRv_OK;
+}
+
+
+TrRv VirtualReaderSetATR( DWORD rdrLun, BYTE *pbATR, DWORD dwATRLength )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( (pReader == NULL) || (dwATRLength == 0) || (dwATRLength > MAX_ATR_SIZE) )
+    {
+        return TrRv_ERR;
+    }
+    bcopy(pbATR, pReader->pcATR, dwATRLength);
+    pReader->dwATRLength = dwATRLength;
+    pReader->scripted = 1;
+    return TrRv_OK;
+}
+
+TrRv VirtualReaderAddRule( DWORD rdrLun, BYTE *pbCmdPrefix, DWORD dwCmdPrefixLength,
+                           BYTE *pbResp, DWORD dwRespLength )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+    virtualRule *pRule;
+
+    if ( (pReader == NULL) || (dwRespLength < 2) || (dwRespLength > VIRTUAL_MAX_DATA_LENGTH) )
+    {
+        return TrRv_ERR;
+    }
+    pRule = calloc(1, sizeof(virtualRule) + dwCmdPrefixLength + dwRespLength);
+    if ( pRule == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Malloc failed");
+        return TrRv_ERR;
+    }
+    pRule->pbCmdPrefix = (BYTE *)(pRule + 1);
+    pRule->dwCmdPrefixLength = dwCmdPrefixLength;
+    pRule->pbResp = pRule->pbCmdPrefix + dwCmdPrefixLength;
+    pRule->dwRespLength = dwRespLength;
+    bcopy(pbCmdPrefix, pRule->pbCmdPrefix, dwCmdPrefixLength);
+    bcopy(pbResp, pRule->pbResp, dwRespLength);
+    if ( pReader->pLastRule != NULL )
+    {
+        pReader->pLastRule->pNext = pRule;
+    }
+    else
+    {
+        pReader->pRules = pRule;
+    }
+    pReader->pLastRule = pRule;
+    pReader->scripted = 1;
+    return TrRv_OK;
+}
+
+void VirtualReaderReset( DWORD rdrLun )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+    virtualRule *pRule;
+    DWORD i;
+
+    if ( pReader == NULL )
+    {
+        return;
+    }
+    while ( pReader->pRules != NULL )
+    {
+        pRule = pReader->pRules;
+        pReader->pRules = pRule->pNext;
+        free(pRule);
+    }
+    pReader->pLastRule = NULL;
+    pReader->handler = NULL;
+    pReader->pContext = NULL;
+    pReader->dwLatencyUs = 0;
+    pReader->dwMessageCount = 0;
+    pReader->bSlotCount = 1;
+    pReader->bMaxBusySlots = 1;
+    pReader->bTPDU = 0;
+    pReader->bT1 = 0;
+    pReader->bT1WTX = 0;
+    pReader->dwT1CorruptEvery = 0;
+    pReader->bManualParams = 0;
+    for (i = 0; i < VIRTUAL_MAX_SLOTS; i++)
+    {
+        pReader->bPresent[i] = 1;
+        pReader->dwParamsLength[i] = 0;
+    }
+    bcopy(DefaultATR, pReader->pcATR, sizeof(DefaultATR));
+    pReader->dwATRLength = sizeof(DefaultATR);
+    pReader->scripted = 0;
+}
+
+void VirtualReaderSetHandler( DWORD rdrLun, VirtualCardHandler handler, void *pContext )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( pReader != NULL )
+    {
+        pReader->handler = handler;
+        pReader->pContext = pContext;
+    }
+}
+
+void VirtualReaderSetCardPresent( DWORD rdrLun, WORD wSlot, BYTE bPresent )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( (pReader != NULL) && (wSlot < VIRTUAL_MAX_SLOTS) )
+    {
+        pthread_mutex_lock(&(pReader->mutex));
+        if ( pReader->bPresent[wSlot] != (bPresent ? 1 : 0) )
+        {
+            // Reported by the next RDR_to_PC_NotifySlotChange
+            pReader->bSlotChanged[wSlot] = 1;
+            pReader->bNotifyPending = 1;
+            pthread_cond_broadcast(&(pReader->interruptCond));
+        }
+        pReader->bPresent[wSlot] = bPresent ? 1 : 0;
+        if ( !bPresent )
+        {
+            pReader->bPowered[wSlot] = 0;
+        }
+        pthread_mutex_unlock(&(pReader->mutex));
+    }
+}
+
+TrRv VirtualReaderSetSlots( DWORD rdrLun, BYTE bSlotCount, BYTE bMaxBusySlots )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( (pReader == NULL) || pReader->used
+         || (bSlotCount == 0) || (bSlotCount > VIRTUAL_MAX_SLOTS)
+         || (bMaxBusySlots == 0) || (bMaxBusySlots > bSlotCount) )
+    {
+        return TrRv_ERR;
+    }
+    pReader->bSlotCount = bSlotCount;
+    pReader->bMaxBusySlots = bMaxBusySlots;
+    pReader->scripted = 1;
+    return TrRv_OK;
+}
+
+TrRv VirtualReaderSetTPDU( DWORD rdrLun, BYTE bT1 )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( (pReader == NULL) || pReader->used )
+    {
+        return TrRv_ERR;
+    }
+    pReader->bTPDU = 1;
+    pReader->bT1 = bT1 ? 1 : 0;
+    pReader->scripted = 1;
+    return TrRv_OK;
+}
+
+TrRv VirtualReaderSetManualParameters( DWORD rdrLun, BYTE bManual )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( (pReader == NULL) || pReader->used )
+    {
+        return TrRv_ERR;
+    }
+    pReader->bManualParams = bManual ? 1 : 0;
+    pReader->scripted = 1;
+    return TrRv_OK;
+}
+
+TrRv VirtualReaderGetParameters( DWORD rdrLun, WORD wSlot, BYTE *pbProtocolNum,
+                                 BYTE *pbParams, DWORD *pdwParamsLength )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( (pReader == NULL) || (wSlot >= VIRTUAL_MAX_SLOTS) )
+    {
+        return TrRv_ERR;
+    }
+    pthread_mutex_lock(&(pReader->mutex));
+    if ( *pdwParamsLength < pReader->dwParamsLength[wSlot] )
+    {
+        pthread_mutex_unlock(&(pReader->mutex));
+        return TrRv_ERR;
+    }
+    *pbProtocolNum = pReader->bProtocol[wSlot];
+    *pdwParamsLength = pReader->dwParamsLength[wSlot];
+    bcopy(pReader->pbParams[wSlot], pbParams, *pdwParamsLength);
+    pthread_mutex_unlock(&(pReader->mutex));
+    return TrRv_OK;
+}
+
+void VirtualReaderSetT1Faults( DWORD rdrLun, DWORD dwCorruptEvery, BYTE bWTX )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( pReader != NULL )
+    {
+        pReader->dwT1CorruptEvery = dwCorruptEvery;
+        pReader->dwT1BlockCount = 0;
+        pReader->bT1WTX = bWTX ? 1 : 0;
+    }
+}
+
+void VirtualReaderSetLatency( DWORD rdrLun, DWORD dwLatencyUs )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+
+    if ( pReader != NULL )
+    {
+        pReader->dwLatencyUs = dwLatencyUs;
+    }
+}
+
+DWORD VirtualReaderGetMessageCount( DWORD rdrLun )
+{
+    virtualReader *pReader = VirtualGetReader(rdrLun);
+    DWORD dwCount = 0;
+
+    if ( pReader != NULL )
+    {
+        pthread_mutex_lock(&(pReader->mutex));
+        dwCount = pReader->dwMessageCount;
+        pthread_mutex_unlock(&(pReader->mutex));
+    }
+    return dwCount;
+}
+
+TrRv VirtualReaderLoadScript( DWORD rdrLun, const char *pcPath )
+{
+    FILE *fp;
+    char pcLine[2048];
+    char *pcValue, *pcEqual;
+    BYTE pbCmd[VIRTUAL_MAX_DATA_LENGTH];
+    BYTE pbResp[VIRTUAL_MAX_DATA_LENGTH];
+    long lCmdLength, lRespLength;
+    unsigned long ulSlots, ulBusy;
+    int iLine = 0;
+    TrRv rv = TrRv_OK;
+
+    if ( VirtualGetReader(rdrLun) == NULL )
+    {
+        return TrRv_ERR;
+    }
+    fp = fopen(pcPath, "r");
+    if ( fp == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Virtual reader: cannot open script %s", pcPath);
+        return TrRv_ERR;
+    }
+    while ( (rv == TrRv_OK) && fgets(pcLine, sizeof(pcLine), fp) )
+    {
+        iLine++;
+        if ( (pcValue = strchr(pcLine, '#')) != NULL )
+        {
+            *pcValue = '\0';
+        }
+        for (pcValue = pcLine; isspace((unsigned char) *pcValue); pcValue++)
+            ;
+        if ( *pcValue == '\0' )
+        {
+            continue;
+        }
+        if ( !strncasecmp(pcValue, "ATR", 3) && isspace((unsigned char) pcValue[3]) )
+        {
+            lRespLength = VirtualParseHex(pcValue + 3, pbResp, MAX_ATR_SIZE);
+            if ( lRespLength <= 0 )
+            {
+                rv = TrRv_ERR;
+            }
+            else
+            {
+                rv = VirtualReaderSetATR(rdrLun, pbResp, lRespLength);
+            }
+        }
+        else if ( !strncasecmp(pcValue, "LATENCY", 7) && isspace((unsigned char) pcValue[7]) )
+        {
+            VirtualReaderSetLatency(rdrLun, strtoul(pcValue + 7, 0, 10));
+        }
+        else if ( !strncasecmp(pcValue, "SLOTS", 5) && isspace((unsigned char) pcValue[5]) )
+        {
+            ulSlots = strtoul(pcValue + 5, &pcEqual, 10);
+            ulBusy = strtoul(pcEqual, 0, 10);
+            rv = VirtualReaderSetSlots(rdrLun, ulSlots, ulBusy ? ulBusy : 1);
+        }
+        else if ( !strncasecmp(pcValue, "TPDU", 4) && isspace((unsigned char) pcValue[4]) )
+        {
+            for (pcValue += 4; isspace((unsigned char) *pcValue); pcValue++)
+                ;
+            if ( !strncasecmp(pcValue, "T0", 2) || !strncasecmp(pcValue, "T1", 2) )
+            {
+                rv = VirtualReaderSetTPDU(rdrLun, (pcValue[1] == '1'));
+            }
+            else
+            {
+                rv = TrRv_ERR;
+            }
+        }
+        else if ( !strncasecmp(pcValue, "T1FAULTS", 8) && isspace((unsigned char) pcValue[8]) )
+        {
+            ulSlots = strtoul(pcValue + 8, &pcEqual, 10);
+            ulBusy = strtoul(pcEqual, 0, 10);
+            VirtualReaderSetT1Faults(rdrLun, ulSlots, ulBusy ? 1 : 0);
+        }
+        else if ( !strncasecmp(pcValue, "PARAMS", 6) && isspace((unsigned char) pcValue[6]) )
+        {
+            for (pcValue += 6; isspace((unsigned char) *pcValue); pcValue++)
+                ;
+            if ( !strncasecmp(pcValue, "MANUAL", 6) || !strncasecmp(pcValue, "AUTO", 4) )
+            {
+                rv = VirtualReaderSetManualParameters(rdrLun, (toupper(pcValue[0]) == 'M'));
+            }
+            else
+            {
+                rv = TrRv_ERR;
+            }
+        }
+        else if ( (pcEqual = strchr(pcValue, '=')) != NULL )
+        {
+            *pcEqual = '\0';
+            lCmdLength = VirtualParseHex(pcValue, pbCmd, sizeof(pbCmd));
+            lRespLength = VirtualParseHex(pcEqual + 1, pbResp, sizeof(pbResp));
+            if ( (lCmdLength < 0) || (lRespLength < 2) )
+            {
+                rv = TrRv_ERR;
+            }
+            else
+            {
+                rv = VirtualReaderAddRule(rdrLun, pbCmd, lCmdLength, pbResp, lRespLength);
+            }
+        }
+        else
+        {
+            rv = TrRv_ERR;
+        }
+        if ( rv != TrRv_OK )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                        "Virtual reader: syntax error in %s line %d", pcPath, iLine);
+        }
+    }
+    fclose(fp);
+    return rv;
+}
@@ -0,0 +1,82 @@
+/*
+ *  virtualreader.h
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ */
+
+#ifndef _VIRTUALREADER_H_
+#define _VIRTUALREADER_H_
+
+#include "Transport.h"
+
+// In-process CCID reader with a scriptable card behind it.
+// It speaks the Bulk-OUT/Bulk-IN CCID messages so that everything above
+// the transport (CCID.c, ifdhandler.c) runs unchanged without hardware.
+// Readers are addressed with the reader part of the Lun (Lun >> 16) and
+// must be scripted before IFDHCreateChannel() if the defaults do not fit.
+
+// Called for every APDU a card receives when a handler is installed
+// (lun identifies the reader and slot as in the IFD handler).
+// Must fill pbResp/pdwRespLength (in: size of pbResp) and return TrRv_OK,
+// or return TrRv_ERR to fall back to the scripted rules.
+// With several busy slots it can be called from different threads.
+typedef TrRv (*VirtualCardHandler)( void *pContext, DWORD lun,
+                                    BYTE *pbCmd, DWORD dwCmdLength,
+                                    BYTE *pbResp, DWORD *pdwRespLength );
+
+// Transport functions (see TrFunctions)
+TrRv OpenVirtual( DWORD lun, DWORD channel );
+TrRv GetConfigDescNumberVirtual( DWORD lun, BYTE* pcconfigDescNb );
+TrRv GetVendorAndProductIDVirtual( DWORD lun, DWORD *vendorID, DWORD *productID );
+TrRv GetClassDescVirtual( DWORD lun, BYTE configDescNb, BYTE bdescType,
+                          BYTE *pcdesc, BYTE *pcdescLength);
+TrRv SetupConnectionsVirtual( DWORD lun, BYTE ConfigDescNb, BYTE interruptPipe);
+TrRv WriteVirtual( DWORD lun, DWORD length, BYTE *Buffer );
+TrRv ReadVirtual( DWORD lun, DWORD *length, BYTE *Buffer );
+TrRv CloseVirtual( DWORD lun );
+TrRv ReadInterruptVirtual( DWORD lun, DWORD *length, BYTE *buffer, DWORD timeout );
+
+// Card emulator scripting
+// Sets the ATR returned on power on
+TrRv VirtualReaderSetATR( DWORD rdrLun, BYTE *pbATR, DWORD dwATRLength );
+// Adds a rule: any APDU starting with pbCmdPrefix gets pbResp back.
+// Rules are evaluated in the order they were added.
+TrRv VirtualReaderAddRule( DWORD rdrLun, BYTE *pbCmdPrefix, DWORD dwCmdPrefixLength,
+                           BYTE *pbResp, DWORD dwRespLength );
+// Removes all rules, the handler and restores the default ATR
+void VirtualReaderReset( DWORD rdrLun );
+// Installs a callback answering APDUs before the rules are looked at
+void VirtualReaderSetHandler( DWORD rdrLun, VirtualCardHandler handler, void *pContext );
+// Inserts or removes the card of a slot (notified on the interrupt pipe)
+void VirtualReaderSetCardPresent( DWORD rdrLun, WORD wSlot, BYTE bPresent );
+// Number of slots and how many of them may process a command at once
+// (bMaxSlotIndex + 1 and bMaxCCIDBusySlots of the class descriptor).
+// Must be called before the reader is opened.
+TrRv VirtualReaderSetSlots( DWORD rdrLun, BYTE bSlotCount, BYTE bMaxBusySlots );
+// Makes the reader work at TPDU level instead of short APDU level.
+// With bT1 the card talks T=1 blocks (give it an ATR offering T=1),
+// otherwise APDUs are answered as T=0 TPDUs.
+// Must be called before the reader is opened.
+TrRv VirtualReaderSetTPDU( DWORD rdrLun, BYTE bT1 );
+// Leaves CCID_CLASS_FEAT_AUTO_CONF_ATR out of the class descriptor: T=1
+// blocks then get no answer until PC_to_RDR_SetParameters selected T=1.
+// Must be called before the reader is opened.
+TrRv VirtualReaderSetManualParameters( DWORD rdrLun, BYTE bManual );
+// Protocol and protocol data structure currently set for a slot
+// (*pdwParamsLength: in, size of pbParams)
+TrRv VirtualReaderGetParameters( DWORD rdrLun, WORD wSlot, BYTE *pbProtocolNum,
+                                 BYTE *pbParams, DWORD *pdwParamsLength );
+// T=1 misbehaviour of the card: garbles the EDC of every dwCorruptEvery-th
+// block it sends (0: never) and, with bWTX, asks for a waiting time
+// extension before each answer
+void VirtualReaderSetT1Faults( DWORD rdrLun, DWORD dwCorruptEvery, BYTE bWTX );
+// Time the card takes to process each command; slots work in parallel
+void VirtualReaderSetLatency( DWORD rdrLun, DWORD dwLatencyUs );
+// Number of Bulk-OUT messages the reader received since its last reset
+DWORD VirtualReaderGetMessageCount( DWORD rdrLun );
+// Loads a script file; see virtualreader.c for the format
+TrRv VirtualReaderLoadScript( DWORD rdrLun, const char *pcPath );
+
+#endif
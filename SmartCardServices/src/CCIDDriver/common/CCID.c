@@ -7,7 +7,13 @@
  *  See COPYING file for license.
  *
  */
+#ifdef __APPLE__
 #include <CoreFoundation/CoreFoundation.h>
+#endif
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include "global.h"
 
 #include "tools.h"
@@ -171,6 +177,251 @@ const char *CCIDGetCommandStatusMessage(BYTE bCommandStatus)
     return "";
 }
 
+static void CCIDFreeBuffers(WORD wRdrLun)
+{
+    CCIDReaderState *pReaderState = &CCIDReaderStates[wRdrLun];
+    WORD i;
+
+    // Do not leave APDUs (PIN verification...) in freed memory
+    if ( pReaderState->pcBulkOutBuffer != NULL )
+    {
+        bzero(pReaderState->pcBulkOutBuffer, pReaderState->dwBufferSize);
+        free(pReaderState->pcBulkOutBuffer);
+        pReaderState->pcBulkOutBuffer = NULL;
+    }
+    if ( pReaderState->pcBulkInBuffer != NULL )
+    {
+        bzero(pReaderState->pcBulkInBuffer, pReaderState->dwBufferSize);
+        free(pReaderState->pcBulkInBuffer);
+        pReaderState->pcBulkInBuffer = NULL;
+    }
+    if ( pReaderState->slotExchanges != NULL )
+    {
+        for (i = 0; i <= pReaderState->bMaxSlotIndex; i++)
+        {
+            if ( pReaderState->slotExchanges[i].pcRespBuffer != NULL )
+            {
+                bzero(pReaderState->slotExchanges[i].pcRespBuffer, pReaderState->dwBufferSize);
+                free(pReaderState->slotExchanges[i].pcRespBuffer);
+            }
+        }
+        free(pReaderState->slotExchanges);
+        pReaderState->slotExchanges = NULL;
+    }
+    if ( pReaderState->t1States != NULL )
+    {
+        free(pReaderState->t1States);
+        pReaderState->t1States = NULL;
+    }
+    if ( pReaderState->bDispatch )
+    {
+        pthread_mutex_destroy(&(pReaderState->dispatchMutex));
+        pthread_cond_destroy(&(pReaderState->dispatchCond));
+        pReaderState->bDispatch = 0;
+    }
+    pReaderState->dwBufferSize = 0;
+}
+
+// Reads RDR_to_PC_NotifySlotChange messages and updates pbSlotPresence
+// until bStopListening is set or the interrupt pipe fails
+static void *CCIDInterruptListener(void *pArg)
+{
+    WORD wRdrLun = (WORD)(size_t) pArg;
+    CCIDReaderState *pReaderState = &CCIDReaderStates[wRdrLun];
+    DWORD Lun = ((DWORD) wRdrLun) << 16;
+    BYTE abMessage[CCID_INTERRUPT_MESSAGE_SIZE];
+    DWORD dwLength;
+    BYTE bBits, bPresence;
+    WORD i;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&(pReaderState->presenceMutex));
+        if ( pReaderState->bStopListening )
+        {
+            pthread_mutex_unlock(&(pReaderState->presenceMutex));
+            break;
+        }
+        pthread_mutex_unlock(&(pReaderState->presenceMutex));
+
+        dwLength = sizeof(abMessage);
+        if ( pReaderState->pTrFunctions->ReadInterrupt(Lun, &dwLength, abMessage,
+                                                       CCID_INTERRUPT_TIMEOUT) != TrRv_OK )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelImportant,
+                        "Interrupt pipe failed, card presence will be polled");
+            pthread_mutex_lock(&(pReaderState->presenceMutex));
+            pReaderState->bListening = 0;
+            pthread_mutex_unlock(&(pReaderState->presenceMutex));
+            break;
+        }
+        if ( dwLength == 0 )
+        {
+            continue;
+        }
+        pthread_mutex_lock(&(pReaderState->presenceMutex));
+        switch ( abMessage[0] )
+        {
+            case RDR_to_PC_NotifySlotChange:
+                // Two bits per slot: bit 0 card present, bit 1 changed
+                for (i = 0; (i <= pReaderState->bMaxSlotIndex) && ((DWORD)(1 + i / 4) < dwLength); i++)
+                {
+                    bBits = (abMessage[1 + i / 4] >> (2 * (i % 4))) & 0x03;
+                    bPresence = CCID_PRESENCE_KNOWN | ((bBits & 0x01) ? CCID_PRESENCE_PRESENT : 0);
+                    if ( (bBits & 0x02)
+                         || (pReaderState->pbSlotPresence[i] & CCID_PRESENCE_CHANGED)
+                         || ((pReaderState->pbSlotPresence[i] & CCID_PRESENCE_KNOWN)
+                             && ((pReaderState->pbSlotPresence[i] ^ bPresence)
+                                 & CCID_PRESENCE_PRESENT)) )
+                    {
+                        bPresence |= CCID_PRESENCE_CHANGED;
+                    }
+                    pReaderState->pbSlotPresence[i] = bPresence;
+                }
+                break;
+            case RDR_to_PC_HardwareError:
+                // bSlot follows the message type: ask the reader next time
+                if ( (dwLength > 1) && (abMessage[1] <= pReaderState->bMaxSlotIndex) )
+                {
+                    LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                                "Hardware error on slot %d", abMessage[1]);
+                    pReaderState->pbSlotPresence[abMessage[1]] = 0;
+                }
+                break;
+            default:
+                LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                            "Unexpected interrupt message: %02X", abMessage[0]);
+                break;
+        }
+        pthread_mutex_unlock(&(pReaderState->presenceMutex));
+    }
+    return NULL;
+}
+
+static void CCIDStartListener(WORD wRdrLun)
+{
+    CCIDReaderState *pReaderState = &CCIDReaderStates[wRdrLun];
+
+    pReaderState->pbSlotPresence = calloc(pReaderState->bMaxSlotIndex + 1, sizeof(BYTE));
+    if ( pReaderState->pbSlotPresence == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Malloc failed");
+        return;
+    }
+    pReaderState->bStopListening = 0;
+    pReaderState->bListening = 1;
+    if ( pthread_create(&(pReaderState->listenerThread), NULL,
+                        CCIDInterruptListener, (void *)(size_t) wRdrLun) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Could not start interrupt listener, card presence will be polled");
+        free(pReaderState->pbSlotPresence);
+        pReaderState->pbSlotPresence = NULL;
+        pReaderState->bListening = 0;
+        return;
+    }
+    pthread_mutex_lock(&(pReaderState->presenceMutex));
+    pReaderState->bListener = 1;
+    pthread_mutex_unlock(&(pReaderState->presenceMutex));
+}
+
+// Must be called before the transport is closed
+static void CCIDStopListener(WORD wRdrLun)
+{
+    CCIDReaderState *pReaderState = &CCIDReaderStates[wRdrLun];
+
+    pthread_mutex_lock(&(pReaderState->presenceMutex));
+    if ( !pReaderState->bListener )
+    {
+        pthread_mutex_unlock(&(pReaderState->presenceMutex));
+        return;
+    }
+    pReaderState->bStopListening = 1;
+    pthread_mutex_unlock(&(pReaderState->presenceMutex));
+    // Returns within CCID_INTERRUPT_TIMEOUT
+    pthread_join(pReaderState->listenerThread, NULL);
+    // Callers check bListener under the lock before using pbSlotPresence
+    pthread_mutex_lock(&(pReaderState->presenceMutex));
+    pReaderState->bListener = 0;
+    pReaderState->bListening = 0;
+    free(pReaderState->pbSlotPresence);
+    pReaderState->pbSlotPresence = NULL;
+    pthread_mutex_unlock(&(pReaderState->presenceMutex));
+}
+
+// Allocates the Bulk-OUT and Bulk-IN buffers of a reader once its
+// dwMaxCCIDMessageLength is known. They are kept until the channel is closed
+// and are distinct so that a transport may post the Bulk-IN read before
+// the Bulk-OUT write has completed.
+static CCIDRv CCIDAllocBuffers(WORD wRdrLun)
+{
+    CCIDReaderState *pReaderState = &CCIDReaderStates[wRdrLun];
+    DWORD dwBufferSize;
+    WORD i;
+
+    // Large enough for a message header and the maximum data for this reader
+    dwBufferSize = sizeof(CCIDMessageBulkOut) + pReaderState->dwMaxCCIDMessageLength;
+    dwBufferSize = (dwBufferSize + CCID_BUFFER_ALIGNMENT - 1) & ~(CCID_BUFFER_ALIGNMENT - 1);
+    pReaderState->dwBufferSize = dwBufferSize;
+    if ( posix_memalign((void **) &(pReaderState->pcBulkOutBuffer),
+                        CCID_BUFFER_ALIGNMENT, dwBufferSize) )
+    {
+        pReaderState->pcBulkOutBuffer = NULL;
+    }
+    if ( posix_memalign((void **) &(pReaderState->pcBulkInBuffer),
+                        CCID_BUFFER_ALIGNMENT, dwBufferSize) )
+    {
+        pReaderState->pcBulkInBuffer = NULL;
+    }
+    if ( (pReaderState->pcBulkOutBuffer == NULL) || (pReaderState->pcBulkInBuffer == NULL) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Malloc failed");
+        CCIDFreeBuffers(wRdrLun);
+        return CCIDRv_ERR_UNSPECIFIED;
+    }
+    pReaderState->t1States = calloc(pReaderState->bMaxSlotIndex + 1, sizeof(CCIDT1State));
+    if ( pReaderState->t1States == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Malloc failed");
+        CCIDFreeBuffers(wRdrLun);
+        return CCIDRv_ERR_UNSPECIFIED;
+    }
+    if ( pReaderState->bMaxSlotIndex == 0 )
+    {
+        return CCIDRv_OK;
+    }
+
+    // Commands for several slots may come from different threads: each
+    // slot gets its own response buffer for the dispatcher, which keeps
+    // up to bMaxCCIDBusySlots of them in flight
+    pReaderState->slotExchanges = calloc(pReaderState->bMaxSlotIndex + 1,
+                                         sizeof(CCIDSlotExchange));
+    if ( pReaderState->slotExchanges == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Malloc failed");
+        CCIDFreeBuffers(wRdrLun);
+        return CCIDRv_ERR_UNSPECIFIED;
+    }
+    for (i = 0; i <= pReaderState->bMaxSlotIndex; i++)
+    {
+        if ( posix_memalign((void **) &(pReaderState->slotExchanges[i].pcRespBuffer),
+                            CCID_BUFFER_ALIGNMENT, dwBufferSize) )
+        {
+            pReaderState->slotExchanges[i].pcRespBuffer = NULL;
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Malloc failed");
+            CCIDFreeBuffers(wRdrLun);
+            return CCIDRv_ERR_UNSPECIFIED;
+        }
+    }
+    pthread_mutex_init(&(pReaderState->dispatchMutex), NULL);
+    pthread_cond_init(&(pReaderState->dispatchCond), NULL);
+    pReaderState->bDispatch = 1;
+    LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                "Reader can process %d of its %d slots concurrently",
+                pReaderState->bMaxCCIDBusySlots, pReaderState->bMaxSlotIndex + 1);
+    return CCIDRv_OK;
+}
+
 CCIDRv CCID_OpenChannel(DWORD Lun, DWORD ChannelID)
 {
     WORD wRdrLun;
@@ -196,11 +447,17 @@ CCIDRv CCID_OpenChannel(DWORD Lun, DWORD ChannelID)
                     "Reader Lun already used: %d", wRdrLun);
         return CCIDRv_ERR_READER_LUN;
     }
+    // The channel ID selects the transport mechanism (USB, virtual reader,
+    // and later serial or even serial from PCMCIA)
+    TrType trType = TrTypeFromChannel(ChannelID);
+    if ( TrFunctionTable[trType].Open == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "No transport available for channel: %08X", ChannelID);
+        return CCIDRv_ERR_TRANSPORT_ERROR;
+    }
     CCIDReaderStates[wRdrLun].used = 1;
-    //++ SHOULD CHECK CHANNELID TO SEE WHICH TRANSPORT TO USE
-    //++ This is to support CCID readers over different transport 
-    //++ mechanism (serial or even serial from PCMCIA)
-    CCIDReaderStates[wRdrLun].pTrFunctions = &TrFunctionTable[TrType_USB];
+    CCIDReaderStates[wRdrLun].pTrFunctions = &TrFunctionTable[trType];
     // Create an "alias" to the transport functions
     TrFunctions *pTrFunctions =  CCIDReaderStates[wRdrLun].pTrFunctions;
     rv = pTrFunctions->Open(Lun, ChannelID);
@@ -239,6 +496,7 @@ CCIDRv CCID_OpenChannel(DWORD Lun, DWORD ChannelID)
     {
         LogMessage( __FILE__,  __LINE__, LogLevelCritical,
                     "Incorrect Class Desc size %d ", bbufferDescLength);
+        CCIDReaderStates[wRdrLun].used = 0;
         // Call close to reset USB structures
         CCIDReaderStates[wRdrLun].pTrFunctions->Close(Lun);
         return CCIDRv_ERR_CLASS_DESC_INVALID;
@@ -262,6 +520,11 @@ CCIDRv CCID_OpenChannel(DWORD Lun, DWORD ChannelID)
     // Initialise fields
     CCIDReaderStates[wRdrLun].bMaxSlotIndex = pstClassDesc->bMaxSlotIndex;
     CCIDReaderStates[wRdrLun].bMaxCCIDBusySlots = pstClassDesc->bMaxCCIDBusySlots;
+    if ( CCIDReaderStates[wRdrLun].bMaxCCIDBusySlots == 0 )
+    {
+        // Invalid, but at least one command must be allowed
+        CCIDReaderStates[wRdrLun].bMaxCCIDBusySlots = 1;
+    }
     CCIDReaderStates[wRdrLun].dwMaxCCIDMessageLength = pstClassDesc->dwMaxCCIDMessageLength;
     CCIDReaderStates[wRdrLun].dwExchangeLevel = (pstClassDesc->dwFeatures)
         & CCID_CLASS_FEAT_EXC_LEVEL_MASK;
@@ -281,11 +544,20 @@ CCIDRv CCID_OpenChannel(DWORD Lun, DWORD ChannelID)
         return CCIDRv_ERR_UNSPECIFIED;
         
     }
-    //+++ Interrupt pipes not supported, hence 0 in parameter
-    rv = pTrFunctions->SetupConnections(Lun, bSelectedConfDesc, 0);
+    if ( CCIDAllocBuffers(wRdrLun) != CCIDRv_OK )
+    {
+        CCIDReaderStates[wRdrLun].used = 0;
+        // Call close to reset USB structures
+        CCIDReaderStates[wRdrLun].pTrFunctions->Close(Lun);
+        return CCIDRv_ERR_UNSPECIFIED;
+    }
+    // The interrupt pipe is only used if the transport can read it
+    rv = pTrFunctions->SetupConnections(Lun, bSelectedConfDesc,
+                                        (pTrFunctions->ReadInterrupt != NULL));
     if ( rv != TrRv_OK )
     {
         CCIDReaderStates[wRdrLun].used = 0;
+        CCIDFreeBuffers(wRdrLun);
         // Call close to reset USB structures
         CCIDReaderStates[wRdrLun].pTrFunctions->Close(Lun);
         return CCIDRv_ERR_TRANSPORT_ERROR;
@@ -296,6 +568,7 @@ CCIDRv CCID_OpenChannel(DWORD Lun, DWORD ChannelID)
     if ( rv != TrRv_OK )
     {
         CCIDReaderStates[wRdrLun].used = 0;
+        CCIDFreeBuffers(wRdrLun);
         // Call close to reset USB structures
         CCIDReaderStates[wRdrLun].pTrFunctions->Close(Lun);
         return CCIDRv_ERR_TRANSPORT_ERROR;
@@ -312,12 +585,19 @@ CCIDRv CCID_OpenChannel(DWORD Lun, DWORD ChannelID)
             if ( rv != CCIDRv_OK )
             {
                 CCIDReaderStates[wRdrLun].used = 0;
+                CCIDFreeBuffers(wRdrLun);
                 // Call close to reset USB structures
                 CCIDReaderStates[wRdrLun].pTrFunctions->Close(Lun);
                 return rv;
             }
         }
     }
+    // Lives as long as the channel, the listener or not
+    pthread_mutex_init(&(CCIDReaderStates[wRdrLun].presenceMutex), NULL);
+    if ( pTrFunctions->ReadInterrupt != NULL )
+    {
+        CCIDStartListener(wRdrLun);
+    }
     
     return CCIDRv_OK;
 }
@@ -339,8 +619,11 @@ CCIDRv CCID_CloseChannel(DWORD Lun)
                     "Reader Lun of unused reader: %d", wRdrLun);
         return CCIDRv_ERR_READER_LUN;
     }
+    CCIDStopListener(wRdrLun);
     // Close USB connection
     rv = CCIDReaderStates[wRdrLun].pTrFunctions->Close(Lun);
+    CCIDFreeBuffers(wRdrLun);
+    pthread_mutex_destroy(&(CCIDReaderStates[wRdrLun].presenceMutex));
     // Clean-up the structure
     bzero(&CCIDReaderStates[wRdrLun], sizeof(CCIDReaderState));
     if ( rv != TrRv_OK )
@@ -353,6 +636,142 @@ CCIDRv CCID_CloseChannel(DWORD Lun)
 }
 
 
+// Fills a Bulk-OUT message header followed by the command data
+static void CCIDBuildMessage(BYTE *pcBuffer, BYTE bMessageTypeCmd, WORD wSlot, BYTE bSeq,
+                             BYTE *abMessageSpecificCmd,
+                             BYTE *abDataCmd, DWORD dwDataCmdLength)
+{
+    CCIDMessageBulkOut *pstmessage = (CCIDMessageBulkOut *) pcBuffer;
+
+    pstmessage->bMessageType = bMessageTypeCmd;
+    pstmessage->dwLength = HostToCCIDLong(dwDataCmdLength);
+    pstmessage->bSlot = wSlot;
+    pstmessage->bSeq = bSeq;
+    pstmessage->bMessageSpecific1 = abMessageSpecificCmd[0];
+    pstmessage->bMessageSpecific2 = abMessageSpecificCmd[1];
+    pstmessage->bMessageSpecific3 = abMessageSpecificCmd[2];
+    // Copy the command data
+    bcopy(abDataCmd, pcBuffer+sizeof(CCIDMessageBulkOut), dwDataCmdLength);
+}
+
+// Sends a command on a reader serving several busy slots and waits for
+// the response of this slot. Up to bMaxCCIDBusySlots commands are in flight;
+// whichever waiting thread finds the Bulk-IN pipe idle reads it and hands
+// the message over to the slot it belongs to (bSlot/bSeq).
+// Time extension requests keep the slot waiting for its final response.
+// On success *ppcResp points to the slot response buffer, valid until the
+// next command on the same slot.
+static CCIDRv CCIDDispatchCommand(DWORD Lun, BYTE bMessageTypeCmd,
+                                  BYTE *abMessageSpecificCmd,
+                                  BYTE *abDataCmd, DWORD dwDataCmdLength,
+                                  BYTE **ppcResp, DWORD *pdwRespLength)
+{
+    WORD wRdrLun = LunToReaderLun(Lun);
+    WORD wSlot = LunToSlotNb(Lun);
+    CCIDReaderState *pReaderState = &CCIDReaderStates[wRdrLun];
+    CCIDSlotExchange *pExchange = &(pReaderState->slotExchanges[wSlot]);
+    CCIDSlotExchange *pTarget;
+    CCIDMessageBulkIn *pstresponse;
+    DWORD dwLength;
+    TrRv trv;
+    WORD i;
+
+    pthread_mutex_lock(&(pReaderState->dispatchMutex));
+    while ( pExchange->bInFlight
+            || (pReaderState->bCurrentCCIDBusySlots >= pReaderState->bMaxCCIDBusySlots) )
+    {
+        pthread_cond_wait(&(pReaderState->dispatchCond), &(pReaderState->dispatchMutex));
+    }
+    pReaderState->bCurrentCCIDBusySlots++;
+    pExchange->bInFlight = 1;
+    pExchange->bDone = 0;
+    pExchange->bSeq = pReaderState->bSeq++;
+
+    CCIDBuildMessage(pReaderState->pcBulkOutBuffer, bMessageTypeCmd, wSlot, pExchange->bSeq,
+                     abMessageSpecificCmd, abDataCmd, dwDataCmdLength);
+    trv = pReaderState->pTrFunctions->Write(Lun, sizeof(CCIDMessageBulkOut) + dwDataCmdLength,
+                                            pReaderState->pcBulkOutBuffer);
+    bzero(pReaderState->pcBulkOutBuffer, sizeof(CCIDMessageBulkOut)+dwDataCmdLength);
+    if ( trv != TrRv_OK )
+    {
+        pExchange->trv = trv;
+        pExchange->bDone = 1;
+    }
+
+    while ( !pExchange->bDone )
+    {
+        if ( pReaderState->bReading )
+        {
+            pthread_cond_wait(&(pReaderState->dispatchCond), &(pReaderState->dispatchMutex));
+            continue;
+        }
+        // Nobody is reading the Bulk-IN pipe: do it on behalf of all slots
+        pReaderState->bReading = 1;
+        pthread_mutex_unlock(&(pReaderState->dispatchMutex));
+        dwLength = pReaderState->dwMaxCCIDMessageLength;
+        trv = pReaderState->pTrFunctions->Read(Lun, &dwLength, pReaderState->pcBulkInBuffer);
+        pthread_mutex_lock(&(pReaderState->dispatchMutex));
+        pReaderState->bReading = 0;
+
+        pstresponse = (CCIDMessageBulkIn *) pReaderState->pcBulkInBuffer;
+        if ( trv != TrRv_OK )
+        {
+            // Nothing came back in time: fail every command in flight
+            for (i = 0; i <= pReaderState->bMaxSlotIndex; i++)
+            {
+                pTarget = &(pReaderState->slotExchanges[i]);
+                if ( pTarget->bInFlight && !pTarget->bDone )
+                {
+                    pTarget->trv = trv;
+                    pTarget->bDone = 1;
+                }
+            }
+        }
+        else if ( dwLength < sizeof(CCIDMessageBulkIn) )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Reader returned too little data");
+        }
+        else if ( (pstresponse->bSlot > pReaderState->bMaxSlotIndex)
+                  || !(pReaderState->slotExchanges[pstresponse->bSlot].bInFlight)
+                  || pReaderState->slotExchanges[pstresponse->bSlot].bDone
+                  || (pReaderState->slotExchanges[pstresponse->bSlot].bSeq != pstresponse->bSeq) )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                        "Dropping unexpected response for slot %d, sequence %d",
+                        pstresponse->bSlot, pstresponse->bSeq);
+        }
+        else if ( CCIDGetCommandStatus(pstresponse->bStatus) == CCID_CMD_STATUS_TIME_REQ )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                        "Reader has requested time extension for slot %d", pstresponse->bSlot);
+        }
+        else
+        {
+            pTarget = &(pReaderState->slotExchanges[pstresponse->bSlot]);
+            bcopy(pReaderState->pcBulkInBuffer, pTarget->pcRespBuffer, dwLength);
+            pTarget->dwRespLength = dwLength;
+            pTarget->trv = TrRv_OK;
+            pTarget->bDone = 1;
+        }
+        bzero(pReaderState->pcBulkInBuffer, dwLength);
+        pthread_cond_broadcast(&(pReaderState->dispatchCond));
+    }
+
+    trv = pExchange->trv;
+    *ppcResp = pExchange->pcRespBuffer;
+    *pdwRespLength = pExchange->dwRespLength;
+    pExchange->bInFlight = 0;
+    pReaderState->bCurrentCCIDBusySlots--;
+    pthread_cond_broadcast(&(pReaderState->dispatchCond));
+    pthread_mutex_unlock(&(pReaderState->dispatchMutex));
+
+    if ( trv != TrRv_OK )
+    {
+        return CCIDRv_ERR_TRANSPORT_ERROR;
+    }
+    return CCIDRv_OK;
+}
+
 CCIDRv CCID_Exchange_Command(DWORD Lun, BYTE bMessageTypeCmd,
                              BYTE *abMessageSpecificCmd,
                              BYTE *abDataCmd, DWORD dwDataCmdLength,
@@ -362,13 +781,15 @@ CCIDRv CCID_Exchange_Command(DWORD Lun, BYTE bMessageTypeCmd,
                              BYTE *abDataResp, DWORD *pdwDataRespLength,
                              BYTE bTimeExtRetry)
 {
-    CCIDMessageBulkOut *pstmessage;
     CCIDMessageBulkIn  *pstresponse;
     WORD wSlot;
     WORD wRdrLun;
     TrRv trv = 0;
     BYTE *pcBuffer;
+    BYTE *pcRespBuffer;
+    TrFunctions *pTrFunctions;
     DWORD dwRespLength;
+    CCIDRv rv;
 
     wRdrLun = LunToReaderLun(Lun);
     if ( wRdrLun >= PCSCLITE_MAX_CHANNELS)
@@ -388,13 +809,6 @@ CCIDRv CCID_Exchange_Command(DWORD Lun, BYTE bMessageTypeCmd,
         LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Slot Lun too large: %d", wSlot);
         return CCIDRv_ERR_SLOT_LUN;
     }
-    if ( CCIDReaderStates[wRdrLun].bCurrentCCIDBusySlots
-         >= CCIDReaderStates[wRdrLun].bMaxCCIDBusySlots )
-    {
-        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Too many slots busy");
-        return CCIDRv_ERR_SLOTS_BUSY;
-    }
-
     if ( CCIDReaderStates[wRdrLun].dwMaxCCIDMessageLength < dwDataCmdLength )
     {
         LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Command too long for reader");
@@ -404,75 +818,91 @@ CCIDRv CCID_Exchange_Command(DWORD Lun, BYTE bMessageTypeCmd,
     // Just to make sure buffer will be large enough for the response
     assert(sizeof(CCIDMessageBulkOut) >= sizeof(CCIDMessageBulkIn));
 
-    // Malloc buffer of size of the message +maximum data for this slot
-    //+++ Could be malloced once and for all at the structure creation
-    pcBuffer = malloc(sizeof(CCIDMessageBulkOut)
-                         + CCIDReaderStates[wRdrLun].dwMaxCCIDMessageLength);
-    if ( pcBuffer == NULL )
-    {
-        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Malloc failed");
-        return CCIDRv_ERR_UNSPECIFIED;        
-    }
-    // See if this is a retry after a time extension request
-    // For T=0, this means that we just have to jump to the read
-    // and not attempt to write
-    if (!bTimeExtRetry)
-    {
-        // Not a retry, send the command
-        //++ bCurrentCCIDBusySlots should be here
-        
-        pstmessage = (CCIDMessageBulkOut *) pcBuffer;
-        pstmessage->bMessageType = bMessageTypeCmd;
-        pstmessage->dwLength = HostToCCIDLong(dwDataCmdLength);
-        pstmessage->bSlot = wSlot;
-        pstmessage->bSeq = CCIDReaderStates[wRdrLun].bSeq++;
-        pstmessage->bMessageSpecific1 = abMessageSpecificCmd[0];
-        pstmessage->bMessageSpecific2 = abMessageSpecificCmd[1];
-        pstmessage->bMessageSpecific3 = abMessageSpecificCmd[2];
-        // Copy the command data
-        bcopy(abDataCmd, pcBuffer+sizeof(CCIDMessageBulkOut), dwDataCmdLength);
-        
-        trv = CCIDReaderStates[wRdrLun].pTrFunctions->Write(Lun,
-                                                            sizeof(CCIDMessageBulkOut) +
-                                                            dwDataCmdLength,
-                                                            pcBuffer);
-    }
-    bzero(pcBuffer, sizeof(CCIDMessageBulkOut)+dwDataCmdLength);
-    if ( trv != TrRv_OK )
+    if ( CCIDReaderStates[wRdrLun].bDispatch )
     {
-        free(pcBuffer);
-        return CCIDRv_ERR_TRANSPORT_ERROR;
-    }
-    dwRespLength =  CCIDReaderStates[wRdrLun].dwMaxCCIDMessageLength;
-    trv = CCIDReaderStates[wRdrLun].pTrFunctions->Read(Lun, &dwRespLength,
-                                                       pcBuffer);
-    if ( trv != TrRv_OK )
-    {
-        free(pcBuffer);
-        return CCIDRv_ERR_TRANSPORT_ERROR;
+        // Several slots may be busy at once, time extensions
+        // are handled by the dispatcher
+        rv = CCIDDispatchCommand(Lun, bMessageTypeCmd, abMessageSpecificCmd,
+                                 abDataCmd, dwDataCmdLength,
+                                 &pcRespBuffer, &dwRespLength);
+        if ( rv != CCIDRv_OK )
+        {
+            return rv;
+        }
     }
-    if ( dwRespLength < sizeof(CCIDMessageBulkIn) )
+    else
     {
-        free(pcBuffer);
-        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Reader returned too little data");
-        return CCIDRv_ERR_UNSPECIFIED;        
+        if ( CCIDReaderStates[wRdrLun].bCurrentCCIDBusySlots
+             >= CCIDReaderStates[wRdrLun].bMaxCCIDBusySlots )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Too many slots busy");
+            return CCIDRv_ERR_SLOTS_BUSY;
+        }
+
+        // Buffers are allocated once and for all in CCID_OpenChannel()
+        pcBuffer = CCIDReaderStates[wRdrLun].pcBulkOutBuffer;
+        pcRespBuffer = CCIDReaderStates[wRdrLun].pcBulkInBuffer;
+        pTrFunctions = CCIDReaderStates[wRdrLun].pTrFunctions;
+        dwRespLength =  CCIDReaderStates[wRdrLun].dwMaxCCIDMessageLength;
+        // See if this is a retry after a time extension request
+        // For T=0, this means that we just have to jump to the read
+        // and not attempt to write
+        if (!bTimeExtRetry)
+        {
+            // Not a retry, send the command
+            //++ bCurrentCCIDBusySlots should be here
+            CCIDBuildMessage(pcBuffer, bMessageTypeCmd, wSlot,
+                             CCIDReaderStates[wRdrLun].bSeq++,
+                             abMessageSpecificCmd, abDataCmd, dwDataCmdLength);
+            
+            if ( pTrFunctions->Exchange != NULL )
+            {
+                // The transport posts the Bulk-IN read before the Bulk-OUT
+                // write completes, saving a round trip per message
+                trv = pTrFunctions->Exchange(Lun, sizeof(CCIDMessageBulkOut) + dwDataCmdLength,
+                                             pcBuffer, &dwRespLength, pcRespBuffer);
+            }
+            else
+            {
+                trv = pTrFunctions->Write(Lun, sizeof(CCIDMessageBulkOut) + dwDataCmdLength,
+                                          pcBuffer);
+                if ( trv == TrRv_OK )
+                {
+                    trv = pTrFunctions->Read(Lun, &dwRespLength, pcRespBuffer);
+                }
+            }
+            bzero(pcBuffer, sizeof(CCIDMessageBulkOut)+dwDataCmdLength);
+        }
+        else
+        {
+            trv = pTrFunctions->Read(Lun, &dwRespLength, pcRespBuffer);
+        }
+        if ( trv != TrRv_OK )
+        {
+            return CCIDRv_ERR_TRANSPORT_ERROR;
+        }
+        if ( dwRespLength < sizeof(CCIDMessageBulkIn) )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Reader returned too little data");
+            return CCIDRv_ERR_UNSPECIFIED;        
+        }
+        BYTE bSeq = ((CCIDMessageBulkIn *) pcRespBuffer)->bSeq;
+        // Check if the returned sequence byte matches that was sent
+        if ( bSeq != ((BYTE)(CCIDReaderStates[wRdrLun].bSeq-1)))
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical, 
+                        "CCID sequence byte returned by reader is wrong %d instead of %d",
+                        bSeq, (CCIDReaderStates[wRdrLun].bSeq-1));
+            return CCIDRv_ERR_WRONG_SEQUENCE;
+        }
     }
-    pstresponse = (CCIDMessageBulkIn *) pcBuffer;
+    pstresponse = (CCIDMessageBulkIn *) pcRespBuffer;
     // Now parse the returned value and copy it in the parameters
     *pbMessageTypeResp = pstresponse->bMessageType;
     *pbStatus = pstresponse->bStatus;
     *pbError = pstresponse->bError;
     *pbMessageSpecificResp = pstresponse->bMessageSpecific;
     dwRespLength -= sizeof(CCIDMessageBulkIn);
-    BYTE bSeq = pstresponse->bSeq;
-    // Check if the returned sequence byte matches that was sent
-    if ( bSeq != ((BYTE)(CCIDReaderStates[wRdrLun].bSeq-1)))
-    {
-        LogMessage( __FILE__,  __LINE__, LogLevelCritical, 
-                    "CCID sequence byte returned by reader is wrong %d instead of %d",
-                    bSeq, (CCIDReaderStates[wRdrLun].bSeq-1));
-        return CCIDRv_ERR_WRONG_SEQUENCE;
-    }
     
     
     LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "ICCStats: %s", 
@@ -493,12 +923,11 @@ CCIDRv CCID_Exchange_Command(DWORD Lun, BYTE bMessageTypeCmd,
         {
             dwRespLength = *pdwDataRespLength;
         }
-        bcopy(pcBuffer + sizeof(CCIDMessageBulkIn), abDataResp, dwRespLength);
+        bcopy(pcRespBuffer + sizeof(CCIDMessageBulkIn), abDataResp, dwRespLength);
     }
     *pdwDataRespLength = dwRespLength;
 
-    bzero(pcBuffer, sizeof(CCIDMessageBulkOut)+dwRespLength);
-    free(pcBuffer);
+    bzero(pcRespBuffer, sizeof(CCIDMessageBulkIn)+dwRespLength);
     
     if ( CCIDGetCommandStatus(*pbStatus) ==  CCID_CMD_STATUS_FAILED )
     {
@@ -676,6 +1105,13 @@ CCIDRv CCID_IccPowerOn(DWORD Lun, BYTE *abDataResp, DWORD *pdwDataRespLength)
     {
         return CCIDRv_ERR_WRONG_MESG_RESP_TYPE;
     }
+    // New ATR: T=1 starts over with its IFSC and EDC
+    if ( (CCIDReaderStates[wRdrLun].t1States != NULL)
+         && (LunToSlotNb(Lun) <= CCIDReaderStates[wRdrLun].bMaxSlotIndex) )
+    {
+        T1Init(&(CCIDReaderStates[wRdrLun].t1States[LunToSlotNb(Lun)]),
+               abDataResp, *pdwDataRespLength);
+    }
     return CCIDRv_OK;
 }
 
@@ -758,15 +1194,114 @@ CCIDRv CCID_GetSlotStatus(DWORD Lun,  BYTE *pbStatus, BYTE *pbClockStatus)
     }
     *pbClockStatus = bMessageSpecificResp;
     *pbStatus = bStatus;
+
+    // Refresh the cached presence, unless a change was notified meanwhile
+    pthread_mutex_lock(&(CCIDReaderStates[wRdrLun].presenceMutex));
+    if ( CCIDReaderStates[wRdrLun].bListener
+         && (LunToSlotNb(Lun) <= CCIDReaderStates[wRdrLun].bMaxSlotIndex)
+         && !(CCIDReaderStates[wRdrLun].pbSlotPresence[LunToSlotNb(Lun)]
+              & CCID_PRESENCE_CHANGED) )
+    {
+        CCIDReaderStates[wRdrLun].pbSlotPresence[LunToSlotNb(Lun)] =
+            CCID_PRESENCE_KNOWN
+            | ((CCIDGetICCStatus(bStatus) != CCID_ICC_STATUS_ABSENT) ?
+               CCID_PRESENCE_PRESENT : 0);
+    }
+    pthread_mutex_unlock(&(CCIDReaderStates[wRdrLun].presenceMutex));
     return CCIDRv_OK;
     
 }
+
+CCIDRv CCID_GetCachedPresence(DWORD Lun, BYTE *pbPresent)
+{
+    WORD wRdrLun;
+    WORD wSlot;
+    BYTE *pbPresence;
+    CCIDRv rv = CCIDRv_ERR_VALUE_NOT_FOUND;
+
+    wRdrLun = LunToReaderLun(Lun);
+    wSlot = LunToSlotNb(Lun);
+    if ( (wRdrLun >= PCSCLITE_MAX_CHANNELS) || !CCIDReaderStates[wRdrLun].used
+         || (wSlot > CCIDReaderStates[wRdrLun].bMaxSlotIndex) )
+    {
+        return CCIDRv_ERR_VALUE_NOT_FOUND;
+    }
+    pthread_mutex_lock(&(CCIDReaderStates[wRdrLun].presenceMutex));
+    if ( !CCIDReaderStates[wRdrLun].bListener )
+    {
+        pthread_mutex_unlock(&(CCIDReaderStates[wRdrLun].presenceMutex));
+        return CCIDRv_ERR_VALUE_NOT_FOUND;
+    }
+    pbPresence = &(CCIDReaderStates[wRdrLun].pbSlotPresence[wSlot]);
+    if ( CCIDReaderStates[wRdrLun].bListening && (*pbPresence & CCID_PRESENCE_KNOWN) )
+    {
+        if ( *pbPresence & CCID_PRESENCE_CHANGED )
+        {
+            // Let the caller look at the new card (power state...)
+            *pbPresence = 0;
+        }
+        else
+        {
+            *pbPresent = (*pbPresence & CCID_PRESENCE_PRESENT) ? 1 : 0;
+            rv = CCIDRv_OK;
+        }
+    }
+    pthread_mutex_unlock(&(CCIDReaderStates[wRdrLun].presenceMutex));
+    return rv;
+}
+// A reader without CCID_CLASS_FEAT_AUTO_CONF_ATR keeps the T=0 default
+// parameters after power on: send it the T=1 ones from the ATR before
+// the first block. Nothing to do for the other readers.
+static CCIDRv CCIDConfigureT1(DWORD Lun)
+{
+    WORD wRdrLun = LunToReaderLun(Lun);
+    WORD wSlot = LunToSlotNb(Lun);
+    CCIDT1State *pT1;
+    BYTE abParams[T1_PARAMETERS_SIZE];
+    BYTE abParamsResp[T1_PARAMETERS_SIZE];
+    DWORD dwParamsLength, dwParamsRespLength;
+    BYTE bProtocolNum;
+    CCIDRv rv;
+
+    if ( CCIDReaderStates[wRdrLun].classDesc.dwFeatures & CCID_CLASS_FEAT_AUTO_CONF_ATR )
+    {
+        return CCIDRv_OK;
+    }
+    if ( (CCIDReaderStates[wRdrLun].t1States == NULL)
+         || (wSlot > CCIDReaderStates[wRdrLun].bMaxSlotIndex) )
+    {
+        return CCIDRv_ERR_NO_SUCH_SLOT;
+    }
+    pT1 = &(CCIDReaderStates[wRdrLun].t1States[wSlot]);
+    if ( pT1->bParametersSet )
+    {
+        return CCIDRv_OK;
+    }
+    dwParamsLength = T1BuildParameters(pT1, abParams);
+    dwParamsRespLength = sizeof(abParamsResp);
+    rv = CCID_SetParameter(Lun, CCID_PROTOCOL_T1, abParams, dwParamsLength,
+                           &bProtocolNum, abParamsResp, &dwParamsRespLength);
+    if ( rv != CCIDRv_OK )
+    {
+        return rv;
+    }
+    if ( bProtocolNum != CCID_PROTOCOL_T1 )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Reader kept protocol %d after SetParameters for T=1", bProtocolNum);
+        return CCIDRv_ERR_PROTOCOL_NOT_SUPPORTED;
+    }
+    pT1->bParametersSet = TRUE;
+    return CCIDRv_OK;
+}
+
 CCIDRv CCID_XfrBlock(DWORD Lun, BYTE bBWI,
                      DWORD dwRequestedProtocol,
                      BYTE *abDataCmd, DWORD dwDataCmdLength,
                      BYTE *abDataResp, DWORD *pdwDataRespLength)
 {
     WORD wRdrLun;
+    CCIDRv rv;
     wRdrLun = LunToReaderLun(Lun);
 
     if ( wRdrLun >= PCSCLITE_MAX_CHANNELS)
@@ -787,14 +1322,16 @@ CCIDRv CCID_XfrBlock(DWORD Lun, BYTE bBWI,
         case CCID_CLASS_FEAT_EXC_LEVEL_LAPDU:
             return CCIDRv_ERR_READER_LEVEL_UNSUPPORTED;
         case CCID_CLASS_FEAT_EXC_LEVEL_TPDU:
-            //+++ 1 for T=1 should be replaced by a #define
-            if (dwRequestedProtocol == 1)
+            if (dwRequestedProtocol == CCID_PROTOCOL_T1)
             {
-                LogMessage( __FILE__,  __LINE__, LogLevelCritical,
-                            "Protocol type of card (T=1) not supported by this driver for this type of reader (TPDU)");                
-                LogMessage( __FILE__,  __LINE__, LogLevelCritical,
-                            "An APDU-level reader should be used");                
-                return CCIDRv_ERR_READER_LEVEL_UNSUPPORTED;
+                rv = CCIDConfigureT1(Lun);
+                if ( rv != CCIDRv_OK )
+                {
+                    return rv;
+                }
+                return CCID_XfrBlockT1(Lun,
+                                       abDataCmd, dwDataCmdLength,
+                                       abDataResp, pdwDataRespLength);
             }
             return CCID_XfrBlockTPDU(Lun, bBWI,
                                       abDataCmd, dwDataCmdLength,
@@ -898,6 +1435,25 @@ CCIDRv CCID_XfrBlockSAPDU(DWORD Lun, BYTE bBWI,
             }
 
         }
+        if ( CCIDGetICCStatus(bStatus) == CCID_ICC_STATUS_ACTIVE )
+        {
+            // Transmission errors, T=1 recovers from them
+            if ( bError == CCID_ERR_ICC_MUTE )
+            {
+                LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "Card mute");
+                return CCIDRv_ERR_ICC_MUTE;
+            }
+            if ( bError == CCID_ERR_XFR_PARITY_ERROR )
+            {
+                LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "Exchange Parity error");
+                return CCIDRv_ERR_XFR_PARITY_ERROR;
+            }
+            if ( bError == CCID_ERR_XFR_OVERRUN )
+            {
+                LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "XFR overrun");
+                return CCIDRv_ERR_XFR_OVERRUN;
+            }
+        }
         if ( CCIDGetICCStatus(bStatus) == CCID_ICC_STATUS_ABSENT)
         {
             return CCIDRv_ERR_CARD_ABSENT;
@@ -929,14 +1485,59 @@ CCIDRv CCID_ResetParameters(DWORD Lun,
                             BYTE *pbProtocolNum,
                             BYTE *abProtocolDataStructure,
                             DWORD *dwProtocolDataStructureLength);
+*/
+
 CCIDRv CCID_SetParameter(DWORD Lun,
                          BYTE bProtocolNum,
                          BYTE *abSetProtocolDataStructure,
                          DWORD dwSetProtocolDataStructureLength,
                          BYTE *pbProtocolNum,
                          BYTE *abProtocolDataStructure,
-                         DWORD *dwProtocolDataStructureLength);
-*/
+                         DWORD *dwProtocolDataStructureLength)
+{
+    CCIDRv rv;
+    BYTE bMessageTypeResp;
+    BYTE bStatus;
+    BYTE bError;
+    BYTE bMessageSpecificResp;
+    BYTE abMessageSpecificCmd[3] = "\x00\x00\x00";
+    abMessageSpecificCmd[0] = bProtocolNum;
+
+    LogHexBuffer(__FILE__,  __LINE__, LogLevelVerbose,
+                 abSetProtocolDataStructure, dwSetProtocolDataStructureLength,
+                 "SetParameters for T=%d: ", bProtocolNum);
+    rv =  CCID_Exchange_Command(Lun, PC_to_RDR_SetParameter,
+                                abMessageSpecificCmd,
+                                abSetProtocolDataStructure,
+                                dwSetProtocolDataStructureLength,
+                                &bMessageTypeResp,
+                                &bStatus, &bError,
+                                &bMessageSpecificResp,
+                                abProtocolDataStructure,
+                                dwProtocolDataStructureLength, 0);
+    if ( rv == CCIDRv_ERR_PRIVATE_ERROR )
+    {
+        // bError is the offset of the first parameter the reader refused
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "SetParameters refused, error %02X", bError);
+        if ( CCIDGetICCStatus(bStatus) == CCID_ICC_STATUS_ABSENT)
+        {
+            return CCIDRv_ERR_CARD_ABSENT;
+        }
+        return CCIDRv_ERR_PROTOCOL_NOT_SUPPORTED;
+    }
+    if (  rv != CCIDRv_OK )
+    {
+        return rv;
+    }
+    if ( bMessageTypeResp != RDR_to_PC_Parameters )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Wrong response type from reader");
+        return CCIDRv_ERR_WRONG_MESG_RESP_TYPE;
+    }
+    *pbProtocolNum = bMessageSpecificResp;
+    return CCIDRv_OK;
+}
 
 CCIDRv CCID_Escape(DWORD Lun,
                    BYTE *abDataCmd, DWORD dwDataCmdLength,
@@ -979,7 +1580,7 @@ CCIDRv CCID_Escape(DWORD Lun,
     return CCIDRv_OK;
 }
 
-//++ TPDU mode will only work with T=0 cards
+//++ T=0 TPDU exchanges, T=1 cards go through CCID_XfrBlockT1()
 CCIDRv CCID_XfrBlockTPDU(DWORD Lun, BYTE bBWI,
                           BYTE *abDataCmd, DWORD dwDataCmdLength,
                           BYTE *abDataResp, DWORD *pdwDataRespLength)
@@ -8,10 +8,30 @@
 
 #ifndef __CCID_H__
 #define __CCID_H__
+#ifdef __APPLE__
 #include <CoreFoundation/CoreFoundation.h>
+#else
+// What CoreFoundation provides to the driver on Mac OS X
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <assert.h>
+typedef uint8_t  UInt8;
+typedef uint16_t UInt16;
+typedef uint32_t UInt32;
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+#endif
+#include <pthread.h>
 #include "wintypes.h"
 #include "pcscdefines.h"
-#include "transport.h"
+#include "Transport.h"
+#include "T1.h"
 
 #define CCID_DESC_TYPE (0x21)
 #define CCID_DESC_SIZE (0x36)
@@ -122,6 +142,11 @@ typedef struct
 #define CCID_CLASS_PROTOCOL_T0  0x00000001
 #define CCID_CLASS_PROTOCOL_T1  0x00000002
 
+// bProtocolNum of the Parameters messages, also the protocol numbers
+// pcscd passes to the IFD handler
+#define CCID_PROTOCOL_T0        0x00
+#define CCID_PROTOCOL_T1        0x01
+
 
 
 // Related to dwFeatures in Class Desc.
@@ -167,6 +192,16 @@ typedef struct {
     DWORD dwExchangeLevel;
     CCIDSlotState *slotStates;
 } tIo;
+// Command in flight on a slot of a reader serving several busy slots
+typedef struct {
+    BYTE bInFlight;
+    BYTE bSeq;
+    BYTE bDone;
+    TrRv trv;
+    DWORD dwRespLength;
+    BYTE *pcRespBuffer;
+} CCIDSlotExchange;
+
 // Used to store the state of a reader (per reader Lun)
 typedef struct {
     BYTE used;
@@ -183,8 +218,47 @@ typedef struct {
     // modified in initialisation of some readers
     DWORD dwExchangeLevel;
     CCIDSlotState *slotStates;
+    // Bulk-OUT/Bulk-IN message buffers, allocated once per channel
+    // (dwBufferSize bytes each, CCID_BUFFER_ALIGNMENT aligned)
+    BYTE *pcBulkOutBuffer;
+    BYTE *pcBulkInBuffer;
+    DWORD dwBufferSize;
+    // Dispatcher used by multi-slot readers: commands for different slots
+    // are sent as they come (up to bMaxCCIDBusySlots at once) and Bulk-IN
+    // responses are routed back to the waiting slot by bSlot/bSeq
+    BYTE bDispatch;
+    BYTE bReading;
+    pthread_mutex_t dispatchMutex;
+    pthread_cond_t dispatchCond;
+    CCIDSlotExchange *slotExchanges;
+    // T=1 protocol state of each slot, used on TPDU-level readers
+    CCIDT1State *t1States;
+    // Card presence of each slot (CCID_PRESENCE_*) kept up to date by a
+    // thread listening to RDR_to_PC_NotifySlotChange on the interrupt pipe.
+    // bListening is cleared if the pipe fails (presence is polled again).
+    // presenceMutex lives as long as the channel; bListener, bListening and
+    // pbSlotPresence are only accessed under it.
+    BYTE bListener;
+    BYTE bListening;
+    BYTE bStopListening;
+    pthread_t listenerThread;
+    pthread_mutex_t presenceMutex;
+    BYTE *pbSlotPresence;
 } CCIDReaderState;
 
+// Alignment of the per-reader message buffers (cache line)
+#define CCID_BUFFER_ALIGNMENT 64
+
+// Values of pbSlotPresence
+#define CCID_PRESENCE_KNOWN     0x01
+#define CCID_PRESENCE_PRESENT   0x02
+// Card inserted and/or removed since last looked at
+#define CCID_PRESENCE_CHANGED   0x04
+// Interrupt pipe read time out, bounds the time to stop the listener (ms)
+#define CCID_INTERRUPT_TIMEOUT  500
+// RDR_to_PC_NotifySlotChange for up to 256 slots
+#define CCID_INTERRUPT_MESSAGE_SIZE (1 + 256 / 4)
+
 
 // values of bMessageType
 #define PC_to_RDR_IccPowerOn                   0x62
@@ -206,6 +280,9 @@ typedef struct {
 #define RDR_to_PC_Parameters                   0x82
 #define RDR_to_PC_Escape                       0x83
 #define RDR_to_PC_DataRateAndClockFrequency    0x84
+// Interrupt-IN messages
+#define RDR_to_PC_NotifySlotChange             0x50
+#define RDR_to_PC_HardwareError                0x51
 
 typedef enum {
     CCIDRv_OK                                 = 0x00,
@@ -276,6 +353,11 @@ CCIDRv CCID_CloseChannel(DWORD Lun);
 CCIDRv CCID_IccPowerOn(DWORD Lun, BYTE *abDataResp, DWORD *pdwDataRespLength);
 CCIDRv CCID_IccPowerOff(DWORD Lun, BYTE *pbClockStatus);                
 CCIDRv CCID_GetSlotStatus(DWORD Lun, BYTE *pbStatus, BYTE *pbClockStatus);
+// Card presence as last notified on the interrupt pipe, without
+// talking to the reader. Returns CCIDRv_ERR_VALUE_NOT_FOUND when unknown,
+// or when the card changed since the last call: CCID_GetSlotStatus()
+// should then be used (it refreshes the cached value).
+CCIDRv CCID_GetCachedPresence(DWORD Lun, BYTE *pbPresent);
 // XfrBlock expects to receive APDU level commands
 // and manages the communication with the CCID reader
 // transparently according to the reader communication level
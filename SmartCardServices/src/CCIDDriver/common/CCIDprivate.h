@@ -34,6 +34,10 @@ CCIDRv CCID_XfrBlockSAPDU(DWORD Lun, BYTE bBWI,
 CCIDRv CCID_XfrBlockTPDU(DWORD Lun, BYTE bBWI,
                          BYTE *abDataCmd, DWORD dwDataCmdLength,
                          BYTE *abDataResp, DWORD *pdwDataRespLength);
+// Runs an APDU over T=1 blocks on a TPDU-level reader (see T1.c)
+CCIDRv CCID_XfrBlockT1(DWORD Lun,
+                       BYTE *abDataCmd, DWORD dwDataCmdLength,
+                       BYTE *abDataResp, DWORD *pdwDataRespLength);
 
 
 #endif
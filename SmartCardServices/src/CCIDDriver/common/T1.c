@@ -0,0 +1,550 @@
+/*
+ *  T1.c
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ */
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+#include <string.h>
+#include <strings.h>
+#include "global.h"
+
+#include "tools.h"
+#include "CCID.h"
+#include "CCIDprivate.h"
+#include "pcscdefines.h"
+#include "T1.h"
+
+
+void T1Init(CCIDT1State *pT1, BYTE *pbATR, DWORD dwATRLength)
+{
+    DWORD i;
+    BYTE bY, bTD;
+    BYTE bLevel = 1;
+    BYTE bT1Bytes = FALSE;
+    BYTE bIFSCFound = FALSE, bEDCFound = FALSE, bBWIFound = FALSE;
+
+    bzero(pT1, sizeof(CCIDT1State));
+    pT1->bIFSC = T1_DEFAULT_IFS;
+    pT1->bIFSD = T1_DEFAULT_IFS;
+    pT1->bEDC = T1_EDC_LRC;
+    pT1->bFiDi = T1_DEFAULT_FIDI;
+    pT1->bGuardTime = T1_DEFAULT_GUARD_TIME;
+    pT1->bWaitingIntegers = T1_DEFAULT_WAITING;
+
+    if ( dwATRLength < 2 )
+    {
+        return;
+    }
+    pT1->bInverse = (pbATR[0] == 0x3F);
+    // Walk the interface bytes: TA1 and TC1 are global, the T=1 specific
+    // ones are the TAi/TBi/TCi (i > 2) following a TD(i-1) that indicates T=1
+    bY = pbATR[1] & 0xF0;
+    i = 2;
+    while ( bY )
+    {
+        if ( bY & 0x10 )
+        {
+            if ( i >= dwATRLength )
+                break;
+            if ( bLevel == 1 )
+            {
+                pT1->bFiDi = pbATR[i];
+            }
+            else if ( bT1Bytes && !bIFSCFound )
+            {
+                pT1->bIFSC = pbATR[i];
+                bIFSCFound = TRUE;
+            }
+            i++;
+        }
+        if ( bY & 0x20 )
+        {
+            if ( i >= dwATRLength )
+                break;
+            if ( bT1Bytes && !bBWIFound )
+            {
+                pT1->bWaitingIntegers = pbATR[i];
+                bBWIFound = TRUE;
+            }
+            i++;
+        }
+        if ( bY & 0x40 )
+        {
+            if ( i >= dwATRLength )
+                break;
+            if ( bLevel == 1 )
+            {
+                pT1->bGuardTime = pbATR[i];
+            }
+            else if ( bT1Bytes && !bEDCFound )
+            {
+                pT1->bEDC = (pbATR[i] & 0x01) ? T1_EDC_CRC : T1_EDC_LRC;
+                bEDCFound = TRUE;
+            }
+            i++;
+        }
+        if ( !(bY & 0x80) || (i >= dwATRLength) )
+        {
+            break;
+        }
+        bTD = pbATR[i++];
+        bY = bTD & 0xF0;
+        bT1Bytes = ((bLevel >= 2) && ((bTD & 0x0F) == 1));
+        bLevel++;
+    }
+    // 0x00 and 0xFF are RFU
+    if ( (pT1->bIFSC == 0x00) || (pT1->bIFSC == 0xFF) )
+    {
+        pT1->bIFSC = T1_DEFAULT_IFS;
+    }
+    pT1->bATRIFSC = pT1->bIFSC;
+}
+
+DWORD T1BuildParameters(CCIDT1State *pT1, BYTE *pbParams)
+{
+    pbParams[0] = pT1->bFiDi;
+    // bmTCCKST1: 0x10, checksum type in bit 0 and convention in bit 1
+    pbParams[1] = 0x10 | ((pT1->bEDC == T1_EDC_CRC) ? 0x01 : 0x00)
+        | (pT1->bInverse ? 0x02 : 0x00);
+    pbParams[2] = pT1->bGuardTime;
+    pbParams[3] = pT1->bWaitingIntegers;
+    // bClockStop: not allowed
+    pbParams[4] = 0x00;
+    pbParams[5] = pT1->bATRIFSC;
+    pbParams[6] = pT1->bNAD;
+    return T1_PARAMETERS_SIZE;
+}
+
+// CRC of ISO/IEC 13239 (polynomial x^16+x^12+x^5+1, reflected), as used in T=1
+static WORD T1ComputeCRC(BYTE *pbData, DWORD dwLength)
+{
+    WORD wCRC = 0xFFFF;
+    BYTE bBit;
+
+    while ( dwLength-- )
+    {
+        wCRC ^= *pbData++;
+        for (bBit = 0; bBit < 8; bBit++)
+        {
+            wCRC = (wCRC & 0x0001) ? ((wCRC >> 1) ^ 0x8408) : (wCRC >> 1);
+        }
+    }
+    return wCRC;
+}
+
+static BYTE T1ComputeLRC(BYTE *pbData, DWORD dwLength)
+{
+    BYTE bLRC = 0;
+
+    while ( dwLength-- )
+    {
+        bLRC ^= *pbData++;
+    }
+    return bLRC;
+}
+
+DWORD T1BuildBlock(BYTE *pbBlock, BYTE bNAD, BYTE bPCB,
+                   BYTE *pbINF, BYTE bLength, BYTE bEDC)
+{
+    DWORD dwLength;
+    WORD wCRC;
+
+    pbBlock[T1_OFFSET_NAD] = bNAD;
+    pbBlock[T1_OFFSET_PCB] = bPCB;
+    pbBlock[T1_OFFSET_LEN] = bLength;
+    if ( bLength )
+    {
+        memcpy(pbBlock + T1_OFFSET_INF, pbINF, bLength);
+    }
+    dwLength = T1_HEADER_SIZE + bLength;
+    if ( bEDC == T1_EDC_CRC )
+    {
+        wCRC = T1ComputeCRC(pbBlock, dwLength);
+        pbBlock[dwLength++] = (BYTE)(wCRC >> 8);
+        pbBlock[dwLength++] = (BYTE)(wCRC & 0xFF);
+    }
+    else
+    {
+        pbBlock[dwLength] = T1ComputeLRC(pbBlock, dwLength);
+        dwLength++;
+    }
+    return dwLength;
+}
+
+BYTE T1CheckBlock(BYTE *pbBlock, DWORD dwLength, BYTE bEDC, BYTE bMaxINF)
+{
+    DWORD dwEDCLength = (bEDC == T1_EDC_CRC) ? 2 : 1;
+    DWORD dwINFLength;
+    WORD wCRC;
+
+    if ( dwLength < T1_HEADER_SIZE + dwEDCLength )
+    {
+        return FALSE;
+    }
+    dwINFLength = pbBlock[T1_OFFSET_LEN];
+    if ( (dwINFLength > bMaxINF)
+         || (dwLength != T1_HEADER_SIZE + dwINFLength + dwEDCLength) )
+    {
+        return FALSE;
+    }
+    if ( bEDC == T1_EDC_CRC )
+    {
+        wCRC = T1ComputeCRC(pbBlock, T1_HEADER_SIZE + dwINFLength);
+        return ( (pbBlock[dwLength - 2] == (BYTE)(wCRC >> 8))
+                 && (pbBlock[dwLength - 1] == (BYTE)(wCRC & 0xFF)) );
+    }
+    return ( pbBlock[dwLength - 1] == T1ComputeLRC(pbBlock, dwLength - 1) );
+}
+
+// Sends one block and gets the block of the card back.
+// *pbValid is cleared when the card answer is lost or garbled
+// (the T=1 error recovery then takes over); other errors are returned.
+static CCIDRv T1Exchange(DWORD Lun, CCIDT1State *pT1, BYTE bBWI,
+                         BYTE *pbSend, DWORD dwSendLength,
+                         BYTE *pbRecv, DWORD *pdwRecvLength, BYTE *pbValid)
+{
+    CCIDRv rv;
+
+    *pdwRecvLength = T1_MAX_BLOCK_SIZE;
+    rv = CCID_XfrBlockSAPDU(Lun, bBWI, pbSend, dwSendLength, pbRecv, pdwRecvLength);
+    if ( (rv == CCIDRv_ERR_XFR_PARITY_ERROR) || (rv == CCIDRv_ERR_XFR_OVERRUN)
+         || (rv == CCIDRv_ERR_ICC_MUTE) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "T=1 block lost: %d", rv);
+        *pbValid = FALSE;
+        return CCIDRv_OK;
+    }
+    if ( rv != CCIDRv_OK )
+    {
+        return rv;
+    }
+    // The card may send up to IFSD bytes in an I-block, and at most
+    // one byte in R and S blocks
+    *pbValid = T1CheckBlock(pbRecv, *pdwRecvLength, pT1->bEDC,
+                            (*pdwRecvLength > T1_OFFSET_PCB)
+                            && T1_IS_I_BLOCK(pbRecv[T1_OFFSET_PCB]) ? pT1->bIFSD : 1);
+    if ( !(*pbValid) )
+    {
+        LogHexBuffer(__FILE__,  __LINE__, LogLevelVerbose, pbRecv, *pdwRecvLength,
+                     "Invalid T=1 block: ");
+    }
+    return CCIDRv_OK;
+}
+
+// Builds the I-block carrying the command bytes from dwOffset on
+static DWORD T1BuildIBlock(CCIDT1State *pT1, BYTE *pbBlock,
+                           BYTE *abDataCmd, DWORD dwDataCmdLength, DWORD dwOffset,
+                           DWORD *pdwChunk, BYTE *pbMore)
+{
+    BYTE bPCB;
+
+    *pdwChunk = dwDataCmdLength - dwOffset;
+    if ( *pdwChunk > pT1->bIFSC )
+    {
+        *pdwChunk = pT1->bIFSC;
+    }
+    *pbMore = (dwOffset + *pdwChunk < dwDataCmdLength);
+    bPCB = T1_I_BLOCK | (pT1->bNs ? T1_I_NS : 0) | (*pbMore ? T1_I_MORE : 0);
+    return T1BuildBlock(pbBlock, pT1->bNAD, bPCB, abDataCmd + dwOffset,
+                        (BYTE) *pdwChunk, pT1->bEDC);
+}
+
+// Exchanges an S(request) for its S(response), retrying on transmission errors
+static CCIDRv T1SendSBlock(DWORD Lun, CCIDT1State *pT1, BYTE bType,
+                           BYTE *pbINF, BYTE bLength,
+                           BYTE *pbRespINF, BYTE *pbRespLength)
+{
+    BYTE abSend[T1_MAX_BLOCK_SIZE];
+    BYTE abRecv[T1_MAX_BLOCK_SIZE];
+    DWORD dwSendLength, dwRecvLength;
+    BYTE bValid;
+    BYTE bTry;
+    CCIDRv rv;
+
+    dwSendLength = T1BuildBlock(abSend, pT1->bNAD, T1_S_BLOCK | bType,
+                                pbINF, bLength, pT1->bEDC);
+    for (bTry = 0; bTry < T1_MAX_RETRIES; bTry++)
+    {
+        rv = T1Exchange(Lun, pT1, 0, abSend, dwSendLength,
+                        abRecv, &dwRecvLength, &bValid);
+        if ( rv != CCIDRv_OK )
+        {
+            return rv;
+        }
+        if ( bValid
+             && (abRecv[T1_OFFSET_PCB] == (T1_S_BLOCK | T1_S_RESPONSE | bType)) )
+        {
+            *pbRespLength = abRecv[T1_OFFSET_LEN];
+            memcpy(pbRespINF, abRecv + T1_OFFSET_INF, *pbRespLength);
+            return CCIDRv_OK;
+        }
+    }
+    return CCIDRv_ERR_UNSPECIFIED;
+}
+
+// Offers the card to send up to bIFSD bytes per I-block (the default is 32)
+static void T1NegotiateIFSD(DWORD Lun, CCIDT1State *pT1)
+{
+    CCIDReaderState *pReaderState = &CCIDReaderStates[LunToReaderLun(Lun)];
+    DWORD dwIFSD = T1_MAX_IFS;
+    BYTE bRespINF[T1_MAX_IFS];
+    BYTE bRespLength;
+    BYTE bIFSD;
+
+    pT1->bIFSDNegotiated = TRUE;
+    if ( pReaderState->classDesc.dwMaxIFSD && (pReaderState->classDesc.dwMaxIFSD < dwIFSD) )
+    {
+        dwIFSD = pReaderState->classDesc.dwMaxIFSD;
+    }
+    // The whole block must fit in one CCID message
+    if ( pReaderState->dwMaxCCIDMessageLength
+         < sizeof(CCIDMessageBulkIn) + T1_MAX_BLOCK_SIZE )
+    {
+        dwIFSD = pReaderState->dwMaxCCIDMessageLength - sizeof(CCIDMessageBulkIn)
+            - (T1_MAX_BLOCK_SIZE - T1_MAX_IFS);
+    }
+    if ( pReaderState->classDesc.dwFeatures & CCID_CLASS_FEAT_AUTO_IFSD )
+    {
+        // The reader already did it when the card was powered
+        pT1->bIFSD = (BYTE) dwIFSD;
+        return;
+    }
+    if ( dwIFSD <= T1_DEFAULT_IFS )
+    {
+        return;
+    }
+    bIFSD = (BYTE) dwIFSD;
+    if ( (T1SendSBlock(Lun, pT1, T1_S_IFS, &bIFSD, 1, bRespINF, &bRespLength) != CCIDRv_OK)
+         || (bRespLength != 1) || (bRespINF[0] != bIFSD) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelImportant,
+                    "IFSD negotiation failed, keeping IFSD = %d", pT1->bIFSD);
+        return;
+    }
+    pT1->bIFSD = bIFSD;
+    LogMessage( __FILE__,  __LINE__, LogLevelVerbose, "IFSD set to %d", bIFSD);
+}
+
+// Runs S(RESYNCH) and resets the protocol state to the one after the ATR
+static CCIDRv T1Resynch(DWORD Lun, CCIDT1State *pT1)
+{
+    BYTE bRespINF[T1_MAX_IFS];
+    BYTE bRespLength;
+    CCIDRv rv;
+
+    LogMessage( __FILE__,  __LINE__, LogLevelImportant, "T=1 resynchronisation");
+    rv = T1SendSBlock(Lun, pT1, T1_S_RESYNCH, NULL, 0, bRespINF, &bRespLength);
+    if ( rv != CCIDRv_OK )
+    {
+        return rv;
+    }
+    pT1->bNs = 0;
+    pT1->bNr = 0;
+    pT1->bIFSC = pT1->bATRIFSC;
+    pT1->bIFSD = T1_DEFAULT_IFS;
+    pT1->bIFSDNegotiated = FALSE;
+    return CCIDRv_OK;
+}
+
+CCIDRv CCID_XfrBlockT1(DWORD Lun,
+                       BYTE *abDataCmd, DWORD dwDataCmdLength,
+                       BYTE *abDataResp, DWORD *pdwDataRespLength)
+{
+    WORD wRdrLun = LunToReaderLun(Lun);
+    WORD wSlot = LunToSlotNb(Lun);
+    CCIDT1State *pT1;
+    // Last I or R block sent, resent when the card asks for it
+    BYTE abBlock[T1_MAX_BLOCK_SIZE];
+    DWORD dwBlockLength;
+    // Block to send next (abBlock, or an S(response) / R(error) block)
+    BYTE abReply[T1_MAX_BLOCK_SIZE];
+    BYTE *pbSend;
+    DWORD dwSendLength;
+    BYTE abRecv[T1_MAX_BLOCK_SIZE];
+    DWORD dwRecvLength;
+    DWORD dwSent, dwChunk, dwRespLength;
+    BYTE bMore, bSending, bValid;
+    BYTE bPCB, bLength;
+    BYTE bBWI;
+    BYTE bRetries;
+    BYTE bResynchs = T1_MAX_RESYNCH;
+    CCIDRv rv;
+
+    if ( (CCIDReaderStates[wRdrLun].t1States == NULL)
+         || (wSlot > CCIDReaderStates[wRdrLun].bMaxSlotIndex) )
+    {
+        return CCIDRv_ERR_NO_SUCH_SLOT;
+    }
+    pT1 = &(CCIDReaderStates[wRdrLun].t1States[wSlot]);
+    if ( dwDataCmdLength == 0 )
+    {
+        return CCIDRv_ERR_UNSPECIFIED;
+    }
+
+restart:
+    if ( !pT1->bIFSDNegotiated )
+    {
+        T1NegotiateIFSD(Lun, pT1);
+    }
+    dwSent = 0;
+    dwRespLength = 0;
+    bBWI = 0;
+    bRetries = T1_MAX_RETRIES;
+    // bSending is set until the card acknowledges our last I-block
+    bSending = TRUE;
+    dwBlockLength = T1BuildIBlock(pT1, abBlock, abDataCmd, dwDataCmdLength, dwSent,
+                                  &dwChunk, &bMore);
+    pbSend = abBlock;
+    dwSendLength = dwBlockLength;
+
+    for (;;)
+    {
+        rv = T1Exchange(Lun, pT1, bBWI, pbSend, dwSendLength,
+                        abRecv, &dwRecvLength, &bValid);
+        if ( rv != CCIDRv_OK )
+        {
+            return rv;
+        }
+        bBWI = 0;
+        pbSend = abBlock;
+        dwSendLength = dwBlockLength;
+        if ( !bValid )
+        {
+            bPCB = T1_R_BLOCK | (pT1->bNr ? T1_R_NR : 0) | T1_R_ERR_EDC;
+            goto error;
+        }
+        bPCB = abRecv[T1_OFFSET_PCB];
+        bLength = abRecv[T1_OFFSET_LEN];
+
+        if ( T1_IS_I_BLOCK(bPCB) )
+        {
+            // Not allowed while we are chaining, or out of sequence
+            if ( (bSending && bMore) || (T1_GET_NS(bPCB) != pT1->bNr) )
+            {
+                bPCB = T1_R_BLOCK | (pT1->bNr ? T1_R_NR : 0) | T1_R_ERR_OTHER;
+                goto error;
+            }
+            if ( bSending )
+            {
+                // The answer acknowledges our last I-block
+                pT1->bNs ^= 1;
+                bSending = FALSE;
+            }
+            pT1->bNr ^= 1;
+            if ( dwRespLength + bLength > *pdwDataRespLength )
+            {
+                LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                            "Response buffer too small for T=1 answer");
+                return CCIDRv_ERR_XFR_OVERRUN;
+            }
+            memcpy(abDataResp + dwRespLength, abRecv + T1_OFFSET_INF, bLength);
+            dwRespLength += bLength;
+            bRetries = T1_MAX_RETRIES;
+            if ( !(bPCB & T1_I_MORE) )
+            {
+                *pdwDataRespLength = dwRespLength;
+                return CCIDRv_OK;
+            }
+            // Card is chaining: ask for the next block
+            dwBlockLength = T1BuildBlock(abBlock, pT1->bNAD,
+                                         T1_R_BLOCK | (pT1->bNr ? T1_R_NR : 0),
+                                         NULL, 0, pT1->bEDC);
+            dwSendLength = dwBlockLength;
+            continue;
+        }
+
+        if ( T1_IS_R_BLOCK(bPCB) )
+        {
+            if ( bSending && bMore && (T1_GET_NR(bPCB) != pT1->bNs) )
+            {
+                // Chained I-block acknowledged, send the next part
+                pT1->bNs ^= 1;
+                dwSent += dwChunk;
+                dwBlockLength = T1BuildIBlock(pT1, abBlock, abDataCmd, dwDataCmdLength,
+                                              dwSent, &dwChunk, &bMore);
+                dwSendLength = dwBlockLength;
+                bRetries = T1_MAX_RETRIES;
+                continue;
+            }
+            // Card asks for our last block again
+            if ( --bRetries == 0 )
+            {
+                goto resynch;
+            }
+            if ( bSending )
+            {
+                // IFSC may have changed in between
+                dwBlockLength = T1BuildIBlock(pT1, abBlock, abDataCmd, dwDataCmdLength,
+                                              dwSent, &dwChunk, &bMore);
+                dwSendLength = dwBlockLength;
+            }
+            continue;
+        }
+
+        // S-block: only requests are expected from the card
+        switch ( bPCB )
+        {
+            case T1_S_BLOCK | T1_S_IFS:
+                if ( (bLength != 1) || (abRecv[T1_OFFSET_INF] == 0x00)
+                     || (abRecv[T1_OFFSET_INF] == 0xFF) )
+                {
+                    bPCB = T1_R_BLOCK | (pT1->bNr ? T1_R_NR : 0) | T1_R_ERR_OTHER;
+                    goto error;
+                }
+                pT1->bIFSC = abRecv[T1_OFFSET_INF];
+                LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                            "Card set IFSC to %d", pT1->bIFSC);
+                break;
+            case T1_S_BLOCK | T1_S_WTX:
+                if ( bLength != 1 )
+                {
+                    bPCB = T1_R_BLOCK | (pT1->bNr ? T1_R_NR : 0) | T1_R_ERR_OTHER;
+                    goto error;
+                }
+                // Card needs more time to answer our response
+                bBWI = abRecv[T1_OFFSET_INF];
+                LogMessage( __FILE__,  __LINE__, LogLevelVerbose,
+                            "Card requested waiting time extension x%d", bBWI);
+                break;
+            case T1_S_BLOCK | T1_S_ABORT:
+                LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Card aborted the chain");
+                dwSendLength = T1BuildBlock(abReply, pT1->bNAD, bPCB | T1_S_RESPONSE,
+                                            NULL, 0, pT1->bEDC);
+                T1Exchange(Lun, pT1, 0, abReply, dwSendLength,
+                           abRecv, &dwRecvLength, &bValid);
+                return CCIDRv_ERR_CMD_ABORTED;
+            default:
+                bPCB = T1_R_BLOCK | (pT1->bNr ? T1_R_NR : 0) | T1_R_ERR_OTHER;
+                goto error;
+        }
+        // Acknowledge the request, the card then carries on
+        dwSendLength = T1BuildBlock(abReply, pT1->bNAD, bPCB | T1_S_RESPONSE,
+                                    abRecv + T1_OFFSET_INF, bLength, pT1->bEDC);
+        pbSend = abReply;
+        continue;
+
+error:
+        // Ask the card to send its last block again
+        if ( --bRetries == 0 )
+        {
+            goto resynch;
+        }
+        dwSendLength = T1BuildBlock(abReply, pT1->bNAD, bPCB, NULL, 0, pT1->bEDC);
+        pbSend = abReply;
+        continue;
+
+resynch:
+        if ( (bResynchs-- == 0) || (T1Resynch(Lun, pT1) != CCIDRv_OK) )
+        {
+            LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                        "T=1 exchange failed, card has to be reset");
+            return CCIDRv_ERR_UNSPECIFIED;
+        }
+        // Whole command has to be sent again
+        goto restart;
+    }
+}
@@ -0,0 +1,93 @@
+/*
+ *  T1.h
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ */
+
+#ifndef __T1_H__
+#define __T1_H__
+
+// ISO 7816-3 T=1 block protocol, run by the host for TPDU-level readers
+// (APDU-level readers do this themselves)
+
+// Block layout: NAD PCB LEN [INF] EDC
+#define T1_OFFSET_NAD           0
+#define T1_OFFSET_PCB           1
+#define T1_OFFSET_LEN           2
+#define T1_OFFSET_INF           3
+#define T1_HEADER_SIZE          3
+#define T1_MAX_IFS              254
+#define T1_DEFAULT_IFS          32
+// Prologue + maximum INF + CRC
+#define T1_MAX_BLOCK_SIZE       (T1_HEADER_SIZE + T1_MAX_IFS + 2)
+
+#define T1_EDC_LRC              0
+#define T1_EDC_CRC              1
+
+// Interface byte values used when the ATR does not give them
+#define T1_DEFAULT_FIDI         0x11    // TA1: Fi = 372, Di = 1
+#define T1_DEFAULT_GUARD_TIME   0x00    // TC1
+#define T1_DEFAULT_WAITING      0x4D    // TBi (i > 2): BWI = 4, CWI = 13
+
+// abProtocolDataStructure of PC_to_RDR_SetParameters for T=1
+#define T1_PARAMETERS_SIZE      7
+
+// PCB coding
+#define T1_I_BLOCK              0x00
+#define T1_I_NS                 0x40
+#define T1_I_MORE               0x20
+#define T1_R_BLOCK              0x80
+#define T1_R_NR                 0x10
+#define T1_R_ERR_EDC            0x01
+#define T1_R_ERR_OTHER          0x02
+#define T1_S_BLOCK              0xC0
+#define T1_S_RESPONSE           0x20
+#define T1_S_RESYNCH            0x00
+#define T1_S_IFS                0x01
+#define T1_S_ABORT              0x02
+#define T1_S_WTX                0x03
+
+#define T1_IS_I_BLOCK(pcb)      (((pcb) & 0x80) == T1_I_BLOCK)
+#define T1_IS_R_BLOCK(pcb)      (((pcb) & 0xC0) == T1_R_BLOCK)
+#define T1_IS_S_BLOCK(pcb)      (((pcb) & 0xC0) == T1_S_BLOCK)
+#define T1_GET_NS(pcb)          (((pcb) & T1_I_NS) ? 1 : 0)
+#define T1_GET_NR(pcb)          (((pcb) & T1_R_NR) ? 1 : 0)
+
+// Attempts on a block before resynchronising, and resynchronisations
+// before giving up on the exchange (ISO 7816-3 rules 6 and 7)
+#define T1_MAX_RETRIES          3
+#define T1_MAX_RESYNCH          3
+
+// Protocol state of a slot, reset on every power on
+typedef struct {
+    BYTE bIFSC;             // Largest INF the card accepts
+    BYTE bIFSD;             // Largest INF we accept from the card
+    BYTE bATRIFSC;          // IFSC announced in the ATR (restored on resynch)
+    BYTE bEDC;              // T1_EDC_LRC or T1_EDC_CRC
+    BYTE bNAD;
+    BYTE bNs;               // N(S) of our next I-block
+    BYTE bNr;               // N(S) expected in the next I-block of the card
+    BYTE bIFSDNegotiated;   // S(IFS request) already sent since power on
+    // From the ATR, for readers that do not configure themselves
+    BYTE bFiDi;             // TA1
+    BYTE bGuardTime;        // TC1
+    BYTE bWaitingIntegers;  // First TBi (i > 2) for T=1: BWI/CWI
+    BYTE bInverse;          // TS announced the inverse convention
+    BYTE bParametersSet;    // PC_to_RDR_SetParameters sent since power on
+} CCIDT1State;
+
+// Resets pT1 and reads IFSC, the EDC type and the timing parameters from the ATR
+void T1Init(CCIDT1State *pT1, BYTE *pbATR, DWORD dwATRLength);
+// Fills pbParams (T1_PARAMETERS_SIZE bytes) with the CCID T=1 protocol
+// data structure matching the ATR pT1 was initialised with
+DWORD T1BuildParameters(CCIDT1State *pT1, BYTE *pbParams);
+// Fills pbBlock (at least T1_MAX_BLOCK_SIZE bytes) and returns its length
+DWORD T1BuildBlock(BYTE *pbBlock, BYTE bNAD, BYTE bPCB,
+                   BYTE *pbINF, BYTE bLength, BYTE bEDC);
+// Returns TRUE if the block is well formed, its INF fits in bMaxINF
+// and its EDC is right
+BYTE T1CheckBlock(BYTE *pbBlock, DWORD dwLength, BYTE bEDC, BYTE bMaxINF);
+
+#endif
@@ -7,10 +7,12 @@
  *  See COPYING file for license.
  *
  */
+#include <stddef.h>
 #include "pcscdefines.h"
 
 #include "Transport.h"
 #include "usbserial.h"
+#include "virtualreader.h"
 
 
 // MAKE SURE VALUES AND ORDER MATCH ENUM IN Transport.h
@@ -24,9 +26,43 @@ TrFunctions TrFunctionTable[] =
       SetupConnectionsUSB,
       WriteUSB,
       ReadUSB,
-      CloseUSB
+      CloseUSB,
+#ifdef __APPLE__
+      //+++ Pipelining on IOKit needs an async read with a run loop source
+      NULL,
+#else
+      ExchangeUSB,
+#endif
+      ReadInterruptUSB
+  },
+  //+++ Serial transport not implemented yet
+  {
+      NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL
+  },
+  {
+      OpenVirtual,
+      GetConfigDescNumberVirtual,
+      GetVendorAndProductIDVirtual,
+      GetClassDescVirtual,
+      SetupConnectionsVirtual,
+      WriteVirtual,
+      ReadVirtual,
+      CloseVirtual,
+      // Already synchronous and in-process
+      NULL,
+      ReadInterruptVirtual
   }
     
 };
 
+TrType TrTypeFromChannel( DWORD channel )
+{
+    if ( (channel & TR_CHANNEL_BASE_MASK) == TR_VIRTUAL_BASE_PORT )
+    {
+        return TrType_VIRTUAL;
+    }
+    // Everything else is a USB hotplug channel
+    return TrType_USB;
+}
+
 
@@ -36,15 +36,34 @@ typedef struct {
     TrRv (*Write)( DWORD lun, DWORD length, BYTE *Buffer );
     TrRv (*Read)( DWORD lun, DWORD *length, BYTE *Buffer );
     TrRv (*Close)( DWORD lun );
+    // Optional (may be NULL): sends a message and reads the answer with the
+    // Bulk-IN read posted before the Bulk-OUT write completes.
+    // sendBuffer and recvBuffer must not overlap.
+    TrRv (*Exchange)( DWORD lun, DWORD sendLength, BYTE *sendBuffer,
+                      DWORD *recvLength, BYTE *recvBuffer );
+    // Optional (may be NULL): waits up to timeout ms for a message on the
+    // interrupt pipe set-up by SetupConnections(..., 1).
+    // *length is set to 0 if nothing came in time.
+    TrRv (*ReadInterrupt)( DWORD lun, DWORD *length, BYTE *buffer, DWORD timeout );
 } TrFunctions;
 
 // MAKE SURE VALUES AND ORDER MATCH TABLE IN Transport.c
 typedef enum {
   TrType_USB                     = 0x00,
   TrType_SERIAL                  = 0x01,
+  TrType_VIRTUAL                 = 0x02,
 } TrType;
 
+// Channel IDs in [TR_VIRTUAL_BASE_PORT, TR_VIRTUAL_BASE_PORT + 0xFFFF]
+// are served by the in-process virtual reader instead of real hardware
+// (e.g. CHANNELID 0x300000 in reader.conf)
+#define TR_VIRTUAL_BASE_PORT    0x300000
+#define TR_CHANNEL_BASE_MASK    0xFFFF0000
+
 extern TrFunctions TrFunctionTable[];
+
+// Returns the transport to use for a given pcscd channel ID
+TrType TrTypeFromChannel( DWORD channel );
 #ifdef __cplusplus
 }
 #endif
@@ -537,6 +537,7 @@ RESPONSECODE IFDHICCPresence(DWORD Lun)
 	 */
     BYTE bStatus, bClockStatus;
     BYTE bICCStatus;
+    BYTE bPresent;
     // Set log level to only critical
     if ( !bLogPeriodic )
     {
@@ -548,6 +549,15 @@ RESPONSECODE IFDHICCPresence(DWORD Lun)
     {
         SetLogLevel((BYTE)iLogValue);
 		return IFD_COMMUNICATION_ERROR;
+    }
+    // Nothing changed since the reader last told us: no need to ask it
+    if ( (CCID_GetCachedPresence(Lun, &bPresent) == CCIDRv_OK)
+         && (bPresent
+             || !(pstIFDDescs[LunToReaderLun(Lun)][LunToSlotNb(Lun)].bPowerFlags
+                  & MASK_POWERFLAGS_PUP)) )
+    {
+        SetLogLevel((BYTE)iLogValue);
+        return bPresent ? IFD_ICC_PRESENT : IFD_ICC_NOT_PRESENT;
     }
 	if (CCID_GetSlotStatus(Lun, &bStatus, &bClockStatus) != CCIDRv_OK)
 	{
@@ -0,0 +1,125 @@
+/*
+ *  tools_linux.c
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+
+#include "tools.h"
+
+// pcsc-lite bundles have no CFBundle registry: the Info.plist is looked
+// up in the driver drop directory. The default is set at build time and
+// may be overridden at run time with the IFD_CCID_DROPDIR environment
+// variable, e.g. for a pcscd installed under another prefix.
+#ifndef PCSCLITE_HP_DROPDIR
+#define PCSCLITE_HP_DROPDIR "/usr/lib/pcsc/drivers"
+#endif
+#define DROPDIR_ENV_NAME "IFD_CCID_DROPDIR"
+#define INFO_PLIST_SUFFIX "/ifd-ccid.bundle/Contents/Info.plist"
+#define INFO_PLIST_PATH_SIZE 1024
+#define INFO_PLIST_VALUE_SIZE 256
+
+// Returns the drop directory the bundle is looked up in
+static const char* GetDropDir(void)
+{
+    const char *pcDropDir;
+
+    pcDropDir = getenv(DROPDIR_ENV_NAME);
+    if ( (pcDropDir == NULL) || (*pcDropDir == '\0') )
+    {
+        return PCSCLITE_HP_DROPDIR;
+    }
+    return pcDropDir;
+}
+
+
+// Minimal Info.plist parser: returns the <string> following <key>keyName</key>
+// The returned value is stored in a static buffer valid until the next call
+const char* ParseInfoPlist(const char *bundleIdentifier, const char *keyName)
+{
+    static char pcValue[INFO_PLIST_VALUE_SIZE];
+    char pcKey[INFO_PLIST_VALUE_SIZE];
+    char pcPath[INFO_PLIST_PATH_SIZE];
+    char *pcPlist, *pcStart, *pcEnd;
+    FILE *fp;
+    long lSize;
+
+    if ( snprintf(pcPath, sizeof(pcPath), "%s" INFO_PLIST_SUFFIX, GetDropDir())
+         >= (int) sizeof(pcPath) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Bundle path too long: %s", GetDropDir());
+        return NULL;
+    }
+    fp = fopen(pcPath, "r");
+    if ( fp == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Bundle not found: %s (%s)", bundleIdentifier, pcPath);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    lSize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    pcPlist = malloc(lSize + 1);
+    if ( (pcPlist == NULL) || (fread(pcPlist, 1, lSize, fp) != (size_t) lSize) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical, "Bundle InfoDic error");
+        free(pcPlist);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    pcPlist[lSize] = '\0';
+
+    snprintf(pcKey, sizeof(pcKey), "<key>%s</key>", keyName);
+    pcStart = strstr(pcPlist, pcKey);
+    if ( pcStart != NULL )
+    {
+        pcStart = strstr(pcStart + strlen(pcKey), "<string>");
+    }
+    if ( pcStart == NULL )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Bundle InfoDic error: %s not found", keyName);
+        free(pcPlist);
+        return NULL;
+    }
+    pcStart += strlen("<string>");
+    pcEnd = strstr(pcStart, "</string>");
+    if ( (pcEnd == NULL) || (pcEnd - pcStart >= INFO_PLIST_VALUE_SIZE) )
+    {
+        LogMessage( __FILE__,  __LINE__, LogLevelCritical,
+                    "Bundle InfoDic error: bad value for %s", keyName);
+        free(pcPlist);
+        return NULL;
+    }
+    memcpy(pcValue, pcStart, pcEnd - pcStart);
+    pcValue[pcEnd - pcStart] = '\0';
+    free(pcPlist);
+    return pcValue;
+}
+
+
+DWORD CCIDToHostLong(DWORD dword)
+{
+    return (le32toh((uint32_t) dword));
+}
+DWORD HostToCCIDLong(DWORD dword)
+{
+    return (htole32((uint32_t) dword));
+}
+WORD CCIDToHostWord(WORD word)
+{
+    return (le16toh((uint16_t) word));
+}
+WORD HostToCCIDWord(WORD word)
+{
+    return (htole16((uint16_t) word));
+}
@@ -0,0 +1,647 @@
+/*
+ *  ccid_virtualtest.c
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ *  Runs the IFD handler and the CCID layer against the in-process
+ *  virtual reader (see Virtual/virtualreader.h). Exits with 0 when all
+ *  checks passed. With -bench it then times CCID_XfrBlock round trips,
+ *  and large APDUs with T=0 and T=1 on TPDU level readers.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "wintypes.h"
+#include "pcscdefines.h"
+#include "ifdhandler.h"
+#include "Transport.h"
+#include "CCID.h"
+#include "CCIDprivate.h"
+#include "T1.h"
+#include "tools.h"
+#include "virtualreader.h"
+
+// Each test uses its own reader so that a failure does not leak into the next one
+#define READER_LUN(rdr)     ((DWORD)(rdr) << 16)
+#define READER_CHANNEL(rdr) (TR_VIRTUAL_BASE_PORT + (rdr))
+
+static int iFailures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if ( !(cond) ) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            iFailures++; \
+        } \
+    } while (0)
+
+static RESPONSECODE TransmitT(DWORD Lun, DWORD dwProtocol,
+                              BYTE *pbCmd, DWORD dwCmdLength,
+                              BYTE *pbResp, DWORD *pdwRespLength)
+{
+    SCARD_IO_HEADER sendPci, recvPci;
+
+    sendPci.Protocol = dwProtocol;
+    sendPci.Length = sizeof(sendPci);
+    return IFDHTransmitToICC(Lun, sendPci, pbCmd, dwCmdLength,
+                             pbResp, pdwRespLength, &recvPci);
+}
+
+static RESPONSECODE Transmit(DWORD Lun, BYTE *pbCmd, DWORD dwCmdLength,
+                             BYTE *pbResp, DWORD *pdwRespLength)
+{
+    return TransmitT(Lun, CCID_PROTOCOL_T0, pbCmd, dwCmdLength, pbResp, pdwRespLength);
+}
+
+// Sets TCK of an ATR in place
+static void SetTCK(BYTE *pbATR, DWORD dwATRLength)
+{
+    BYTE bTCK = 0;
+    DWORD i;
+
+    for (i = 1; i < dwATRLength - 1; i++)
+    {
+        bTCK ^= pbATR[i];
+    }
+    pbATR[dwATRLength - 1] = bTCK;
+}
+
+// Card behind the T=1 tests: READ BINARY returns 256 bytes, any other
+// command must carry the bytes 5, 6, 7... as data
+static DWORD dwLastCmdLength;
+
+static TrRv T1CardHandler(void *pContext, DWORD lun,
+                          BYTE *pbCmd, DWORD dwCmdLength,
+                          BYTE *pbResp, DWORD *pdwRespLength)
+{
+    DWORD i;
+
+    dwLastCmdLength = dwCmdLength;
+    if ( (dwCmdLength >= 2) && (pbCmd[1] == 0xB0) )
+    {
+        for (i = 0; i < 256; i++)
+        {
+            pbResp[i] = (BYTE) i;
+        }
+        pbResp[256] = 0x90;
+        pbResp[257] = 0x00;
+        *pdwRespLength = 258;
+        return TrRv_OK;
+    }
+    for (i = 5; i < dwCmdLength; i++)
+    {
+        if ( pbCmd[i] != (BYTE) i )
+        {
+            pbResp[0] = 0x6A;
+            pbResp[1] = 0x80;
+            *pdwRespLength = 2;
+            return TrRv_OK;
+        }
+    }
+    pbResp[0] = 0x90;
+    pbResp[1] = 0x00;
+    *pdwRespLength = 2;
+    return TrRv_OK;
+}
+
+// Reads 256 bytes and writes 255: both need chaining with the default IFS
+static void RunT1Exchanges(DWORD Lun, int iCount)
+{
+    BYTE readBinary[] = { 0x00, 0xB0, 0x00, 0x00, 0x00 };
+    BYTE update[5 + 255];
+    BYTE resp[300];
+    DWORD dwRespLength, i;
+    int n;
+
+    update[0] = 0x00;
+    update[1] = 0xD6;
+    update[2] = 0x00;
+    update[3] = 0x00;
+    update[4] = 0xFF;
+    for (i = 5; i < sizeof(update); i++)
+    {
+        update[i] = (BYTE) i;
+    }
+    for (n = 0; n < iCount; n++)
+    {
+        dwRespLength = sizeof(resp);
+        CHECK(TransmitT(Lun, CCID_PROTOCOL_T1, readBinary, sizeof(readBinary),
+                        resp, &dwRespLength) == IFD_SUCCESS);
+        CHECK((dwRespLength == 258) && (resp[255] == 0xFF) && (resp[256] == 0x90));
+
+        dwRespLength = sizeof(resp);
+        CHECK(TransmitT(Lun, CCID_PROTOCOL_T1, update, sizeof(update),
+                        resp, &dwRespLength) == IFD_SUCCESS);
+        CHECK((dwRespLength == 2) && (resp[0] == 0x90) && (dwLastCmdLength == sizeof(update)));
+    }
+}
+
+// Short APDU level reader answering from scripted rules
+static void TestAPDU(void)
+{
+    DWORD Lun = READER_LUN(0);
+    BYTE getData[] = { 0x00, 0xCA, 0x00, 0x00, 0x02 };
+    BYTE getDataResp[] = { 0x01, 0x02, 0x90, 0x00 };
+    BYTE unknown[] = { 0x00, 0x12, 0x00, 0x00, 0x00 };
+    BYTE atr[MAX_ATR_SIZE], resp[300];
+    DWORD dwATRLength, dwRespLength;
+
+    CHECK(VirtualReaderAddRule(0, getData, 2, getDataResp, sizeof(getDataResp)) == TrRv_OK);
+    CHECK(IFDHCreateChannel(Lun, READER_CHANNEL(0)) == IFD_SUCCESS);
+    CHECK(IFDHICCPresence(Lun) == IFD_ICC_PRESENT);
+
+    dwATRLength = sizeof(atr);
+    CHECK(IFDHPowerICC(Lun, IFD_POWER_UP, atr, &dwATRLength) == IFD_SUCCESS);
+    CHECK((dwATRLength > 0) && (atr[0] == 0x3B));
+
+    dwRespLength = sizeof(resp);
+    CHECK(Transmit(Lun, getData, sizeof(getData), resp, &dwRespLength) == IFD_SUCCESS);
+    CHECK((dwRespLength == sizeof(getDataResp))
+          && !memcmp(resp, getDataResp, sizeof(getDataResp)));
+
+    // Commands matching no rule get 6D 00
+    dwRespLength = sizeof(resp);
+    CHECK(Transmit(Lun, unknown, sizeof(unknown), resp, &dwRespLength) == IFD_SUCCESS);
+    CHECK((dwRespLength == 2) && (resp[0] == 0x6D) && (resp[1] == 0x00));
+
+    CHECK(IFDHCloseChannel(Lun) == IFD_SUCCESS);
+    VirtualReaderReset(0);
+}
+
+// Card removal on one slot is reported through the interrupt pipe
+// without affecting the other slot
+static void TestPresence(void)
+{
+    DWORD Lun0 = READER_LUN(1), Lun1 = READER_LUN(1) | 1;
+
+    CHECK(VirtualReaderSetSlots(1, 2, 2) == TrRv_OK);
+    CHECK(IFDHCreateChannel(Lun0, READER_CHANNEL(1)) == IFD_SUCCESS);
+    CHECK(IFDHICCPresence(Lun0) == IFD_ICC_PRESENT);
+    CHECK(IFDHICCPresence(Lun1) == IFD_ICC_PRESENT);
+
+    VirtualReaderSetCardPresent(1, 1, 0);
+    // Leave time for the listener to pick up the notification
+    usleep(50000);
+    CHECK(IFDHICCPresence(Lun1) == IFD_ICC_NOT_PRESENT);
+    CHECK(IFDHICCPresence(Lun0) == IFD_ICC_PRESENT);
+
+    VirtualReaderSetCardPresent(1, 1, 1);
+    usleep(50000);
+    CHECK(IFDHICCPresence(Lun1) == IFD_ICC_PRESENT);
+
+    CHECK(IFDHCloseChannel(Lun0) == IFD_SUCCESS);
+    VirtualReaderReset(1);
+}
+
+// Card behind the concurrency test: answers with the slot the command
+// reached and the two data bytes of the command
+static TrRv SlotEchoHandler(void *pContext, DWORD lun,
+                            BYTE *pbCmd, DWORD dwCmdLength,
+                            BYTE *pbResp, DWORD *pdwRespLength)
+{
+    if ( dwCmdLength < 7 )
+    {
+        return TrRv_ERR;
+    }
+    pbResp[0] = (BYTE) LunToSlotNb(lun);
+    pbResp[1] = pbCmd[5];
+    pbResp[2] = pbCmd[6];
+    pbResp[3] = 0x90;
+    pbResp[4] = 0x00;
+    *pdwRespLength = 5;
+    return TrRv_OK;
+}
+
+#define CONCURRENT_SLOTS        4
+#define CONCURRENT_EXCHANGES    8
+#define CONCURRENT_LATENCY_US   20000
+
+typedef struct {
+    DWORD Lun;
+    BYTE bSlot;
+    int iMismatches;
+} SlotWorker;
+
+// Sends CONCURRENT_EXCHANGES numbered commands to one slot and checks
+// that every answer comes from that slot and carries the same number
+static void *SlotWorkerRun(void *pArg)
+{
+    SlotWorker *pWorker = (SlotWorker *) pArg;
+    BYTE cmd[] = { 0x00, 0xDA, 0x00, 0x00, 0x02, 0x00, 0x00 };
+    BYTE resp[32];
+    DWORD dwRespLength;
+    int n;
+
+    for (n = 0; n < CONCURRENT_EXCHANGES; n++)
+    {
+        cmd[5] = pWorker->bSlot;
+        cmd[6] = (BYTE) n;
+        dwRespLength = sizeof(resp);
+        if ( (Transmit(pWorker->Lun, cmd, sizeof(cmd), resp, &dwRespLength) != IFD_SUCCESS)
+             || (dwRespLength != 5) || (resp[0] != pWorker->bSlot)
+             || (resp[1] != pWorker->bSlot) || (resp[2] != (BYTE) n) )
+        {
+            pWorker->iMismatches++;
+        }
+    }
+    return NULL;
+}
+
+static double Now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// A reader with several busy slots and a slow card: one thread per slot
+// must get its own answers back (the dispatcher routes them by bSlot and
+// bSeq, whichever thread reads the Bulk-IN pipe) and the slots must
+// overlap, so the run takes about 1/CONCURRENT_SLOTS of the serial time
+static void TestConcurrentSlots(void)
+{
+    SlotWorker workers[CONCURRENT_SLOTS];
+    pthread_t threads[CONCURRENT_SLOTS];
+    BYTE atr[MAX_ATR_SIZE];
+    DWORD dwATRLength;
+    double dStart, dSerial, dParallel;
+    int i, iMismatches;
+
+    CHECK(VirtualReaderSetSlots(5, CONCURRENT_SLOTS, CONCURRENT_SLOTS) == TrRv_OK);
+    VirtualReaderSetLatency(5, CONCURRENT_LATENCY_US);
+    VirtualReaderSetHandler(5, SlotEchoHandler, NULL);
+    CHECK(IFDHCreateChannel(READER_LUN(5), READER_CHANNEL(5)) == IFD_SUCCESS);
+    CHECK(CCIDReaderStates[5].bMaxCCIDBusySlots == CONCURRENT_SLOTS);
+    for (i = 0; i < CONCURRENT_SLOTS; i++)
+    {
+        workers[i].Lun = READER_LUN(5) | i;
+        workers[i].bSlot = (BYTE) i;
+        workers[i].iMismatches = 0;
+        dwATRLength = sizeof(atr);
+        CHECK(IFDHPowerICC(workers[i].Lun, IFD_POWER_UP, atr, &dwATRLength) == IFD_SUCCESS);
+    }
+
+    // Same exchanges, one slot after the other from a single thread
+    dStart = Now();
+    for (i = 0; i < CONCURRENT_SLOTS; i++)
+    {
+        SlotWorkerRun(&workers[i]);
+    }
+    dSerial = Now() - dStart;
+
+    dStart = Now();
+    for (i = 0; i < CONCURRENT_SLOTS; i++)
+    {
+        CHECK(pthread_create(&threads[i], NULL, SlotWorkerRun, &workers[i]) == 0);
+    }
+    for (i = 0; i < CONCURRENT_SLOTS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    dParallel = Now() - dStart;
+
+    iMismatches = 0;
+    for (i = 0; i < CONCURRENT_SLOTS; i++)
+    {
+        iMismatches += workers[i].iMismatches;
+    }
+    CHECK(iMismatches == 0);
+    // Ideally dParallel * CONCURRENT_SLOTS == dSerial; leave room for
+    // scheduling on a loaded machine
+    CHECK(dParallel * CONCURRENT_SLOTS < dSerial * 1.5);
+    if ( dParallel * CONCURRENT_SLOTS >= dSerial * 1.5 )
+    {
+        fprintf(stderr, "%d slots: serial %.1f ms, parallel %.1f ms\n",
+                CONCURRENT_SLOTS, dSerial * 1e3, dParallel * 1e3);
+    }
+
+    CHECK(IFDHCloseChannel(READER_LUN(5)) == IFD_SUCCESS);
+    VirtualReaderReset(5);
+}
+
+// The bundle Info.plist is looked up in IFD_CCID_DROPDIR when it is set
+static void TestInfoPlist(void)
+{
+    char pcDir[] = "/tmp/ccidtestXXXXXX";
+    char pcPath[256];
+    const char *pcValue;
+    FILE *fp;
+
+    CHECK(mkdtemp(pcDir) != NULL);
+    snprintf(pcPath, sizeof(pcPath), "%s/ifd-ccid.bundle", pcDir);
+    mkdir(pcPath, 0700);
+    snprintf(pcPath, sizeof(pcPath), "%s/ifd-ccid.bundle/Contents", pcDir);
+    mkdir(pcPath, 0700);
+    snprintf(pcPath, sizeof(pcPath), "%s/ifd-ccid.bundle/Contents/Info.plist", pcDir);
+    fp = fopen(pcPath, "w");
+    CHECK(fp != NULL);
+    if ( fp == NULL )
+    {
+        return;
+    }
+    fputs("<dict>\n\t<key>ifdReadTimeOut</key>\n\t<string>1234</string>\n</dict>\n", fp);
+    fclose(fp);
+
+    setenv("IFD_CCID_DROPDIR", pcDir, 1);
+    pcValue = ParseInfoPlist("com.apple.ccidclassdriver", "ifdReadTimeOut");
+    CHECK((pcValue != NULL) && !strcmp(pcValue, "1234"));
+    CHECK(ParseInfoPlist("com.apple.ccidclassdriver", "ifdMissing") == NULL);
+    unsetenv("IFD_CCID_DROPDIR");
+
+    unlink(pcPath);
+    snprintf(pcPath, sizeof(pcPath), "%s/ifd-ccid.bundle/Contents", pcDir);
+    rmdir(pcPath);
+    snprintf(pcPath, sizeof(pcPath), "%s/ifd-ccid.bundle", pcDir);
+    rmdir(pcPath);
+    rmdir(pcDir);
+}
+
+// Parameters derived from the ATR
+static void TestT1Parameters(void)
+{
+    // TA1 = 13, TC1 = 02, TD1: T=1, TD2: T=1 with TA3 (IFSC) and TB3 (BWI/CWI)
+    BYTE atr[] = { 0x3B, 0xD0, 0x13, 0x02, 0x81, 0x31, 0x80, 0x45, 0x00 };
+    BYTE expected[T1_PARAMETERS_SIZE] = { 0x13, 0x10, 0x02, 0x45, 0x00, 0x80, 0x00 };
+    // Only TD1 for T=1 and TD2 with TC3 asking for a CRC
+    BYTE atrDefault[] = { 0x3B, 0x80, 0x81, 0x71, 0x20, 0x45, 0x01, 0x00 };
+    BYTE expectedDefault[T1_PARAMETERS_SIZE] = { 0x11, 0x11, 0x00, 0x45, 0x00, 0x20, 0x00 };
+    BYTE params[T1_PARAMETERS_SIZE];
+    CCIDT1State t1;
+
+    SetTCK(atr, sizeof(atr));
+    T1Init(&t1, atr, sizeof(atr));
+    CHECK((t1.bIFSC == 0x80) && (t1.bEDC == T1_EDC_LRC));
+    CHECK(T1BuildParameters(&t1, params) == T1_PARAMETERS_SIZE);
+    CHECK(!memcmp(params, expected, sizeof(expected)));
+
+    SetTCK(atrDefault, sizeof(atrDefault));
+    T1Init(&t1, atrDefault, sizeof(atrDefault));
+    CHECK((t1.bIFSC == 0x20) && (t1.bEDC == T1_EDC_CRC));
+    T1BuildParameters(&t1, params);
+    CHECK(!memcmp(params, expectedDefault, sizeof(expectedDefault)));
+}
+
+// T=1 on a TPDU reader that configures itself from the ATR, with LRC
+// and CRC cards, garbled blocks and waiting time extensions
+static void TestT1(void)
+{
+    DWORD Lun = READER_LUN(2);
+    BYTE atrLRC[] = { 0x3B, 0x80, 0x81, 0x31, 0x20, 0x45, 0x00 };
+    BYTE atrCRC[] = { 0x3B, 0x80, 0x81, 0x71, 0x20, 0x45, 0x01, 0x00 };
+    BYTE atr[MAX_ATR_SIZE];
+    DWORD dwATRLength;
+    CCIDT1State *pT1;
+
+    SetTCK(atrLRC, sizeof(atrLRC));
+    SetTCK(atrCRC, sizeof(atrCRC));
+    CHECK(VirtualReaderSetATR(2, atrLRC, sizeof(atrLRC)) == TrRv_OK);
+    CHECK(VirtualReaderSetTPDU(2, 1) == TrRv_OK);
+    VirtualReaderSetHandler(2, T1CardHandler, NULL);
+    CHECK(IFDHCreateChannel(Lun, READER_CHANNEL(2)) == IFD_SUCCESS);
+
+    dwATRLength = sizeof(atr);
+    CHECK(IFDHPowerICC(Lun, IFD_POWER_UP, atr, &dwATRLength) == IFD_SUCCESS);
+    pT1 = &(CCIDReaderStates[2].t1States[0]);
+    CHECK((pT1->bIFSC == 0x20) && (pT1->bEDC == T1_EDC_LRC));
+    RunT1Exchanges(Lun, 4);
+    // The reader takes blocks as large as its dwMaxIFSD
+    CHECK(pT1->bIFSD == 254);
+    // Configured from the ATR: no SetParameters needed
+    CHECK(!pT1->bParametersSet);
+
+    // Every 5th block of the card is garbled, and it asks for more time
+    VirtualReaderSetT1Faults(2, 5, 1);
+    RunT1Exchanges(Lun, 4);
+    VirtualReaderSetT1Faults(2, 0, 0);
+
+    CHECK(VirtualReaderSetATR(2, atrCRC, sizeof(atrCRC)) == TrRv_OK);
+    dwATRLength = sizeof(atr);
+    CHECK(IFDHPowerICC(Lun, IFD_RESET, atr, &dwATRLength) == IFD_SUCCESS);
+    CHECK(pT1->bEDC == T1_EDC_CRC);
+    RunT1Exchanges(Lun, 4);
+
+    CHECK(IFDHCloseChannel(Lun) == IFD_SUCCESS);
+    VirtualReaderReset(2);
+}
+
+// A TPDU reader without automatic configuration stays at T=0 until it
+// gets PC_to_RDR_SetParameters with the T=1 data of the ATR
+static void TestT1ManualParameters(void)
+{
+    DWORD Lun = READER_LUN(3);
+    BYTE atrT1[] = { 0x3B, 0xD0, 0x13, 0x02, 0x81, 0x31, 0x80, 0x45, 0x00 };
+    BYTE expected[T1_PARAMETERS_SIZE] = { 0x13, 0x10, 0x02, 0x45, 0x00, 0x80, 0x00 };
+    BYTE selectFile[] = { 0x00, 0xA4, 0x00, 0x00, 0x02, 0x05, 0x06 };
+    BYTE atr[MAX_ATR_SIZE], resp[300], params[T1_PARAMETERS_SIZE];
+    DWORD dwATRLength, dwRespLength, dwParamsLength;
+    BYTE bProtocolNum;
+
+    SetTCK(atrT1, sizeof(atrT1));
+    CHECK(VirtualReaderSetATR(3, atrT1, sizeof(atrT1)) == TrRv_OK);
+    CHECK(VirtualReaderSetTPDU(3, 1) == TrRv_OK);
+    CHECK(VirtualReaderSetManualParameters(3, 1) == TrRv_OK);
+    VirtualReaderSetHandler(3, T1CardHandler, NULL);
+    CHECK(IFDHCreateChannel(Lun, READER_CHANNEL(3)) == IFD_SUCCESS);
+    CHECK(!(CCIDReaderStates[3].classDesc.dwFeatures & CCID_CLASS_FEAT_AUTO_CONF_ATR));
+
+    dwATRLength = sizeof(atr);
+    CHECK(IFDHPowerICC(Lun, IFD_POWER_UP, atr, &dwATRLength) == IFD_SUCCESS);
+    dwParamsLength = sizeof(params);
+    CHECK(VirtualReaderGetParameters(3, 0, &bProtocolNum, params, &dwParamsLength) == TrRv_OK);
+    CHECK(bProtocolNum == CCID_PROTOCOL_T0);
+
+    // Without SetParameters the card does not answer T=1 blocks
+    CCIDReaderStates[3].t1States[0].bParametersSet = TRUE;
+    dwRespLength = sizeof(resp);
+    CHECK(TransmitT(Lun, CCID_PROTOCOL_T1, selectFile, sizeof(selectFile),
+                    resp, &dwRespLength) != IFD_SUCCESS);
+
+    // A new power on resets the parameters on both sides
+    dwATRLength = sizeof(atr);
+    CHECK(IFDHPowerICC(Lun, IFD_RESET, atr, &dwATRLength) == IFD_SUCCESS);
+    dwRespLength = sizeof(resp);
+    CHECK(TransmitT(Lun, CCID_PROTOCOL_T1, selectFile, sizeof(selectFile),
+                    resp, &dwRespLength) == IFD_SUCCESS);
+    CHECK((dwRespLength == 2) && (resp[0] == 0x90));
+    CHECK(CCIDReaderStates[3].t1States[0].bParametersSet);
+
+    dwParamsLength = sizeof(params);
+    CHECK(VirtualReaderGetParameters(3, 0, &bProtocolNum, params, &dwParamsLength) == TrRv_OK);
+    CHECK((bProtocolNum == CCID_PROTOCOL_T1) && (dwParamsLength == sizeof(expected))
+          && !memcmp(params, expected, sizeof(expected)));
+    RunT1Exchanges(Lun, 2);
+
+    CHECK(IFDHCloseChannel(Lun) == IFD_SUCCESS);
+    VirtualReaderReset(3);
+}
+
+// Times iCount CCID_XfrBlock round trips of one APDU; returns the number
+// of CCID messages each of them took
+static double BenchAPDU(const char *pcName, DWORD Lun, DWORD dwProtocol,
+                        BYTE *pbCmd, DWORD dwCmdLength, DWORD dwRespExpected, int iCount)
+{
+    BYTE resp[300];
+    DWORD dwRespLength, dwMessages;
+    double dStart, dElapsed;
+    int n;
+
+    dwMessages = VirtualReaderGetMessageCount(LunToReaderLun(Lun));
+    dStart = Now();
+    for (n = 0; n < iCount; n++)
+    {
+        dwRespLength = sizeof(resp);
+        if ( (CCID_XfrBlock(Lun, 0, dwProtocol, pbCmd, dwCmdLength,
+                            resp, &dwRespLength) != CCIDRv_OK)
+             || (dwRespLength != dwRespExpected) )
+        {
+            CHECK(!"round trip failed");
+            return 0;
+        }
+    }
+    dElapsed = Now() - dStart;
+    dwMessages = VirtualReaderGetMessageCount(LunToReaderLun(Lun)) - dwMessages;
+    printf("%-28s %4u bytes out %4u in  %8.2f us/round trip  %5.1f messages\n", pcName,
+           (unsigned int) dwCmdLength, (unsigned int) dwRespExpected,
+           dElapsed * 1e6 / iCount, (double) dwMessages / iCount);
+    return (double) dwMessages / iCount;
+}
+
+// Round trips over a short APDU level reader answering at once, so that
+// only the driver and the message handling are measured
+static void BenchXfrBlock(void)
+{
+    DWORD Lun = READER_LUN(4);
+    BYTE getData[] = { 0x00, 0xCA, 0x00, 0x00, 0x02 };
+    BYTE getDataResp[] = { 0x01, 0x02, 0x90, 0x00 };
+    BYTE readBinary[] = { 0x00, 0xB0, 0x00, 0x00, 0x00 };
+    BYTE atr[MAX_ATR_SIZE];
+    DWORD dwATRLength;
+
+    CHECK(VirtualReaderAddRule(4, getData, 2, getDataResp, sizeof(getDataResp)) == TrRv_OK);
+    CHECK(IFDHCreateChannel(Lun, READER_CHANNEL(4)) == IFD_SUCCESS);
+    dwATRLength = sizeof(atr);
+    CHECK(IFDHPowerICC(Lun, IFD_POWER_UP, atr, &dwATRLength) == IFD_SUCCESS);
+
+    BenchAPDU("short APDU", Lun, CCID_PROTOCOL_T0, getData, sizeof(getData),
+              sizeof(getDataResp), 100000);
+    VirtualReaderSetHandler(4, T1CardHandler, NULL);
+    BenchAPDU("short APDU, 256 byte answer", Lun, CCID_PROTOCOL_T0,
+              readBinary, sizeof(readBinary), 258, 100000);
+
+    CHECK(IFDHCloseChannel(Lun) == IFD_SUCCESS);
+    VirtualReaderReset(4);
+}
+
+// Reads 256 bytes and writes 255 on a TPDU level reader with T=0 or
+// with T=1 and the given IFSC; the card takes dwLatencyUs per message.
+// pdMessages gets the messages per read and per write.
+static void BenchProtocol(const char *pcName, DWORD rdr, BYTE bT1, BYTE bIFSC,
+                          DWORD dwLatencyUs, int iCount, double *pdMessages)
+{
+    DWORD Lun = READER_LUN(rdr);
+    DWORD dwProtocol = bT1 ? CCID_PROTOCOL_T1 : CCID_PROTOCOL_T0;
+    // TD1: T=1, TD2: T=1 with TA3 (IFSC) and TB3
+    BYTE atrT1[] = { 0x3B, 0x80, 0x81, 0x31, 0x20, 0x45, 0x00 };
+    BYTE readBinary[] = { 0x00, 0xB0, 0x00, 0x00, 0x00 };
+    BYTE update[5 + 255];
+    BYTE atr[MAX_ATR_SIZE];
+    char pcLabel[64];
+    DWORD dwATRLength, i;
+
+    update[0] = 0x00;
+    update[1] = 0xD6;
+    update[2] = 0x00;
+    update[3] = 0x00;
+    update[4] = 0xFF;
+    for (i = 5; i < sizeof(update); i++)
+    {
+        update[i] = (BYTE) i;
+    }
+    if ( bT1 )
+    {
+        atrT1[4] = bIFSC;
+        SetTCK(atrT1, sizeof(atrT1));
+        CHECK(VirtualReaderSetATR(rdr, atrT1, sizeof(atrT1)) == TrRv_OK);
+    }
+    CHECK(VirtualReaderSetTPDU(rdr, bT1) == TrRv_OK);
+    VirtualReaderSetHandler(rdr, T1CardHandler, NULL);
+    VirtualReaderSetLatency(rdr, dwLatencyUs);
+    CHECK(IFDHCreateChannel(Lun, READER_CHANNEL(rdr)) == IFD_SUCCESS);
+    dwATRLength = sizeof(atr);
+    CHECK(IFDHPowerICC(Lun, IFD_POWER_UP, atr, &dwATRLength) == IFD_SUCCESS);
+
+    snprintf(pcLabel, sizeof(pcLabel), "%s, read", pcName);
+    pdMessages[0] = BenchAPDU(pcLabel, Lun, dwProtocol, readBinary, sizeof(readBinary),
+                              258, iCount);
+    snprintf(pcLabel, sizeof(pcLabel), "%s, write", pcName);
+    pdMessages[1] = BenchAPDU(pcLabel, Lun, dwProtocol, update, sizeof(update),
+                              2, iCount);
+
+    CHECK(IFDHCloseChannel(Lun) == IFD_SUCCESS);
+    VirtualReaderReset(rdr);
+}
+
+// Large APDUs with T=0 against T=1 with a small and with the largest
+// IFSC: first the cost of the driver alone, then with each message
+// taking about a USB frame
+static void BenchT1(void)
+{
+    double t0[2], t1Small[2], t1Large[2];
+    DWORD dwLatencyUs;
+    int iCount;
+
+    for (dwLatencyUs = 0; dwLatencyUs <= 1000; dwLatencyUs += 1000)
+    {
+        iCount = dwLatencyUs ? 100 : 20000;
+        printf("%u us per message:\n", (unsigned int) dwLatencyUs);
+        BenchProtocol("T=0", 6, 0, 0, dwLatencyUs, iCount, t0);
+        BenchProtocol("T=1, IFSC 32", 6, 1, 0x20, dwLatencyUs, iCount, t1Small);
+        BenchProtocol("T=1, IFSC 254", 6, 1, 0xFE, dwLatencyUs, iCount, t1Large);
+    }
+    // One message per APDU with T=0; T=1 chains, less with a larger IFSC
+    CHECK((t0[0] == 1) && (t0[1] == 1));
+    CHECK(t1Large[0] > 1);
+    CHECK(t1Large[1] < t1Small[1]);
+}
+
+int main(int argc, char **argv)
+{
+    SetLogLevel(0);
+
+    TestAPDU();
+    TestPresence();
+    TestConcurrentSlots();
+    TestInfoPlist();
+    TestT1Parameters();
+    TestT1();
+    TestT1ManualParameters();
+
+    if ( iFailures )
+    {
+        fprintf(stderr, "%d check(s) failed\n", iFailures);
+        return 1;
+    }
+    printf("all checks passed\n");
+
+    if ( (argc > 1) && !strcmp(argv[1], "-bench") )
+    {
+        BenchXfrBlock();
+        BenchT1();
+        if ( iFailures )
+        {
+            fprintf(stderr, "%d benchmark check(s) failed\n", iFailures);
+            return 1;
+        }
+    }
+    return 0;
+}
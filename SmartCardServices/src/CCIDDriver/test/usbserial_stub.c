@@ -0,0 +1,56 @@
+/*
+ *  usbserial_stub.c
+ *  ifd-CCID
+ *
+ *  See COPYING file for license.
+ *
+ *  Stands in for the USB transport when libusb-1.0 is not installed:
+ *  the tests only use the virtual reader.
+ *
+ */
+
+#include "wintypes.h"
+#include "usbserial.h"
+
+TrRv OpenUSB( DWORD lun, DWORD Channel )
+{
+    return TrRv_ERR;
+}
+TrRv GetConfigDescNumberUSB( DWORD lun, BYTE* pcconfigDescNb )
+{
+    return TrRv_ERR;
+}
+TrRv GetVendorAndProductIDUSB( DWORD lun, DWORD *vendorID, DWORD *productID )
+{
+    return TrRv_ERR;
+}
+TrRv GetClassDescUSB( DWORD lun, BYTE configDescNb, BYTE bdescType,
+                      BYTE *pcdesc, BYTE *pcdescLength )
+{
+    return TrRv_ERR;
+}
+TrRv SetupConnectionsUSB( DWORD lun, BYTE ConfigDescNb, BYTE interruptPipe )
+{
+    return TrRv_ERR;
+}
+TrRv WriteUSB( DWORD lun, DWORD length, BYTE *Buffer )
+{
+    return TrRv_ERR;
+}
+TrRv ReadUSB( DWORD lun, DWORD *length, BYTE *Buffer )
+{
+    return TrRv_ERR;
+}
+TrRv CloseUSB( DWORD lun )
+{
+    return TrRv_ERR;
+}
+TrRv ExchangeUSB( DWORD lun, DWORD sendLength, BYTE *sendBuffer,
+                  DWORD *recvLength, BYTE *recvBuffer )
+{
+    return TrRv_ERR;
+}
+TrRv ReadInterruptUSB( DWORD lun, DWORD *length, BYTE *buffer, DWORD timeout )
+{
+    return TrRv_ERR;
+}
@@ -46,6 +46,27 @@
 
 #define MSC_DEBUG 1
 
+/* Features a token refused, remembered per connection so they are not
+   tried again on every operation.  A slot is claimed by
+   PL_MSCInitializePlugin and only touched by the connection's own calls
+   after that. */
+#define LC_REFUSED_EXT_APDU  0x01
+
+typedef struct {
+  MSCLPTokenConnection pConnection;
+  MSCULong32 refused;
+} lcRefusedFeatures;
+
+static lcRefusedFeatures lcRefused[MSC_MAX_REMEMBERED_CONNECTIONS];
+
+#ifndef WIN32
+#define lcClaimRefused(slot, conn) \
+  __sync_bool_compare_and_swap(&(slot), (MSCLPTokenConnection)0, (conn))
+#else
+#define lcClaimRefused(slot, conn) \
+  (InterlockedCompareExchangePointer((PVOID volatile *)&(slot), (conn), 0) == 0)
+#endif
+
 /* Local transport structure */
 typedef struct {
   MSCUChar8  pBuffer[MAX_BUFFER_SIZE];
@@ -68,6 +89,13 @@ void MemCopyTo32( MSCPULong32, MSCPUChar8 );
 MSCUShort16 getUShort16( MSCPUChar8 );
 void setUShort16( MSCPUChar8, MSCUShort16 );
 MSCLong32 SCardExchangeAPDU( MSCLPTokenConnection, MSCLPTransmitBuffer );
+MSCLong32 SCardExchangeRawAPDU( MSCLPTokenConnection, MSCPUChar8, MSCULong32,
+				MSCPUChar8, MSCPULong32 );
+lcRefusedFeatures *lcMSCRefused( MSCLPTokenConnection );
+int lcMSCCryptFits( MSCLPTokenConnection, MSCULong32 );
+MSC_RV lcMSCCryptFinal( MSCLPTokenConnection, MSCUChar8, MSCUChar8,
+			MSCPUChar8, MSCULong32, MSCPUChar8, MSCULong32,
+			MSCPUChar8, MSCPULong32 );
 MSC_RV lcMSCGetObjectAttributes( MSCLPTokenConnection, 
 				 MSCString, MSCLPObjectInfo );
 
@@ -723,13 +751,25 @@ MSC_RV PL_MSCComputeCrypt( MSCLPTokenConnection pConnection,
   MSCPUChar8 apduResponse; MSCPUChar8 pBuffer;
   MSCUShort16 outSize;
   MSCUChar8 dataLocation;
+  MSCUChar8 cipherDirection;
   MSCTransmitBuffer transmitBuffer;
   MSCPUChar8 ppRecvBuffer;
   MSCULong32 currentPointer;
+  MSCULong32 outputCapacity;
+  MSCULong32 objectSize;
   MSCObjectACL objACL;
 
   pBuffer = transmitBuffer.pBuffer; apduResponse = transmitBuffer.apduResponse;
 
+  /* Size of pOutputData; *outputDataSize is only set on success */
+  outputCapacity = *outputDataSize;
+
+  /* FIX - Forcing Encrypt Mode */
+  cipherDirection = cryptInit->cipherDirection;
+  if (cipherDirection == MSC_DIR_SIGN) {
+    cipherDirection = MSC_DIR_ENCRYPT;
+  }
+
   /******************************************/
   /* Do the MSC_CIPHER_INIT portion of the code */
   /******************************************/
@@ -767,13 +807,7 @@ MSC_RV PL_MSCComputeCrypt( MSCLPTokenConnection pConnection,
   currentPointer += MSC_SIZEOF_CIPHERMODE;
 
   /* Cipher direction */
-  pBuffer[OFFSET_DATA+currentPointer] = cryptInit->cipherDirection;
-
-  /* FIX - Forcing Encrypt Mode */
-  if (cryptInit->cipherDirection == MSC_DIR_SIGN) {
-    pBuffer[OFFSET_DATA+currentPointer] = MSC_DIR_ENCRYPT;
-  }
-
+  pBuffer[OFFSET_DATA+currentPointer] = cipherDirection;
   currentPointer += MSC_SIZEOF_CIPHERDIR;  
 
   pBuffer[OFFSET_DATA+currentPointer] = dataLocation;
@@ -803,119 +837,90 @@ MSC_RV PL_MSCComputeCrypt( MSCLPTokenConnection pConnection,
     return convertSW(apduResponse);
   }
 
+  /*******************************************/
+  /* Do the MSC_CIPHER_FINAL portion of the code */
+  /*******************************************/
 
-  if ( (inputDataSize + MSC_SIZEOF_CIPHERMODE + MSC_SIZEOF_CIPHERDIR
-	+ MSC_SIZEOF_DATALOCATION) > MSC_MAXSIZEOF_APDU_DATALEN ) {
-
-    /*********************************************/
-    /* Do the MSC_CIPHER_PROCESS portion of the code */
-    /*********************************************/
+  /* Input in the apdu, short or extended */
+  dataLocation = DL_APDU;
 
-    /* TODO : I don't want to do this now */
+  rv = lcMSCCryptFinal( pConnection, cryptInit->keyNum, MSC_CIPHER_FINAL,
+			&dataLocation, MSC_SIZEOF_DATALOCATION,
+			pInputData, inputDataSize,
+			pOutputData, outputDataSize );
 
-    pBuffer[OFFSET_P2]     = MSC_CIPHER_PROCESS;
-    pBuffer[OFFSET_LC]     = 0; /* TODO */
-    
-    currentPointer  = 0;
-        
-    return MSC_UNSUPPORTED_FEATURE;
-
-  } else {
-
-    /*******************************************/
-    /* Do the MSC_CIPHER_FINAL portion of the code */
-    /*******************************************/
+  if ( rv != MSC_UNSUPPORTED_FEATURE ) {
+    return rv;
+  }
 
-    pBuffer[OFFSET_P2]        = MSC_CIPHER_FINAL;
-    currentPointer            = 0;
+  /* Too big, put in object first */
+  pBuffer[OFFSET_P2]    = MSC_CIPHER_FINAL;
+  pBuffer[OFFSET_LC]    = MSC_SIZEOF_DATALOCATION;
+  pBuffer[OFFSET_DATA]  = DL_OBJECT;
 
-    if ( inputDataSize + MSC_SIZEOF_DATALOCATION > 
-	 MSC_MAXSIZEOF_APDU_DATALEN ) 
-      {
-	/* Too big, put in object first */
-	pBuffer[OFFSET_LC]    = MSC_SIZEOF_DATALOCATION;
-	pBuffer[OFFSET_DATA]  = DL_OBJECT;
-	dataLocation          = DL_OBJECT;
+  objACL.readPermission   = MSC_AUT_PIN_1;
+  objACL.writePermission  = MSC_AUT_PIN_1;
+  objACL.deletePermission = MSC_AUT_PIN_1;
 
-	objACL.readPermission   = MSC_AUT_PIN_1;
-	objACL.writePermission  = MSC_AUT_PIN_1;
-	objACL.deletePermission = MSC_AUT_PIN_1;
+  rv = PL_MSCCreateObject(pConnection, IN_OBJECT_ID, inputDataSize,
+			  &objACL);
 
-	rv = PL_MSCCreateObject(pConnection, IN_OBJECT_ID, inputDataSize,
-				&objACL);
+  if ( rv != MSC_SUCCESS ) {
+    return rv;
+  }
 
-	if ( rv != MSC_SUCCESS ) {
-	  return rv;
-	}
+  rv = PL_MSCWriteLargeObject(pConnection, IN_OBJECT_ID, pInputData,
+			      inputDataSize);
 
-	rv = PL_MSCWriteLargeObject(pConnection, IN_OBJECT_ID, pInputData,
-				 inputDataSize);
+  if ( rv != MSC_SUCCESS ) {
+    return rv;
+  }
 
-	if ( rv != MSC_SUCCESS ) {
-	  return rv;
-	}
+  transmitBuffer.bufferSize = pBuffer[OFFSET_LC] + 5;
 
-      } else {
-	/* Can be placed into an apdu */
-	pBuffer[OFFSET_LC]    = MSC_SIZEOF_DATALOCATION + 2 + inputDataSize;
-	pBuffer[OFFSET_DATA]  = DL_APDU;
-	dataLocation          = DL_APDU;
-	currentPointer       += MSC_SIZEOF_DATALOCATION;
-	{
-	  // I'm not sure if inputDataSize has the right length for MemCopy16()
-	  MSCUShort16 value = inputDataSize;
-	  MemCopy16(&pBuffer[OFFSET_DATA + currentPointer], &value);
-	  currentPointer	     += 2;
-	}
-	memcpy(&pBuffer[OFFSET_DATA+currentPointer], pInputData, 
-	       inputDataSize);
-      }    
+  /* Set up the APDU exchange */
+  transmitBuffer.apduResponseSize = MSC_MAXSIZE_BUFFER;
+  rv = SCardExchangeAPDU( pConnection, &transmitBuffer );
 
-    transmitBuffer.bufferSize = pBuffer[OFFSET_LC] + 5;
+  if ( rv != SCARD_S_SUCCESS ) {
+    return convertPCSC(rv);
+  }
 
-    /* Set up the APDU exchange */
-    transmitBuffer.apduResponseSize = MSC_MAXSIZE_BUFFER;
-    rv = SCardExchangeAPDU( pConnection, &transmitBuffer );
+  if ( transmitBuffer.apduResponseSize != 2 ) {
+    return MSC_UNSPECIFIED_ERROR;
+  }
 
-    if ( rv != SCARD_S_SUCCESS ) {
-      return convertPCSC(rv);
-    }
+  if ( convertSW(apduResponse) != MSC_SUCCESS ) {
+    return convertSW(apduResponse);
+  }
 
-    /* Operation must have failed */
-    if ( (transmitBuffer.apduResponseSize == 2)&&
-	 (dataLocation == DL_APDU) ) {
-      return convertSW(apduResponse);
+  /* Output stored into an object */
+  ppRecvBuffer = 0;
+  objectSize = 0;
+  rv = PL_MSCReadAllocateObject( pConnection, OUT_OBJECT_ID,
+				 &ppRecvBuffer, &objectSize );
+  if ( rv == MSC_SUCCESS ) {
+    /* Object holds the data chunk size followed by the data */
+    if ( objectSize < MSC_SIZEOF_CRYPTLEN ) {
+      rv = MSC_UNSPECIFIED_ERROR;
+    } else {
+      MemCopyTo16(&outSize, ppRecvBuffer);
 
-      /* Output stored into apdu */
-    } else if ( (transmitBuffer.apduResponseSize > 2)&&
-		(dataLocation == DL_APDU) ) {
-      MemCopyTo16(&outSize, apduResponse);
-      memcpy(pOutputData, &apduResponse[MSC_SIZEOF_CRYPTLEN], outSize);
-      *outputDataSize = outSize;
-      return convertSW(&apduResponse[MSC_SIZEOF_CRYPTLEN+outSize]);
-
-      /* Output stored into an object */
-    } else if ( (transmitBuffer.apduResponseSize == 2)&&
-		(dataLocation == DL_OBJECT) ) {
-      rv = PL_MSCReadAllocateObject( pConnection, OUT_OBJECT_ID,
-				     &ppRecvBuffer, outputDataSize );
-      if ( rv == MSC_SUCCESS ) {
-	/* Write Data Chunk Size */
-	setUShort16(ppRecvBuffer, *outputDataSize);
-	/* Write Data */
-	memcpy(pOutputData, &ppRecvBuffer[MSC_SIZEOF_CRYPTLEN], 
-	       getUShort16(ppRecvBuffer));
+      if ( outSize + MSC_SIZEOF_CRYPTLEN > objectSize ||
+	   outSize > outputCapacity ) {
+	rv = MSC_UNSPECIFIED_ERROR;
+      } else {
+	memcpy(pOutputData, &ppRecvBuffer[MSC_SIZEOF_CRYPTLEN], outSize);
+	*outputDataSize = outSize;
       }
+    }
+  }
 
-      if ( ppRecvBuffer ) {
-	free(ppRecvBuffer);
-      }
+  if ( ppRecvBuffer ) {
+    free(ppRecvBuffer);
+  }
 
-      return rv;
-    } else {
-      return MSC_UNSPECIFIED_ERROR;
-    }
-  } 
+  return rv;
 }
 
 MSC_RV PL_MSCExtAuthenticate( MSCLPTokenConnection pConnection, 
@@ -1986,8 +1991,9 @@ void setUShort16(MSCPUChar8 dstValue, MSCUShort16 srcValue) {
 }
 
 
-MSCLong32 SCardExchangeAPDU( MSCLPTokenConnection pConnection, 
-			     MSCLPTransmitBuffer transmitBuffer ) {
+MSCLong32 SCardExchangeRawAPDU( MSCLPTokenConnection pConnection,
+				MSCPUChar8 pSend, MSCULong32 sendSize,
+				MSCPUChar8 pRecv, MSCPULong32 pRecvSize ) {
   
   MSCLong32 rv, ret;
   MSCULong32 originalLength;
@@ -1995,7 +2001,7 @@ MSCLong32 SCardExchangeAPDU( MSCLPTokenConnection pConnection,
   MSCULong32 dwActiveProtocol;
   int i;
 
-  originalLength = transmitBuffer->apduResponseSize;
+  originalLength = *pRecvSize;
 
   while (1) {
     
@@ -2003,39 +2009,39 @@ MSCLong32 SCardExchangeAPDU( MSCLPTokenConnection pConnection,
     printf("->: ");
     
 #define DEBUG_INS(a, b) if ((a) == (b)) printf("[" #b "] ");
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_MSC_GEN_KEYPAIR);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_IMPORT_KEY);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_EXPORT_KEY);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_COMPUTE_CRYPT);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_CREATE_PIN);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_VERIFY_PIN);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_CHANGE_PIN);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_UNBLOCK_PIN);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_LOGOUT_ALL);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_GET_CHALLENGE);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_EXT_AUTH);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_CREATE_OBJ);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_DELETE_OBJ);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_READ_OBJ);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_WRITE_OBJ);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_LIST_OBJECTS);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_LIST_PINS);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_LIST_KEYS);
-    DEBUG_INS(transmitBuffer->pBuffer[OFFSET_INS], INS_GET_STATUS);
+    DEBUG_INS(pSend[OFFSET_INS], INS_MSC_GEN_KEYPAIR);
+    DEBUG_INS(pSend[OFFSET_INS], INS_IMPORT_KEY);
+    DEBUG_INS(pSend[OFFSET_INS], INS_EXPORT_KEY);
+    DEBUG_INS(pSend[OFFSET_INS], INS_COMPUTE_CRYPT);
+    DEBUG_INS(pSend[OFFSET_INS], INS_CREATE_PIN);
+    DEBUG_INS(pSend[OFFSET_INS], INS_VERIFY_PIN);
+    DEBUG_INS(pSend[OFFSET_INS], INS_CHANGE_PIN);
+    DEBUG_INS(pSend[OFFSET_INS], INS_UNBLOCK_PIN);
+    DEBUG_INS(pSend[OFFSET_INS], INS_LOGOUT_ALL);
+    DEBUG_INS(pSend[OFFSET_INS], INS_GET_CHALLENGE);
+    DEBUG_INS(pSend[OFFSET_INS], INS_EXT_AUTH);
+    DEBUG_INS(pSend[OFFSET_INS], INS_CREATE_OBJ);
+    DEBUG_INS(pSend[OFFSET_INS], INS_DELETE_OBJ);
+    DEBUG_INS(pSend[OFFSET_INS], INS_READ_OBJ);
+    DEBUG_INS(pSend[OFFSET_INS], INS_WRITE_OBJ);
+    DEBUG_INS(pSend[OFFSET_INS], INS_LIST_OBJECTS);
+    DEBUG_INS(pSend[OFFSET_INS], INS_LIST_PINS);
+    DEBUG_INS(pSend[OFFSET_INS], INS_LIST_KEYS);
+    DEBUG_INS(pSend[OFFSET_INS], INS_GET_STATUS);
     
-    for (i=0; i < transmitBuffer->bufferSize; i++) {
-      printf("%02x ", transmitBuffer->pBuffer[i]);
+    for (i=0; i < sendSize; i++) {
+      printf("%02x ", pSend[i]);
     } printf("\n");
 #endif
     
     while(1) {
-      transmitBuffer->apduResponseSize = originalLength;
+      *pRecvSize = originalLength;
       
       rv =  SCardTransmit(pConnection->hCard, pConnection->ioType,
-			  transmitBuffer->pBuffer, 
-			  transmitBuffer->bufferSize, 0,
-			  transmitBuffer->apduResponse, 
-			  &transmitBuffer->apduResponseSize );
+			  pSend, 
+			  sendSize, 0,
+			  pRecv, 
+			  pRecvSize );
       
       if ( rv == SCARD_S_SUCCESS ) {
 	break;
@@ -2069,30 +2075,30 @@ MSCLong32 SCardExchangeAPDU( MSCLPTokenConnection pConnection,
 #ifdef MSC_DEBUG
     printf("<-: ");
     
-    for (i=0; i < transmitBuffer->apduResponseSize; i++) {
-      printf("%02x ", transmitBuffer->apduResponse[i]);
+    for (i=0; i < *pRecvSize; i++) {
+      printf("%02x ", pRecv[i]);
     } printf("\n");
 #endif
     
-    if ( transmitBuffer->apduResponseSize == 2 && 
-	 transmitBuffer->apduResponse[0] == 0x61 ) {
+    if ( *pRecvSize == 2 && 
+	 pRecv[0] == 0x61 ) {
 #ifdef MSC_DEBUG
       printf("->: 0x00 0xC0 0x00 0x00 %02x\n", 
-	     transmitBuffer->apduResponse[1]);
+	     pRecv[1]);
 #endif
-      getResponse[4] = transmitBuffer->apduResponse[1];
-      transmitBuffer->apduResponseSize   = originalLength;
+      getResponse[4] = pRecv[1];
+      *pRecvSize   = originalLength;
       rv =  SCardTransmit(pConnection->hCard, pConnection->ioType,
 			  getResponse, 5, 0,
-			  transmitBuffer->apduResponse, 
-			  &transmitBuffer->apduResponseSize );
+			  pRecv, 
+			  pRecvSize );
       
       if ( rv == SCARD_S_SUCCESS ) {
 #ifdef MSC_DEBUG	
 	printf("<-: ");
 	
-	for (i=0; i < transmitBuffer->apduResponseSize; i++) {
-	  printf("%02x ", transmitBuffer->apduResponse[i]);
+	for (i=0; i < *pRecvSize; i++) {
+	  printf("%02x ", pRecv[i]);
 	} printf("\n");
 #endif
 	break;
@@ -2129,6 +2135,144 @@ MSCLong32 SCardExchangeAPDU( MSCLPTokenConnection pConnection,
   return rv;
 }
 
+MSCLong32 SCardExchangeAPDU( MSCLPTokenConnection pConnection, 
+			     MSCLPTransmitBuffer transmitBuffer ) {
+
+  return SCardExchangeRawAPDU( pConnection, transmitBuffer->pBuffer,
+			       transmitBuffer->bufferSize,
+			       transmitBuffer->apduResponse,
+			       &transmitBuffer->apduResponseSize );
+}
+
+/* Can a ComputeCrypt() data field of dataSize bytes go in one APDU ? */
+int lcMSCCryptFits( MSCLPTokenConnection pConnection, MSCULong32 dataSize ) {
+
+  lcRefusedFeatures *refused;
+
+  if ( dataSize <= MSC_MAXSIZEOF_APDU_DATALEN ) {
+    return 1;
+  }
+
+  /* Extended length APDU's are only passed through as-is by T=1 */
+  refused = lcMSCRefused(pConnection);
+  if ( pConnection->ioType != SCARD_PCI_T1 ||
+       (refused && (refused->refused & LC_REFUSED_EXT_APDU)) ) {
+    return 0;
+  }
+
+  return dataSize <= MSC_MAXSIZEOF_EXT_APDU_DATALEN;
+}
+
+/* Sends a ComputeCrypt() APDU whose data is pHeader, the input length and
+   the input, and reads the output from the response.  Uses an extended
+   length APDU when the data does not fit a short one.  Returns
+   MSC_UNSUPPORTED_FEATURE if the data does not fit or the token refused
+   the extended APDU; in the latter case that is remembered for the
+   connection and the operation is still pending on the token.
+   *outputDataSize is the size of pOutputData on input. */
+MSC_RV lcMSCCryptFinal( MSCLPTokenConnection pConnection, MSCUChar8 keyNum,
+			MSCUChar8 cipherOp, MSCPUChar8 pHeader,
+			MSCULong32 headerSize, MSCPUChar8 pInputData,
+			MSCULong32 inputDataSize, MSCPUChar8 pOutputData,
+			MSCPULong32 outputDataSize ) {
+
+  MSCLong32 rv;
+  MSCUChar8 pBuffer[MSC_MAXSIZEOF_EXT_APDU_DATALEN + 9];
+  MSCUChar8 apduResponse[MSC_MAXSIZEOF_EXT_APDU_DATALEN + 4];
+  MSCULong32 apduResponseSize;
+  MSCULong32 dataSize, currentPointer;
+  MSCUShort16 outSize, sw;
+  lcRefusedFeatures *refused;
+  int extended;
+
+  dataSize = headerSize + MSC_SIZEOF_CRYPTLEN + inputDataSize;
+
+  if ( !lcMSCCryptFits(pConnection, dataSize) ) {
+    return MSC_UNSUPPORTED_FEATURE;
+  }
+
+  extended = (dataSize > MSC_MAXSIZEOF_APDU_DATALEN);
+
+  pBuffer[OFFSET_CLA]    = CardEdge_CLA;
+  pBuffer[OFFSET_INS]    = INS_COMPUTE_CRYPT;
+  pBuffer[OFFSET_P1]     = keyNum;
+  pBuffer[OFFSET_P2]     = cipherOp;
+
+  if ( extended ) {
+    /* 00 Lc(2) */
+    pBuffer[OFFSET_LC]   = 0x00;
+    pBuffer[OFFSET_LC+1] = (dataSize >> 8) & 0xFF;
+    pBuffer[OFFSET_LC+2] = dataSize & 0xFF;
+    currentPointer       = OFFSET_DATA + 2;
+  } else {
+    pBuffer[OFFSET_LC]   = dataSize;
+    currentPointer       = OFFSET_DATA;
+  }
+
+  memcpy(&pBuffer[currentPointer], pHeader, headerSize);
+  currentPointer += headerSize;
+
+  {
+    MSCUShort16 value = inputDataSize;
+    MemCopy16(&pBuffer[currentPointer], &value);
+    currentPointer += MSC_SIZEOF_CRYPTLEN;
+  }
+
+  memcpy(&pBuffer[currentPointer], pInputData, inputDataSize);
+  currentPointer += inputDataSize;
+
+  if ( extended ) {
+    /* Le(2) = 00 00, up to 65536 bytes */
+    pBuffer[currentPointer++] = 0x00;
+    pBuffer[currentPointer++] = 0x00;
+  }
+
+  apduResponseSize = sizeof(apduResponse);
+  rv = SCardExchangeRawAPDU( pConnection, pBuffer, currentPointer,
+			     apduResponse, &apduResponseSize );
+
+  if ( rv != SCARD_S_SUCCESS ) {
+    if ( extended && rv != SCARD_W_REMOVED_CARD && rv != SCARD_W_RESET_CARD &&
+	 rv != SCARD_E_NO_SMARTCARD ) {
+      if ( (refused = lcMSCRefused(pConnection)) ) {
+	refused->refused |= LC_REFUSED_EXT_APDU;
+      }
+      return MSC_UNSUPPORTED_FEATURE;
+    }
+    return convertPCSC(rv);
+  }
+
+  if ( apduResponseSize < 2 ) {
+    return MSC_UNSPECIFIED_ERROR;
+  }
+
+  if ( apduResponseSize == 2 ) {
+    sw = convertSW(apduResponse);
+
+    /* Wrong length / INS or CLA not supported: no extended APDU's here */
+    if ( extended && (sw == 0x6700 || sw == 0x6D00 || sw == 0x6E00) ) {
+      if ( (refused = lcMSCRefused(pConnection)) ) {
+	refused->refused |= LC_REFUSED_EXT_APDU;
+      }
+      return MSC_UNSUPPORTED_FEATURE;
+    }
+
+    return sw;
+  }
+
+  MemCopyTo16(&outSize, apduResponse);
+
+  if ( outSize + MSC_SIZEOF_CRYPTLEN + 2 > apduResponseSize ||
+       outSize > *outputDataSize ) {
+    return MSC_UNSPECIFIED_ERROR;
+  }
+
+  memcpy(pOutputData, &apduResponse[MSC_SIZEOF_CRYPTLEN], outSize);
+  *outputDataSize = outSize;
+
+  return convertSW(&apduResponse[MSC_SIZEOF_CRYPTLEN+outSize]);
+}
+
 MSC_RV PL_MSCIdentifyToken( MSCLPTokenConnection pConnection ) {
 
   MSCLong32 rv;
@@ -2164,13 +2308,44 @@ MSC_RV PL_MSCIdentifyToken( MSCLPTokenConnection pConnection ) {
   }
 }
 
+/* Slot remembering the features refused on a connection, 0 if all slots
+   were taken when it was established */
+lcRefusedFeatures *lcMSCRefused( MSCLPTokenConnection pConnection ) {
+
+  int i;
+
+  for (i = 0; i < MSC_MAX_REMEMBERED_CONNECTIONS; i++) {
+    if ( lcRefused[i].pConnection == pConnection ) {
+      return &lcRefused[i];
+    }
+  }
+
+  return 0;
+}
+
 MSC_RV PL_MSCInitializePlugin( MSCLPTokenConnection pConnection ) {
 
+  int i;
+
+  for (i = 0; i < MSC_MAX_REMEMBERED_CONNECTIONS; i++) {
+    if ( lcClaimRefused(lcRefused[i].pConnection, pConnection) ) {
+      lcRefused[i].refused = 0;
+      break;
+    }
+  }
+
   return MSC_SUCCESS;
 }
 
 MSC_RV PL_MSCFinalizePlugin( MSCLPTokenConnection pConnection ) {
 
+  lcRefusedFeatures *refused;
+
+  if ( (refused = lcMSCRefused(pConnection)) ) {
+    refused->refused = 0;
+    refused->pConnection = 0;
+  }
+
   return MSC_SUCCESS;
 }
 
@@ -40,6 +40,14 @@
 #define DL_APDU          0x01
 #define DL_OBJECT        0x02
 
+// Largest ComputeCrypt() data field sent as an extended length APDU (T=1
+// only).  Enough for a 4096 bit RSA block.
+#define MSC_MAXSIZEOF_EXT_APDU_DATALEN  1024
+
+// Connections whose refused features are remembered between
+// PL_MSCInitializePlugin and PL_MSCFinalizePlugin
+#define MSC_MAX_REMEMBERED_CONNECTIONS  32
+
 /* Some useful offsets in the buffer */
 #define OFFSET_CLA	0x00
 #define OFFSET_INS	0x01
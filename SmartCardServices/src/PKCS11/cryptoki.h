@@ -104,6 +104,15 @@
 
 #define P11_MAX_ULONG ((CK_ULONG)(~0))
 
+/* Lock-free counters shared with the slot watcher thread */
+#ifndef WIN32
+#define P11_ATOMIC_INC(x)       __sync_add_and_fetch(&(x), 1)
+#define P11_ATOMIC_GET(x)       __sync_add_and_fetch(&(x), 0)
+#else
+#define P11_ATOMIC_INC(x)       InterlockedIncrement((LONG volatile *)&(x))
+#define P11_ATOMIC_GET(x)       InterlockedExchangeAdd((LONG volatile *)&(x), 0)
+#endif
+
 /* Preference settings */
 #define P11_SLOT_WATCH_THREAD_FULL          0
 #define P11_SLOT_WATCH_THREAD_PARTIAL       1
@@ -113,6 +122,18 @@
 #define P11_DEFAULT_PRK_ATTRIB_OBJ_SIZE   912
 #define P11_DEFAULT_CERT_ATTRIB_OBJ_SIZE  712
 #define P11_DEFAULT_LOG_FILENAME          "PKCS11.log"
+#define P11_CACHE_KEY_SIZE                20   /* SHA-1 token fingerprint */
+
+/* Locks held by an entry point, always acquired in this order.  st.async_lock
+** guards the slot list and token change handling, P11_Slot.lock guards card
+** I/O and the token's objects, P11_Session.lock guards search and crypto
+** state.  st.session_list_lock is a leaf lock for walking st.sessions and
+** for session reference counts.  Nothing blocks on a slot or session lock
+** while holding st.async_lock except token change handling. */
+#define P11_LOCK_GLOBAL     0x01
+#define P11_LOCK_SLOT       0x02
+#define P11_LOCK_SESSION    0x04
+#define P11_LOCK_REF        0x08    /* Session reference, set by session_Lock */
 
 
 /******************************************************************************
@@ -187,6 +208,10 @@ typedef struct
     P11_Pin pins[2];                /* Array of cached PIN's             */
     MSCStatusInfo status_info;      /* Status of token                   */
     MSCTokenConnection conn;        /* Connection to token               */
+    CK_ULONG session_count;         /* Number of open sessions           */
+    P11_Mutex lock;                 /* Card I/O and token object lock    */
+    CK_BYTE cache_key[P11_CACHE_KEY_SIZE]; /* Fingerprint of token's object cache */
+    CK_BBOOL cache_storable;        /* Objects may be saved to the cache */
 } P11_Slot;
 
 /* A session with one slot.  */
@@ -195,6 +220,8 @@ typedef struct _P11_Session
     CK_SESSION_INFO session;        /* CK session info                   */
     CK_VOID_PTR application;        /* Passed to notify callback         */
     CK_NOTIFY notify;               /* Notify callback                   */
+    P11_Mutex lock;                 /* Search and crypto state lock      */
+    CK_ULONG refs;                  /* Entry points using the session    */
 
     P11_Object *search_object;      /* Current object (used with C_FindObjects) */
     CK_ATTRIBUTE *search_attrib;    /* Current search attributes                */
@@ -202,6 +229,14 @@ typedef struct _P11_Session
 
     CK_MECHANISM sign_mech;         /* Active signing mechanism */
     CK_OBJECT_HANDLE sign_key;      /* Active signing key       */
+    void *sign_ctx;                 /* Host hash for multi-part signing */
+
+    CK_MECHANISM verify_mech;       /* Active verification mechanism         */
+    CK_OBJECT_HANDLE verify_key;    /* Active verification key               */
+    void *verify_ctx;               /* Host hash for multi-part verification */
+
+    CK_MECHANISM digest_mech;       /* Active digest mechanism */
+    void *digest_ctx;               /* Host hash for digesting */
 
     struct _P11_Session *prev;
     struct _P11_Session *next;
@@ -227,6 +262,7 @@ typedef struct _P11_Preferences
     CK_ULONG prvkey_attrib_size;
     CK_ULONG data_attrib_size;
     CK_ULONG disable_security;
+    CK_ULONG object_cache;
     CK_CHAR log_filename[256];
 } P11_Preferences;
 
@@ -238,9 +274,13 @@ typedef struct
     P11_Slot *slots;                /* Array of all slots                                        */
     CK_ULONG slot_count;            /* Number of slots in array                                  */
     P11_Session *sessions;          /* List of all sessions with all slots                       */
-    char *slot_status;              /* Says if the token state changed for a slot                */
+    volatile CK_ULONG *slot_event_gen; /* Per-slot token event generation (bumped by the watcher) */
+    CK_ULONG *slot_seen_gen;        /* Per-slot generation last handled by slot_TokenChanged     */
+    volatile CK_ULONG event_gen;    /* Bumped after any slot event; checked without locking      */
+    volatile CK_ULONG seen_event_gen; /* Value of event_gen last handled by slot_TokenChanged    */
     P11_Mutex log_lock;             /* Log mutex                                                 */
     P11_Mutex async_lock;           /* Asychronous mutex                                         */
+    P11_Mutex session_list_lock;    /* Guards walks of st.sessions outside of async_lock         */
     CK_ULONG native_locks;
     CK_ULONG create_threads;
 } P11_State;
@@ -255,10 +295,16 @@ extern P11_State st;
 /* p11x_async.c */
 CK_RV async_StartSlotWatcher();
 CK_RV async_StopSlotWatcher();
+ void async_FreeGenerations();
  void *async_WatchSlots(void *parent_pid);
  void async_SignalHandler(int sig);
 MSCULong32 async_TokenEventCallback(MSCTokenInfo *tokenInfo, MSCULong32 len, void *data);
 
+/* p11x_cache.c */
+CK_RV cache_LoadObjects(CK_SLOT_ID slotID);
+ void cache_StoreObjects(CK_SLOT_ID slotID);
+ void cache_Invalidate(MSCLPTokenConnection pConnection);
+
 /* p11x_debug.c */
 void debug_Init();
 void debug_CheckCorrupt(size_t i);
@@ -267,6 +313,16 @@ void *debug_Malloc(size_t size, int line, char *file);
 void debug_Free(void *ptr, int line, char *file);
 void *debug_Calloc(size_t size, int line, char *file);
 
+/* p11x_digest.c */
+CK_BBOOL digest_IsHashMechanism(CK_MECHANISM_TYPE mech);
+CK_ULONG digest_Length(CK_MECHANISM_TYPE mech);
+   CK_RV digest_Init(CK_MECHANISM_TYPE mech, void **ctx);
+   CK_RV digest_Update(void *ctx, CK_BYTE *data, CK_ULONG data_len);
+   CK_RV digest_Final(void **ctx, CK_BYTE *out, CK_ULONG *out_len);
+    void digest_Free(void **ctx);
+   CK_RV digest_EncodeInfo(CK_MECHANISM_TYPE mech, CK_BYTE *hash, CK_ULONG hash_len, CK_BYTE *out, CK_ULONG *out_len);
+   CK_RV digest_VerifyRSA(P11_Object *key, CK_BYTE *data, CK_ULONG data_len, CK_BYTE *sig, CK_ULONG sig_len);
+
 /* p11x_error.c */
 CK_RV error_LogCmd(CK_RV err, CK_RV cond, CK_CHAR *file, CK_LONG line, char *(*stringifyFn)(CK_RV));
  char *error_Stringify(CK_RV rv);
@@ -341,17 +397,23 @@ CK_ULONG slot_MechanismCount(P11_MechInfo *mech);
    CK_RV slot_UpdateSlotList();
    CK_RV slot_FreeAllSlots();
    CK_RV slot_DisconnectSlot(CK_ULONG slotID, CK_ULONG action);
-   CK_RV slot_PublicMode(CK_ULONG slotID);
-   CK_RV slot_UserMode(CK_ULONG slotID);
+   CK_RV slot_PublicMode(CK_ULONG slotID, CK_SESSION_HANDLE hLocked);
+   CK_RV slot_UserMode(CK_ULONG slotID, CK_SESSION_HANDLE hLocked);
    CK_RV slot_TokenPresent(CK_ULONG slotID);
    CK_RV slot_TokenChanged();
+    void slot_SignalEvent(CK_ULONG slotID);
    CK_RV slot_AsyncUpdateSlot();
     void slot_BlankTokenInfo(CK_TOKEN_INFO *token_info);
-   CK_RV slot_ReverifyPins();
+   CK_RV slot_ReverifyPins(MSCLPTokenConnection pConnection);
+   CK_RV slot_Lock(CK_ULONG slotID, CK_ULONG locks, CK_ULONG *held);
+    void slot_Unlock(CK_ULONG slotID, CK_ULONG held);
 
 /* p11x_session.c */
 CK_RV session_AddSession(CK_SESSION_HANDLE *phSession);
 CK_RV session_FreeSession(CK_SESSION_HANDLE hSession);
+CK_SESSION_HANDLE session_NextSlotSession(CK_ULONG slotID, CK_SESSION_HANDLE hAfter);
+CK_RV session_Lock(CK_SESSION_HANDLE hSession, CK_ULONG locks, CK_ULONG *held);
+ void session_Unlock(CK_SESSION_HANDLE hSession, CK_ULONG held);
 
 /* p11x_thread_xxx.c */
 CK_RV thread_Initialize();
@@ -22,21 +22,26 @@ CK_DEFINE_FUNCTION(CK_RV, C_EncryptInit)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_EncryptInit");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
     log_Log(LOG_LOW, "Encrypt mech: %X", *pMechanism);
     log_Log(LOG_LOW, "Encrypt key: %lX", hKey);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pMechanism || !hKey)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!USER_MODE)
         rv = CKR_USER_NOT_LOGGED_IN;
     else if (pMechanism->mechanism != CKM_RSA_PKCS)
@@ -49,7 +54,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_EncryptInit)
         session->sign_key = hKey;
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_EncryptInit");
 
@@ -68,6 +73,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_Encrypt)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
     P11_Object *key = (P11_Object *)session->sign_key;
     MSCCryptInit cryptInit;
@@ -76,14 +82,18 @@ CK_DEFINE_FUNCTION(CK_RV, C_Encrypt)
 
     P11_LOG_START("C_Encrypt");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pEncryptedData || !pData)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!key)
         rv = CKR_OPERATION_NOT_INITIALIZED;
     else if (!USER_MODE)
@@ -137,7 +147,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_Encrypt)
 
     session->sign_key = 0;
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_Encrypt");
 
@@ -208,21 +218,26 @@ CK_DEFINE_FUNCTION(CK_RV, C_DecryptInit)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_DecryptInit");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
     log_Log(LOG_LOW, "Decrypt mech: %X", *pMechanism);
     log_Log(LOG_LOW, "Decrypt key: %lX", hKey);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pMechanism || !hKey)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!USER_MODE)
         rv = CKR_USER_NOT_LOGGED_IN;
     else if (pMechanism->mechanism != CKM_RSA_PKCS)
@@ -235,7 +250,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_DecryptInit)
         session->sign_key = hKey;
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_DecryptInit");
 
@@ -254,6 +269,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_Decrypt)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
     P11_Object *key = (P11_Object *)session->sign_key;
     MSCCryptInit cryptInit;
@@ -262,14 +278,18 @@ CK_DEFINE_FUNCTION(CK_RV, C_Decrypt)
 
     P11_LOG_START("C_Decrypt");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pEncryptedData || !pData)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!key)
         rv = CKR_OPERATION_NOT_INITIALIZED;
     else if (!USER_MODE)
@@ -379,7 +399,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_Decrypt)
 
     session->sign_key = 0;
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_Decrypt");
 
@@ -20,15 +20,31 @@ CK_DEFINE_FUNCTION(CK_RV, C_DigestInit)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_DigestInit");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pMechanism)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (session->digest_ctx)
+        rv = CKR_OPERATION_ACTIVE;
+    else if ((pMechanism->mechanism != CKM_SHA_1) && (pMechanism->mechanism != CKM_SHA256))
+        rv = CKR_MECHANISM_INVALID;
+    else if (!CKR_ERROR(rv = digest_Init(pMechanism->mechanism, &session->digest_ctx)))
+        session->digest_mech = *pMechanism;
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_DigestInit");
 
@@ -47,15 +63,38 @@ CK_DEFINE_FUNCTION(CK_RV, C_Digest)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_Digest");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if ((!pData && ulDataLen) || !pulDigestLen)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!session->digest_ctx)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (!pDigest)
+        *pulDigestLen = digest_Length(session->digest_mech.mechanism);
+    else if (*pulDigestLen < digest_Length(session->digest_mech.mechanism))
+    {
+        *pulDigestLen = digest_Length(session->digest_mech.mechanism);
+        rv = CKR_BUFFER_TOO_SMALL;
+    }
+    else if (CKR_ERROR(rv = digest_Update(session->digest_ctx, pData, ulDataLen)))
+        digest_Free(&session->digest_ctx);
+    else
+        rv = digest_Final(&session->digest_ctx, pDigest, pulDigestLen);
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_Digest");
 
@@ -73,15 +112,29 @@ CK_DEFINE_FUNCTION(CK_RV, C_DigestUpdate)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_DigestUpdate");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pPart && ulPartLen)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!session->digest_ctx)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (CKR_ERROR(rv = digest_Update(session->digest_ctx, pPart, ulPartLen)))
+        digest_Free(&session->digest_ctx);
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_DigestUpdate");
 
@@ -125,15 +178,36 @@ CK_DEFINE_FUNCTION(CK_RV, C_DigestFinal)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_DigestFinal");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pulDigestLen)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!session->digest_ctx)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (!pDigest)
+        *pulDigestLen = digest_Length(session->digest_mech.mechanism);
+    else if (*pulDigestLen < digest_Length(session->digest_mech.mechanism))
+    {
+        *pulDigestLen = digest_Length(session->digest_mech.mechanism);
+        rv = CKR_BUFFER_TOO_SMALL;
+    }
+    else
+        rv = digest_Final(&session->digest_ctx, pDigest, pulDigestLen);
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_DigestFinal");
 
@@ -102,6 +102,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_Initialize)
                 {
                     thread_MutexInit(&st.log_lock);
                     thread_MutexInit(&st.async_lock);
+                    thread_MutexInit(&st.session_list_lock);
                 }
             }
 
@@ -158,6 +159,12 @@ CK_DEFINE_FUNCTION(CK_RV, C_Finalize)
             st.async_lock = 0;
         }
 
+        if (st.session_list_lock)
+        {
+            thread_MutexDestroy(st.session_list_lock);
+            st.session_list_lock = 0;
+        }
+
         if (st.prefs.threaded)
             thread_Finalize();
 
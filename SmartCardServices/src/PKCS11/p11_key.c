@@ -67,21 +67,26 @@ CK_DEFINE_FUNCTION(CK_RV, C_GenerateKeyPair)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
     CK_ULONG i;
     CK_ATTRIBUTE *attrib;
 
     P11_LOG_START("C_GenerateKeyPair");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pMechanism || !pPublicKeyTemplate ||
              !pPrivateKeyTemplate || !phPublicKey || !phPrivateKey)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (READ_ONLY_SESSION)
         rv = CKR_SESSION_READ_ONLY;
     else if (CKR_ERROR(rv = slot_BeginTransaction(session->session.slotID)))
@@ -116,7 +121,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_GenerateKeyPair)
 
     log_Log(LOG_LOW, "Returning handles for public key: %lX and private key: %lX", *phPublicKey, *phPrivateKey);
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_GenerateKeyPair");
 
@@ -167,6 +172,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_UnwrapKey)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Object *object;
     P11_Attrib *attrib;
     MSCCryptInit cryptInit;
@@ -179,15 +185,19 @@ CK_DEFINE_FUNCTION(CK_RV, C_UnwrapKey)
 
     P11_LOG_START("C_UnwrapKey");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pMechanism ||
              !hUnwrappingKey || !pWrappedKey || !pTemplate)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (READ_ONLY_SESSION)
         rv = CKR_SESSION_READ_ONLY;
     else if (pMechanism->mechanism == CKM_RSA_PKCS)
@@ -312,7 +322,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_UnwrapKey)
         rv = CKR_MECHANISM_INVALID;
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_UnwrapKey");
 
@@ -22,6 +22,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_CreateObject)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
     P11_Object *object;
     P11_Attrib *attrib;
@@ -32,14 +33,18 @@ CK_DEFINE_FUNCTION(CK_RV, C_CreateObject)
 
     P11_LOG_START("C_CreateObject");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pTemplate)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (READ_ONLY_SESSION)
         rv = CKR_SESSION_READ_ONLY;
     else if (!CKR_ERROR(object_TemplateGetAttrib(CKA_CLASS, pTemplate, ulCount, 0)))
@@ -182,7 +187,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_CreateObject)
     else
         rv = CKR_TEMPLATE_INCOMPLETE;
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_CreateObject");
     return rv;
@@ -278,6 +283,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetAttributeValue)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     CK_RV perm_rv = CKR_OK;
     P11_Object *object = (P11_Object *)hObject;
     P11_Attrib *attrib;
@@ -286,16 +292,20 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetAttributeValue)
 
     P11_LOG_START("C_GetAttributeValue");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
     log_Log(LOG_LOW, "Object handle: %lX", hObject);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pTemplate)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (INVALID_OBJECT)
         rv = CKR_OBJECT_HANDLE_INVALID;
     else
@@ -369,7 +379,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetAttributeValue)
         if ((rv == CKR_OK) && (perm_rv != CKR_OK))
             rv = perm_rv;
     }
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_GetAttributeValue");
 
@@ -388,20 +398,25 @@ CK_DEFINE_FUNCTION(CK_RV, C_SetAttributeValue)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
     P11_Object *object = (P11_Object *)hObject;
     ULONG i;
 
     P11_LOG_START("C_SetAttributeValue");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pTemplate)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (INVALID_OBJECT)
         rv = CKR_OBJECT_HANDLE_INVALID;
     else if (CKR_ERROR(rv = slot_BeginTransaction(session->session.slotID)))
@@ -426,7 +441,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_SetAttributeValue)
         (void)CKR_ERROR(rv = slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN));
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_SetAttributeValue");
 
@@ -444,6 +459,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjectsInit)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     CK_RV msc_rv;
     P11_Slot *slot;
     P11_Session *session = (P11_Session *)hSession;
@@ -452,14 +468,18 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjectsInit)
 
     P11_LOG_START("C_FindObjectsInit");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (ulCount && !pTemplate)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else
     {
         slot = &st.slots[session->session.slotID - 1];
@@ -483,23 +503,31 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjectsInit)
         {
             if (!CKR_ERROR(rv = slot_BeginTransaction(session->session.slotID)))
             {
-                msc_rv = msc_ListKeys(&slot->conn, MSC_SEQUENCE_RESET, &keyInfo);
-                while (!MSC_ERROR(msc_rv) && !CKR_ERROR(rv))
+                if (!slot->objects && !CKR_ERROR_NOLOG(cache_LoadObjects(session->session.slotID)))
+                    log_Log(LOG_LOW, "Token objects restored from cache");
+                else
                 {
-                    rv = object_UpdateKeyInfo(hSession, 0, &keyInfo);
-                    msc_rv = msc_ListKeys(&slot->conn, MSC_SEQUENCE_NEXT, &keyInfo); 
-                }
+                    msc_rv = msc_ListKeys(&slot->conn, MSC_SEQUENCE_RESET, &keyInfo);
+                    while (!MSC_ERROR(msc_rv) && !CKR_ERROR(rv))
+                    {
+                        rv = object_UpdateKeyInfo(hSession, 0, &keyInfo);
+                        msc_rv = msc_ListKeys(&slot->conn, MSC_SEQUENCE_NEXT, &keyInfo); 
+                    }
         
-                msc_rv = msc_ListObjects(&slot->conn, MSC_SEQUENCE_RESET, &objectInfo);
-                while (!MSC_ERROR(msc_rv) && !CKR_ERROR(rv))
-                {
-                    if (!islower(objectInfo.objectID[0]))
-                        rv = object_UpdateObjectInfo(hSession, 0, &objectInfo);
+                    msc_rv = msc_ListObjects(&slot->conn, MSC_SEQUENCE_RESET, &objectInfo);
+                    while (!MSC_ERROR(msc_rv) && !CKR_ERROR(rv))
+                    {
+                        if (!islower(objectInfo.objectID[0]))
+                            rv = object_UpdateObjectInfo(hSession, 0, &objectInfo);
         
-                    msc_rv = msc_ListObjects(&slot->conn, MSC_SEQUENCE_NEXT, &objectInfo); 
-                }
+                        msc_rv = msc_ListObjects(&slot->conn, MSC_SEQUENCE_NEXT, &objectInfo); 
+                    }
     
-                /* Fixme: Need to delete objects that are no longer on the token */
+                    /* Fixme: Need to delete objects that are no longer on the token */
+
+                    if (!CKR_ERROR(rv))
+                        cache_StoreObjects(session->session.slotID);
+                }
 
                 if (!CKR_ERROR(rv))
                     (void)CKR_ERROR(rv = slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN));
@@ -511,7 +539,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjectsInit)
         session->search_object = st.slots[session->session.slotID - 1].objects;
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_FindObjectsInit");
     return rv;
@@ -530,6 +558,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjects)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
     P11_Slot *slot = &st.slots[session->session.slotID - 1];
     CK_ULONG j, objnum;
@@ -537,12 +566,16 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjects)
 
     P11_LOG_START("C_FindObjects");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!phObject || !ulMaxObjectCount || !pulObjectCount)
         rv= CKR_ARGUMENTS_BAD;
     else
@@ -580,7 +613,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjects)
         *pulObjectCount = objnum;
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_FindObjects");
 
@@ -596,16 +629,21 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjectsFinal)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_FindObjectsFinal");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else
     {
         session->search_object = 0x00;
@@ -619,7 +657,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_FindObjectsFinal)
         session->search_attrib_count = 0x00;
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_FindObjectsFinal");
 
@@ -24,19 +24,24 @@ CK_DEFINE_FUNCTION(CK_RV, C_OpenSession)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session;
     CK_ULONG pin_state;
 
     P11_LOG_START("C_OpenSession");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (INVALID_SLOT)
         rv = CKR_SLOT_ID_INVALID;
     else if (!phSession)
         rv = CKR_ARGUMENTS_BAD;
+    else if (CKR_ERROR(rv = slot_Lock(slotID, P11_LOCK_SLOT, &held)))
+        /* Intentionally blank */;
     else
     {
         if (!(flags & CKF_RW_SESSION) && slot_CheckRWSOsession(slotID))
@@ -50,6 +55,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_OpenSession)
             log_Log(LOG_LOW, "New session handle: %X", *phSession);
             session = (P11_Session *)*phSession;
             session->session.slotID = slotID;
+            st.slots[slotID - 1].session_count++;
 
             pin_state = st.slots[slotID - 1].pin_state;
 
@@ -79,7 +85,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_OpenSession)
         }
     }
 
-    thread_MutexUnlock(st.async_lock);
+    slot_Unlock(slotID, held);
 
     P11_LOG_END("C_OpenSession");
 
@@ -95,21 +101,26 @@ CK_DEFINE_FUNCTION(CK_RV, C_CloseSession)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
-    CK_SLOT_ID slotID = session->session.slotID;
 
     P11_LOG_START("C_CloseSession");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT, &held)))
+        /* Intentionally blank */;
     else if (!CKR_ERROR(rv = session_FreeSession(hSession)))
-        rv = slot_ReleaseConnection(slotID);
+        rv = slot_ReleaseConnection(session->session.slotID);
 
-    thread_MutexUnlock(st.async_lock);
+    /* Our reference keeps the session's memory until here */
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_CloseSession");
 
@@ -124,25 +135,22 @@ CK_DEFINE_FUNCTION(CK_RV, C_CloseAllSessions)
 )
 {
     CK_RV rv = CKR_OK;
-    P11_Session *session_l;
-    P11_Session *session_l_temp;
+    CK_SESSION_HANDLE hSession;
 
     P11_LOG_START("C_CloseAllSessions");
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    rv = slot_TokenChanged();
+
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else
     {
-        session_l = st.sessions;
-
-        while (session_l)
+        /* Sessions may be opened and closed by other threads meanwhile, so
+           always restart from the first session left on the slot */
+        while ((hSession = session_NextSlotSession(slotID, 0)))
         {
-            session_l_temp = session_l->next;
-
-            if (session_l->session.slotID == slotID)
-                C_CloseSession((CK_SESSION_HANDLE)session_l); /* Fixme: ignore errors? */
-
-            session_l = session_l_temp;
+            if (CKR_ERROR(C_CloseSession(hSession)))
+                break;
         }
     }
 
@@ -160,25 +168,30 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetSessionInfo)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_GetSessionInfo");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (!pInfo)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else
     {
         log_Log(LOG_LOW, "Session state: %lu", session->session.state);
         memcpy(pInfo, &session->session, sizeof(CK_SESSION_INFO));
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_GetSessionInfo");
 
@@ -250,18 +263,23 @@ CK_DEFINE_FUNCTION(CK_RV, C_Login)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_Login");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (!pPin || !ulPinLen)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!CKR_ERROR(rv = slot_BeginTransaction(session->session.slotID)))
     {
         if (userType == CKU_SO)
@@ -275,10 +293,10 @@ CK_DEFINE_FUNCTION(CK_RV, C_Login)
         (void)CKR_ERROR(slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN));
 
         if (rv == CKR_OK)
-            slot_UserMode(session->session.slotID);
+            slot_UserMode(session->session.slotID, hSession);
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_Login");
 
@@ -293,20 +311,25 @@ CK_DEFINE_FUNCTION(CK_RV, C_Logout)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_Logout");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!CKR_ERROR(rv = slot_BeginTransaction(session->session.slotID)))
     {
         if (rv == CKR_OK)
-            slot_PublicMode(session->session.slotID);
+            slot_PublicMode(session->session.slotID, hSession);
 
         memset(st.slots[session->session.slotID - 1].pins, 0x00, sizeof(st.slots[session->session.slotID - 1].pins));
 
@@ -316,7 +339,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_Logout)
             (void)CKR_ERROR(rv = slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN));
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_Logout");
 
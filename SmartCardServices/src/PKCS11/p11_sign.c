@@ -12,6 +12,143 @@
 
 #include "cryptoki.h"
 #include <openssl/rsa.h>
+#include <openssl/evp.h>
+
+/******************************************************************************
+** Function: sign_CardRSA
+**
+** Signs a PKCS #1 v1.5 payload (raw data or DigestInfo) with an on-card RSA
+** key.  The card pads the payload itself when it can, otherwise the host
+** pads and the card does a raw RSA operation.
+**
+** Parameters:
+**  session  - Session performing the signature
+**  key      - Private key object
+**  data     - Payload to sign
+**  data_len - Length of payload
+**  sig      - Receives the signature
+**  sig_len  - In: size of sig, Out: length of signature
+**
+** Returns:
+**  CKR_FUNCTION_FAILED if the card operation failed
+**  CKR_MECHANISM_PARAM_INVALID if the card can't do PKCS #1 signatures
+**  CKR_HOST_MEMORY if memory alloc failed
+**  CKR_OK
+*******************************************************************************/
+static CK_RV sign_CardRSA(P11_Session *session, P11_Object *key, CK_BYTE *data, CK_ULONG data_len, CK_BYTE *sig, CK_ULONG *sig_len)
+{
+    CK_RV rv = CKR_OK;
+    MSCCryptInit cryptInit;
+    MSCULong32 ulValue, lenValue;
+    MSCULong32 outputDataSize;
+    CK_BYTE *to = 0;
+    CK_ULONG tlen;
+
+    if (CKR_ERROR(rv = slot_BeginTransaction(session->session.slotID)))
+        return rv;
+
+    if (MSC_ERROR(msc_GetCapabilities(&st.slots[session->session.slotID - 1].conn,
+                    MSC_TAG_CAPABLE_RSA,
+                    (CK_BYTE_PTR) &ulValue,
+                    &lenValue)))
+        rv = CKR_FUNCTION_FAILED;
+    else if (ulValue & MSC_CAPABLE_RSA_NOPAD)
+    {
+        cryptInit.keyNum = key->msc_key->keyNum;
+        cryptInit.cipherMode = MSC_MODE_RSA_NOPAD;
+        cryptInit.cipherDirection = MSC_DIR_SIGN;
+        cryptInit.optParams = 0;
+        cryptInit.optParamsSize = 0;
+
+        tlen = key->msc_key->keySize / 8;
+        to = (CK_BYTE *)malloc(tlen);
+
+        log_Log(LOG_LOW, "Pad and Sign object keyNum: %lu tlen: %lu", 
+                key->msc_key->keyNum, tlen);
+
+        if (!to)
+            rv = CKR_HOST_MEMORY;
+        else if (!RSA_padding_add_PKCS1_type_1(to, tlen, data, data_len))
+            rv = CKR_FUNCTION_FAILED;
+        else
+        {
+            outputDataSize = *sig_len;
+            if (MSC_ERROR(msc_ComputeCrypt(
+                        &st.slots[session->session.slotID - 1].conn,
+                                       &cryptInit,
+                                       to,
+                                       tlen,
+                                       sig,
+                                       &outputDataSize)))
+                rv = CKR_FUNCTION_FAILED;
+            *sig_len = outputDataSize;
+        }
+    }
+    else if (ulValue & MSC_CAPABLE_RSA_PKCS1)
+    {
+        cryptInit.keyNum = key->msc_key->keyNum;
+        cryptInit.cipherMode = MSC_MODE_RSA_PAD_PKCS1;
+        cryptInit.cipherDirection = MSC_DIR_SIGN;
+        cryptInit.optParams = 0;
+        cryptInit.optParamsSize = 0;
+
+        log_Log(LOG_LOW, "Sign object keyNum: %lu DataLen: %lu", 
+                key->msc_key->keyNum, data_len);
+
+        outputDataSize = *sig_len;
+        if (MSC_ERROR(msc_ComputeCrypt(
+                        &st.slots[session->session.slotID - 1].conn,
+                        &cryptInit,
+                        data,
+                        data_len,
+                        sig,
+                        &outputDataSize)))
+            rv = CKR_FUNCTION_FAILED;
+        *sig_len = outputDataSize;
+    }
+    else
+        rv = CKR_MECHANISM_PARAM_INVALID;
+
+    (void)CKR_ERROR(slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN));
+
+    if (to)
+        free(to);
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: sign_HashAndSign
+**
+** Finishes the host-side hash of a hash-and-sign mechanism, wraps it in a
+** DigestInfo and has the card sign it.  The hash context is always released.
+**
+** Parameters:
+**  session  - Session performing the signature
+**  key      - Private key object
+**  sig      - Receives the signature
+**  sig_len  - In: size of sig, Out: length of signature
+**
+** Returns:
+**  See digest_Final, digest_EncodeInfo and sign_CardRSA
+*******************************************************************************/
+static CK_RV sign_HashAndSign(P11_Session *session, P11_Object *key, CK_BYTE *sig, CK_ULONG *sig_len)
+{
+    CK_RV rv = CKR_OK;
+    CK_BYTE hash[EVP_MAX_MD_SIZE];
+    CK_ULONG hash_len = sizeof(hash);
+    CK_BYTE info[EVP_MAX_MD_SIZE + 32];
+    CK_ULONG info_len = sizeof(info);
+
+    if (CKR_ERROR(rv = digest_Final(&session->sign_ctx, hash, &hash_len)))
+        /* Intentionally blank */;
+    else if (CKR_ERROR(rv = digest_EncodeInfo(session->sign_mech.mechanism, hash, hash_len, info, &info_len)))
+        /* Intentionally blank */;
+    else
+        rv = sign_CardRSA(session, key, info, info_len, sig, sig_len);
+
+    return rv;
+}
 
 /* C_SignInit initializes a signature (private key encryption)
  * operation, where the signature is (will be) an appendix to
@@ -25,32 +162,43 @@ CK_DEFINE_FUNCTION(CK_RV, C_SignInit)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     CK_OBJECT_HANDLE hObject = hKey; /* Needed for INVALID_OBJECT check */
     P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_SignInit");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pMechanism)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (INVALID_OBJECT)
         rv = CKR_OBJECT_HANDLE_INVALID;
     else if (!USER_MODE)
         rv = CKR_USER_NOT_LOGGED_IN;
+    else if (digest_IsHashMechanism(pMechanism->mechanism) &&
+             CKR_ERROR(rv = digest_Init(pMechanism->mechanism, &session->sign_ctx)))
+        /* Intentionally blank */;
     else
     {
+        if (!digest_IsHashMechanism(pMechanism->mechanism))
+            digest_Free(&session->sign_ctx);
+
         session->sign_mech = *pMechanism;
         session->sign_key = hObject;
 
         log_Log(LOG_LOW, "Sign object handle: 0x%lX", hObject);
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_SignInit");
 
@@ -71,24 +219,26 @@ CK_DEFINE_FUNCTION(CK_RV, C_Sign)
 )
 {
     CK_RV rv = CKR_OK;
-    MSCCryptInit cryptInit;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Session *session = (P11_Session *)hSession;
     P11_Object *key = (P11_Object *)session->sign_key;
-    CK_BYTE *to = 0;
-    CK_ULONG tlen;
 
     P11_LOG_START("C_Sign");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
     log_Log(LOG_LOW, "Output buffer len: %lu", *pulSignatureLen);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_SESSION_HANDLE_INVALID;
     else if (!pData || !pSignature)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (!key)
         rv = CKR_OPERATION_NOT_INITIALIZED;
     else if (!USER_MODE)
@@ -98,89 +248,23 @@ CK_DEFINE_FUNCTION(CK_RV, C_Sign)
         *pulSignatureLen = key->msc_key->keySize / 8;
         rv = CKR_BUFFER_TOO_SMALL;
     }
-    else if (CKR_ERROR(rv = slot_BeginTransaction(session->session.slotID)))
-        /* Intentionally blank */;
     else if (session->sign_mech.mechanism == CKM_RSA_PKCS)
+        rv = sign_CardRSA(session, key, pData, ulDataLen, pSignature, pulSignatureLen);
+    else if (digest_IsHashMechanism(session->sign_mech.mechanism))
     {
-        MSCULong32  ulValue, lenValue;
-
-        if (MSC_ERROR(msc_GetCapabilities(&st.slots[session->session.slotID - 1].conn,
-                        MSC_TAG_CAPABLE_RSA,
-                        (CK_BYTE_PTR) &ulValue,
-                        &lenValue)))
-            rv = CKR_FUNCTION_FAILED;
-        else if (ulValue & MSC_CAPABLE_RSA_NOPAD)
-        {
-        cryptInit.keyNum = key->msc_key->keyNum;
-        cryptInit.cipherMode = MSC_MODE_RSA_NOPAD;
-        cryptInit.cipherDirection = MSC_DIR_SIGN;
-        cryptInit.optParams = 0;
-        cryptInit.optParamsSize = 0;
-
-        tlen = key->msc_key->keySize / 8;
-        to = (CK_BYTE *)malloc(tlen);
-
-            log_Log(LOG_LOW, "Pad and Sign object keyNum: %lu tlen: %lu", 
-                    key->msc_key->keyNum, tlen);
-
-        if (!to)
-            rv = CKR_HOST_MEMORY;
-        else if (!RSA_padding_add_PKCS1_type_1(to, tlen, pData, ulDataLen))
-            rv = CKR_FUNCTION_FAILED;
-
-            else
-			{
-				MSCULong32 outputDataSize = *pulSignatureLen;
-				if (MSC_ERROR(msc_ComputeCrypt(
-                            &st.slots[session->session.slotID - 1].conn,
-                                           &cryptInit,
-                                           to,
-                                           tlen,
-                                           pSignature,
-                                           &outputDataSize)))
-					rv = CKR_FUNCTION_FAILED;
-				*pulSignatureLen = outputDataSize;
-			}
-        }
-        else if (ulValue & MSC_CAPABLE_RSA_PKCS1)
-        {
-            cryptInit.keyNum = key->msc_key->keyNum;
-            cryptInit.cipherMode = MSC_MODE_RSA_PAD_PKCS1;
-            cryptInit.cipherDirection = MSC_DIR_SIGN;
-            cryptInit.optParams = 0;
-            cryptInit.optParamsSize = 0;
-
-            log_Log(LOG_LOW, "Sign object keyNum: %lu DataLen: %lu", 
-                    key->msc_key->keyNum, ulDataLen);
-
-			MSCULong32 outputDataSize = *pulSignatureLen;
-			if (MSC_ERROR(msc_ComputeCrypt(
-                            &st.slots[session->session.slotID - 1].conn,
-                            &cryptInit,
-                            pData,
-                            ulDataLen,
-                            pSignature,
-                            &outputDataSize)))
-                rv = CKR_FUNCTION_FAILED;
-			*pulSignatureLen = outputDataSize;
-        }
-        else
-            rv = CKR_MECHANISM_PARAM_INVALID;
-
-        (void)CKR_ERROR(slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN));
+        if (!CKR_ERROR(rv = digest_Update(session->sign_ctx, pData, ulDataLen)))
+            rv = sign_HashAndSign(session, key, pSignature, pulSignatureLen);
     }
     else
-    {
-        (void)CKR_ERROR(slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN));
         rv = CKR_MECHANISM_INVALID;
-    }
 
-    session->sign_key = 0;
-
-    if (to)
-        free(to);
+    if (!INVALID_SESSION && (rv != CKR_BUFFER_TOO_SMALL))
+    {
+        session->sign_key = 0;
+        digest_Free(&session->sign_ctx);
+    }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_Sign");
 
@@ -199,15 +283,39 @@ CK_DEFINE_FUNCTION(CK_RV, C_SignUpdate)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_SignUpdate");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pPart && ulPartLen)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!session->sign_key)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (!USER_MODE)
+        rv = CKR_USER_NOT_LOGGED_IN;
+    else if (!session->sign_ctx)
+        rv = CKR_MECHANISM_INVALID; /* Raw CKM_RSA_PKCS is single-part only */
+    else
+        rv = digest_Update(session->sign_ctx, pPart, ulPartLen);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR_NOLOG(rv) && !INVALID_SESSION)
+    {
+        session->sign_key = 0;
+        digest_Free(&session->sign_ctx);
+    }
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_SignUpdate");
 
@@ -225,15 +333,46 @@ CK_DEFINE_FUNCTION(CK_RV, C_SignFinal)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
+    P11_Object *key = 0;
 
     P11_LOG_START("C_SignFinal");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pulSignatureLen)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!(key = (P11_Object *)session->sign_key) || !session->sign_ctx)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (!USER_MODE)
+        rv = CKR_USER_NOT_LOGGED_IN;
+    else if (!pSignature)
+        *pulSignatureLen = key->msc_key->keySize / 8;
+    else if ((CK_ULONG)(key->msc_key->keySize / 8) > *pulSignatureLen)
+    {
+        *pulSignatureLen = key->msc_key->keySize / 8;
+        rv = CKR_BUFFER_TOO_SMALL;
+    }
+    else
+        rv = sign_HashAndSign(session, key, pSignature, pulSignatureLen);
 
-    thread_MutexUnlock(st.async_lock);
+    /* A length query or a short buffer leaves the operation active */
+    if (!INVALID_SESSION && pSignature && (rv != CKR_BUFFER_TOO_SMALL))
+    {
+        session->sign_key = 0;
+        digest_Free(&session->sign_ctx);
+    }
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_SignFinal");
 
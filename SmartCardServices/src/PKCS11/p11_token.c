@@ -26,10 +26,10 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetSlotList)
 
     P11_LOG_START("C_GetSlotList");
 
-    thread_MutexLock(st.async_lock);
-
     (void)CKR_ERROR(slot_TokenChanged());
 
+    thread_MutexLock(st.async_lock);
+
     if (!pulCount)
         rv = CKR_ARGUMENTS_BAD;
     else if (!st.slots)
@@ -91,11 +91,11 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetSlotInfo)
 
     P11_LOG_START("C_GetSlotInfo");
 
+    (void)CKR_ERROR(slot_TokenChanged());
+
     thread_MutexLock(st.async_lock);
     log_Log(LOG_LOW, "Checking slot: %ld", slotID);
 
-    (void)CKR_ERROR(slot_TokenChanged());
-
     if (!pInfo)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SLOT)
@@ -126,10 +126,12 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetTokenInfo)
 
     P11_LOG_START("C_GetTokenInfo");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
     log_Log(LOG_LOW, "Checking slot: %ld", slotID);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (!pInfo)
         rv = CKR_ARGUMENTS_BAD;
@@ -162,9 +164,11 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetMechanismList)
 
     P11_LOG_START("C_GetMechanismList");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (INVALID_SLOT)
         rv = CKR_SLOT_ID_INVALID;
@@ -212,9 +216,11 @@ CK_DEFINE_FUNCTION(CK_RV, C_GetMechanismInfo)
 
     P11_LOG_START("C_GetMechanismInfo");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (INVALID_SLOT)
         rv = CKR_SLOT_ID_INVALID;
@@ -284,6 +290,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_InitPIN)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Slot *slot;
     P11_Session *session;
 
@@ -298,6 +305,8 @@ CK_DEFINE_FUNCTION(CK_RV, C_InitPIN)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (READ_ONLY_SESSION)
         rv = CKR_SESSION_READ_ONLY;
     else
@@ -321,7 +330,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_InitPIN)
             rv = slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN);
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_InitPIN");
 
@@ -340,19 +349,24 @@ CK_DEFINE_FUNCTION(CK_RV, C_SetPIN)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
     P11_Slot *slot;
     P11_Session *session;
 
     P11_LOG_START("C_SetPIN");
 
+    rv = slot_TokenChanged();
+
     thread_MutexLock(st.async_lock);
 
-    if (CKR_ERROR(rv = slot_TokenChanged()))
+    if (CKR_ERROR(rv))
         rv = CKR_DEVICE_REMOVED;
     else if (!pOldPin || !pNewPin)
         rv = CKR_ARGUMENTS_BAD;
     else if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
     else if (READ_ONLY_SESSION)
         rv = CKR_SESSION_READ_ONLY;
     else
@@ -376,7 +390,7 @@ CK_DEFINE_FUNCTION(CK_RV, C_SetPIN)
             rv = slot_EndTransaction(session->session.slotID, MSC_LEAVE_TOKEN);
     }
 
-    thread_MutexUnlock(st.async_lock);
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_SetPIN");
 
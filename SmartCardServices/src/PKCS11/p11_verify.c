@@ -11,6 +11,40 @@
 ******************************************************************************/
 
 #include "cryptoki.h"
+#include <openssl/evp.h>
+
+/******************************************************************************
+** Function: verify_HashAndVerify
+**
+** Finishes the host-side hash of a hash-and-verify mechanism and checks the
+** signature against the resulting DigestInfo.  The hash context is always
+** released.
+**
+** Parameters:
+**  session  - Session performing the verification
+**  sig      - Signature
+**  sig_len  - Length of signature
+**
+** Returns:
+**  See digest_Final, digest_EncodeInfo and digest_VerifyRSA
+*******************************************************************************/
+static CK_RV verify_HashAndVerify(P11_Session *session, CK_BYTE *sig, CK_ULONG sig_len)
+{
+    CK_RV rv = CKR_OK;
+    CK_BYTE hash[EVP_MAX_MD_SIZE];
+    CK_ULONG hash_len = sizeof(hash);
+    CK_BYTE info[EVP_MAX_MD_SIZE + 32];
+    CK_ULONG info_len = sizeof(info);
+
+    if (CKR_ERROR(rv = digest_Final(&session->verify_ctx, hash, &hash_len)))
+        /* Intentionally blank */;
+    else if (CKR_ERROR(rv = digest_EncodeInfo(session->verify_mech.mechanism, hash, hash_len, info, &info_len)))
+        /* Intentionally blank */;
+    else
+        rv = digest_VerifyRSA((P11_Object *)session->verify_key, info, info_len, sig, sig_len);
+
+    return rv;
+}
 
 /* C_VerifyInit initializes a verification operation, where the
  * signature is an appendix to the data, and plaintext cannot
@@ -23,15 +57,44 @@ CK_DEFINE_FUNCTION(CK_RV, C_VerifyInit)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    CK_OBJECT_HANDLE hObject = hKey; /* Needed for INVALID_OBJECT check */
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_VerifyInit");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pMechanism)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (INVALID_OBJECT)
+        rv = CKR_OBJECT_HANDLE_INVALID;
+    else if ((pMechanism->mechanism != CKM_RSA_PKCS) &&
+             !digest_IsHashMechanism(pMechanism->mechanism))
+        rv = CKR_MECHANISM_INVALID;
+    else if (digest_IsHashMechanism(pMechanism->mechanism) &&
+             CKR_ERROR(rv = digest_Init(pMechanism->mechanism, &session->verify_ctx)))
+        /* Intentionally blank */;
+    else
+    {
+        if (pMechanism->mechanism == CKM_RSA_PKCS)
+            digest_Free(&session->verify_ctx);
+
+        session->verify_mech = *pMechanism;
+        session->verify_key = hObject;
+
+        log_Log(LOG_LOW, "Verify object handle: 0x%lX", hObject);
+    }
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_VerifyInit");
 
@@ -52,15 +115,37 @@ CK_DEFINE_FUNCTION(CK_RV, C_Verify)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_Verify");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if ((!pData && ulDataLen) || !pSignature)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!session->verify_key)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (session->verify_mech.mechanism == CKM_RSA_PKCS)
+        rv = digest_VerifyRSA((P11_Object *)session->verify_key, pData, ulDataLen, pSignature, ulSignatureLen);
+    else if (!CKR_ERROR(rv = digest_Update(session->verify_ctx, pData, ulDataLen)))
+        rv = verify_HashAndVerify(session, pSignature, ulSignatureLen);
+
+    if (!INVALID_SESSION)
+    {
+        session->verify_key = 0;
+        digest_Free(&session->verify_ctx);
+    }
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_Verify");
 
@@ -79,15 +164,37 @@ CK_DEFINE_FUNCTION(CK_RV, C_VerifyUpdate)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_VerifyUpdate");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pPart && ulPartLen)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!session->verify_key)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (!session->verify_ctx)
+        rv = CKR_MECHANISM_INVALID; /* Raw CKM_RSA_PKCS is single-part only */
+    else
+        rv = digest_Update(session->verify_ctx, pPart, ulPartLen);
+
+    if (CKR_ERROR_NOLOG(rv) && !INVALID_SESSION)
+    {
+        session->verify_key = 0;
+        digest_Free(&session->verify_ctx);
+    }
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_VerifyUpdate");
 
@@ -105,15 +212,35 @@ CK_DEFINE_FUNCTION(CK_RV, C_VerifyFinal)
 )
 {
     CK_RV rv = CKR_OK;
+    CK_ULONG held = P11_LOCK_GLOBAL;
+    P11_Session *session = (P11_Session *)hSession;
 
     P11_LOG_START("C_VerifyFinal");
 
-    thread_MutexLock(st.async_lock);
+    rv = slot_TokenChanged();
 
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-    log_Log(LOG_MED, "Function not supported");
+    thread_MutexLock(st.async_lock);
 
-    thread_MutexUnlock(st.async_lock);
+    if (CKR_ERROR(rv))
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (!pSignature)
+        rv = CKR_ARGUMENTS_BAD;
+    else if (INVALID_SESSION)
+        rv = CKR_SESSION_HANDLE_INVALID;
+    else if (CKR_ERROR(rv = session_Lock(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+        /* Intentionally blank */;
+    else if (!session->verify_key || !session->verify_ctx)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else
+        rv = verify_HashAndVerify(session, pSignature, ulSignatureLen);
+
+    if (!INVALID_SESSION)
+    {
+        session->verify_key = 0;
+        digest_Free(&session->verify_ctx);
+    }
+
+    session_Unlock(hSession, held);
 
     P11_LOG_END("C_VerifyFinal");
 
@@ -47,13 +47,20 @@ CK_RV async_StartSlotWatcher()
         tokenArray[i].tokenState = 0;
     }
 
-    st.slot_status = (char *)malloc(st.slot_count);
+    st.slot_event_gen = (volatile CK_ULONG *)calloc(st.slot_count, sizeof(CK_ULONG));
+    st.slot_seen_gen = (CK_ULONG *)calloc(st.slot_count, sizeof(CK_ULONG));
 
-    if (!st.slot_status)
+    if (!st.slot_event_gen || !st.slot_seen_gen)
+    {
+        async_FreeGenerations();
         rv = CKR_HOST_MEMORY;
+    }
     else
     {
-        memset(st.slot_status, 0x01, st.slot_count);
+        /* Every slot starts out "changed" so the first call reads all tokens */
+        st.seen_event_gen = st.event_gen;
+        for (i = 0; i < st.slot_count; i++)
+            slot_SignalEvent(i + 1);
 
         if (st.prefs.threaded && st.create_threads)
         {
@@ -62,8 +69,7 @@ CK_RV async_StartSlotWatcher()
                                                    async_TokenEventCallback, 
                                                    0)))
             {
-                free(st.slot_status);
-                st.slot_status = 0;
+                async_FreeGenerations();
                 rv = CKR_FUNCTION_FAILED;
             }
         }
@@ -93,22 +99,44 @@ CK_RV async_StopSlotWatcher()
     if (st.prefs.threaded && st.create_threads)
         msc_CallbackCancelEvent();
 
-    if (st.slot_status)
+    async_FreeGenerations();
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: async_FreeGenerations
+**
+** Frees the per-slot event generation arrays.
+**
+** Parameters:
+**  none
+**
+** Returns:
+**  none
+*******************************************************************************/
+void async_FreeGenerations()
+{
+    if (st.slot_event_gen)
     {
-        free(st.slot_status);
-        st.slot_status = 0;    
+        free((void *)st.slot_event_gen);
+        st.slot_event_gen = 0;
     }
 
-    return rv;
+    if (st.slot_seen_gen)
+    {
+        free(st.slot_seen_gen);
+        st.slot_seen_gen = 0;
+    }
 }
 
 /******************************************************************************
 ** Function: async_TokenEventCallback
 **
 ** Called for asynchronous token events.  Depending on the thread mode this
-** will either set a flag that will be picked up later by any call into the
-** P11 module, or if in fully threaded mode this will update all information
-** about the token in the callback thread.
+** will either bump the slot's event generation, which will be picked up later
+** by any call into the P11 module, or if in fully threaded mode this will
+** update all information about the token in the callback thread.
 **
 ** Parameters:
 **  tokenArray - Token status information
@@ -127,16 +155,12 @@ MSCULong32 async_TokenEventCallback(MSCTokenInfo *tokenArray, MSCULong32 arrayLe
         if (tokenArray[i].tokenState & MSC_STATE_CHANGED)
         {
             log_Log(LOG_LOW, "Async event on slot %ld: 0x%lX", i + 1, tokenArray[i].tokenState);
-            st.slot_status[i] = 0x01;
+            slot_SignalEvent(i + 1);
         }
     }
 
     if (st.prefs.slot_watch_scheme == P11_SLOT_WATCH_THREAD_FULL)
-    {
-        thread_MutexLock(st.async_lock);
         slot_TokenChanged();
-        thread_MutexUnlock(st.async_lock);
-    }
 
     return MSC_SUCCESS;
 }
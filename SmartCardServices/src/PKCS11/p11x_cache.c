@@ -0,0 +1,704 @@
+/******************************************************************************
+**
+**  $Id$
+**
+**  Package: PKCS-11
+**  License: Same terms as the rest of the PKCS-11 module
+**  Purpose: On-disk cache of token objects and their attributes.  A cache
+**           file is named after a fingerprint of the token (ATR, name,
+**           memory status), of its key and object lists (IDs, sizes and
+**           ACL's) and of its public keys, which tell apart cards that were
+**           personalised alike.  Reconnecting to a known token restores the
+**           object list from the file instead of reading every object off
+**           the card.  Files are authenticated with HMAC-SHA1 under a random
+**           per-user secret kept next to them.  Off unless the ObjectCache
+**           preference is set.
+**
+******************************************************************************/
+
+#include "cryptoki.h"
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+
+#define CACHE_MAGIC         "P11OBJC2"
+#define CACHE_KIND_NONE     0   /* Object derived on the host (not on token) */
+#define CACHE_KIND_KEY      1   /* Object has MSCKeyInfo                     */
+#define CACHE_KIND_OBJ      2   /* Object has MSCObjectInfo                  */
+#define CACHE_SECRET_NAME   "secret"
+#define CACHE_SECRET_SIZE   32
+#define CACHE_MAC_SIZE      20  /* HMAC-SHA1 trailer                         */
+#define CACHE_HMAC_BLOCK    64
+#define CACHE_MAX_PUB_KEYS  16  /* Public keys hashed into the fingerprint   */
+
+/******************************************************************************
+** Function: cache_GetPath
+**
+** Builds the cache directory or cache file path for a fingerprint
+**
+** Parameters:
+**  key      - Fingerprint (P11_CACHE_KEY_SIZE bytes), or 0 for the directory
+**             (or the secret file, see cache_GetSecret)
+**  path     - Receives the path
+**  path_len - Size of path
+**
+** Returns:
+**  CKR_FUNCTION_FAILED if there is no usable cache directory
+**  CKR_OK
+*******************************************************************************/
+static CK_RV cache_GetPath(CK_BYTE *key, char *path, CK_ULONG path_len)
+{
+    CK_RV rv = CKR_OK;
+    CK_ULONG i, len;
+#ifndef WIN32
+    char *home = getenv("HOME");
+    char dirname[] = "/.pkcs11cache";
+#else
+    char home[] = "C:\\Program Files\\Muscle";
+    char dirname[] = "\\cache";
+#endif
+
+    if (!home || (strlen(home) + sizeof(dirname) + (P11_CACHE_KEY_SIZE * 2) + 2 > path_len))
+        rv = CKR_FUNCTION_FAILED;
+    else
+    {
+        strcpy(path, home);
+        strcat(path, dirname);
+
+        if (key)
+        {
+            len = strlen(path);
+#ifndef WIN32
+            path[len++] = '/';
+#else
+            path[len++] = '\\';
+#endif
+            for (i = 0; i < P11_CACHE_KEY_SIZE; i++, len += 2)
+                sprintf(&path[len], "%02X", key[i]);
+        }
+    }
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: cache_GetSecret
+**
+** Reads the per-user secret that cache files are authenticated with.  The
+** secret lives in the cache directory, which is only accessible to its owner,
+** and is created from random bytes the first time a cache file is stored.
+**
+** Parameters:
+**  secret - Receives CACHE_SECRET_SIZE bytes
+**  create - Whether to create the secret if there is none yet
+**
+** Returns:
+**  CKR_FUNCTION_FAILED if there is no usable secret
+**  CKR_OK
+*******************************************************************************/
+static CK_RV cache_GetSecret(CK_BYTE *secret, CK_BBOOL create)
+{
+    CK_RV rv = CKR_OK;
+    char path[512];
+    FILE *fp = 0;
+#ifndef WIN32
+    int fd;
+#endif
+
+    if (CKR_ERROR_NOLOG(rv = cache_GetPath(0, path, sizeof(path) - sizeof(CACHE_SECRET_NAME) - 1)))
+        return rv;
+
+#ifndef WIN32
+    strcat(path, "/" CACHE_SECRET_NAME);
+#else
+    strcat(path, "\\" CACHE_SECRET_NAME);
+#endif
+
+    if ((fp = fopen(path, "rb")))
+    {
+        if (fread(secret, 1, CACHE_SECRET_SIZE, fp) != CACHE_SECRET_SIZE)
+            rv = CKR_FUNCTION_FAILED;
+    }
+    else if (!create || (RAND_bytes(secret, CACHE_SECRET_SIZE) != 1))
+        rv = CKR_FUNCTION_FAILED;
+    else
+    {
+#ifndef WIN32
+        if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR)) >= 0)
+            fp = fdopen(fd, "wb");
+#else
+        fp = fopen(path, "wb");
+#endif
+        if (!fp || (fwrite(secret, 1, CACHE_SECRET_SIZE, fp) != CACHE_SECRET_SIZE))
+            rv = CKR_FUNCTION_FAILED;
+    }
+
+    if (fp && fclose(fp))
+        rv = CKR_FUNCTION_FAILED;
+
+    if (CKR_ERROR_NOLOG(rv))
+    {
+        memset(secret, 0x00, CACHE_SECRET_SIZE);
+        if (create)
+            remove(path);
+    }
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: cache_MacInit
+**
+** Starts an HMAC-SHA1 over a cache file
+**
+** Parameters:
+**  secret - Per-user secret from cache_GetSecret
+**  mac    - Receives the inner hash context
+**
+** Returns:
+**  Error from digest functions
+**  CKR_OK
+*******************************************************************************/
+static CK_RV cache_MacInit(CK_BYTE *secret, void **mac)
+{
+    CK_RV rv = CKR_OK;
+    CK_BYTE pad[CACHE_HMAC_BLOCK];
+    CK_ULONG i;
+
+    memset(pad, 0x36, sizeof(pad));
+    for (i = 0; i < CACHE_SECRET_SIZE; i++)
+        pad[i] ^= secret[i];
+
+    if (!CKR_ERROR(rv = digest_Init(CKM_SHA_1, mac)))
+        rv = digest_Update(*mac, pad, sizeof(pad));
+
+    memset(pad, 0x00, sizeof(pad));
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: cache_MacFinal
+**
+** Finishes the HMAC-SHA1 started by cache_MacInit
+**
+** Parameters:
+**  secret - Secret passed to cache_MacInit
+**  mac    - Inner hash context; released on return
+**  out    - Receives CACHE_MAC_SIZE bytes
+**
+** Returns:
+**  Error from digest functions
+**  CKR_OK
+*******************************************************************************/
+static CK_RV cache_MacFinal(CK_BYTE *secret, void **mac, CK_BYTE *out)
+{
+    CK_RV rv = CKR_OK;
+    CK_BYTE pad[CACHE_HMAC_BLOCK];
+    CK_BYTE hash[EVP_MAX_MD_SIZE];
+    CK_ULONG hash_len = 0;
+    void *outer = 0;
+    CK_ULONG i;
+
+    memset(pad, 0x5C, sizeof(pad));
+    for (i = 0; i < CACHE_SECRET_SIZE; i++)
+        pad[i] ^= secret[i];
+
+    if (!CKR_ERROR(rv = digest_Final(mac, hash, &hash_len)) &&
+        !CKR_ERROR(rv = digest_Init(CKM_SHA_1, &outer)) &&
+        !CKR_ERROR(rv = digest_Update(outer, pad, sizeof(pad))) &&
+        !CKR_ERROR(rv = digest_Update(outer, hash, hash_len)))
+        rv = digest_Final(&outer, hash, &hash_len);
+
+    if (!CKR_ERROR_NOLOG(rv))
+        memcpy(out, hash, CACHE_MAC_SIZE);
+
+    digest_Free(mac);
+    digest_Free(&outer);
+    memset(pad, 0x00, sizeof(pad));
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: cache_Write
+**
+** Writes a block of data to a cache file
+**
+** Parameters:
+**  fp   - Open cache file
+**  mac  - HMAC context the data is added to
+**  data - Data to write
+**  len  - Length of data
+**
+** Returns:
+**  CKR_FUNCTION_FAILED if the write failed
+**  CKR_OK
+*******************************************************************************/
+static CK_RV cache_Write(FILE *fp, void *mac, void *data, CK_ULONG len)
+{
+    if (fwrite(data, 1, len, fp) != len)
+        return CKR_FUNCTION_FAILED;
+
+    return digest_Update(mac, (CK_BYTE *)data, len);
+}
+
+/******************************************************************************
+** Function: cache_Read
+**
+** Reads a block of data from a cache file
+**
+** Parameters:
+**  fp   - Open cache file
+**  mac  - HMAC context the data is added to
+**  data - Receives data
+**  len  - Length of data
+**
+** Returns:
+**  CKR_FUNCTION_FAILED if the file is short
+**  CKR_OK
+*******************************************************************************/
+static CK_RV cache_Read(FILE *fp, void *mac, void *data, CK_ULONG len)
+{
+    if (fread(data, 1, len, fp) != len)
+        return CKR_FUNCTION_FAILED;
+
+    return digest_Update(mac, (CK_BYTE *)data, len);
+}
+
+/******************************************************************************
+** Function: cache_Fingerprint
+**
+** Lists the keys and objects on a token and hashes them, along with the
+** token's identity and the value of its public keys, into slot->cache_key.
+** Sets slot->cache_storable if the token may be cached: every object must be
+** readable without a PIN so that no protected data ever ends up on disk, and
+** at least one public key must be readable.  The ATR and the listings are the
+** same on every card of a batch; the key values are not, and are cheap to
+** read next to the objects the cache saves.
+**
+** Must be called inside a transaction.
+**
+** Parameters:
+**  slotID - Slot number
+**
+** Returns:
+**  CKR_FUNCTION_FAILED if the token could not be listed
+**  Error from digest functions
+**  CKR_OK
+*******************************************************************************/
+static CK_RV cache_Fingerprint(CK_SLOT_ID slotID)
+{
+    CK_RV rv = CKR_OK;
+    MSC_RV msc_rv;
+    P11_Slot *slot = &st.slots[slotID - 1];
+    MSCKeyInfo keyInfo;
+    MSCObjectInfo objectInfo;
+    MSCUChar8 pub_keys[CACHE_MAX_PUB_KEYS];
+    MSCUChar8 keyBlob[4096];
+    MSCULong32 keyBlobSize;
+    CK_ULONG pub_count = 0, pub_read = 0, i;
+    CK_BYTE hash[EVP_MAX_MD_SIZE];
+    CK_ULONG hash_len = 0;
+    void *ctx = 0;
+
+    slot->cache_storable = FALSE;
+
+    if (CKR_ERROR(rv = digest_Init(CKM_SHA_1, &ctx)))
+        return rv;
+
+    (void)digest_Update(ctx, (CK_BYTE *)slot->conn.tokenInfo.tokenName, strlen(slot->conn.tokenInfo.tokenName));
+    (void)digest_Update(ctx, slot->conn.tokenInfo.tokenId, min(slot->conn.tokenInfo.tokenIdLength, MAX_ATR_SIZE));
+    (void)digest_Update(ctx, (CK_BYTE *)&slot->status_info.totalMemory, sizeof(slot->status_info.totalMemory));
+    (void)digest_Update(ctx, (CK_BYTE *)&slot->status_info.freeMemory, sizeof(slot->status_info.freeMemory));
+
+    msc_rv = msc_ListKeys(&slot->conn, MSC_SEQUENCE_RESET, &keyInfo);
+    while (!MSC_ERROR(msc_rv))
+    {
+        (void)digest_Update(ctx, &keyInfo.keyNum, sizeof(keyInfo.keyNum));
+        (void)digest_Update(ctx, &keyInfo.keyType, sizeof(keyInfo.keyType));
+        (void)digest_Update(ctx, (CK_BYTE *)&keyInfo.keySize, sizeof(keyInfo.keySize));
+        (void)digest_Update(ctx, (CK_BYTE *)&keyInfo.keyACL, sizeof(keyInfo.keyACL));
+        (void)digest_Update(ctx, (CK_BYTE *)&keyInfo.keyPolicy, sizeof(keyInfo.keyPolicy));
+
+        if (((keyInfo.keyType == MSC_KEY_RSA_PUBLIC) || (keyInfo.keyType == MSC_KEY_DSA_PUBLIC)) &&
+            (pub_count < CACHE_MAX_PUB_KEYS))
+            pub_keys[pub_count++] = keyInfo.keyNum;
+
+        msc_rv = msc_ListKeys(&slot->conn, MSC_SEQUENCE_NEXT, &keyInfo);
+    }
+
+    slot->cache_storable = TRUE;
+
+    msc_rv = msc_ListObjects(&slot->conn, MSC_SEQUENCE_RESET, &objectInfo);
+    while (!MSC_ERROR(msc_rv))
+    {
+        if (objectInfo.objectACL.readPermission != MSC_AUT_ALL)
+            slot->cache_storable = FALSE;
+
+        (void)digest_Update(ctx, (CK_BYTE *)objectInfo.objectID, strnlen(objectInfo.objectID, MSC_MAXSIZE_OBJID));
+        (void)digest_Update(ctx, (CK_BYTE *)&objectInfo.objectSize, sizeof(objectInfo.objectSize));
+        (void)digest_Update(ctx, (CK_BYTE *)&objectInfo.objectACL, sizeof(objectInfo.objectACL));
+        msc_rv = msc_ListObjects(&slot->conn, MSC_SEQUENCE_NEXT, &objectInfo);
+    }
+
+    /* Exported once the listing is done so its sequence is not disturbed */
+    for (i = 0; (i < pub_count) && ((msc_rv == MSC_SEQUENCE_END) || !MSC_ERROR(msc_rv)); i++)
+    {
+        keyBlobSize = sizeof(keyBlob);
+        if (!MSC_ERROR(msc_ExportKey(&slot->conn, pub_keys[i], keyBlob, &keyBlobSize, 0, 0)))
+        {
+            (void)digest_Update(ctx, &pub_keys[i], sizeof(pub_keys[i]));
+            (void)digest_Update(ctx, keyBlob, keyBlobSize);
+            pub_read++;
+        }
+    }
+
+    if (!pub_read)
+        slot->cache_storable = FALSE;
+
+    if ((msc_rv != MSC_SEQUENCE_END) && MSC_ERROR(msc_rv))
+    {
+        digest_Free(&ctx);
+        slot->cache_storable = FALSE;
+        rv = CKR_FUNCTION_FAILED;
+    }
+    else if (!CKR_ERROR(rv = digest_Final(&ctx, hash, &hash_len)))
+        memcpy(slot->cache_key, hash, P11_CACHE_KEY_SIZE);
+    else
+        slot->cache_storable = FALSE;
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: cache_LoadObjects
+**
+** Fingerprints the token in a slot and, if a matching cache file exists,
+** rebuilds the slot's object list from it.  The slot must have no objects.
+**
+** Must be called inside a transaction.
+**
+** Parameters:
+**  slotID - Slot number
+**
+** Returns:
+**  CKR_FUNCTION_FAILED if the cache is disabled, missing or unusable; the
+**      caller should read the objects off the token (and may then call
+**      cache_StoreObjects)
+**  CKR_OK if the objects were restored
+*******************************************************************************/
+CK_RV cache_LoadObjects(CK_SLOT_ID slotID)
+{
+    CK_RV rv = CKR_OK;
+    P11_Slot *slot = &st.slots[slotID - 1];
+    P11_Object *object, *tail = 0;
+    CK_ULONG object_count, attrib_count, i, j;
+    CK_ATTRIBUTE ck_attrib;
+    CK_BYTE kind;
+    CK_BYTE *value;
+    char magic[sizeof(CACHE_MAGIC)];
+    CK_BYTE key[P11_CACHE_KEY_SIZE];
+    CK_BYTE secret[CACHE_SECRET_SIZE];
+    CK_BYTE mac_value[CACHE_MAC_SIZE], file_mac[CACHE_MAC_SIZE];
+    void *mac = 0;
+    char path[512];
+    FILE *fp = 0;
+
+    slot->cache_storable = FALSE;
+
+    if (!st.prefs.object_cache || slot->objects)
+        rv = CKR_FUNCTION_FAILED;
+    else if (CKR_ERROR(rv = cache_Fingerprint(slotID)))
+        rv = CKR_FUNCTION_FAILED;
+    else if (!slot->cache_storable)
+        rv = CKR_FUNCTION_FAILED;
+    else if (CKR_ERROR_NOLOG(rv = cache_GetPath(slot->cache_key, path, sizeof(path))))
+        /* Intentionally blank */;
+    else if (!(fp = fopen(path, "rb")))
+        rv = CKR_FUNCTION_FAILED;
+    else if (CKR_ERROR_NOLOG(rv = cache_GetSecret(secret, FALSE)) ||
+             CKR_ERROR(rv = cache_MacInit(secret, &mac)))
+        /* Intentionally blank */;
+    else if (CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, magic, sizeof(magic))) ||
+             CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, key, sizeof(key))) ||
+             CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, &object_count, sizeof(object_count))))
+        /* Intentionally blank */;
+    else if (memcmp(magic, CACHE_MAGIC, sizeof(magic)) || memcmp(key, slot->cache_key, sizeof(key)))
+        rv = CKR_FUNCTION_FAILED;
+    else
+    {
+        for (i = 0; (i < object_count) && !CKR_ERROR_NOLOG(rv); i++)
+        {
+            object = (P11_Object *)calloc(1, sizeof(P11_Object));
+            if (!object)
+            {
+                rv = CKR_HOST_MEMORY;
+                break;
+            }
+
+            /* Append so the list comes back in the order it was saved */
+            object->check = object;
+            object->prev = tail;
+            if (tail)
+                tail->next = object;
+            else
+                slot->objects = object;
+            tail = object;
+
+            if (CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, &kind, sizeof(kind))) ||
+                CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, &object->sensitive, sizeof(object->sensitive))))
+                break;
+
+            if (kind == CACHE_KIND_KEY)
+            {
+                if (!(object->msc_key = (MSCKeyInfo *)calloc(1, sizeof(MSCKeyInfo))))
+                    rv = CKR_HOST_MEMORY;
+                else
+                    rv = cache_Read(fp, mac, object->msc_key, sizeof(MSCKeyInfo));
+            }
+            else if (kind == CACHE_KIND_OBJ)
+            {
+                if (!(object->msc_obj = (MSCObjectInfo *)calloc(1, sizeof(MSCObjectInfo))))
+                    rv = CKR_HOST_MEMORY;
+                else
+                    rv = cache_Read(fp, mac, object->msc_obj, sizeof(MSCObjectInfo));
+            }
+
+            if (CKR_ERROR_NOLOG(rv) ||
+                CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, &attrib_count, sizeof(attrib_count))))
+                break;
+
+            for (j = 0; (j < attrib_count) && !CKR_ERROR_NOLOG(rv); j++)
+            {
+                CK_BBOOL token;
+
+                value = 0;
+
+                if (CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, &ck_attrib.type, sizeof(ck_attrib.type))) ||
+                    CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, &token, sizeof(token))) ||
+                    CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, &ck_attrib.ulValueLen, sizeof(ck_attrib.ulValueLen))))
+                    /* Intentionally blank */;
+                else if (ck_attrib.ulValueLen && !(value = (CK_BYTE *)malloc(ck_attrib.ulValueLen)))
+                    rv = CKR_HOST_MEMORY;
+                else if (ck_attrib.ulValueLen && CKR_ERROR_NOLOG(rv = cache_Read(fp, mac, value, ck_attrib.ulValueLen)))
+                    /* Intentionally blank */;
+                else
+                    rv = object_AddAttribute(object, ck_attrib.type, token, value, ck_attrib.ulValueLen, 0);
+
+                if (value)
+                    free(value);
+            }
+        }
+
+        /* Nothing restored is used unless the whole file authenticates */
+        if (!CKR_ERROR_NOLOG(rv) &&
+            !CKR_ERROR_NOLOG(rv = cache_MacFinal(secret, &mac, mac_value)) &&
+            ((fread(file_mac, 1, sizeof(file_mac), fp) != sizeof(file_mac)) ||
+             (fgetc(fp) != EOF) ||
+             memcmp(file_mac, mac_value, sizeof(file_mac))))
+            rv = CKR_FUNCTION_FAILED;
+
+        if (CKR_ERROR_NOLOG(rv))
+        {
+            log_Log(LOG_MED, "Object cache %s is corrupt; reading token instead", path);
+            object_FreeAllObjects(slotID, slot->objects);
+            slot->objects = 0;
+            remove(path);
+            rv = CKR_FUNCTION_FAILED;
+        }
+        else
+            log_Log(LOG_LOW, "Restored %lu objects from cache %s", object_count, path);
+    }
+
+    if (fp)
+        fclose(fp);
+
+    digest_Free(&mac);
+    memset(secret, 0x00, sizeof(secret));
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: cache_StoreObjects
+**
+** Saves the object list of a slot under the fingerprint computed by the last
+** cache_LoadObjects.  Does nothing if that call found the token uncacheable
+** or if the token has since been written to.
+**
+** Parameters:
+**  slotID - Slot number
+**
+** Returns:
+**  none
+*******************************************************************************/
+void cache_StoreObjects(CK_SLOT_ID slotID)
+{
+    CK_RV rv = CKR_OK;
+    P11_Slot *slot = &st.slots[slotID - 1];
+    P11_Object *object;
+    P11_Attrib *attrib;
+    CK_ULONG object_count = 0, attrib_count;
+    CK_BYTE kind;
+    CK_BYTE secret[CACHE_SECRET_SIZE];
+    CK_BYTE mac_value[CACHE_MAC_SIZE];
+    void *mac = 0;
+    char path[512];
+    char tmp_path[520];
+    FILE *fp;
+
+    if (!st.prefs.object_cache || !slot->cache_storable)
+        return;
+
+    slot->cache_storable = FALSE;
+
+    if (CKR_ERROR_NOLOG(cache_GetPath(0, path, sizeof(path))))
+        return;
+
+#ifndef WIN32
+    (void)mkdir(path, S_IRWXU);
+#else
+    (void)_mkdir(path);
+#endif
+
+    if (CKR_ERROR_NOLOG(cache_GetSecret(secret, TRUE)) ||
+        CKR_ERROR(cache_MacInit(secret, &mac)))
+    {
+        log_Log(LOG_MED, "Unable to set up object cache secret in %s", path);
+        digest_Free(&mac);
+        memset(secret, 0x00, sizeof(secret));
+        return;
+    }
+
+    if (CKR_ERROR_NOLOG(cache_GetPath(slot->cache_key, path, sizeof(path))))
+    {
+        digest_Free(&mac);
+        memset(secret, 0x00, sizeof(secret));
+        return;
+    }
+
+    sprintf(tmp_path, "%s.tmp", path);
+
+    if (!(fp = fopen(tmp_path, "wb")))
+    {
+        log_Log(LOG_MED, "Unable to create object cache %s", tmp_path);
+        digest_Free(&mac);
+        memset(secret, 0x00, sizeof(secret));
+        return;
+    }
+
+    for (object = slot->objects; object; object = object->next)
+        object_count++;
+
+    if (CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, CACHE_MAGIC, sizeof(CACHE_MAGIC))) ||
+        CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, slot->cache_key, P11_CACHE_KEY_SIZE)) ||
+        CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, &object_count, sizeof(object_count))))
+        /* Intentionally blank */;
+
+    for (object = slot->objects; object && !CKR_ERROR_NOLOG(rv); object = object->next)
+    {
+        kind = object->msc_key ? CACHE_KIND_KEY : (object->msc_obj ? CACHE_KIND_OBJ : CACHE_KIND_NONE);
+
+        if (CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, &kind, sizeof(kind))) ||
+            CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, &object->sensitive, sizeof(object->sensitive))))
+            break;
+
+        if (kind == CACHE_KIND_KEY)
+            rv = cache_Write(fp, mac, object->msc_key, sizeof(MSCKeyInfo));
+        else if (kind == CACHE_KIND_OBJ)
+            rv = cache_Write(fp, mac, object->msc_obj, sizeof(MSCObjectInfo));
+
+        /* object_AddAttribute prepends, so save the attributes last to first */
+        attrib_count = 0;
+        for (attrib = object->attrib; attrib && attrib->next; attrib = attrib->next)
+            attrib_count++;
+        if (attrib)
+            attrib_count++;
+
+        if (CKR_ERROR_NOLOG(rv) ||
+            CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, &attrib_count, sizeof(attrib_count))))
+            break;
+
+        for (; attrib && !CKR_ERROR_NOLOG(rv); attrib = attrib->prev)
+        {
+            if (CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, &attrib->attrib.type, sizeof(attrib->attrib.type))) ||
+                CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, &attrib->token, sizeof(attrib->token))) ||
+                CKR_ERROR_NOLOG(rv = cache_Write(fp, mac, &attrib->attrib.ulValueLen, sizeof(attrib->attrib.ulValueLen))))
+                /* Intentionally blank */;
+            else if (attrib->attrib.ulValueLen)
+                rv = cache_Write(fp, mac, attrib->attrib.pValue, attrib->attrib.ulValueLen);
+        }
+    }
+
+    if (!CKR_ERROR_NOLOG(rv) &&
+        !CKR_ERROR_NOLOG(rv = cache_MacFinal(secret, &mac, mac_value)) &&
+        (fwrite(mac_value, 1, sizeof(mac_value), fp) != sizeof(mac_value)))
+        rv = CKR_FUNCTION_FAILED;
+
+    digest_Free(&mac);
+    memset(secret, 0x00, sizeof(secret));
+
+    if (fclose(fp) || CKR_ERROR_NOLOG(rv))
+    {
+        log_Log(LOG_MED, "Unable to write object cache %s", tmp_path);
+        remove(tmp_path);
+    }
+    else
+    {
+#ifdef WIN32
+        remove(path);
+#endif
+        if (rename(tmp_path, path))
+            remove(tmp_path);
+        else
+            log_Log(LOG_LOW, "Saved %lu objects to cache %s", object_count, path);
+    }
+}
+
+/******************************************************************************
+** Function: cache_Invalidate
+**
+** Called before anything is written to a token.  Removes the cache file that
+** was loaded or saved for the token and stops the current listing from
+** being saved.
+**
+** Parameters:
+**  pConnection - Connection to the token being modified
+**
+** Returns:
+**  none
+*******************************************************************************/
+void cache_Invalidate(MSCLPTokenConnection pConnection)
+{
+    CK_ULONG i;
+    P11_Slot *slot;
+    char path[512];
+    CK_BYTE empty_key[P11_CACHE_KEY_SIZE];
+
+    memset(empty_key, 0x00, sizeof(empty_key));
+
+    for (i = 0; i < st.slot_count; i++)
+    {
+        slot = &st.slots[i];
+
+        if (&slot->conn != pConnection)
+            continue;
+
+        slot->cache_storable = FALSE;
+
+        if (memcmp(slot->cache_key, empty_key, sizeof(empty_key)) &&
+            !CKR_ERROR_NOLOG(cache_GetPath(slot->cache_key, path, sizeof(path))))
+            remove(path);
+
+        memset(slot->cache_key, 0x00, sizeof(slot->cache_key));
+        break;
+    }
+}
+
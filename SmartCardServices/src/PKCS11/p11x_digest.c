@@ -0,0 +1,333 @@
+/******************************************************************************
+**
+**  $Id$
+**
+**  Package: PKCS-11
+**  License: Same terms as the rest of the PKCS-11 module
+**  Purpose: Host-side message digesting used by the digest, sign and verify
+**           functions.  Only the resulting DigestInfo is sent to the token.
+**
+******************************************************************************/
+
+#include "cryptoki.h"
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/bn.h>
+
+/* DER encoded DigestInfo prefixes (PKCS #1 v2.1, section 9.2) */
+static const CK_BYTE digest_SHA1Prefix[] =
+{
+    0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2B, 0x0E,
+    0x03, 0x02, 0x1A, 0x05, 0x00, 0x04, 0x14
+};
+
+static const CK_BYTE digest_SHA256Prefix[] =
+{
+    0x30, 0x31, 0x30, 0x0D, 0x06, 0x09, 0x60, 0x86,
+    0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05,
+    0x00, 0x04, 0x20
+};
+
+/******************************************************************************
+** Function: digest_GetMD
+**
+** Maps a digest or hash-and-sign mechanism to its OpenSSL digest
+**
+** Parameters:
+**  mech - Mechanism type
+**
+** Returns:
+**  The EVP_MD for the mechanism or 0 if the mechanism does not hash
+*******************************************************************************/
+static const EVP_MD *digest_GetMD(CK_MECHANISM_TYPE mech)
+{
+    switch (mech)
+    {
+        case CKM_SHA_1:
+        case CKM_SHA1_RSA_PKCS:
+            return EVP_sha1();
+        case CKM_SHA256:
+        case CKM_SHA256_RSA_PKCS:
+            return EVP_sha256();
+        default:
+            return 0;
+    }
+}
+
+/******************************************************************************
+** Function: digest_IsHashMechanism
+**
+** Tells if a mechanism hashes its input on the host
+**
+** Parameters:
+**  mech - Mechanism type
+**
+** Returns:
+**  TRUE if the mechanism hashes, FALSE otherwise
+*******************************************************************************/
+CK_BBOOL digest_IsHashMechanism(CK_MECHANISM_TYPE mech)
+{
+    return (digest_GetMD(mech) != 0) ? TRUE : FALSE;
+}
+
+/******************************************************************************
+** Function: digest_Length
+**
+** Returns the size of the hash produced by a mechanism
+**
+** Parameters:
+**  mech - Mechanism type
+**
+** Returns:
+**  Hash length in bytes or 0 if the mechanism does not hash
+*******************************************************************************/
+CK_ULONG digest_Length(CK_MECHANISM_TYPE mech)
+{
+    const EVP_MD *md = digest_GetMD(mech);
+
+    return md ? (CK_ULONG)EVP_MD_size(md) : 0;
+}
+
+/******************************************************************************
+** Function: digest_Init
+**
+** Allocates and initializes an incremental digest context.  Any context
+** already in *ctx is released first.
+**
+** Parameters:
+**  mech - Mechanism type (CKM_SHA_1, CKM_SHA256 or a hash-and-sign mechanism)
+**  ctx  - Receives the new context
+**
+** Returns:
+**  CKR_MECHANISM_INVALID if the mechanism does not hash
+**  CKR_HOST_MEMORY if memory alloc failed
+**  CKR_FUNCTION_FAILED if OpenSSL could not initialize the digest
+**  CKR_OK
+*******************************************************************************/
+CK_RV digest_Init(CK_MECHANISM_TYPE mech, void **ctx)
+{
+    CK_RV rv = CKR_OK;
+    const EVP_MD *md = digest_GetMD(mech);
+    EVP_MD_CTX *md_ctx;
+
+    digest_Free(ctx);
+
+    if (!md)
+        rv = CKR_MECHANISM_INVALID;
+    else if (!(md_ctx = EVP_MD_CTX_create()))
+        rv = CKR_HOST_MEMORY;
+    else if (!EVP_DigestInit_ex(md_ctx, md, 0))
+    {
+        EVP_MD_CTX_destroy(md_ctx);
+        rv = CKR_FUNCTION_FAILED;
+    }
+    else
+        *ctx = md_ctx;
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: digest_Update
+**
+** Feeds more data into an incremental digest context
+**
+** Parameters:
+**  ctx      - Context from digest_Init
+**  data     - Data to hash
+**  data_len - Length of data
+**
+** Returns:
+**  CKR_OPERATION_NOT_INITIALIZED if there is no context
+**  CKR_FUNCTION_FAILED if OpenSSL failed
+**  CKR_OK
+*******************************************************************************/
+CK_RV digest_Update(void *ctx, CK_BYTE *data, CK_ULONG data_len)
+{
+    CK_RV rv = CKR_OK;
+
+    if (!ctx)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (data_len && !EVP_DigestUpdate((EVP_MD_CTX *)ctx, data, data_len))
+        rv = CKR_FUNCTION_FAILED;
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: digest_Final
+**
+** Finishes an incremental digest and releases the context
+**
+** Parameters:
+**  ctx     - Context from digest_Init; set to 0 on return
+**  out     - Receives the hash (must hold EVP_MAX_MD_SIZE bytes)
+**  out_len - Receives the hash length
+**
+** Returns:
+**  CKR_OPERATION_NOT_INITIALIZED if there is no context
+**  CKR_FUNCTION_FAILED if OpenSSL failed
+**  CKR_OK
+*******************************************************************************/
+CK_RV digest_Final(void **ctx, CK_BYTE *out, CK_ULONG *out_len)
+{
+    CK_RV rv = CKR_OK;
+    unsigned int len = 0;
+
+    if (!*ctx)
+        rv = CKR_OPERATION_NOT_INITIALIZED;
+    else if (!EVP_DigestFinal_ex((EVP_MD_CTX *)*ctx, out, &len))
+        rv = CKR_FUNCTION_FAILED;
+    else
+        *out_len = len;
+
+    digest_Free(ctx);
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: digest_Free
+**
+** Releases an incremental digest context (if any)
+**
+** Parameters:
+**  ctx - Context from digest_Init; set to 0 on return
+**
+** Returns:
+**  none
+*******************************************************************************/
+void digest_Free(void **ctx)
+{
+    if (*ctx)
+    {
+        EVP_MD_CTX_destroy((EVP_MD_CTX *)*ctx);
+        *ctx = 0;
+    }
+}
+
+/******************************************************************************
+** Function: digest_EncodeInfo
+**
+** Wraps a hash in the DER DigestInfo structure used by PKCS #1 v1.5 signatures
+**
+** Parameters:
+**  mech     - Hash-and-sign or digest mechanism that produced the hash
+**  hash     - Hash value
+**  hash_len - Length of hash
+**  out      - Receives the DigestInfo
+**  out_len  - In: size of out, Out: length of the DigestInfo
+**
+** Returns:
+**  CKR_MECHANISM_INVALID if the mechanism does not hash
+**  CKR_BUFFER_TOO_SMALL if out is too small
+**  CKR_OK
+*******************************************************************************/
+CK_RV digest_EncodeInfo(CK_MECHANISM_TYPE mech, CK_BYTE *hash, CK_ULONG hash_len, CK_BYTE *out, CK_ULONG *out_len)
+{
+    CK_RV rv = CKR_OK;
+    const CK_BYTE *prefix;
+    CK_ULONG prefix_len;
+
+    switch (mech)
+    {
+        case CKM_SHA_1:
+        case CKM_SHA1_RSA_PKCS:
+            prefix = digest_SHA1Prefix;
+            prefix_len = sizeof(digest_SHA1Prefix);
+            break;
+        case CKM_SHA256:
+        case CKM_SHA256_RSA_PKCS:
+            prefix = digest_SHA256Prefix;
+            prefix_len = sizeof(digest_SHA256Prefix);
+            break;
+        default:
+            prefix = 0;
+            prefix_len = 0;
+            rv = CKR_MECHANISM_INVALID;
+            break;
+    }
+
+    if (CKR_ERROR_NOLOG(rv))
+        /* Intentionally blank */;
+    else if (prefix_len + hash_len > *out_len)
+        rv = CKR_BUFFER_TOO_SMALL;
+    else
+    {
+        memcpy(out, prefix, prefix_len);
+        memcpy(out + prefix_len, hash, hash_len);
+        *out_len = prefix_len + hash_len;
+    }
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: digest_VerifyRSA
+**
+** Verifies a PKCS #1 v1.5 signature on the host using the modulus and public
+** exponent attributes of a public key (or certificate) object.
+**
+** Parameters:
+**  key      - Public key or certificate object
+**  data     - Expected signature payload (DigestInfo or raw data)
+**  data_len - Length of data
+**  sig      - Signature
+**  sig_len  - Length of signature
+**
+** Returns:
+**  CKR_KEY_TYPE_INCONSISTENT if the object has no RSA public key
+**  CKR_SIGNATURE_LEN_RANGE if the signature length does not match the key
+**  CKR_SIGNATURE_INVALID if the signature does not match
+**  CKR_HOST_MEMORY if memory alloc failed
+**  CKR_OK
+*******************************************************************************/
+CK_RV digest_VerifyRSA(P11_Object *key, CK_BYTE *data, CK_ULONG data_len, CK_BYTE *sig, CK_ULONG sig_len)
+{
+    CK_RV rv = CKR_OK;
+    P11_Attrib *modulus = 0;
+    P11_Attrib *pub_exp = 0;
+    RSA *rsa = 0;
+    BIGNUM *n = 0;
+    BIGNUM *e = 0;
+    CK_BYTE *out = 0;
+    int out_len;
+
+    if (CKR_ERROR_NOLOG(object_GetAttrib(CKA_MODULUS, key, &modulus)) ||
+        CKR_ERROR_NOLOG(object_GetAttrib(CKA_PUBLIC_EXPONENT, key, &pub_exp)))
+        rv = CKR_KEY_TYPE_INCONSISTENT;
+    else if (sig_len != modulus->attrib.ulValueLen)
+        rv = CKR_SIGNATURE_LEN_RANGE;
+    else if (!(rsa = RSA_new()) ||
+             !(n = BN_bin2bn(modulus->attrib.pValue, modulus->attrib.ulValueLen, 0)) ||
+             !(e = BN_bin2bn(pub_exp->attrib.pValue, pub_exp->attrib.ulValueLen, 0)) ||
+             !(out = (CK_BYTE *)malloc(sig_len)))
+        rv = CKR_HOST_MEMORY;
+    else
+    {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+        rsa->n = n;
+        rsa->e = e;
+#else
+        RSA_set0_key(rsa, n, e, 0);
+#endif
+        n = e = 0; /* Now owned by rsa */
+
+        out_len = RSA_public_decrypt(sig_len, sig, out, rsa, RSA_PKCS1_PADDING);
+
+        if ((out_len < 0) || ((CK_ULONG)out_len != data_len) || memcmp(out, data, data_len))
+            rv = CKR_SIGNATURE_INVALID;
+    }
+
+    if (out)
+        free(out);
+    if (n)
+        BN_free(n);
+    if (e)
+        BN_free(e);
+    if (rsa)
+        RSA_free(rsa);
+
+    return rv;
+}
+
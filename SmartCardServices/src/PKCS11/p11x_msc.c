@@ -168,6 +168,8 @@ MSC_RV msc_WriteFramework(
 {
     MSC_RV rv;
 
+    cache_Invalidate(pConnection);
+
     rv = MSCWriteFramework( 
       pConnection, 
       pInitParams 
@@ -242,6 +244,8 @@ MSC_RV msc_GenerateKeys(
 {
     MSC_RV rv;
 
+    cache_Invalidate(pConnection);
+
     rv = MSCGenerateKeys(
       pConnection,
       prvKeyNum,
@@ -265,6 +269,8 @@ MSC_RV msc_ImportKey(
 {
     MSC_RV rv;
 
+    cache_Invalidate(pConnection);
+
     rv = MSCImportKey(
       pConnection,
       keyNum,
@@ -328,7 +334,7 @@ MSC_RV msc_ComputeCrypt(
     
         if (rv != MSC_SUCCESS)
         {
-            if (CKR_ERROR(slot_ReverifyPins()))
+            if (CKR_ERROR(slot_ReverifyPins(pConnection)))
                 break;
         }
         else
@@ -488,6 +494,8 @@ MSC_RV msc_CreateObject(
 {
     MSC_RV rv;
 
+    cache_Invalidate(pConnection);
+
     rv = MSCCreateObject(
       pConnection,
       objectID,
@@ -506,6 +514,8 @@ MSC_RV msc_DeleteObject(
 {
     MSC_RV rv;
 
+    cache_Invalidate(pConnection);
+
     rv = MSCDeleteObject(
       pConnection,
       objectID,
@@ -525,6 +535,8 @@ MSC_RV msc_WriteObject(
 {
     MSC_RV rv;
 
+    cache_Invalidate(pConnection);
+
     rv = MSCWriteObject(
       pConnection,
       objectID,
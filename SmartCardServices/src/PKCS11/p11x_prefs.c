@@ -253,6 +253,21 @@ void util_ParsePreference(char *buf, CK_ULONG buf_size)
                     log_Log(LOG_HIGH, "Invalid DisableSecurity preference specified: %s", token);
             }
         }
+        else if (!strcasecmp("ObjectCache", token))
+        {
+            token = strtok_r(0, sep, &strtok_ptr);
+            if (!token)
+                P11_ERR("Config option \"ObjectCache\" failed");
+            else
+            {
+                if (!strcasecmp("True", token) || !strcasecmp("Yes", token))
+                    st.prefs.object_cache = 1;
+                else if (!strcasecmp("False", token) || !strcasecmp("No", token))
+                    st.prefs.object_cache = 0;
+                else
+                    log_Log(LOG_HIGH, "Invalid ObjectCache preference specified: %s", token);
+            }
+        }
     }
 }
 
@@ -30,6 +30,8 @@ CK_RV session_AddSession(CK_SESSION_HANDLE *phSession)
 
     *phSession = 0;
 
+    thread_MutexLock(st.session_list_lock);
+
     if (st.sessions)
     {
         st.sessions->prev = (P11_Session *)calloc(1, sizeof(P11_Session));
@@ -55,13 +57,50 @@ CK_RV session_AddSession(CK_SESSION_HANDLE *phSession)
         }
     }
 
+    thread_MutexUnlock(st.session_list_lock);
+
+    if (*phSession)
+        (void)CKR_ERROR(thread_MutexInit(&((P11_Session *)*phSession)->lock));
+
     return rv;
 }
+/******************************************************************************
+** Function: session_Destroy
+**
+** Releases the memory of a session that has been unlinked from st.sessions
+** and is no longer referenced by any entry point
+**
+** Parameters:
+**  session - Session to release
+**
+** Returns:
+**  none
+*******************************************************************************/
+static void session_Destroy(P11_Session *session)
+{
+    if (session->lock)
+        thread_MutexDestroy(session->lock);
+
+    if (session->search_attrib)
+        free(session->search_attrib);
+
+    digest_Free(&session->sign_ctx);
+    digest_Free(&session->verify_ctx);
+    digest_Free(&session->digest_ctx);
+    
+    /* Clear memory, just to be safe */
+    memset(session, 0x00, sizeof(P11_Session));
+
+    free(session);
+}
 
 /******************************************************************************
 ** Function: session_FreeSession
 **
-** Deletes/removes a session
+** Deletes/removes a session.  The caller must hold the lock of the session's
+** slot.  The session is unlinked and its handle invalidated at once; if an
+** entry point still holds a reference from session_Lock the memory is
+** released by its session_Unlock.
 **
 ** Parameters:
 **  hSession - Handle of session to remove
@@ -74,6 +113,7 @@ CK_RV session_FreeSession(CK_SESSION_HANDLE hSession)
 {
     CK_RV rv = CKR_OK;
     P11_Session *session = (P11_Session *)hSession;
+    CK_BBOOL unused;
 
     if (INVALID_SESSION)
         rv = CKR_SESSION_HANDLE_INVALID;
@@ -81,6 +121,8 @@ CK_RV session_FreeSession(CK_SESSION_HANDLE hSession)
     {
         log_Log(LOG_LOW, "Removing session: %lX", hSession);
 
+        thread_MutexLock(st.session_list_lock);
+
         if (session->prev) /* Fixme: check for head of list? st.sessions */
         {
             session->prev->next = session->next;
@@ -100,15 +142,134 @@ CK_RV session_FreeSession(CK_SESSION_HANDLE hSession)
         if (!session->prev && !session->next)
             st.sessions = 0x00;
 
-        if (session->search_attrib)
-            free(session->search_attrib);
-        
-        /* Clear memory, just to be safe */
-        memset(session, 0x00, sizeof(P11_Session));
-    
-        free(session);
+        session->prev = session->next = 0;
+        session->check = 0;
+        unused = (session->refs == 0);
+
+        thread_MutexUnlock(st.session_list_lock);
+
+        if (session->session.slotID && st.slots[session->session.slotID - 1].session_count)
+            st.slots[session->session.slotID - 1].session_count--;
+
+        if (unused)
+            session_Destroy(session);
     }
 
     return rv;
 }
 
+/******************************************************************************
+** Function: session_NextSlotSession
+**
+** Walks the sessions of a slot.  The set of sessions of a slot only changes
+** under its slot lock, so a caller holding it may pass the previous result
+** back in; other callers should only ask for the first session.
+**
+** Parameters:
+**  slotID - Slot number
+**  hAfter - Session to continue after, or 0 for the first one
+**
+** Returns:
+**  Handle of the next session of the slot, or 0 if there is none
+*******************************************************************************/
+CK_SESSION_HANDLE session_NextSlotSession(CK_ULONG slotID, CK_SESSION_HANDLE hAfter)
+{
+    P11_Session *session_l;
+
+    thread_MutexLock(st.session_list_lock);
+
+    session_l = hAfter ? ((P11_Session *)hAfter)->next : st.sessions;
+    while (session_l && (session_l->session.slotID != slotID))
+        session_l = session_l->next;
+
+    thread_MutexUnlock(st.session_list_lock);
+
+    return (CK_SESSION_HANDLE)session_l;
+}
+
+/******************************************************************************
+** Function: session_Lock
+**
+** Called by an entry point holding st.async_lock once the session handle has
+** been validated.  Takes a reference on the session and drops st.async_lock
+** (unless P11_LOCK_GLOBAL is requested) before waiting for the requested
+** slot and/or session locks, so a long card operation on one slot does not
+** hold up entry points on other slots behind st.async_lock.  The session may
+** have been closed while waiting, so it is re-validated afterwards.
+**
+** Parameters:
+**  hSession - Validated session handle
+**  locks    - P11_LOCK_SLOT, P11_LOCK_SESSION and/or P11_LOCK_GLOBAL
+**  held     - Returns the locks now held, for session_Unlock
+**
+** Returns:
+**  CKR_SESSION_CLOSED if the session was closed while waiting
+**  CKR_OK
+*******************************************************************************/
+CK_RV session_Lock(CK_SESSION_HANDLE hSession, CK_ULONG locks, CK_ULONG *held)
+{
+    CK_RV rv = CKR_OK;
+    P11_Session *session = (P11_Session *)hSession;
+
+    thread_MutexLock(st.session_list_lock);
+    session->refs++;
+    thread_MutexUnlock(st.session_list_lock);
+
+    if (!(locks & P11_LOCK_GLOBAL))
+        thread_MutexUnlock(st.async_lock);
+
+    if (locks & P11_LOCK_SLOT)
+        thread_MutexLock(st.slots[session->session.slotID - 1].lock);
+
+    if (locks & P11_LOCK_SESSION)
+        thread_MutexLock(session->lock);
+
+    *held = locks | P11_LOCK_REF;
+
+    thread_MutexLock(st.session_list_lock);
+    if (session->check != session)
+        rv = CKR_SESSION_CLOSED;
+    thread_MutexUnlock(st.session_list_lock);
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: session_Unlock
+**
+** Releases the locks and the reference returned by session_Lock.  If
+** session_Lock was never reached only st.async_lock is held and only it is
+** released.  Dropping the last reference to a closed session frees it.
+**
+** Parameters:
+**  hSession - Session handle passed to session_Lock
+**  held     - Locks held
+**
+** Returns:
+**  none
+*******************************************************************************/
+void session_Unlock(CK_SESSION_HANDLE hSession, CK_ULONG held)
+{
+    P11_Session *session = (P11_Session *)hSession;
+    CK_BBOOL unused = FALSE;
+
+    if (held & P11_LOCK_SESSION)
+        thread_MutexUnlock(session->lock);
+
+    if (held & P11_LOCK_SLOT)
+        thread_MutexUnlock(st.slots[session->session.slotID - 1].lock);
+
+    if (held & P11_LOCK_GLOBAL)
+        thread_MutexUnlock(st.async_lock);
+
+    if (held & P11_LOCK_REF)
+    {
+        thread_MutexLock(st.session_list_lock);
+        session->refs--;
+        unused = (session->refs == 0) && (session->check != session);
+        thread_MutexUnlock(st.session_list_lock);
+    }
+
+    if (unused)
+        session_Destroy(session);
+}
@@ -93,6 +93,8 @@ CK_BBOOL slot_CheckRWSOsession(CK_ULONG slotID)
     CK_BBOOL rv = FALSE;
     P11_Session *session_l;
 
+    thread_MutexLock(st.session_list_lock);
+
     session_l = st.sessions;
     while (session_l)
     {
@@ -106,6 +108,8 @@ CK_BBOOL slot_CheckRWSOsession(CK_ULONG slotID)
         session_l = session_l->next;
     }
 
+    thread_MutexUnlock(st.session_list_lock);
+
     return rv;
 }
 
@@ -149,7 +153,7 @@ CK_RV slot_EstablishConnection(CK_ULONG slotID)
             {
                 /* memset(&slot->conn, 0x00, sizeof(slot->conn)); */
                 /* memcpy(&slot->conn.tokenInfo, &token_info, sizeof(MSCTokenInfo)); */
-                st.slot_status[slotID - 1] = 0x01;
+                slot_SignalEvent(slotID);
                 log_Log(LOG_MED, "MSCEstablishConnection failed");
 
                 if ((msc_rv == MSC_TOKEN_RESET) || (msc_rv == MSC_TOKEN_REMOVED))
@@ -177,7 +181,6 @@ CK_RV slot_EstablishConnection(CK_ULONG slotID)
 CK_RV slot_ReleaseConnection(CK_ULONG slotID)
 {
     CK_RV rv = CKR_OK;
-    P11_Session *session_l;
     P11_Slot *slot;
 
     if (INVALID_SLOT)
@@ -186,16 +189,10 @@ CK_RV slot_ReleaseConnection(CK_ULONG slotID)
     {
         slot = &st.slots[slotID - 1];
         /* Don't close the connection if a session is using it */
-        /* Fixme: this could be sped up by using reference counting instead */
         log_Log(LOG_LOW, "Attempting release");
-        session_l = st.sessions;
 
-        while (session_l)
-        {
-            if (session_l->session.slotID == slotID)
-                return rv;
-            session_l = session_l->next;
-        }
+        if (slot->session_count)
+            return rv;
 
         if (slot->conn.hCard)
         {
@@ -433,6 +430,13 @@ CK_RV slot_UpdateMechanisms(CK_ULONG slotID)
                                CKF_WRAP |
                                CKF_UNWRAP;
 
+            /* Hashing is done on the host, only the DigestInfo goes to the card */
+            slot_AddMechanism(slot, CKM_SHA256_RSA_PKCS, &mech);
+            mech->info.ulMinKeySize = slot_MinRSAKeySize(temp_cap);
+            mech->info.ulMaxKeySize = slot_MaxRSAKeySize(temp_cap);
+            mech->info.flags = CKF_SIGN |
+                               CKF_VERIFY;
+
             if (!MSC_ERROR(msc_GetCapabilities(&slot->conn, MSC_TAG_CAPABLE_RSA, 
                             (MSCUChar8 *)&temp_cap, &len)))
             {
@@ -474,6 +478,12 @@ CK_RV slot_UpdateMechanisms(CK_ULONG slotID)
             }
         }
 
+        /* Digests are computed on the host regardless of card capabilities */
+        slot_AddMechanism(slot, CKM_SHA_1, &mech);
+        mech->info.flags = CKF_DIGEST;
+        slot_AddMechanism(slot, CKM_SHA256, &mech);
+        mech->info.flags = CKF_DIGEST;
+
         if (crypto_alg & MSC_SUPPORT_DSA)
         {
             log_Log(LOG_LOW, "Card supports DSA");
@@ -689,6 +699,8 @@ CK_RV slot_UpdateToken(CK_ULONG slotID)
             !MSC_ERROR(msc_ListPINs(&slot->conn, &pin_bit_mask))
             )
         {
+            thread_MutexLock(st.session_list_lock);
+
             session_l = st.sessions;
             sess_count = rw_sess_count = 0;
 
@@ -704,6 +716,8 @@ CK_RV slot_UpdateToken(CK_ULONG slotID)
                 session_l = session_l->next;
             }
 
+            thread_MutexUnlock(st.session_list_lock);
+
             util_PadStrSet(slot->token_info.label, (CK_CHAR *)slot->conn.tokenInfo.tokenName, sizeof(slot->token_info.label));
             util_PadStrSet(slot->token_info.manufacturerID, (CK_CHAR *)"Unknown MFR", sizeof(slot->token_info.manufacturerID));
             util_PadStrSet(slot->token_info.model, (CK_CHAR *)"Unknown Model", sizeof(slot->token_info.model));
@@ -803,6 +817,7 @@ CK_RV slot_UpdateSlotList()
             else for (i = 0; i < arrayLength; i++)
             {
                 memcpy(&st.slots[i].conn.tokenInfo, &tokenArray[i], sizeof(MSCTokenInfo));
+                (void)CKR_ERROR(thread_MutexInit(&st.slots[i].lock));
                 st.slot_count = i + 1;
                 log_Log(LOG_LOW, "Added reader: %s", tokenArray[i].slotName);
             }
@@ -841,7 +856,14 @@ CK_RV slot_FreeAllSlots()
     if (st.slots)
     {
         for (i = 1; i <= st.slot_count; i++)
+        {
+            thread_MutexLock(st.slots[i - 1].lock);
             slot_DisconnectSlot(i, MSC_RESET_TOKEN); /* Fixme: Don't care if this fails? */
+            thread_MutexUnlock(st.slots[i - 1].lock);
+
+            if (st.slots[i - 1].lock)
+                thread_MutexDestroy(st.slots[i - 1].lock);
+        }
 
         free(st.slots);
         log_Log(LOG_LOW, "Freed st.slots");
@@ -856,7 +878,8 @@ CK_RV slot_FreeAllSlots()
 /******************************************************************************
 ** Function: slot_DisconnectSlot
 **
-** Releases a slot and all information about any tokens in the slot.
+** Releases a slot and all information about any tokens in the slot.  The
+** caller must hold the slot lock.
 **
 ** Parameters:
 **  slotID - Slot number to release
@@ -869,7 +892,7 @@ CK_RV slot_FreeAllSlots()
 CK_RV slot_DisconnectSlot(CK_ULONG slotID, CK_ULONG action)
 {
     CK_RV rv = CKR_OK;
-    P11_Session *session_l;
+    CK_SESSION_HANDLE hSession;
     P11_Slot *slot;
 
     if (INVALID_SLOT)
@@ -877,15 +900,9 @@ CK_RV slot_DisconnectSlot(CK_ULONG slotID, CK_ULONG action)
     else
     {
         slot = &st.slots[slotID - 1];
-        session_l = st.sessions;
-
-        while (session_l)
-        {
-            if (session_l->session.slotID == slotID)
-                session_FreeSession((CK_SESSION_HANDLE)session_l);
 
-            session_l = st.sessions;
-        }
+        while ((hSession = session_NextSlotSession(slotID, 0)))
+            session_FreeSession(hSession);
 
         object_FreeAllObjects(slotID, st.slots[slotID - 1].objects);
         slot_FreeAllMechanisms(slot->mechanisms);
@@ -895,6 +912,8 @@ CK_RV slot_DisconnectSlot(CK_ULONG slotID, CK_ULONG action)
         slot_BlankTokenInfo(&slot->token_info);
 
         memset(&slot->status_info, 0x00, sizeof(slot->status_info));
+        memset(slot->cache_key, 0x00, sizeof(slot->cache_key));
+        slot->cache_storable = FALSE;
 
         if (slot->conn.hCard)
         {
@@ -912,18 +931,22 @@ CK_RV slot_DisconnectSlot(CK_ULONG slotID, CK_ULONG action)
 /******************************************************************************
 ** Function: slot_PublicMode
 **
-** Switchs all sessions of a slot to PUBLIC mode (versus USER or SO mode)
+** Switchs all sessions of a slot to PUBLIC mode (versus USER or SO mode).
+** The caller must hold the slot lock and the lock of hLocked, if any; the
+** other sessions of the slot are locked in turn while they are updated.
 **
 ** Parameters:
-**  slotID - Slot number
+**  slotID  - Slot number
+**  hLocked - Session whose lock the caller already holds, or 0
 **
 ** Returns:
 **  CKR_SLOT_ID_INVALID if slotID is invalid
 **  CKR_OK
 *******************************************************************************/
-CK_RV slot_PublicMode(CK_ULONG slotID)
+CK_RV slot_PublicMode(CK_ULONG slotID, CK_SESSION_HANDLE hLocked)
 {
     CK_RV rv = CKR_OK;
+    CK_SESSION_HANDLE hSession = 0;
     P11_Session *session_l;
 
     if (INVALID_SLOT)
@@ -932,30 +955,32 @@ CK_RV slot_PublicMode(CK_ULONG slotID)
     {
         st.slots[slotID - 1].pin_state = 0; /* Fixme: create #define for this */
 
-        session_l = st.sessions;
-        while (session_l)
+        while ((hSession = session_NextSlotSession(slotID, hSession)))
         {
-            if (session_l->session.slotID == slotID)
-            {
-                switch (session_l->session.state)
-                {
-                case CKS_RO_USER_FUNCTIONS:
-                    session_l->session.state = CKS_RO_PUBLIC_SESSION;
-                    break;
-                case CKS_RW_USER_FUNCTIONS:
-                    session_l->session.state = CKS_RW_PUBLIC_SESSION;
-                    break;
-                case CKS_RW_SO_FUNCTIONS: /* Fixme: can't really handle this one well */
-                    session_l->session.state = CKS_RO_PUBLIC_SESSION;
-                    break;
-                default:
-                    break;
-                }
+            session_l = (P11_Session *)hSession;
 
-                session_l->session.flags = (session_l->session.flags & ~CKF_RW_SESSION);
+            if (hSession != hLocked)
+                thread_MutexLock(session_l->lock);
+
+            switch (session_l->session.state)
+            {
+            case CKS_RO_USER_FUNCTIONS:
+                session_l->session.state = CKS_RO_PUBLIC_SESSION;
+                break;
+            case CKS_RW_USER_FUNCTIONS:
+                session_l->session.state = CKS_RW_PUBLIC_SESSION;
+                break;
+            case CKS_RW_SO_FUNCTIONS: /* Fixme: can't really handle this one well */
+                session_l->session.state = CKS_RO_PUBLIC_SESSION;
+                break;
+            default:
+                break;
             }
 
-            session_l = session_l->next;
+            session_l->session.flags = (session_l->session.flags & ~CKF_RW_SESSION);
+
+            if (hSession != hLocked)
+                thread_MutexUnlock(session_l->lock);
         }
     }
 
@@ -965,18 +990,21 @@ CK_RV slot_PublicMode(CK_ULONG slotID)
 /******************************************************************************
 ** Function: slot_UserMode
 **
-** Switchs all sessions of a slot to USER mode (versus PUBLIC or SO mode)
+** Switchs all sessions of a slot to USER mode (versus PUBLIC or SO mode).
+** Locking is as for slot_PublicMode.
 **
 ** Parameters:
-**  slotID - Slot number
+**  slotID  - Slot number
+**  hLocked - Session whose lock the caller already holds, or 0
 **
 ** Returns:
 **  CKR_SLOT_ID_INVALID if slotID is invalid
 **  CKR_OK
 *******************************************************************************/
-CK_RV slot_UserMode(CK_ULONG slotID)
+CK_RV slot_UserMode(CK_ULONG slotID, CK_SESSION_HANDLE hLocked)
 {
     CK_RV rv = CKR_OK;
+    CK_SESSION_HANDLE hSession = 0;
     P11_Session *session_l;
 
     if (INVALID_SLOT)
@@ -985,29 +1013,31 @@ CK_RV slot_UserMode(CK_ULONG slotID)
     {
         st.slots[slotID - 1].pin_state = 1; /* Fixme: create #define for this */
 
-        session_l = st.sessions;
-        while (session_l)
+        while ((hSession = session_NextSlotSession(slotID, hSession)))
         {
-            if (session_l->session.slotID == slotID)
-            {
-                switch (session_l->session.state)
-                {
-                case CKS_RO_PUBLIC_SESSION:
-                    object_UserMode((CK_SESSION_HANDLE)session_l);
-                    session_l->session.state = CKS_RO_USER_FUNCTIONS;
-                    break;
-                case CKS_RW_PUBLIC_SESSION:
-                    object_UserMode((CK_SESSION_HANDLE)session_l);
-                    session_l->session.state = CKS_RW_USER_FUNCTIONS;
-                    break;
-                default:
-                    break;
-                }
+            session_l = (P11_Session *)hSession;
 
-                session_l->session.flags = (session_l->session.flags | CKF_RW_SESSION);
+            if (hSession != hLocked)
+                thread_MutexLock(session_l->lock);
+
+            switch (session_l->session.state)
+            {
+            case CKS_RO_PUBLIC_SESSION:
+                object_UserMode(hSession);
+                session_l->session.state = CKS_RO_USER_FUNCTIONS;
+                break;
+            case CKS_RW_PUBLIC_SESSION:
+                object_UserMode(hSession);
+                session_l->session.state = CKS_RW_USER_FUNCTIONS;
+                break;
+            default:
+                break;
             }
 
-            session_l = session_l->next;
+            session_l->session.flags = (session_l->session.flags | CKF_RW_SESSION);
+
+            if (hSession != hLocked)
+                thread_MutexUnlock(session_l->lock);
         }
     }
 
@@ -1045,56 +1075,93 @@ CK_RV slot_TokenPresent(CK_ULONG slotID)
 }
 
 /******************************************************************************
-** Function: slot_TokenChanged
+** Function: slot_SignalEvent
 **
-** Master routine that checks the status of a token.  This calls
-** slot_UpdateToken and slot_UpdateMechanisms to update information about the
-** current token.  If a token status has not changed then this function does
-** not do anything.
+** Records a token event on a slot by bumping its event generation and then
+** the global generation.  Safe to call from the slot watcher thread without
+** holding st.async_lock.
 **
 ** Parameters:
+**  slotID - Slot that changed
+**
+** Returns:
 **  none
+*******************************************************************************/
+void slot_SignalEvent(CK_ULONG slotID)
+{
+    if (!INVALID_SLOT && st.slot_event_gen)
+    {
+        P11_ATOMIC_INC(st.slot_event_gen[slotID - 1]);
+        P11_ATOMIC_INC(st.event_gen);
+    }
+}
+
+/******************************************************************************
+** Function: slot_UpdateChangedTokens
+**
+** Slow path of slot_TokenChanged.  Tears down and rereads every slot whose
+** event generation moved since it was last handled.  The caller must hold
+** st.async_lock.
+**
+** Parameters:
+**  watched - Whether the slot watcher thread is delivering events
 **
 ** Returns:
 **  CKR_CRYPTOKI_NOT_INITIALIZED
+**  CKR_DEVICE_REMOVED
 **  CKR_OK
 *******************************************************************************/
-CK_RV slot_TokenChanged()
+static CK_RV slot_UpdateChangedTokens(CK_ULONG watched)
 {
     CK_RV rv = CKR_OK;
     CK_ULONG i;
+    CK_ULONG gen;
     P11_Session *sess;
 
-    sess = st.sessions;
-    log_Log(LOG_LOW, "Active session list:");
-    while (sess)
-    {
-        log_Log(LOG_LOW, "Session ID: %X", sess);
-        sess = sess->next;
-    }
-
     if (!st.initialized)
         rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-    else if (!st.slot_status || !st.slots)
-        rv = CKR_FUNCTION_FAILED;
+    else if (watched && (P11_ATOMIC_GET(st.event_gen) == st.seen_event_gen))
+        /* Another thread handled the event first */;
     else
+    {
+        thread_MutexLock(st.session_list_lock);
+        sess = st.sessions;
+        log_Log(LOG_LOW, "Active session list:");
+        while (sess)
+        {
+            log_Log(LOG_LOW, "Session ID: %X", sess);
+            sess = sess->next;
+        }
+        thread_MutexUnlock(st.session_list_lock);
+
+        /* Read before the slots so events arriving meanwhile are not lost */
+        st.seen_event_gen = P11_ATOMIC_GET(st.event_gen);
+
         for (i = 0; i < st.slot_count; i++)
         {
             if (!st.prefs.threaded && !(st.slots[i].slot_info.flags & CKF_TOKEN_PRESENT))
             {
                 slot_UpdateSlot(i + 1);
                 if ((st.slots[i].slot_info.flags & CKF_TOKEN_PRESENT))
-                    st.slot_status[i] = 0x01;
+                    slot_SignalEvent(i + 1);
             }
 
+            /* Without a watcher thread the token has to be polled for removal */
+            if (!watched && st.slots[i].conn.hCard && msc_IsTokenMoved(&st.slots[i].conn))
+                slot_SignalEvent(i + 1);
+
             /* Old code, may still be useful; handles reset differently
-            if (st.slot_status[i] || (st.slots[i].conn.hCard &&
+            if (st.slot_event_gen[i] != st.slot_seen_gen[i] || (st.slots[i].conn.hCard &&
                 (msc_IsTokenReset(&st.slots[i].conn) || msc_IsTokenMoved(&st.slots[i].conn))))
             */
 
-            if (st.slot_status[i] || (st.slots[i].conn.hCard &&
-                msc_IsTokenMoved(&st.slots[i].conn)))
+            gen = P11_ATOMIC_GET(st.slot_event_gen[i]);
+
+            if (gen != st.slot_seen_gen[i])
             {
+                /* Wait for in-flight card I/O on this slot before tearing it down */
+                thread_MutexLock(st.slots[i].lock);
+
                 if (st.slots[i].conn.hCard)
                     msc_ClearReset(&st.slots[i].conn);
 
@@ -1110,12 +1177,63 @@ CK_RV slot_TokenChanged()
                     (void)CKR_ERROR(slot_EndTransaction(i + 1, MSC_LEAVE_TOKEN));
                 }
     
-                st.slot_status[i] = 0x00;
+                st.slot_seen_gen[i] = gen;
 
                 if (st.slots[i].conn.hCard)
                     rv = CKR_DEVICE_REMOVED;
+
+                thread_MutexUnlock(st.slots[i].lock);
             }
         }
+    }
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: slot_TokenChanged
+**
+** Master routine that checks the status of a token.  This calls
+** slot_UpdateToken and slot_UpdateMechanisms to update information about the
+** current token.  If a token status has not changed then this function does
+** not do anything.
+**
+** When the slot watcher thread is running it is the only source of token
+** events, so the common case is a single comparison of the global event
+** generation and no traffic to the resource manager.
+**
+** The caller must not hold st.async_lock.  The fast path reads both
+** generations atomically and takes no lock; st.async_lock is only taken when
+** an event is pending, and the generation is checked again under it since
+** another thread may have handled the event in the meantime.  Entry points
+** take st.async_lock afterwards to validate their handle, so a slot torn down
+** between the two just fails that validation, as it would had the event
+** arrived after the check.
+**
+** Parameters:
+**  none
+**
+** Returns:
+**  CKR_CRYPTOKI_NOT_INITIALIZED
+**  CKR_OK
+*******************************************************************************/
+CK_RV slot_TokenChanged()
+{
+    CK_RV rv = CKR_OK;
+    CK_ULONG watched = st.prefs.threaded && st.create_threads;
+
+    if (!st.initialized)
+        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
+    else if (!st.slot_event_gen || !st.slot_seen_gen || !st.slots)
+        rv = CKR_FUNCTION_FAILED;
+    else if (watched && (P11_ATOMIC_GET(st.event_gen) == P11_ATOMIC_GET(st.seen_event_gen)))
+        /* No token events since the last check */;
+    else
+    {
+        thread_MutexLock(st.async_lock);
+        rv = slot_UpdateChangedTokens(watched);
+        thread_MutexUnlock(st.async_lock);
+    }
 
     return rv;
 }
@@ -1145,26 +1263,30 @@ void slot_BlankTokenInfo(CK_TOKEN_INFO *token_info)
 /******************************************************************************
 ** Function: slot_ReverifyPins()
 **
-** Reverifies cached PIN's.  If any cached PIN fails to verify then this will
-** kill that PIN so that it won't be used again.  This is to prevent the
-** caching mechanism from inadvertantly locking a token.
+** Reverifies cached PIN's on the token behind a connection.  If any cached PIN
+** fails to verify then this will kill that PIN so that it won't be used again.
+** This is to prevent the caching mechanism from inadvertantly locking a token.
+** The caller must hold the lock of the slot owning the connection.
 **
 ** Parameters:
-**  none
+**  pConnection - Connection whose operation failed
 **
 ** Returns:
 **  Error from slot_VerifyPIN
 **  CKR_OK
 *******************************************************************************/
-CK_RV slot_ReverifyPins()
+CK_RV slot_ReverifyPins(MSCLPTokenConnection pConnection)
 {
     CK_RV rv = CKR_OK;
     CK_ULONG i;
 
-    log_Log(LOG_LOW, "Reverifying all cached PIN's");
+    log_Log(LOG_LOW, "Reverifying cached PIN's");
 
     for (i = 0; i < st.slot_count; i++)
     {
+        if (&st.slots[i].conn != pConnection)
+            continue;
+
         if (st.slots[i].conn.hCard && msc_IsTokenReset(&st.slots[i].conn))
         {
             msc_ClearReset(&st.slots[i].conn);
@@ -1193,7 +1315,10 @@ CK_RV slot_ReverifyPins()
                     memset(st.slots[i].pins[CKU_USER].pin, 0x00, sizeof(st.slots[i].pins[CKU_USER].pin));
                 }
                 else
-                    slot_UserMode(i + 1);
+                    /* Sessions are still in USER mode from C_Login, only the
+                       card forgot the PIN; the caller holds a session lock
+                       that slot_UserMode would not know about */
+                    st.slots[i].pin_state = 1;
             }
         }
     }
@@ -1201,3 +1326,56 @@ CK_RV slot_ReverifyPins()
     return rv;
 }
 
+/******************************************************************************
+** Function: slot_Lock
+**
+** Slot flavour of session_Lock for entry points that take a slot ID.  Called
+** with st.async_lock held; drops st.async_lock (unless P11_LOCK_GLOBAL is
+** requested) and then waits for the slot lock.  Slots are never freed while
+** the library is initialized, but the token may change while waiting, so the
+** caller has to work from the slot's state as found under the slot lock.
+**
+** Parameters:
+**  slotID - Validated slot number
+**  locks  - P11_LOCK_SLOT and/or P11_LOCK_GLOBAL
+**  held   - Returns the locks now held, for slot_Unlock
+**
+** Returns:
+**  CKR_OK
+*******************************************************************************/
+CK_RV slot_Lock(CK_ULONG slotID, CK_ULONG locks, CK_ULONG *held)
+{
+    CK_RV rv = CKR_OK;
+
+    if (!(locks & P11_LOCK_GLOBAL))
+        thread_MutexUnlock(st.async_lock);
+
+    if (locks & P11_LOCK_SLOT)
+        thread_MutexLock(st.slots[slotID - 1].lock);
+
+    *held = locks;
+
+    return rv;
+}
+
+/******************************************************************************
+** Function: slot_Unlock
+**
+** Releases the locks returned by slot_Lock
+**
+** Parameters:
+**  slotID - Slot number passed to slot_Lock
+**  held   - Locks held
+**
+** Returns:
+**  none
+*******************************************************************************/
+void slot_Unlock(CK_ULONG slotID, CK_ULONG held)
+{
+    if (held & P11_LOCK_SLOT)
+        thread_MutexUnlock(st.slots[slotID - 1].lock);
+
+    if (held & P11_LOCK_GLOBAL)
+        thread_MutexUnlock(st.async_lock);
+}
+
@@ -30,13 +30,18 @@ P11_State st = { 0,                             /* initialized             */
                    P11_DEFAULT_PRK_ATTRIB_OBJ_SIZE,  /* prefs.prvkey_attrib_size*/
                    P11_DEFAULT_ATTRIB_OBJ_SIZE,      /* prefs.data_attrib_size  */
                    0,                                /* prefs.disable_security  */
+                   0,                                /* prefs.object_cache      */
                    P11_DEFAULT_LOG_FILENAME },       /* prefs.log_filename      */
                  0,                             /* slots                   */ 
                  0,                             /* slot_count              */
                  0,                             /* sessions                */
-                 0,                             /* slot_status             */
+                 0,                             /* slot_event_gen          */
+                 0,                             /* slot_seen_gen           */
+                 0,                             /* event_gen               */
+                 0,                             /* seen_event_gen          */
                  0,                             /* log_lock                */
                  0,                             /* async_lock              */
+                 0,                             /* session_list_lock       */
                  0,                             /* native_locks            */
                  0                              /* create_threads          */
                };
@@ -96,6 +101,12 @@ CK_RV state_Free()
             free(st.async_lock);
             st.async_lock = 0;
         }
+
+        if (st.session_list_lock)
+        {
+            thread_MutexDestroy(st.session_list_lock);
+            st.session_list_lock = 0;
+        }
     
         if (st.prefs.threaded)
             thread_Finalize();
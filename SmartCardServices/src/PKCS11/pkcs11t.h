@@ -546,6 +546,9 @@ typedef CK_ULONG          CK_MECHANISM_TYPE;
 #define CKM_RSA_PKCS_PSS               0x0000000D
 #define CKM_SHA1_RSA_PKCS_PSS          0x0000000E
 
+/* CKM_SHA256_RSA_PKCS is new for v2.20 */
+#define CKM_SHA256_RSA_PKCS            0x00000040
+
 #define CKM_DSA_KEY_PAIR_GEN           0x00000010
 #define CKM_DSA                        0x00000011
 #define CKM_DSA_SHA1                   0x00000012
@@ -616,6 +619,9 @@ typedef CK_ULONG          CK_MECHANISM_TYPE;
 #define CKM_SHA_1_HMAC                 0x00000221
 #define CKM_SHA_1_HMAC_GENERAL         0x00000222
 
+/* CKM_SHA256 is new for v2.20 */
+#define CKM_SHA256                     0x00000250
+
 /* CKM_RIPEMD128, CKM_RIPEMD128_HMAC, 
  * CKM_RIPEMD128_HMAC_GENERAL, CKM_RIPEMD160, CKM_RIPEMD160_HMAC,
  * and CKM_RIPEMD160_HMAC_GENERAL are new for v2.10 */
@@ -0,0 +1,268 @@
+/******************************************************************************
+**
+**  $Id$
+**
+**  Package: PKCS-11
+**  License: Same terms as the rest of the PKCS-11 module
+**  Purpose: Multi-threaded test and benchmark of session_Lock/session_Unlock.
+**           Links the real p11x_session.c and p11x_thread.c against a fake
+**           two slot state, without any card or resource manager.
+**
+**           Threads on slot 1 hold their slot lock for a simulated card
+**           operation while threads on slot 2 only do host work.  The time
+**           slot 2 entry points take to get their locks is measured with the
+**           current protocol (st.async_lock released before waiting) and with
+**           the previous one (waiting for the slot lock while holding
+**           st.async_lock), which lets slot 1's queue stall every other entry
+**           point.  A test closes a session while another thread is waiting
+**           to lock it.
+**
+******************************************************************************/
+
+#include "cryptoki.h"
+#include "thread_generic.h"
+#include <sys/time.h>
+#include <unistd.h>
+
+#define CARD_THREADS    4       /* Entry points queued on slot 1    */
+#define HOST_THREADS    4       /* Entry points on slot 2           */
+#define CARD_OP_USEC    2000    /* Simulated card I/O per operation */
+#define HOST_PAUSE_USEC 100     /* Pause between slot 2 operations  */
+#define RUN_USEC        1000000
+
+P11_State st;
+
+static int stop;
+static volatile int blocking_mode;
+static CK_ULONG host_ops;
+static CK_ULONG host_wait_usec;
+static CK_ULONG host_max_usec;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static CK_ULONG now_usec()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Dependencies of p11x_session.c and p11x_thread.c */
+void log_Log(CK_ULONG level, char *format, ...) { }
+void digest_Free(void **ctx) { }
+CK_RV error_LogCmd(CK_RV err, CK_RV cond, CK_CHAR *file, CK_LONG line, char *(*stringifyFn)(CK_RV)) { return err; }
+char *error_Stringify(CK_RV rv) { return ""; }
+int SYS_MutexInit(PCSCLITE_MUTEX_T m) { return pthread_mutex_init(m, 0); }
+int SYS_MutexDestroy(PCSCLITE_MUTEX_T m) { return pthread_mutex_destroy(m); }
+int SYS_MutexLock(PCSCLITE_MUTEX_T m) { return pthread_mutex_lock(m); }
+int SYS_MutexUnLock(PCSCLITE_MUTEX_T m) { return pthread_mutex_unlock(m); }
+
+/* Entry point skeleton, as in C_SignInit */
+static CK_RV enter(CK_SESSION_HANDLE hSession, CK_ULONG locks, CK_ULONG *held)
+{
+    CK_RV rv;
+
+    *held = P11_LOCK_GLOBAL;
+    thread_MutexLock(st.async_lock);
+
+    if (INVALID_SESSION)
+        return CKR_SESSION_HANDLE_INVALID;
+
+    if (!blocking_mode)
+        return session_Lock(hSession, locks, held);
+
+    /* Previous protocol: take the slot and session locks first */
+    rv = session_Lock(hSession, locks | P11_LOCK_GLOBAL, held);
+    thread_MutexUnlock(st.async_lock);
+    *held &= ~P11_LOCK_GLOBAL;
+
+    return rv;
+}
+
+static void *card_thread(void *arg)
+{
+    CK_SESSION_HANDLE hSession = (CK_SESSION_HANDLE)arg;
+    CK_ULONG held;
+
+    while (!P11_ATOMIC_GET(stop))
+    {
+        if (!CKR_ERROR(enter(hSession, P11_LOCK_SLOT | P11_LOCK_SESSION, &held)))
+            usleep(CARD_OP_USEC);
+        session_Unlock(hSession, held);
+    }
+
+    return 0;
+}
+
+static void *host_thread(void *arg)
+{
+    CK_SESSION_HANDLE hSession = (CK_SESSION_HANDLE)arg;
+    CK_ULONG held;
+    CK_ULONG start, wait;
+
+    while (!P11_ATOMIC_GET(stop))
+    {
+        start = now_usec();
+        if (!CKR_ERROR(enter(hSession, P11_LOCK_SESSION, &held)))
+        {
+            wait = now_usec() - start;
+
+            pthread_mutex_lock(&stats_lock);
+            host_ops++;
+            host_wait_usec += wait;
+            if (wait > host_max_usec)
+                host_max_usec = wait;
+            pthread_mutex_unlock(&stats_lock);
+        }
+        session_Unlock(hSession, held);
+
+        usleep(HOST_PAUSE_USEC);
+    }
+
+    return 0;
+}
+
+static CK_SESSION_HANDLE open_session(CK_SLOT_ID slotID)
+{
+    CK_SESSION_HANDLE hSession;
+
+    if (CKR_ERROR(session_AddSession(&hSession)))
+        exit(1);
+
+    ((P11_Session *)hSession)->session.slotID = slotID;
+    st.slots[slotID - 1].session_count++;
+
+    return hSession;
+}
+
+static void run(int blocking)
+{
+    pthread_t threads[CARD_THREADS + HOST_THREADS];
+    CK_SESSION_HANDLE sessions[CARD_THREADS + HOST_THREADS];
+    CK_ULONG held;
+    int i;
+
+    blocking_mode = blocking;
+    stop = 0;
+    host_ops = host_wait_usec = host_max_usec = 0;
+
+    for (i = 0; i < CARD_THREADS + HOST_THREADS; i++)
+    {
+        sessions[i] = open_session(i < CARD_THREADS ? 1 : 2);
+        pthread_create(&threads[i], 0, i < CARD_THREADS ? card_thread : host_thread, (void *)sessions[i]);
+    }
+
+    usleep(RUN_USEC);
+    P11_ATOMIC_INC(stop);
+
+    for (i = 0; i < CARD_THREADS + HOST_THREADS; i++)
+    {
+        pthread_join(threads[i], 0);
+
+        thread_MutexLock(st.async_lock);
+        session_Lock(sessions[i], P11_LOCK_SLOT, &held);
+        session_FreeSession(sessions[i]);
+        session_Unlock(sessions[i], held);
+    }
+
+    printf("  %s %7lu ops, %6.1f us mean wait, %6lu us max wait\n",
+           blocking ? "waiting under st.async_lock:" : "st.async_lock released:     ",
+           host_ops, host_ops ? (double)host_wait_usec / host_ops : 0.0, host_max_usec);
+}
+
+static CK_SESSION_HANDLE waiter_session;
+static CK_RV waiter_rv;
+
+static void *waiter_thread(void *arg)
+{
+    CK_ULONG held;
+
+    waiter_rv = enter(waiter_session, P11_LOCK_SLOT | P11_LOCK_SESSION, &held);
+    session_Unlock(waiter_session, held);
+
+    return 0;
+}
+
+/* Closes a session while another entry point waits for its slot lock */
+static int test_close_while_waiting()
+{
+    CK_SESSION_HANDLE hOwner = open_session(1);
+    CK_ULONG held;
+    pthread_t waiter;
+    int failed = 0;
+
+    blocking_mode = 0;
+    waiter_session = open_session(1);
+
+    thread_MutexLock(st.async_lock);
+    session_Lock(hOwner, P11_LOCK_SLOT, &held);
+
+    pthread_create(&waiter, 0, waiter_thread, 0);
+    usleep(100000);
+
+    /* The waiter must have released st.async_lock; only try for it, since
+       blocking on it while holding a slot lock would invert the lock order */
+    if (pthread_mutex_trylock((PCSCLITE_MUTEX_T)st.async_lock))
+    {
+        printf("FAIL: st.async_lock held while waiting for a slot\n");
+        failed = 1;
+    }
+    else
+        pthread_mutex_unlock((PCSCLITE_MUTEX_T)st.async_lock);
+
+    /* As slot_DisconnectSlot would on token removal */
+    session_FreeSession(waiter_session);
+
+    if (session_NextSlotSession(1, 0) != hOwner || session_NextSlotSession(1, hOwner))
+    {
+        printf("FAIL: closed session still listed\n");
+        failed = 1;
+    }
+
+    session_FreeSession(hOwner);
+    session_Unlock(hOwner, held);
+    pthread_join(waiter, 0);
+
+    if (waiter_rv != CKR_SESSION_CLOSED)
+    {
+        printf("FAIL: waiter got 0x%lX instead of CKR_SESSION_CLOSED\n", waiter_rv);
+        failed = 1;
+    }
+
+    if (st.sessions)
+    {
+        printf("FAIL: session list not empty\n");
+        failed = 1;
+    }
+
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int failed;
+
+    st.prefs.threaded = 1;
+    st.native_locks = 1;
+    st.slot_count = 2;
+    st.slots = (P11_Slot *)calloc(st.slot_count, sizeof(P11_Slot));
+
+    thread_Initialize();
+    thread_MutexInit(&st.async_lock);
+    thread_MutexInit(&st.session_list_lock);
+    thread_MutexInit(&st.slots[0].lock);
+    thread_MutexInit(&st.slots[1].lock);
+
+    failed = test_close_while_waiting();
+    printf("close while waiting: %s\n", failed ? "FAIL" : "ok");
+
+    if (argc > 1 && !strcmp(argv[1], "-bench"))
+    {
+        printf("slot 2 lock waits over %d s, %d threads queued on a %d us card op on slot 1:\n",
+               RUN_USEC / 1000000, CARD_THREADS, CARD_OP_USEC);
+        run(1);
+        run(0);
+    }
+
+    return failed;
+}
@@ -503,6 +503,11 @@ void Application::getDevices( void ) {
 
 			unsigned char ucDeviceId = d->getDeviceID( );
 
+            if( ucDeviceId >= m_Slots.size( ) ) {
+
+                m_Slots.resize( ucDeviceId + 1 );
+            }
+
             m_Slots[ ucDeviceId ].reset( new Slot( d ) );
 		}
 	}
@@ -522,6 +527,11 @@ void Application::addSlot( const boost::shared_ptr< Device >& a_pDevice ) {
 
     unsigned char ucDeviceId = a_pDevice->getDeviceID( );
 
+    if( ucDeviceId >= m_Slots.size( ) ) {
+
+        m_Slots.resize( ucDeviceId + 1 );
+    }
+
     m_Slots[ ucDeviceId ].reset( new Slot( a_pDevice ) );
 
     m_Slots[ ucDeviceId ]->setEvent( true, ucDeviceId );
@@ -530,19 +540,25 @@ void Application::addSlot( const boost::shared_ptr< Device >& a_pDevice ) {
 }
 
 
-/*
+/* The third byte of the session handle is the identifier of the slot owning the session (see Slot::computeSessionHandle)
 */
 const boost::shared_ptr< Slot >& Application::getSlotFromSession( const CK_SESSION_HANDLE& a_hSession ) {
 
-	BOOST_FOREACH( boost::shared_ptr< Slot >& s, m_Slots ) {
-	
-		if( s.get( ) && s->isSessionOwner( a_hSession ) ) {
+    size_t ulSlotId = ( a_hSession >> 16 ) & 0xFF;
 
-			return s;
-		}	
-	}
+    if( ( a_hSession >> 24 ) || ( ulSlotId >= m_Slots.size( ) ) ) {
+
+        throw PKCS11Exception( CKR_SESSION_HANDLE_INVALID );
+    }
+
+    boost::shared_ptr< Slot >& s = m_Slots[ ulSlotId ];
 
-	throw PKCS11Exception( CKR_SESSION_HANDLE_INVALID );
+    if( !s.get( ) || !s->isSessionOwner( a_hSession ) ) {
+
+        throw PKCS11Exception( CKR_SESSION_HANDLE_INVALID );
+    }
+
+    return s;
 }
 
 
@@ -28,11 +28,9 @@
 #include "DeviceMonitor.hpp"
 #include "IDeviceMonitorListener.hpp"
 #include "Slot.hpp"
-#include <boost/array.hpp>
+#include <vector>
 
 
-const int g_iMaxSlot = 5;
-
 class DeviceMonitor;
 class Device;
 class Slot;
@@ -44,7 +42,9 @@ class Application : public IDeviceMonitorListener {
 
 public:
 
-	typedef boost::array< boost::shared_ptr< Slot >, g_iMaxSlot > ARRAY_SLOTS;
+	// The slot identifier is the identifier of the device it is built on.
+	// The array grows with the device list of the monitor.
+	typedef std::vector< boost::shared_ptr< Slot > > ARRAY_SLOTS;
 
 	Application( );
 
@@ -26,6 +26,7 @@
 #include <boost/thread/condition_variable.hpp>
 #include <vector>
 #include <string>
+#include <set>
 #include "Log.hpp"
 #include "DeviceMonitor.hpp"
 
@@ -60,6 +61,8 @@ DeviceMonitor::DeviceMonitor( ) {
 
     m_stEmptyDevice = "empty";
 
+    m_aDevices.resize( g_iMaxReader );
+
     unsigned char ucDeviceID = 0;
 
     BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
@@ -101,29 +104,21 @@ void DeviceMonitor::getDevicesStates( const SCARDCONTEXT& h ) {
 
     getDevicesList( h, vDevices );
 
-    // Build an SCARD_READERSTATE array for all seen devices
-    SCARD_READERSTATE aReaderStates[ g_iMaxReader ];
-
-    memset( aReaderStates, 0, sizeof( aReaderStates ) );
-
-    unsigned char j = 0;
-
-    size_t m = vDevices.size( );
+    if( vDevices.empty( ) ) {
 
-    BOOST_FOREACH( SCARD_READERSTATE &scr, aReaderStates ) {
+        return;
+    }
 
-        memset( &scr, 0, sizeof( SCARD_READERSTATE ) );
+    // Build an SCARD_READERSTATE array for all seen devices
+    DWORD j = (DWORD)vDevices.size( );
 
-        if( j < m ) {
+    std::vector< SCARD_READERSTATE > aReaderStates( j );
 
-            aReaderStates[ j ].szReader = vDevices.at( j ).c_str( );
+    memset( &aReaderStates[ 0 ], 0, j * sizeof( SCARD_READERSTATE ) );
 
-            ++j;
+    for( DWORD i = 0 ; i < j ; ++i ) {
 
-        } else {
-         
-            break;
-        }
+        aReaderStates[ i ].szReader = vDevices.at( i ).c_str( );
     }
 
     // Query the status for all known devices
@@ -151,8 +146,6 @@ void DeviceMonitor::getDevicesStates( const SCARDCONTEXT& h ) {
     }
 
     // Create inner device objects
-    j = 0;
-
     BOOST_FOREACH( SCARD_READERSTATE &scr, aReaderStates ) {
 
         // If he reader exists
@@ -160,10 +153,8 @@ void DeviceMonitor::getDevicesStates( const SCARDCONTEXT& h ) {
 
             scr.dwCurrentState = scr.dwEventState;
 
-            addReader( scr, j );
+            addReader( scr );
         }
-
-        ++j;
     }
 }
 
@@ -292,69 +283,60 @@ void DeviceMonitor::getDevicesList( const SCARDCONTEXT& h, std::vector< std::str
 
 /*
 */
-void DeviceMonitor::getReader( SCARD_READERSTATE& scr ) {
-
-    BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
+void DeviceMonitor::removeReader( const unsigned char& a_ucDeviceID ) {
 
-        if( d.get( ) && ( 0 == d->getReaderName( ).compare( scr.szReader ) ) ) {
+    if( a_ucDeviceID >= m_aDevices.size( ) ) {
 
-            //Log::log( "   ===> Update reader <%s>\n", scr.szReader );
+        return;
+    }
 
-            d->put( scr );
+    boost::shared_ptr< Device >& d = m_aDevices[ a_ucDeviceID ];
 
-            return;
-        }
-    }	
-}
+    if( d.get( ) ) {
 
+        Log::log( "DeviceMonitor::removeReader - <%s> - id <%d>", d->getReaderName( ).c_str( ), a_ucDeviceID );
+    }
 
-/*
-*/
-void DeviceMonitor::updateReader( const SCARD_READERSTATE& scr ) {
+    SCARD_READERSTATE s;
 
-    BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
+    memset( &s, 0, sizeof( SCARD_READERSTATE ) );
 
-        if( d.get( ) && ( 0 == d->getReaderName( ).compare( scr.szReader ) ) ) {
+    s.szReader = m_stEmptyDevice.c_str( );
 
-            //Log::log( "   ===> Update reader <%s>\n", scr.szReader );
+    s.dwCurrentState = SCARD_STATE_EMPTY;
 
-            d->update( scr );
+    s.dwEventState = SCARD_STATE_EMPTY;
 
-            return;
-        }
-    }	
+    d.reset( new Device( s, a_ucDeviceID ) );
 }
 
 
-/*
+/* Rebuild the reader states buffer from the device list. The first cell (Plug&Play notification) is kept
 */
-void DeviceMonitor::removeReader( LPCSTR s ) {
+void DeviceMonitor::getReaderStates( std::vector< SCARD_READERSTATE >& a_ReaderStates, std::vector< unsigned char >& a_ReaderDeviceIDs ) {
 
-    unsigned char ucDeviceID = 0;
-
-    BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
+    a_ReaderStates.resize( 1 );
 
-        if( d.get( ) && ( 0 == d->getReaderName( ).compare( s ) ) ) {
+    a_ReaderDeviceIDs.resize( 1 );
 
-            Log::log( "DeviceMonitor::removeReader - <%s> - id <%d>", s, ucDeviceID );
+    unsigned char ucDeviceID = 0;
 
-            SCARD_READERSTATE s;
+    BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
 
-            memset( &s, 0, sizeof( SCARD_READERSTATE ) );
+        // Ignore empty device cell
+        if( d.get( ) && d->getReaderName( ).compare( m_stEmptyDevice ) ) {
 
-            s.szReader = m_stEmptyDevice.c_str( );
+            a_ReaderStates.push_back( SCARD_READERSTATE( ) );
 
-            s.dwCurrentState = SCARD_STATE_EMPTY;
+            d->put( a_ReaderStates.back( ) );
 
-            s.dwEventState = SCARD_STATE_EMPTY;
+            a_ReaderDeviceIDs.push_back( ucDeviceID );
 
-            d.reset( new Device( s, ucDeviceID ) );
-
-            return;
+            Log::log( "DeviceMonitor::getReaderStates - Prepare to poll reader <%s>", a_ReaderStates.back( ).szReader );
         }
 
         ++ucDeviceID;
-    }	
+    }
 }
 
 
@@ -395,44 +377,57 @@ void DeviceMonitor::addReader( const SCARDCONTEXT& h, const std::string& a_stDev
 
     scr.dwCurrentState = scr.dwEventState;
 
-    unsigned char ucDeviceID = 0;
+    addReader( scr );
+}
 
-    BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
 
-        if( d.get( ) && ( 0 == d->getReaderName( ).compare( m_stEmptyDevice ) ) ) {
+/*
+*/
+void DeviceMonitor::addReader( const SCARD_READERSTATE& a_State ) {
 
-            Log::log( "DeviceMonitor::addReader - <%s> - id <%d>", a_stDeviceName.c_str( ), ucDeviceID );
+    unsigned char ucDeviceID = 0;
 
-            d.reset( new Device( scr, ucDeviceID ) );
+    if( !getFreeDeviceID( ucDeviceID ) ) {
 
-            /*if( SCARD_STATE_PRESENT & scr.dwEventState ) {
+        Log::log( "DeviceMonitor::addReader - <%s> - No more device identifier available", a_State.szReader );
 
-                d->addMiniDriver( );
-            }*/
+        return;
+    }
 
-            break;
-        }
+    Log::log( "DeviceMonitor::addReader - <%s> - id <%d>", a_State.szReader, ucDeviceID );
 
-        ++ucDeviceID;
-    }
+    m_aDevices[ ucDeviceID ].reset( new Device( a_State, ucDeviceID ) );
 }
 
 
-/*
+/* Return the first empty device cell. A new cell is appended when all the cells are used
 */
-void DeviceMonitor::addReader( const SCARD_READERSTATE& a_State, const unsigned char& a_ucDeviceID ) {
+bool DeviceMonitor::getFreeDeviceID( unsigned char& a_ucDeviceID ) {
+
+    unsigned char ucDeviceID = 0;
 
     BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
 
         if( d.get( ) && ( 0 == d->getReaderName( ).compare( m_stEmptyDevice ) ) ) {
 
-            Log::log( "DeviceMonitor::addReader - <%s> - id <%d>", a_State.szReader, a_ucDeviceID );
-
-            d.reset( new Device( a_State, a_ucDeviceID ) );
+            a_ucDeviceID = ucDeviceID;
 
-            return;
+            return true;
         }
+
+        ++ucDeviceID;
+    }
+
+    if( m_aDevices.size( ) >= (size_t)g_iMaxDeviceID ) {
+
+        return false;
     }
+
+    a_ucDeviceID = (unsigned char)m_aDevices.size( );
+
+    m_aDevices.push_back( boost::shared_ptr< Device >( ) );
+
+    return true;
 }
 
 
@@ -503,49 +498,6 @@ void DeviceMonitor::addSmartCard( const std::string& a_stReaderName ) {
 }
 
 
-/*
-*/
-bool DeviceMonitor::isReaderExists( const SCARDCONTEXT& h, const std::string& a_stReaderName ) {
-
-    std::vector< std::string > deviceList;
-
-    getDevicesList( h, deviceList );
-
-    BOOST_FOREACH( const std::string& s, deviceList ) {
-
-        if( 0 == s.compare( a_stReaderName ) ) {
-
-            Log::log( "DeviceMonitor::isReaderExists - Reader <%s> exists", a_stReaderName.c_str( ) );
-
-            return true;
-        }
-    }
-
-    return false;
-    /*
-    SCARD_READERSTATE scr;
-
-    memset( &scr, 0, sizeof( SCARD_READERSTATE ) );
-
-    scr.szReader = a_stReaderName.c_str( );
-
-    LONG rv = SCardGetStatusChange( h, 100, &scr, 1 );
-
-    Log::log( "DeviceMonitor::isReaderExists - Current state <%#02x>", scr.dwCurrentState );
-    Log::log( "DeviceMonitor::isReaderExists - Event state <%#02x>", scr.dwEventState );
-
-    if( SCARD_S_SUCCESS != rv ) { // Expect for 0x8010002E Cannot find a smart card reader
-
-    Log::log( "DeviceMonitor::isReaderExists - SCardGetStatusChange <%#02x>", rv );
-
-    return false;
-    }
-
-    return true;
-    */
-}
-
-
 /*
 */
 void DeviceMonitor::unblockWaitingThread( void ) {
@@ -702,7 +654,7 @@ void DeviceMonitor::printDeviceList( void ) {
 
 /*
 */
-void DeviceMonitor::printReaderStateList( boost::array< SCARD_READERSTATE, g_iMaxReader + 1 >& l ) {
+void DeviceMonitor::printReaderStateList( std::vector< SCARD_READERSTATE >& l ) {
 
     int i = 0;
 
@@ -941,31 +893,21 @@ void DeviceMonitor::monitorReaderEvent( void ) {
 
         std::vector< std::string > vDevices;
 
-        vDevices.reserve( g_iMaxReader );
+        vDevices.reserve( m_aDevices.size( ) );
 
         vDevices.clear( );
 
         // Build the smart card reader states buffer. Reserve the first cell to Plug&Play notification declaration
-        SCARD_READERSTATE aReaderStates[ g_iMaxReader + 1 ];
+        std::vector< SCARD_READERSTATE > aReaderStates( 1 );
 
-        memset( &aReaderStates[ 0 ], 0, sizeof( aReaderStates ) );
+        memset( &aReaderStates[ 0 ], 0, sizeof( SCARD_READERSTATE ) );
 
         aReaderStates[ 0 ].szReader = PNP_NOTIFICATION.c_str( );
 
-        DWORD dwReaderStatesCount = 1;
+        // Identifier of the device polled into each cell of the reader states buffer
+        std::vector< unsigned char > aReaderDeviceIDs( 1, (unsigned char)g_iMaxDeviceID );
 
-        BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
-
-            // Ignore empty device cell
-            if( d.get( ) && d->getReaderName( ).compare( m_stEmptyDevice ) ) {
-
-                d->put( aReaderStates[ dwReaderStatesCount ] );
-
-                ++dwReaderStatesCount;
-            }
-        }
-
-        size_t uiReaderStatesLen = sizeof( aReaderStates ) / sizeof( SCARD_READERSTATE );
+        getReaderStates( aReaderStates, aReaderDeviceIDs );
 
         // Start to spy the readers states
         do {
@@ -979,7 +921,7 @@ void DeviceMonitor::monitorReaderEvent( void ) {
             }
 
             Log::log( "DeviceMonitor::monitorReaderEvent - Query new card/reader status for:" );
-            for( size_t i = 0 ; i < uiReaderStatesLen ; ++i ) {
+            for( size_t i = 0 ; i < aReaderStates.size( ) ; ++i ) {
                 
                 if( aReaderStates[ i ].szReader ) {
 
@@ -990,7 +932,7 @@ void DeviceMonitor::monitorReaderEvent( void ) {
             // Query the status for all known devices plus the Plug&Play notification
             long rv;
             try {
-                rv = SCardGetStatusChange( DeviceMonitor::m_hContext, INFINITE, aReaderStates, dwReaderStatesCount );
+                rv = SCardGetStatusChange( DeviceMonitor::m_hContext, INFINITE, &aReaderStates[ 0 ], (DWORD)aReaderStates.size( ) );
             }
             catch( ... ) { }
 
@@ -1036,6 +978,8 @@ void DeviceMonitor::monitorReaderEvent( void ) {
                 break;
             }
 
+            bool bDeviceListChanged = false;
+
             // A Plug&Play event occured. A reader has been removed or inserted
             if( aReaderStates[ 0 ].dwEventState & SCARD_STATE_CHANGED ) {
 
@@ -1053,208 +997,167 @@ void DeviceMonitor::monitorReaderEvent( void ) {
                     break;
                 }
 
-                // First compare the current readers with the new device list to know if the reader has been previously detected
-                bool bFound = false;
+                std::set< std::string > newDevices( vDevices.begin( ), vDevices.end( ) );
 
-                BOOST_FOREACH( SCARD_READERSTATE& rs, aReaderStates ) {
+                std::set< std::string > knownDevices;
 
-                    if( rs.szReader && PNP_NOTIFICATION.compare( rs.szReader ) ) {
-
-                        Log::log( "DeviceMonitor::monitorReaderEvent - Check removal of reader <%s>", rs.szReader );
+                // First compare the current readers with the new device list to know if the reader has been previously detected
+                for( size_t i = 1 ; i < aReaderStates.size( ) ; ++i ) {
 
-                        bFound = false;
+                    SCARD_READERSTATE& rs = aReaderStates[ i ];
 
-                        BOOST_FOREACH( std::string& s, vDevices ) {
+                    if( !rs.szReader ) {
 
-                            Log::log( "DeviceMonitor::monitorReaderEvent - Locate removal of reader <%s> compared to <%s>", rs.szReader, s.c_str( ) );
+                        continue;
+                    }
 
-                            if( 0 == s.compare( (LPSTR)( rs.szReader ) ) ) {
+                    if( newDevices.end( ) != newDevices.find( rs.szReader ) ) {
 
-                                // The reader is still in use
-                                bFound = true;
+                        // The reader is still in use
+                        knownDevices.insert( rs.szReader );
 
-                                Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> still in use", s.c_str( ) );
+                        continue;
+                    }
 
-                                break;
-                            }
-                        }
+                    Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> removed", rs.szReader );
 
-                        if( !bFound ) {
+                    // The reader has been removed
+                    notifyListenerReaderRemoved( rs.szReader );
 
-                            Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> removed", rs.szReader );
+                    // Remove the device from the current device list
+                    removeReader( aReaderDeviceIDs[ i ] );
 
-                            // The reader has been removed
-                            notifyListenerReaderRemoved( rs.szReader );
+                    // The reader name was owned by the removed device
+                    rs.szReader = NULL;
 
-                            // Remove the device from the current device list
-                            removeReader( rs.szReader );
-                        }
-                    }
+                    bDeviceListChanged = true;
                 }
 
                 // Second compare the new device list to the old one to know if new devices have been inserted
                 BOOST_FOREACH( std::string& s, vDevices ) {
 
-                    Log::log( "DeviceMonitor::monitorReaderEvent - Locate new reader for reader <%s>", s.c_str( ) );
-
-                    bool bFound = false;
-
-                    BOOST_FOREACH( SCARD_READERSTATE& rs, aReaderStates ) {
-
-                        Log::log( "DeviceMonitor::monitorReaderEvent - Locate new reader for reader <%s> compared to <%s>", s.c_str( ), rs.szReader );
-
-                        if( rs.szReader && ( 0 == s.compare( (LPSTR)( rs.szReader ) ) ) ) {
+                    if( knownDevices.end( ) != knownDevices.find( s ) ) {
 
-                            // The reader is already known
-                            bFound = true;
-
-                            Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> is known", rs.szReader );
-
-                            break;
-                        }
-                    }	
+                        continue;
+                    }
 
-                    if( !bFound ) {
+                    Log::log( "DeviceMonitor::monitorReaderEvent - Found new reader <%s>", s.c_str( ) );
 
-                        Log::log( "DeviceMonitor::monitorReaderEvent - Found new reader <%s>", s.c_str( ) );
+                    // The reader is unknown. Add the new reader into the current device list
+                    addReader( m_hContext, s ); 
 
-                        // The reader is unknown. Add the new reader into the current device list
-                        addReader( m_hContext, s ); 
+                    // Notify the insertion
+                    notifyListenerReaderInserted( s );
 
-                        // Notify the insertion
-                        notifyListenerReaderInserted( s );
-                    }
+                    bDeviceListChanged = true;
                 }
             }
 
             // A real change state notification came.
-            // Locate state changes in the current reader list avoiding the first cell which is dedicated to Plug&Play notification declaration
-            BOOST_FOREACH( SCARD_READERSTATE& srs, aReaderStates ) {
+            // Only the readers flagged as changed are processed avoiding the first cell which is dedicated to Plug&Play notification declaration
+            for( size_t i = 0 ; i < aReaderStates.size( ) ; ++i ) {
+
+                SCARD_READERSTATE& srs = aReaderStates[ i ];
 
                 // Update the state
                 srs.dwCurrentState = srs.dwEventState;
 
-                if( !srs.szReader ) {
+                if( !i || !srs.szReader ) {
 
                     continue;
                 }
 
-                if( !PNP_NOTIFICATION.compare( srs.szReader ) ) {
+                boost::shared_ptr< Device > d = m_aDevices[ aReaderDeviceIDs[ i ] ];
+
+                if( !( SCARD_STATE_CHANGED & srs.dwEventState ) ) {
+
+                    // Store the reader state
+                    d->update( srs );
 
                     continue;
                 }
 
-                if( SCARD_STATE_CHANGED & srs.dwEventState ) {
+                Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> - State changed <%#02x>", srs.szReader, srs.dwEventState );
 
-                    Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> - State changed <%#02x>", srs.szReader, srs.dwEventState );
+                // The reader is not known anymore by the resource manager
+                if( SCARD_STATE_UNKNOWN & srs.dwEventState ) {
 
-                    // Get the current registered reader state to compare with the new incoming state
-                    SCARD_READERSTATE scr;
+                    Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> removed", srs.szReader );
 
-                    memset( &scr, 0, sizeof( SCARD_READERSTATE ) );
+                    notifyListenerReaderRemoved( srs.szReader );
 
-                    scr.szReader = srs.szReader;
+                    removeReader( aReaderDeviceIDs[ i ] );
 
-                    getReader( scr );
+                    srs.szReader = NULL;
 
-                    // If a smart card is present and this is not already the state of the reader
-                    if( ( SCARD_STATE_PRESENT & srs.dwEventState ) && ( 0 == ( SCARD_STATE_PRESENT & scr.dwCurrentState ) ) ) {
-// LCA: remove comment on ATR test!
-                        // !!!!! ONLY NOTIFY IF A .NET SMART CARD IS PRESENT !!!!!
-                        if( ( SCARD_STATE_MUTE != ( SCARD_STATE_MUTE & srs.dwEventState ) ) && ( 0 == memcmp( g_DotNetSmartCardAtr, srs.rgbAtr, srs.cbAtr ) ) ) {
+                    bDeviceListChanged = true;
 
-                            Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> - .NET Card inserted", srs.szReader );
+                    continue;
+                }
 
-                            try {
-                                
-                                addSmartCard( srs.szReader );
+                // Get the current registered reader state to compare with the new incoming state
+                SCARD_READERSTATE scr = d->getReaderState( );
 
-                                notifyListenerSmartCardInserted( srs.szReader );
-                            
-                            } catch( ... ) {
-                            
-                                // This is not a .NET smart card. Nothing to do.
-                            }
-                        }
+                // The high word of the state counts the card events of the reader.
+                // If it moved while a smart card stayed present, the smart card has been swapped between two notifications
+                bool bCardSwapped = ( SCARD_STATE_PRESENT & srs.dwEventState ) && ( SCARD_STATE_PRESENT & scr.dwCurrentState ) && ( ( srs.dwEventState >> 16 ) != ( scr.dwCurrentState >> 16 ) );
 
-                        // If a smart card been removed and this is not already the state of the reader
-                    } else if( ( SCARD_STATE_EMPTY & srs.dwEventState ) && ( 0 == ( SCARD_STATE_EMPTY & scr.dwCurrentState ) ) ) {
+                // If a smart card been removed and this is not already the state of the reader
+                if( bCardSwapped || ( ( SCARD_STATE_EMPTY & srs.dwEventState ) && ( 0 == ( SCARD_STATE_EMPTY & scr.dwCurrentState ) ) ) ) {
 // LCA: Only notify for .NET card?
-                        bool isDotNetToken = true;
+                    bool isDotNetToken = true;
 
-                        BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
+                    try {
 
-                            // Ignore empty device cell
-                            if( d.get( ) && ( 0 == d->getReaderName( ).compare( srs.szReader ) ) ) {
+                        d->getCardModule( );
 
-                                try {
+                    } catch (...) {
 
-                                    d->getCardModule( );
-                                
-                                } catch (...) {
-
-                                    isDotNetToken = false;
-                                }
-
-                                break;
-                            }
-                        }
+                        isDotNetToken = false;
+                    }
 
-                        if (isDotNetToken)
-                        {
-                            Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> - Card removed", srs.szReader );
+                    if (isDotNetToken)
+                    {
+                        Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> - Card removed", srs.szReader );
 
-                            // Query the status of the device
-                            if( isReaderExists( m_hContext, srs.szReader ) ) {
+                        // The reader exists, only the smart card has been removed
+                        removeSmartCard( srs.szReader );
 
-                                // The reader exists, only the smart card has been removed
-                                removeSmartCard( srs.szReader );
+                        notifyListenerSmartCardRemoved( srs.szReader );
+                    }
+                }
 
-                                notifyListenerSmartCardRemoved( srs.szReader );
+                // If a smart card is present and this is not already the state of the reader
+                if( bCardSwapped || ( ( SCARD_STATE_PRESENT & srs.dwEventState ) && ( 0 == ( SCARD_STATE_PRESENT & scr.dwCurrentState ) ) ) ) {
+// LCA: remove comment on ATR test!
+                    // !!!!! ONLY NOTIFY IF A .NET SMART CARD IS PRESENT !!!!!
+                    if( ( SCARD_STATE_MUTE != ( SCARD_STATE_MUTE & srs.dwEventState ) ) && ( 0 == memcmp( g_DotNetSmartCardAtr, srs.rgbAtr, srs.cbAtr ) ) ) {
 
-                            } else {
+                        Log::log( "DeviceMonitor::monitorReaderEvent - Reader <%s> - .NET Card inserted", srs.szReader );
 
-                                // The reader has been removed and also the smart card
-                                notifyListenerReaderRemoved( srs.szReader );
+                        try {
+                            
+                            addSmartCard( srs.szReader );
 
-                                // Remove the device from the current device list
-                                removeReader( srs.szReader );
-                            }
+                            notifyListenerSmartCardInserted( srs.szReader );
+                        
+                        } catch( ... ) {
+                        
+                            // This is not a .NET smart card. Nothing to do.
                         }
                     }
                 }
 
                 // Store the reader state
-                updateReader( srs );
+                d->update( srs );
             }
-            Log::log( "DeviceMonitor::monitorReaderEvent - Rebuild the list of readers to poll" );
-
-            // Build the new smart card reader state buffer with the plug& play notification query as first cell 
-            dwReaderStatesCount = 1;
 
-            //memset( &aReaderStates[ 1 ], 0, sizeof( SCARD_READERSTATE ) * (v g_iMaxReader );
+            // Build the new smart card reader state buffer only when a reader came or left
+            if( bDeviceListChanged ) {
 
-            //aReaderStates[ 0 ].szReader = /*readerNames[ 0 ];*/ PNP_NOTIFICATION.c_str( );
+                Log::log( "DeviceMonitor::monitorReaderEvent - Rebuild the list of readers to poll" );
 
-            BOOST_FOREACH( boost::shared_ptr< Device >& d, m_aDevices ) {
-
-                memset( &aReaderStates[ dwReaderStatesCount ], 0, sizeof( SCARD_READERSTATE ) );
-
-                // Ignore empty device cell
-                if( d.get( ) && d->getReaderName( ).compare( m_stEmptyDevice ) ) {
-
-                    d->put( aReaderStates[ dwReaderStatesCount ] );
-
-                    Log::log( "DeviceMonitor::monitorReaderEvent - Prepare to poll reader <%s>", aReaderStates[ dwReaderStatesCount ].szReader );
-
-                    //memset( readerNames[ dwReaderStatesCount ], 0,sizeof( readerNames[ dwReaderStatesCount ] ) );
-
-                    //memcpy( readerNames[ dwReaderStatesCount ], d->getReaderName( ).c_str( ), d->getReaderName( ).size( ) );
-
-                    //aReaderStates[ dwReaderStatesCount ].szReader = d->getReaderName( ).c_str( ); //readerNames[ dwReaderStatesCount ];
-
-                    ++dwReaderStatesCount;
-                }
+                getReaderStates( aReaderStates, aReaderDeviceIDs );
             }
 
             Log::log( "DeviceMonitor::monitorReaderEvent - Ready to poll" );
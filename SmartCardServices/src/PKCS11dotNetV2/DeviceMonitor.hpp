@@ -46,8 +46,12 @@
 #include "Device.hpp"
 
 
+// Number of device cells created at start up. More cells are appended when more readers are connected.
 const int g_iMaxReader = 5; //MAXIMUM_SMARTCARD_READERS
 
+// The device identifier is stored into one byte of the session handles (0xFF means no device)
+const int g_iMaxDeviceID = 0xFF;
+
 
 /*
 */
@@ -59,7 +63,7 @@ public:
 
     virtual ~DeviceMonitor( ) { }
 
-    typedef boost::array< boost::shared_ptr< Device >, g_iMaxReader > DEVICES;
+    typedef std::vector< boost::shared_ptr< Device > > DEVICES;
 
 	inline DEVICES& getDeviceList( void ) { return m_aDevices; };
 
@@ -97,24 +101,22 @@ private:
 
 	void notifyListenerSmartCardChanged( const std::string& );
 
-	void updateReader( const SCARD_READERSTATE& );
-
-	void removeReader( LPCSTR );
+	void removeReader( const unsigned char& );
 	
 	void addReader( const SCARDCONTEXT&, const std::string& );
 
-    void addReader( const SCARD_READERSTATE&, const unsigned char& );
+    void addReader( const SCARD_READERSTATE& );
+
+    bool getFreeDeviceID( unsigned char& );
 
     void removeSmartCard( const std::string& );
 	
 	void addSmartCard( const std::string& );
 	
-	void getReader( SCARD_READERSTATE& );
+	void getReaderStates( std::vector< SCARD_READERSTATE >&, std::vector< unsigned char >& );
 
 	void unblockWaitingThread( void );
 
-    bool isReaderExists( const SCARDCONTEXT& h, const std::string& );
-
 	DEVICES m_aDevices;
 	
 	std::list< IDeviceMonitorListener* > m_Listeners;
@@ -125,7 +127,7 @@ private:
 	
 	void printReaderState( const SCARD_READERSTATE& scrs, const int& iIndex );
 	void printDeviceList( void );
-	void printReaderStateList( boost::array< SCARD_READERSTATE, g_iMaxReader + 1 >& );
+	void printReaderStateList( std::vector< SCARD_READERSTATE >& );
 	void getState( const DWORD& dwState, std::string& stState );
 
 };
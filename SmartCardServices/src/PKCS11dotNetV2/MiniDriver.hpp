@@ -126,6 +126,8 @@ public:
 
     inline Marshaller::u1Array* readFile( const std::string& a_stDirectory, const std::string& a_stFile ) { return m_Files.readFile( a_stDirectory, a_stFile ); }
 
+    inline void prefetch( const std::string& a_stPathPKCS11, const std::string& a_stFileTokenInfo, const std::string& a_stPrefixPublicObject ) { m_Files.prefetch( a_stPathPKCS11, a_stFileTokenInfo, a_stPrefixPublicObject ); }
+
     inline void writeFile( const std::string& a_stDirectory, const std::string& a_stFile, Marshaller::u1Array* a_FileData, const bool& a_bAddToCache = true ) { { Log::begin( "MiniDriver::writeFile" ); Log::log( "Directory <%s> - File <%s>", a_stDirectory.c_str( ), a_stFile.c_str( ) ); m_Files.writeFile( a_stDirectory, a_stFile, a_FileData, a_bAddToCache ); cacheSerialize( ); Log::end( "MiniDriver::writeFile" ); } }
 
     void createFile( const std::string&, const std::string&, const bool& );
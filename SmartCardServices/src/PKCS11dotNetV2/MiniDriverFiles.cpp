@@ -896,6 +896,112 @@ Marshaller::u1Array* MiniDriverFiles::readFileWithoutCheck( const std::string& a
 }
 
 
+/* Load into the cache the files read when the token is created: the container map file, the MiniDriver certificates,
+the token information file and the public PKCS11 objects. Private objects are read after login.
+The PKCS11 directory and file names are the ones used by the token.
+The files are read one after the other inside the transaction of the caller and the card memory is only checked at the end.
+Files which can not be read are left out and will be read again on demand
+*/
+void MiniDriverFiles::prefetch( const std::string& a_stPathPKCS11, const std::string& a_stFileTokenInfo, const std::string& a_stPrefixPublicObject ) {
+
+    Log::begin( "MiniDriverFiles::prefetch" );
+    Timer t;
+    t.start( );
+
+    if( !m_CardModule ) {
+
+        Log::end( "MiniDriverFiles::prefetch" );
+        return;
+    }
+
+    typedef std::pair< std::string, std::string > FILE_PATH;
+
+    std::vector< FILE_PATH > files;
+
+    try {
+
+        FILES_NAME fs = enumFiles( s_stPathMscp );
+
+        BOOST_FOREACH( const std::string& s, fs ) {
+
+            if( !s.compare( szCONTAINER_MAP_FILE ) || !s.find( szUSER_KEYEXCHANGE_CERT_PREFIX ) || !s.find( szUSER_SIGNATURE_CERT_PREFIX ) ) {
+
+                files.push_back( FILE_PATH( s_stPathMscp, s ) );
+            }
+        }
+
+    } catch( ... ) { }
+
+    try {
+
+        FILES_NAME fs = enumFiles( a_stPathPKCS11 );
+
+        BOOST_FOREACH( const std::string& s, fs ) {
+
+            if( !s.compare( a_stFileTokenInfo ) || !s.find( a_stPrefixPublicObject ) ) {
+
+                files.push_back( FILE_PATH( a_stPathPKCS11, s ) );
+            }
+        }
+
+    } catch( ... ) { }
+
+    unsigned int uiCount = 0;
+
+    BOOST_FOREACH( const FILE_PATH& p, files ) {
+
+        // Already read or loaded from the disk cache
+        if( m_BinaryFiles.end( ) != m_BinaryFiles.find( p.second ) ) {
+
+            continue;
+        }
+
+        std::string stPath = p.first + s_stPathSeparator + p.second;
+
+        try {
+
+            Marshaller::u1Array* f = m_CardModule->readFileWithoutMemoryCheck( &stPath );
+
+            if( f ) {
+
+                std::string stFile = p.second;
+
+                m_BinaryFiles.insert( stFile, f );
+
+                ++uiCount;
+            }
+
+        } catch( MiniDriverException& x ) {
+
+            Log::error( "MiniDriverFiles::prefetch", "readFile failed" );
+
+            // The garbage collection has occured on the card. Stop here and let the remaining files be read on demand
+            if( SCARD_E_NO_MEMORY == x.getError( ) ) {
+
+                break;
+            }
+
+        } catch( ... ) {
+
+            Log::error( "MiniDriverFiles::prefetch", "readFile failed" );
+
+            break;
+        }
+    }
+
+    // Nothing was read so the card memory is unchanged
+    if( uiCount ) {
+
+        m_CardModule->manageGarbageCollector( );
+    }
+
+    Log::log( "MiniDriverFiles::prefetch - <%d> files read", uiCount );
+
+    t.stop( "MiniDriverFiles::prefetch" );
+    Log::end( "MiniDriverFiles::prefetch" );
+}
+
+
 /* ReadFile
 */
 Marshaller::u1Array* MiniDriverFiles::readFile( const std::string& a_stDirectory, const std::string& a_stFile ) {
@@ -77,6 +77,8 @@ public:
 
     Marshaller::u1Array* readFileWithoutCheck( const std::string&, const std::string& );
 
+    void prefetch( const std::string&, const std::string&, const std::string& );
+
     void clearFile( std::string const & );
 
     FILES_NAME& enumFiles( const std::string& );
@@ -2581,9 +2581,6 @@ CK_SESSION_HANDLE Slot::computeSessionHandle( const bool& a_bIsReadWrite ) {
 
     // He here the convention to compute the session handle:
 
-    // byte #1: session index. We do not accept to open more than 255 sessions.
-    h |= ++s_ucSessionIndex;
-
     // byte #2: session properties has R/W or R/O
     h |= ( a_bIsReadWrite << 8 );
 
@@ -2608,7 +2605,23 @@ CK_SESSION_HANDLE Slot::computeSessionHandle( const bool& a_bIsReadWrite ) {
 
     // byte #4: RFU and set to 0x00
 
-    return h;
+    // byte #1: session index. We do not accept to open more than 255 sessions.
+    // The index wraps so skip the values still used by an opened session of this slot
+    // and the value 0 which would give an invalid handle for the first slot
+    for( int i = 0 ; i < 0xFF ; ++i ) {
+
+        if( !++s_ucSessionIndex ) {
+
+            ++s_ucSessionIndex;
+        }
+
+        if( m_Sessions.end( ) == m_Sessions.find( h | s_ucSessionIndex ) ) {
+
+            return ( h | s_ucSessionIndex );
+        }
+    }
+
+    throw PKCS11Exception( CKR_SESSION_COUNT );
 }
 
 
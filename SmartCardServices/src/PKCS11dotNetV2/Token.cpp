@@ -45,6 +45,10 @@
 
 const unsigned char g_ucPKCS_EMEV15_PADDING_TAG = 0x02;
 
+Token::CERTIFICATE_CACHE Token::m_CertificateCache;
+
+boost::mutex Token::m_CertificateCacheMutex;
+
 /*
 */
 Token::Token( Slot* a_pSlot, Device* a_pDevice ) {
@@ -83,6 +87,20 @@ Token::Token( Slot* a_pSlot, Device* a_pDevice ) {
 
     m_Device = a_pDevice;
 
+    // Load the files needed to create the token in a single transaction
+    if( m_Device ) {
+
+        try {
+
+            m_Device->beginTransaction( );
+
+            m_Device->prefetch( g_stPathPKCS11, g_stPathTokenInfo, g_stPrefixPublicObject );
+
+        } catch( ... ) { }
+
+        m_Device->endTransaction( );
+    }
+
     // Set the seed for the random generator
     Marshaller::u1Array challenge( 8 );
     generateRandom( challenge.GetBuffer( ), 8 );
@@ -4881,17 +4899,8 @@ void Token::generateDefaultAttributesKeyPublic( Pkcs11ObjectKeyPublicRSA* a_pObj
                     continue;
                 }
 
-                X509Cert x509cert( objCertificate->m_pValue->GetBuffer( ), objCertificate->m_pValue->GetLength( ) );
-
-                // Get the certificate public key modulus
-                BEROctet::Blob modulus = x509cert.Modulus( );
-
-                Marshaller::u1Array m( modulus.size( ) );
-
-                m.SetBuffer( modulus.data( ) );
-
                 // Check if the both certificate and public key share the same modulus
-                if( 0 == memcmp( m.GetBuffer( ), p, l ) ) {
+                if( certificateHasModulus( objCertificate, p, l ) ) {
 
                     if( objCertificate->m_pSubject.get( ) ) {
 
@@ -4901,11 +4910,7 @@ void Token::generateDefaultAttributesKeyPublic( Pkcs11ObjectKeyPublicRSA* a_pObj
                     } else {
 
                         // Generate the subject
-                        BEROctet::Blob sb( x509cert.Subject( ) );
-
-                        a_pObject->m_pSubject.reset( new Marshaller::u1Array( static_cast< s4 >( sb.size( ) ) ) );
-
-                        a_pObject->m_pSubject->SetBuffer( const_cast< unsigned char* >( sb.data( ) ) );
+                        generateSubject( objCertificate->m_pValue, a_pObject->m_pSubject );
                     }
 
                     // By the way copy the certificate ID
@@ -4977,16 +4982,7 @@ void Token::generateDefaultAttributesKeyPrivate( RSAPrivateKeyObject* a_pObject
 
             if( objCertificate->m_pValue.get( ) ) {
 
-                X509Cert x509cert( objCertificate->m_pValue->GetBuffer( ), objCertificate->m_pValue->GetLength( ) );
-
-                // Get the certificate public key modulus
-                BEROctet::Blob modulus = x509cert.Modulus( );
-
-                Marshaller::u1Array m( modulus.size( ) );
-
-                m.SetBuffer( modulus.data( ) );
-
-                if( 0 == memcmp( m.GetBuffer( ), p, l ) ) {
+                if( certificateHasModulus( objCertificate, p, l ) ) {
 
                     // Give the same container index of the private key to the certificate
                     objCertificate->m_ucContainerIndex = a_pObject->m_ucContainerIndex;
@@ -5002,11 +4998,7 @@ void Token::generateDefaultAttributesKeyPrivate( RSAPrivateKeyObject* a_pObject
                     } else {
 
                         // Get the certificate subject
-                        BEROctet::Blob sb( x509cert.Subject( ) );
-
-                        a_pObject->m_pSubject.reset( new Marshaller::u1Array( static_cast< s4 >( sb.size( ) ) ) );
-
-                        a_pObject->m_pSubject->SetBuffer( const_cast< unsigned char* >( sb.data( ) ) );
+                        generateSubject( objCertificate->m_pValue, a_pObject->m_pSubject );
                     }
 
                     break;
@@ -5108,13 +5100,9 @@ void Token::generateID( boost::shared_ptr< Marshaller::u1Array>& a_pModulus, boo
 */
 void Token::generateSerialNumber( boost::shared_ptr< Marshaller::u1Array>& a_pCertificateValue, boost::shared_ptr< Marshaller::u1Array>& a_pSerialNumber ) {
 
-    X509Cert x509cert( a_pCertificateValue->GetBuffer( ), a_pCertificateValue->GetLength( ) );
-
-    BEROctet::Blob b( x509cert.SerialNumber( ) );
-
-    a_pSerialNumber.reset( new Marshaller::u1Array( static_cast< s4 >( b.size( ) ) ) );
+    boost::shared_ptr< const CertificateAttributes > a = getCertificateAttributes( a_pCertificateValue );
 
-    a_pSerialNumber->SetBuffer( const_cast< unsigned char* >( b.data( ) ) );
+    a_pSerialNumber.reset( new Marshaller::u1Array( *( a->m_pSerialNumber.get( ) ) ) );
 }
 
 
@@ -5122,13 +5110,9 @@ void Token::generateSerialNumber( boost::shared_ptr< Marshaller::u1Array>& a_pCe
 */
 void Token::generateIssuer( boost::shared_ptr< Marshaller::u1Array>& a_pCertificateValue, boost::shared_ptr< Marshaller::u1Array>& a_pIssuer ) {
 
-    X509Cert x509cert( a_pCertificateValue->GetBuffer( ), a_pCertificateValue->GetLength( ) );
-
-    BEROctet::Blob b( x509cert.Issuer( ) );
+    boost::shared_ptr< const CertificateAttributes > a = getCertificateAttributes( a_pCertificateValue );
 
-    a_pIssuer.reset( new Marshaller::u1Array( static_cast< s4 >( b.size( ) ) ) );
-
-    a_pIssuer->SetBuffer( const_cast< unsigned char* >( b.data( ) ) );
+    a_pIssuer.reset( new Marshaller::u1Array( *( a->m_pIssuer.get( ) ) ) );
 }
 
 
@@ -5136,13 +5120,9 @@ void Token::generateIssuer( boost::shared_ptr< Marshaller::u1Array>& a_pCertific
 */
 void Token::generateSubject( boost::shared_ptr< Marshaller::u1Array>& a_pCertificateValue, boost::shared_ptr< Marshaller::u1Array>& a_pSubject ) {
 
-    X509Cert x509cert( a_pCertificateValue->GetBuffer( ), a_pCertificateValue->GetLength( ) );
+    boost::shared_ptr< const CertificateAttributes > a = getCertificateAttributes( a_pCertificateValue );
 
-    BEROctet::Blob b( x509cert.Subject( ) );
-
-    a_pSubject.reset( new Marshaller::u1Array( static_cast< s4 >( b.size( ) ) ) );
-
-    a_pSubject->SetBuffer( const_cast< unsigned char* >( b.data( ) ) );
+    a_pSubject.reset( new Marshaller::u1Array( *( a->m_pSubject.get( ) ) ) );
 }
 
 
@@ -5150,16 +5130,17 @@ void Token::generateSubject( boost::shared_ptr< Marshaller::u1Array>& a_pCertifi
 */
 void Token::generatePublicKeyModulus( boost::shared_ptr< Marshaller::u1Array>& a_pCertificateValue, boost::shared_ptr< Marshaller::u1Array>& a_pModulus, u8& a_u8CheckValue ) {
 
-    X509Cert x509cert( a_pCertificateValue->GetBuffer( ), a_pCertificateValue->GetLength( ) );
+    boost::shared_ptr< const CertificateAttributes > a = getCertificateAttributes( a_pCertificateValue );
 
-    BEROctet::Blob modulus = x509cert.Modulus( );
+    if( !a->m_pModulus ) {
 
-    a_pModulus.reset( new Marshaller::u1Array( modulus.size( ) ) );
+        throw std::runtime_error( "X509CertFormatError" );
+    }
 
-    a_pModulus->SetBuffer( modulus.data( ) );
+    a_pModulus.reset( new Marshaller::u1Array( *( a->m_pModulus.get( ) ) ) );
 
     // Compatibility with old P11
-    a_u8CheckValue = Util::MakeCheckValue( modulus.data( ), static_cast< unsigned int >( modulus.size( ) ) );
+    a_u8CheckValue = Util::MakeCheckValue( a_pModulus->GetBuffer( ), a_pModulus->GetLength( ) );
 }
 
 
@@ -5167,19 +5148,129 @@ void Token::generatePublicKeyModulus( boost::shared_ptr< Marshaller::u1Array>& a
 */
 void Token::generateRootAndSmartCardLogonFlags( boost::shared_ptr< Marshaller::u1Array>& a_pCertificateValue, bool& a_bIsRoot, unsigned long& a_ulCertificateCategory, bool& a_bIsSmartCardLogon ) {
 
-    X509Cert x509cert( a_pCertificateValue->GetBuffer( ), a_pCertificateValue->GetLength( ) );
+    boost::shared_ptr< const CertificateAttributes > a = getCertificateAttributes( a_pCertificateValue );
 
-    a_bIsRoot = ( x509cert.IsCACert( ) || x509cert.IsRootCert( ) );
+    a_bIsRoot = a->m_bIsRoot;
 
     // CKA_CERTIFICATE_CATEGORY attribute set to "authority" (2) is the certificate is a root or CA one
     a_ulCertificateCategory = a_bIsRoot ? 2 : 1; 
 
     // Look for the Windows Smart Card Logon OID
-    a_bIsSmartCardLogon = x509cert.isSmartCardLogon( );
+    a_bIsSmartCardLogon = a->m_bIsSmartCardLogon;
     //Log::log( "SmartCardLogon <%d>", a_pObject->m_bIsSmartCardLogon );
 }
 
 
+/* Get the attributes parsed from a certificate value.
+The certificate is parsed once for the whole process. The result is kept by SHA-1 of the value
+so that synchronizing the objects again only parses the certificates which have changed.
+A parsing error is not kept and is thrown to the caller.
+*/
+boost::shared_ptr< const Token::CertificateAttributes > Token::getCertificateAttributes( boost::shared_ptr< Marshaller::u1Array>& a_pCertificateValue ) {
+
+    if( !a_pCertificateValue ) {
+
+        throw std::runtime_error( "X509CertFormatError" );
+    }
+
+    CSHA1 sha1;
+
+    unsigned char hash[ SHA1_HASH_LENGTH ];
+
+    sha1.hashCore( a_pCertificateValue->GetBuffer( ), 0, a_pCertificateValue->GetLength( ) );
+
+    sha1.hashFinal( hash );
+
+    std::string stKey( reinterpret_cast< char* >( hash ), sizeof( hash ) );
+
+    {
+        boost::mutex::scoped_lock lock( m_CertificateCacheMutex );
+
+        CERTIFICATE_CACHE::const_iterator i = m_CertificateCache.find( stKey );
+
+        if( i != m_CertificateCache.end( ) ) {
+
+            return i->second;
+        }
+    }
+
+    X509Cert x509cert( a_pCertificateValue->GetBuffer( ), a_pCertificateValue->GetLength( ) );
+
+    boost::shared_ptr< CertificateAttributes > a( new CertificateAttributes );
+
+    BEROctet::Blob b( x509cert.SerialNumber( ) );
+
+    a->m_pSerialNumber.reset( new Marshaller::u1Array( static_cast< s4 >( b.size( ) ) ) );
+
+    a->m_pSerialNumber->SetBuffer( b.data( ) );
+
+    b = x509cert.Issuer( );
+
+    a->m_pIssuer.reset( new Marshaller::u1Array( static_cast< s4 >( b.size( ) ) ) );
+
+    a->m_pIssuer->SetBuffer( b.data( ) );
+
+    b = x509cert.Subject( );
+
+    a->m_pSubject.reset( new Marshaller::u1Array( static_cast< s4 >( b.size( ) ) ) );
+
+    a->m_pSubject->SetBuffer( b.data( ) );
+
+    try {
+
+        b = x509cert.Modulus( );
+
+        a->m_pModulus.reset( new Marshaller::u1Array( static_cast< s4 >( b.size( ) ) ) );
+
+        a->m_pModulus->SetBuffer( b.data( ) );
+
+    } catch( ... ) {
+
+        // Not a RSA public key. The other attributes are still valid.
+    }
+
+    a->m_bIsRoot = ( x509cert.IsCACert( ) || x509cert.IsRootCert( ) );
+
+    a->m_bIsSmartCardLogon = x509cert.isSmartCardLogon( );
+
+    boost::mutex::scoped_lock lock( m_CertificateCacheMutex );
+
+    if( m_CertificateCache.size( ) >= CERTIFICATE_CACHE_MAX_ENTRIES ) {
+
+        // The keys are hashes so this drops an arbitrary entry
+        m_CertificateCache.erase( m_CertificateCache.begin( ) );
+    }
+
+    m_CertificateCache[ stKey ] = a;
+
+    return a;
+}
+
+
+/* Check if the public key of the certificate has the given modulus
+*/
+bool Token::certificateHasModulus( X509PubKeyCertObject* a_pCertificate, const unsigned char* a_pModulus, const unsigned int& a_uiModulusLength ) {
+
+    boost::shared_ptr< const CertificateAttributes > a;
+
+    try {
+
+        a = getCertificateAttributes( a_pCertificate->m_pValue );
+
+    } catch( ... ) {
+
+        return false;
+    }
+
+    if( !a->m_pModulus || ( a->m_pModulus->GetLength( ) < a_uiModulusLength ) ) {
+
+        return false;
+    }
+
+    return ( 0 == memcmp( a->m_pModulus->GetBuffer( ), a_pModulus, a_uiModulusLength ) );
+}
+
+
 /* Search for a private key using the same public key exponent to set the same container index
 */
 void Token::searchContainerIndex( boost::shared_ptr< Marshaller::u1Array>& a_pModulus, unsigned char& a_ucContainerIndex, unsigned char& a_ucKeySpec ) {
@@ -5403,16 +5494,7 @@ void Token::setContainerIndexToCertificate( boost::shared_ptr< Marshaller::u1Arr
 
             if( objCertificate->m_pValue.get( ) ) {
 
-                X509Cert x509cert( objCertificate->m_pValue->GetBuffer( ), objCertificate->m_pValue->GetLength( ) );
-
-                // Get the certificate public key modulus
-                BEROctet::Blob modulus = x509cert.Modulus( );
-
-                Marshaller::u1Array m( modulus.size( ) );
-
-                m.SetBuffer( modulus.data( ) );
-
-                if( 0 == memcmp( m.GetBuffer( ), p, l ) ) {
+                if( certificateHasModulus( objCertificate, p, l ) ) {
 
                     // Give the same container index of the private key to the certificate
                     objCertificate->m_ucContainerIndex = a_ucContainerIndex;
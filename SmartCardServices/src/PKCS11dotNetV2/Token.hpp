@@ -28,8 +28,10 @@
 #include <boost/ptr_container/ptr_set.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <boost/random.hpp>
+#include <boost/thread/mutex.hpp>
 #include <string>
 #include <vector>
+#include <map>
 #include "MiniDriver.hpp"
 #include "Device.hpp"
 #include "Session.hpp"
@@ -279,6 +281,36 @@ private:
 
     void generateRootAndSmartCardLogonFlags( boost::shared_ptr< Marshaller::u1Array>&, bool&, unsigned long&, bool& );
 
+    // Attributes parsed out of a certificate value
+    struct CertificateAttributes {
+
+        boost::shared_ptr< Marshaller::u1Array > m_pSerialNumber;
+
+        boost::shared_ptr< Marshaller::u1Array > m_pIssuer;
+
+        boost::shared_ptr< Marshaller::u1Array > m_pSubject;
+
+        // Empty if the public key is not a RSA one
+        boost::shared_ptr< Marshaller::u1Array > m_pModulus;
+
+        bool m_bIsRoot;
+
+        bool m_bIsSmartCardLogon;
+    };
+
+    typedef std::map< std::string, boost::shared_ptr< const CertificateAttributes > > CERTIFICATE_CACHE;
+
+    static const size_t CERTIFICATE_CACHE_MAX_ENTRIES = 256;
+
+    // Shared by all the tokens of the process and keyed by the SHA-1 of the certificate value
+    static CERTIFICATE_CACHE m_CertificateCache;
+
+    static boost::mutex m_CertificateCacheMutex;
+
+    boost::shared_ptr< const CertificateAttributes > getCertificateAttributes( boost::shared_ptr< Marshaller::u1Array>& );
+
+    bool certificateHasModulus( X509PubKeyCertObject*, const unsigned char*, const unsigned int& );
+
     void searchContainerIndex( boost::shared_ptr< Marshaller::u1Array>&, unsigned char&, unsigned char& );
 
     void setDefaultAttributesCertificate( X509PubKeyCertObject* );
@@ -30,6 +30,111 @@
 #include "beroctet.h"
 
 
+// Decodes the data octets of an OID into "X Y Z ..." notation
+
+static std::string DecodeObjectID(unsigned char const *pbData, size_t cbData)
+{
+
+    if(!cbData)
+        throw std::runtime_error("BEREmptyOctet");
+
+    std::string OID;
+
+    // The scratch buffer "text" below needs to be large enough to hold
+    // the decimal encoding of two 32 bit integers, including a space
+    // and the terminating zero.
+
+    char text[40];
+
+    unsigned int subid;
+    const unsigned char *c = pbData;
+    const unsigned char *Last = c + cbData;
+    bool First = true;
+
+    while(c<Last)
+    {
+        subid = (*c)&0x7F;
+        while((*c)&0x80)
+        {
+            c++;
+            if(c>=Last)
+                throw std::runtime_error("BERUnexpectedEndOfOctet");
+            if(subid>0x01FFFFFF)
+                throw std::runtime_error("BEROIDSubIdentifierOverflow");
+            subid = (subid<<7) | ((*c)&0x7F);
+        }
+        if(First)
+        {
+            unsigned int X,Y;
+            if(subid<40)
+                X=0;
+            else if(subid<80)
+                X=1;
+            else
+                X=2;
+            Y = subid-X*40;
+            sprintf(text,"%d %d",X,Y);
+            OID = text;
+            First = false;
+        }
+        else
+        {
+            sprintf(text," %d",subid);
+            OID += text;
+        }
+        c++;
+    }
+
+    return OID;
+}
+
+// Decodes the data octets of a UTCTime or GeneralizedTime into "YYYYMMDDHHMMSS"
+
+// We here apply the convention from RFC 2459 that the 2 digit year
+// encoded in UTCTime is in the range 1950-2049.
+
+static std::string DecodeTime(unsigned int dwTag, unsigned char const *pbData, size_t cbData)
+{
+
+    static const size_t UnivUTCTimeSize = 13;
+    static const size_t UnivGenTimeSize = 15;
+
+    if(dwTag==dwBerUnivUTCTime)
+    {
+        // UTCTime
+
+        if(cbData!=UnivUTCTimeSize)
+            throw std::runtime_error("BERInconsistentDataLength");
+
+        std::string strCentury, strYear((char*)pbData,2);
+        int iYear;
+        if(sscanf(strYear.c_str(),"%d",&iYear)!=1)
+            throw std::runtime_error("FormatDecodingError");
+
+        if(iYear>=50) strCentury = "19";
+        else strCentury = "20";
+
+        // Add century and strip off the 'Z'
+
+        return strCentury + std::string((char*)pbData,UnivUTCTimeSize-1);
+    }
+    else if(dwTag==dwBerUnivGenTime)
+    {
+        // GeneralizedTime
+
+        if(cbData!=UnivGenTimeSize)
+            throw std::runtime_error("BERInconsistentDataLength");
+
+        // Return the string as is, stripping off the 'Z'
+
+        return std::string((char*)pbData,UnivGenTimeSize-1);
+    }
+    else
+        throw std::runtime_error("BERInconsistentOperation");
+
+}
+
+
 BEROctet::BEROctet() : m_tcClass(tcUniversal),
                        m_fConstructed(fBerPcPrimitive),
                        m_dwTag(dwBerUnivZero),
@@ -227,57 +332,7 @@ std::string BEROctet::ObjectID() const
     if(m_tcClass!=tcUniversal || m_dwTag!=dwBerUnivObjectIdent)
         throw std::runtime_error("BERInconsistentOperation");
 
-    if(!m_blbData.size())
-        throw std::runtime_error("BEREmptyOctet");
-
-    std::string OID;
-
-    // The scratch buffer "text" below needs to be large enough to hold
-    // the decimal encoding of two 32 bit integers, including a space
-    // and the terminating zero.
-
-    char text[40];
-
-    unsigned int subid;
-    const unsigned char *c = m_blbData.data();
-    const unsigned char *Last = c + m_blbData.size();
-    bool First = true;
-
-    while(c<Last)
-    {
-        subid = (*c)&0x7F;
-        while((*c)&0x80)
-        {
-            c++;
-            if(c>=Last)
-                throw std::runtime_error("BERUnexpectedEndOfOctet");
-            if(subid>0x01FFFFFF)
-                throw std::runtime_error("BEROIDSubIdentifierOverflow");
-            subid = (subid<<7) | ((*c)&0x7F);
-        }
-        if(First)
-        {
-            unsigned int X,Y;
-            if(subid<40)
-                X=0;
-            else if(subid<80)
-                X=1;
-            else
-                X=2;
-            Y = subid-X*40;
-            sprintf(text,"%d %d",X,Y);
-            OID = text;
-            First = false;
-        }
-        else
-        {
-            sprintf(text," %d",subid);
-            OID += text;
-        }
-        c++;
-    }
-
-    return OID;
+    return DecodeObjectID(m_blbData.data(), m_blbData.size());
 }
 
 // Encode an OID
@@ -377,51 +432,13 @@ void BEROctet::ObjectID(std::string const &str)
 
 // Decode a Time octet. Output format: "YYYYMMDDHHMMSS"
 
-// We here apply the convention from RFC 2459 that the 2 digit year
-// encoded in UTCTime is in the range 1950-2049.
-
 std::string BEROctet::Time() const
 {
 
-    static const Blob::size_type UnivUTCTimeSize = 13;
-    static const Blob::size_type UnivGenTimeSize = 15;
-
     if(m_tcClass!=tcUniversal)
         throw std::runtime_error("BERInconsistentOperation");
 
-    if(m_dwTag==dwBerUnivUTCTime)
-    {
-        // UTCTime
-
-        if(m_blbData.size()!=UnivUTCTimeSize)
-            throw std::runtime_error("BERInconsistentDataLength");
-
-        std::string strCentury, strYear((char*)m_blbData.data(),2);
-        int iYear;
-        if(sscanf(strYear.c_str(),"%d",&iYear)!=1)
-            throw std::runtime_error("FormatDecodingError");
-
-        if(iYear>=50) strCentury = "19";
-        else strCentury = "20";
-
-        // Add century and strip off the 'Z'
-
-        return strCentury + std::string((char*)m_blbData.data(),UnivUTCTimeSize-1);
-    }
-    else if(m_dwTag==dwBerUnivGenTime)
-    {
-        // GeneralizedTime
-
-        if(m_blbData.size()!=UnivGenTimeSize)
-            throw std::runtime_error("BERInconsistentDataLength");
-
-        // Return the string as is, stripping off the 'Z'
-
-        return std::string((char*)m_blbData.data(),UnivGenTimeSize-1);
-    }
-    else
-        throw std::runtime_error("BERInconsistentOperation");
-
+    return DecodeTime(m_dwTag, m_blbData.data(), m_blbData.size());
 }
 
 // Encode a Time. Input format: "YYYYMMDDHHMMSS"
@@ -612,44 +629,307 @@ BEROctet::Blob BEROctet::LengthOctets(unsigned int dwLength)
 
 void BEROctet::Decode(Blob const &blb)
 {
+    Decode(BERView(blb));
+}
 
-    if(!blb.size())
-        throw std::runtime_error("BEREmptyOctet");
+void BEROctet::Decode(BERView const &view)
+{
+
+    m_tcClass      = view.Class();
+    m_fConstructed = view.Constructed();
+    m_dwTag        = view.Tag();
+    m_fDefinite    = true;
+
+    m_blbOrigOctet = view.OctetBlob();
+    m_fModified = false;
 
-    size_t BufferSize = blb.size();
+    size_t l = m_SubOctetList.size( );
+    for( std::vector< BEROctet const* >::size_type i = 0; i < l; ++i ) {
+     
+        delete m_SubOctetList[i];
+    }
 
-    m_fConstructed = (blb[0]&0x20) ? true : false;
+    m_SubOctetList.resize(0);
+    m_blbData = Blob();
 
-    switch(blb[0]&0xC0)
+    if(m_fConstructed)
     {
 
-    case 0x00:
-        m_tcClass = tcUniversal;
-        break;
+        // Constructed type
 
-    case 0x40:
-        m_tcClass = tcApplication;
-        break;
+        for(BERView sub = view.FirstSubOctet(); !sub.Empty(); sub = sub.NextOctet())
+        {
 
-    case 0x80:
-        m_tcClass = tcContext;
-        break;
+            BEROctet *suboct = new BEROctet();
 
-    case 0xC0:
-        m_tcClass = tcPrivate;
-        break;
+            try
+            {
+                suboct->Decode(sub);
+            }
+            catch(...)
+            {
+                delete suboct;
+                throw;
+            }
 
-    default:
-        throw std::runtime_error("BERIllegalClass");
+            m_SubOctetList.push_back(suboct);
+        }
+    }
+    else
+        m_blbData = view.DataBlob();
+
+}
+
+bool BEROctet::Modified() const
+{
+    if(m_fModified)
+        return true;
+
+    if(m_fConstructed) {
+        std::vector< BEROctet const* >::size_type l = m_SubOctetList.size( );
+        for( std::vector< BEROctet const* >::size_type i = 0; i < l; ++i ) {
+
+            if(m_SubOctetList[i]->Modified()) {
+                
+                return true;
+            }
+        }
+    }
+
+    return false;
+
+}
+
+
+BERView::BERView() : m_pbOctet(0),
+                     m_pbData(0),
+                     m_pbEnd(0),
+                     m_pbLimit(0),
+                     m_tcClass(tcUniversal),
+                     m_fConstructed(fBerPcPrimitive),
+                     m_dwTag(dwBerUnivZero)
+{
+}
+
+BERView::BERView(unsigned char const *pbBuffer, size_t cbBuffer) : m_pbOctet(0),
+                                                                   m_pbData(0),
+                                                                   m_pbEnd(0),
+                                                                   m_pbLimit(0),
+                                                                   m_tcClass(tcUniversal),
+                                                                   m_fConstructed(fBerPcPrimitive),
+                                                                   m_dwTag(dwBerUnivZero)
+{
+    if(!pbBuffer)
+        throw std::runtime_error("BEREmptyOctet");
+
+    Decode(pbBuffer, pbBuffer + cbBuffer);
+}
+
+BERView::BERView(BEROctet::Blob const &blb) : m_pbOctet(0),
+                                              m_pbData(0),
+                                              m_pbEnd(0),
+                                              m_pbLimit(0),
+                                              m_tcClass(tcUniversal),
+                                              m_fConstructed(fBerPcPrimitive),
+                                              m_dwTag(dwBerUnivZero)
+{
+    Decode(blb.data(), blb.data() + blb.size());
+}
+
+// Returns true if the view does not refer to any octet
+
+bool BERView::Empty() const
+{
+    return m_pbOctet==0;
+}
+
+TagClass BERView::Class() const
+{
+    return m_tcClass;
+}
+
+bool BERView::Constructed() const
+{
+    return m_fConstructed;
+}
+
+unsigned int BERView::Tag() const
+{
+    return m_dwTag;
+}
+
+unsigned char const *BERView::Octet() const
+{
+    return m_pbOctet;
+}
+
+size_t BERView::OctetSize() const
+{
+    return m_pbEnd - m_pbOctet;
+}
+
+unsigned char const *BERView::Data() const
+{
+    return m_pbData;
+}
+
+size_t BERView::DataSize() const
+{
+    return m_pbEnd - m_pbData;
+}
+
+// Copies of the octet and of its data part, for callers that keep them
+
+BEROctet::Blob BERView::OctetBlob() const
+{
+    return BEROctet::Blob(m_pbOctet, OctetSize());
+}
+
+BEROctet::Blob BERView::DataBlob() const
+{
+    return BEROctet::Blob(m_pbData, DataSize());
+}
+
+// Returns the first sub-octet of a constructed octet
+
+BERView BERView::FirstSubOctet() const
+{
+    if(!m_fConstructed)
+        throw std::runtime_error("BERInconsistentOperation");
+
+    BERView sub;
+    if(m_pbData<m_pbEnd)
+        sub.Decode(m_pbData, m_pbEnd);
+
+    return sub;
+}
+
+// Returns the octet following this one in the enclosing octet (or buffer)
+
+BERView BERView::NextOctet() const
+{
+    BERView next;
+    if(m_pbOctet && m_pbEnd<m_pbLimit)
+        next.Decode(m_pbEnd, m_pbLimit);
+
+    return next;
+}
+
+size_t BERView::SubOctetCount() const
+{
+    size_t n = 0;
+    for(BERView sub = FirstSubOctet(); !sub.Empty(); sub = sub.NextOctet())
+        n++;
+
+    return n;
+}
+
+BERView BERView::SubOctet(size_t index) const
+{
+    BERView sub = FirstSubOctet();
+    while(index-- && !sub.Empty())
+        sub = sub.NextOctet();
+
+    if(sub.Empty())
+        throw std::runtime_error("BERInconsistentOperation");
+
+    return sub;
+}
+
+std::string BERView::ObjectID() const
+{
+    if(m_tcClass!=tcUniversal || m_dwTag!=dwBerUnivObjectIdent)
+        throw std::runtime_error("BERInconsistentOperation");
+
+    return DecodeObjectID(m_pbData, DataSize());
+}
+
+// Compares the OID with one encoded by EncodeOID, without decoding it
+
+bool BERView::IsObjectID(BEROctet::Blob const &blbOID) const
+{
+    if(m_tcClass!=tcUniversal || m_dwTag!=dwBerUnivObjectIdent)
+        return false;
+
+    return DataSize()==blbOID.size() && !memcmp(m_pbData, blbOID.data(), blbOID.size());
+}
+
+std::string BERView::Time() const
+{
+    if(m_tcClass!=tcUniversal)
+        throw std::runtime_error("BERInconsistentOperation");
+
+    return DecodeTime(m_dwTag, m_pbData, DataSize());
+}
+
+// Same results as BEROctet::SearchOID and BEROctet::SearchOIDNext.
+// The OID is encoded once and compared as raw octets while walking.
+
+void BERView::SearchOID(std::string const &OID, std::vector<BERView> &result) const
+{
+    SearchOID(EncodeOID(OID), false, result);
+}
+
+void BERView::SearchOIDNext(std::string const &OID, std::vector<BERView> &result) const
+{
+    SearchOID(EncodeOID(OID), true, result);
+}
+
+void BERView::SearchOID(BEROctet::Blob const &blbOID, bool fNext, std::vector<BERView> &result) const
+{
+    if(!m_fConstructed)
+        return;
+
+    for(BERView sub = FirstSubOctet(); !sub.Empty(); sub = sub.NextOctet())
+    {
+        if(sub.Class()==tcUniversal && sub.Tag()==dwBerUnivObjectIdent)
+        {
+            if(sub.IsObjectID(blbOID))
+            {
+                if(!fNext)
+                    result.push_back(*this);
+                else
+                {
+                    BERView next = sub.NextOctet();
+                    if(!next.Empty())
+                        result.push_back(next);
+                }
+            }
+        }
+        else if(sub.Constructed())
+            sub.SearchOID(blbOID, fNext, result);
     }
+}
+
+// Returns the data octets of an OID given as "X Y Z ..."
+
+BEROctet::Blob BERView::EncodeOID(std::string const &OID)
+{
+    BEROctet oct(tcUniversal, fBerPcPrimitive, dwBerUnivObjectIdent);
+    oct.ObjectID(OID);
+
+    return oct.Data();
+}
+
+// Decodes the identifier and length octets at pbOctet.
+// The octet must end at or before pbLimit.
+
+void BERView::Decode(unsigned char const *pbOctet, unsigned char const *pbLimit)
+{
+
+    if(pbOctet>=pbLimit)
+        throw std::runtime_error("BEREmptyOctet");
 
-    const unsigned char *c = blb.data();
-    const unsigned char *Last = c + blb.size() - 1;
-    m_dwTag = *c & 0x1F;
+    const unsigned char *c = pbOctet;
+    const unsigned char *Last = pbLimit - 1;
 
-    if(m_dwTag>30)
+    bool fConstructed = (*c & 0x20) ? true : false;
+    TagClass tcClass = static_cast<TagClass>((*c & 0xC0) >> 6);
+    unsigned int dwTag = *c & 0x1F;
+
+    if(dwTag>30)
     {
-        m_dwTag = 0;
+        dwTag = 0;
 
         c++;
         if(c>Last)
@@ -657,16 +937,16 @@ void BEROctet::Decode(Blob const &blb)
 
         while (*c & 0x80)
         {
-            m_dwTag = (m_dwTag << 7) | ((*c) & 0x7F);
+            dwTag = (dwTag << 7) | ((*c) & 0x7F);
             c++;
             if(c>Last)
                 throw std::runtime_error("BERUnexpectedEndOfOctet");
         }
 
-        if(m_dwTag > 0x01FFFFFF)
+        if(dwTag > 0x01FFFFFF)
             throw std::runtime_error("BERTagValueOverflow");
 
-        m_dwTag = (m_dwTag << 7) | ((*c) & 0x7F);
+        dwTag = (dwTag << 7) | ((*c) & 0x7F);
 
     }
 
@@ -698,64 +978,15 @@ void BEROctet::Decode(Blob const &blb)
 
     c++;
 
-    const unsigned char *bpData = c;
-
-    size_t OctetSize = DataSize + (bpData-blb.data());
-
-    m_blbOrigOctet = blb.substr(0,OctetSize);
-    m_fModified = false;
-
-    if(OctetSize>static_cast<unsigned int>(BufferSize))
+    if(DataSize>static_cast<size_t>(pbLimit-c))
         throw std::runtime_error("BERInconsistentDataLength");
 
-    size_t l = m_SubOctetList.size( );
-    for( std::vector< BEROctet const* >::size_type i = 0; i < l; ++i ) {
-     
-        delete m_SubOctetList[i];
-    }
-
-    m_SubOctetList.resize(0);
-    m_blbData = Blob();
-
-    if(m_fConstructed)
-    {
-
-        // Constructed type
-
-        while(DataSize)
-        {
-
-            BEROctet *suboct = new BEROctet(Blob(bpData,DataSize));
-
-            m_SubOctetList.push_back(suboct);
-
-            Blob blbSubOct = suboct->Octet();
-
-            bpData += blbSubOct.size();
-            DataSize -= blbSubOct.size();
-        }
-    }
-    else
-        m_blbData = Blob(bpData,DataSize);
-
-}
-
-bool BEROctet::Modified() const
-{
-    if(m_fModified)
-        return true;
-
-    if(m_fConstructed) {
-        std::vector< BEROctet const* >::size_type l = m_SubOctetList.size( );
-        for( std::vector< BEROctet const* >::size_type i = 0; i < l; ++i ) {
-
-            if(m_SubOctetList[i]->Modified()) {
-                
-                return true;
-            }
-        }
-    }
-
-    return false;
+    m_pbOctet      = pbOctet;
+    m_pbData       = c;
+    m_pbEnd        = c + DataSize;
+    m_pbLimit      = pbLimit;
+    m_tcClass      = tcClass;
+    m_fConstructed = fConstructed;
+    m_dwTag        = dwTag;
 
 }
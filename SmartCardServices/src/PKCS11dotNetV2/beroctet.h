@@ -159,6 +159,8 @@ const char OID_Netscape_certificate_type[]        = "2 16 840 1 113730 1 1";
 const bool fBerPcPrimitive = false;
 const bool fBerPcConstructed = true;
 
+class BERView;
+
 class BEROctet
 {
 
@@ -198,6 +200,7 @@ private:
     static Blob LengthOctets(unsigned int dwLength);
 
     void Decode(Blob const &blb);
+    void Decode(BERView const &view);
     bool Modified() const;               // =true if octet or sub-octets are modified since decoding
 
     Blob m_blbOrigOctet;            // Original octet that was decoded
@@ -213,6 +216,62 @@ private:
 
 };
 
+// Read-only view of an octet inside a buffer owned by someone else.
+// Only the identifier and length octets are decoded when a view is made;
+// sub-octets are decoded on demand while walking, so nothing is copied
+// and nothing is allocated. The buffer must outlive the views on it.
+
+class BERView
+{
+
+public:
+    BERView();
+    BERView(unsigned char const *pbBuffer, size_t cbBuffer);
+    explicit BERView(BEROctet::Blob const &blb);
+
+    bool Empty() const;
+
+    TagClass Class() const;
+    bool Constructed() const;
+    unsigned int Tag() const;
+
+    unsigned char const *Octet() const;     // Identifier, length and data octets
+    size_t OctetSize() const;
+    unsigned char const *Data() const;      // Data octets only
+    size_t DataSize() const;
+
+    BEROctet::Blob OctetBlob() const;
+    BEROctet::Blob DataBlob() const;
+
+    BERView FirstSubOctet() const;          // Empty view if there is none
+    BERView NextOctet() const;              // Next octet in the enclosing one, empty view after the last
+    size_t SubOctetCount() const;
+    BERView SubOctet(size_t index) const;
+
+    std::string ObjectID() const;
+    bool IsObjectID(BEROctet::Blob const &blbOID) const;  // blbOID: encoded OID data octets
+    std::string Time() const;
+
+    void SearchOID(std::string const &OID, std::vector<BERView> &result) const;
+    void SearchOIDNext(std::string const &OID, std::vector<BERView> &result) const;
+
+    static BEROctet::Blob EncodeOID(std::string const &OID);
+
+private:
+    void Decode(unsigned char const *pbOctet, unsigned char const *pbLimit);
+    void SearchOID(BEROctet::Blob const &blbOID, bool fNext, std::vector<BERView> &result) const;
+
+    unsigned char const *m_pbOctet;         // First identifier octet, 0 when empty
+    unsigned char const *m_pbData;          // First data octet
+    unsigned char const *m_pbEnd;           // Past the last data octet
+    unsigned char const *m_pbLimit;         // Past the enclosing data, where NextOctet() stops
+
+    TagClass m_tcClass;
+    bool m_fConstructed;
+    unsigned int m_dwTag;
+
+};
+
 
 #endif // _include_beroctet_h
 
@@ -53,82 +53,147 @@ bool CCertUtils::IsInteger(BYTE *content)
 
 
 //------------------------------------------------------------------------------
-// int ExtractContent(ASN1 *pAsn1)
+// void LocateNames(BYTE *pCert, DWORD dwCertLen,
+//                  BERView *pSerialNumber, BERView *pIssuer, BERView *pSubject)
 //
-// Description : Extract contents of a Asn1 block 'pAsn1->Asn1' and place it
-//              in 'pAsn1->Content'.
+// Description : Points the views at the serialNumber, issuer and subject
+//               fields of the TBSCertificate. Nothing is copied.
 //
-// Remarks     : Field Asn1.pData is allocated by calling function.
-//
-// In          : pAsn1->Asn1.pData
-//
-// Out         : This fileds are filled (if RV_SUCCESS) :
-//                - Tag
-//                - Asn1.usLen
-//                - Content.usLen
-//                - Content.pData
+// In          : pCert : Value of a X509 certificate.
+//               dwCertLen : Length of value.
 //
-// Responses   : RV_SUCCESS : All is OK.
-//               RV_INVALID_DATA : Asn1 block format not supported.
+// Throws      : std::runtime_error if the certificate is malformed.
 //
 //------------------------------------------------------------------------------
-int CCertUtils::ExtractContent(ASN1 *pAsn1)
-
+void CCertUtils::LocateNames(BYTE *pCert, DWORD dwCertLen,
+                             BERView *pSerialNumber,
+                             BERView *pIssuer,
+                             BERView *pSubject
+                            )
 {
-   BYTE
-      *pData;
+   BERView
+      Value(pCert, dwCertLen),
+      tbsCert,
+      Current;
    int
-      NbBytes,
       i;
 
-   pData = pAsn1->Asn1.pData;
+   tbsCert = Value.FirstSubOctet();
+   Current = tbsCert.FirstSubOctet();
 
-   if ((pData[0] & 0x1F) == 0x1F)
+   if (    (Current.Class() == tcContext)
+        && (Current.Tag() == (TAG_OPTION_VERSION & 0x1F))
+      )
    {
-      // High-tag-number : not supported
-      return(RV_INVALID_DATA);
-   }
-   else
-   {
-      pAsn1->Tag = pData[0];
+      // We have A0 03 02 01 vv  where vv is the version
+      Current = Current.NextOctet();
    }
 
-   if (pData[1] == 0x80)
+   // serialNumber, signature, issuer, validity, subject
+   BERView Fields[5];
+   for (i = 0; i < 5; i++)
    {
-      // Constructed, indefinite-length method : not supported
-      return(RV_INVALID_DATA);
-   }
-   else if (pData[1] > 0x82)
-   {
-      // Constructed, definite-length method : too long
-      return(RV_INVALID_DATA);
+      if (Current.Empty())
+      {
+         throw std::runtime_error("X509CertFormatError");
+      }
+      Fields[i] = Current;
+      Current = Current.NextOctet();
    }
-   else if (pData[1] < 0x80)
-   {
-      // Primitive, definite-length method
 
-      pAsn1->Content.usLen = pData[1];
-      pAsn1->Content.pData = &pData[2];
+   *pSerialNumber = Fields[0];
+   *pIssuer = Fields[2];
+   *pSubject = Fields[4];
+}
 
-      pAsn1->Asn1.usLen = ( USHORT )( pAsn1->Content.usLen + 2 );
-   }
-   else
-   {
-      // Constructed, definite-length method
 
-      NbBytes = pData[1] & 0x7F;
+//------------------------------------------------------------------------------
+// void FindAttribute(const BERView &name, const BEROctet::Blob &blbOID,
+//                    BLOC *pValue)
+//
+// Description : Walks the RDNs of a Name and points 'pValue' at the content
+//               of the last AttributeValue whose type is 'blbOID' (as
+//               encoded by BERView::EncodeOID). 'pValue' is left untouched
+//               when there is none.
+//
+//------------------------------------------------------------------------------
+void CCertUtils::FindAttribute(const BERView &name,
+                               const BEROctet::Blob &blbOID,
+                               BLOC *pValue
+                              )
+{
+   BERView
+      RDN,
+      AVA,
+      AttributeTypePart,
+      AttributeValuePart;
 
-      pAsn1->Content.usLen = 0;
-      for (i = 0; i < NbBytes; i++)
+   for (RDN = name.FirstSubOctet(); !RDN.Empty(); RDN = RDN.NextOctet())
+   {
+      for (AVA = RDN.FirstSubOctet(); !AVA.Empty(); AVA = AVA.NextOctet())
       {
-          pAsn1->Content.usLen = ( USHORT )( ( pAsn1->Content.usLen << 8 ) + pData[ 2 + i ] );
+         AttributeTypePart = AVA.FirstSubOctet();
+         if (AttributeTypePart.Empty())
+         {
+            throw std::runtime_error("X509CertFormatError");
+         }
+
+         AttributeValuePart = AttributeTypePart.NextOctet();
+         if (AttributeValuePart.Empty() || (AttributeValuePart.DataSize() > 0xFFFF))
+         {
+            throw std::runtime_error("X509CertFormatError");
+         }
+
+         if (AttributeTypePart.IsObjectID(blbOID))
+         {
+            pValue->pData = const_cast<BYTE_PTR>(AttributeValuePart.Data());
+            pValue->usLen = ( USHORT )AttributeValuePart.DataSize();
+         }
       }
-      pAsn1->Content.pData = &pData[2+NbBytes];
+   }
+}
+
 
-      pAsn1->Asn1.usLen = ( USHORT )( pAsn1->Content.usLen + 2 + NbBytes );
+//------------------------------------------------------------------------------
+// void LocateLabelParts(BYTE *pCert, DWORD dwCertLen, BERView *pSerialNumber,
+//                       BLOC *pOrganizationName, BLOC *pCommonName)
+//
+// Description : Finds what a certificate label is made of: the
+//               OrganizationName of the Issuer (its CommonName if it has
+//               none) and the CommonName of the Subject.
+//
+//------------------------------------------------------------------------------
+void CCertUtils::LocateLabelParts(BYTE *pCert, DWORD dwCertLen,
+                                  BERView *pSerialNumber,
+                                  BLOC *pOrganizationName,
+                                  BLOC *pCommonName
+                                 )
+{
+   BERView
+      issuerPart,
+      subjectPart;
+   BEROctet::Blob
+      blbOrganizationName(BERView::EncodeOID(OID_id_at_organizationName)),
+      blbCommonName(BERView::EncodeOID(OID_id_at_commonName));
+
+   pOrganizationName->pData = NULL;
+   pOrganizationName->usLen = 0;
+   pCommonName->pData = NULL;
+   pCommonName->usLen = 0;
+
+   LocateNames(pCert, dwCertLen, pSerialNumber, &issuerPart, &subjectPart);
+
+   // Search field 'OrganizationName' in 'Issuer'
+   FindAttribute(issuerPart, blbOrganizationName, pOrganizationName);
+
+   // If no 'OrganizationName' is 'Issuer' search for 'CommonName' in 'Issuer'
+   if (pOrganizationName->usLen == 0)
+   {
+      FindAttribute(issuerPart, blbCommonName, pOrganizationName);
    }
 
-   return(RV_SUCCESS);
+   // Search 'CommonName' in 'Subject'
+   FindAttribute(subjectPart, blbCommonName, pCommonName);
 }
 
 //------------------------------------------------------------------------------
@@ -231,27 +296,19 @@ BYTE* CCertUtils::GetDERLength(BYTE *content, DWORD *len)
 //               false: Parsing fails.
 //
 //------------------------------------------------------------------------------
-bool CCertUtils::ParseCertificateValue(BYTE *pCert,         DWORD /*dwCertLen*/,
+bool CCertUtils::ParseCertificateValue(BYTE *pCert,         DWORD dwCertLen,
                                        BYTE *pSerialNumber, DWORD *pdwSerialNumberLen,
                                        BYTE *pIssuer,       DWORD *pdwIssuerLen,
                                        BYTE *pSubject,      DWORD *pdwSubjectLen
                                       )
 
 {
-   ASN1
-      Value,
-      tbsCert,
+   BERView
       serialNumberPart,
-      signaturePart,
       issuerPart,
-      validityPart,
       subjectPart;
    bool
       bValuesToBeReturned;
-   BYTE
-      *pCurrent;
-   int
-      rv;
    DWORD
       SerialNumberLen,
       IssuerLen,
@@ -263,51 +320,19 @@ bool CCertUtils::ParseCertificateValue(BYTE *pCert,         DWORD /*dwCertLen*/,
                         && (pSubject != NULL);
 
 
-   Value.Asn1.pData = pCert;
-   rv = ExtractContent(&Value);
-   if (rv != RV_SUCCESS) return false;
-
-   tbsCert.Asn1.pData = Value.Content.pData;
-   rv = ExtractContent(&tbsCert);
-   if (rv != RV_SUCCESS) return false;
-
-
-   pCurrent = tbsCert.Content.pData;
-   if (pCurrent[0] == TAG_OPTION_VERSION)
+   try
    {
-      // We have A0 03 02 01 vv  where vv is the version
-      pCurrent += 5;
+      LocateNames(pCert, dwCertLen, &serialNumberPart, &issuerPart, &subjectPart);
+   }
+   catch (std::exception &)
+   {
+      return false;
    }
-
-   serialNumberPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&serialNumberPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = serialNumberPart.Content.pData + serialNumberPart.Content.usLen;
-
-   signaturePart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&signaturePart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = signaturePart.Content.pData + signaturePart.Content.usLen;
-
-   issuerPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&issuerPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = issuerPart.Content.pData + issuerPart.Content.usLen;
-
-   validityPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&validityPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = validityPart.Content.pData + validityPart.Content.usLen;
-
-   subjectPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&subjectPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = subjectPart.Content.pData + subjectPart.Content.usLen;
 
 
-   SerialNumberLen = serialNumberPart.Content.usLen;
-   IssuerLen = issuerPart.Asn1.usLen;
-   SubjectLen = subjectPart.Asn1.usLen;
+   SerialNumberLen = ( DWORD )serialNumberPart.DataSize();
+   IssuerLen = ( DWORD )issuerPart.OctetSize();
+   SubjectLen = ( DWORD )subjectPart.OctetSize();
 
    if (bValuesToBeReturned)
    {
@@ -318,9 +343,9 @@ bool CCertUtils::ParseCertificateValue(BYTE *pCert,         DWORD /*dwCertLen*/,
       {
          return(false);
       }
-      memcpy(pSerialNumber, serialNumberPart.Content.pData, SerialNumberLen);
-      memcpy(pIssuer, issuerPart.Asn1.pData, IssuerLen);
-      memcpy(pSubject, subjectPart.Asn1.pData, SubjectLen);
+      memcpy(pSerialNumber, serialNumberPart.Data(), SerialNumberLen);
+      memcpy(pIssuer, issuerPart.Octet(), IssuerLen);
+      memcpy(pSubject, subjectPart.Octet(), SubjectLen);
       *pdwSerialNumberLen = SerialNumberLen;
       *pdwIssuerLen = IssuerLen;
       *pdwSubjectLen = SubjectLen;
@@ -339,207 +364,28 @@ bool CCertUtils::ParseCertificateValue(BYTE *pCert,         DWORD /*dwCertLen*/,
 // ------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------
 bool CCertUtils::MakeCertificateLabel(BYTE  *pCert,
-                                      DWORD  /*dwCertLen*/,
+                                      DWORD  dwCertLen,
                                       BYTE  *pLabel,
                                       DWORD *pdwLabelLen
                                      )
 {
-   ASN1
-        AttributeTypePart,
-        AttributeValuePart,
-        AVA,
-        RDN,
-      Value,
-      tbsCert,
-      serialNumberPart,
-      signaturePart,
-      issuerPart,
-      validityPart,
-      subjectPart;
+   BERView
+      serialNumberPart;
     BLOC
         OrganizationName,
         CommonName;
    bool
       bValuesToBeReturned;
-   BYTE
-      *pCurrentRDN,
-      *pCurrent;
-   int
-      rv;
-
-    OrganizationName.pData = NULL;
-    OrganizationName.usLen = 0;
-    CommonName.pData = NULL;
-    CommonName.usLen = 0;
 
     bValuesToBeReturned =   (pLabel != NULL);
 
-   Value.Asn1.pData = pCert;
-   rv = ExtractContent(&Value);
-   if (rv != RV_SUCCESS) return false;
-
-   tbsCert.Asn1.pData = Value.Content.pData;
-   rv = ExtractContent(&tbsCert);
-   if (rv != RV_SUCCESS) return false;
-
-
-   pCurrent = tbsCert.Content.pData;
-   if (pCurrent[0] == TAG_OPTION_VERSION)
+   try
    {
-      /* We have A0 03 02 01 vv  where vv is the version                      */
-      pCurrent += 5;
+      LocateLabelParts(pCert, dwCertLen, &serialNumberPart, &OrganizationName, &CommonName);
    }
-
-   serialNumberPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&serialNumberPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = serialNumberPart.Content.pData + serialNumberPart.Content.usLen;
-
-   signaturePart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&signaturePart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = signaturePart.Content.pData + signaturePart.Content.usLen;
-
-   issuerPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&issuerPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = issuerPart.Content.pData + issuerPart.Content.usLen;
-
-   validityPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&validityPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = validityPart.Content.pData + validityPart.Content.usLen;
-
-   subjectPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&subjectPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = subjectPart.Content.pData + subjectPart.Content.usLen;
-
-
-    // Search field 'OrganizationName' in 'Issuer'
-   pCurrent = issuerPart.Content.pData;
-
-   while (pCurrent < issuerPart.Content.pData + issuerPart.Content.usLen)
+   catch (std::exception &)
    {
-      RDN.Asn1.pData = pCurrent;
-      rv = ExtractContent(&RDN);
-      if (rv != RV_SUCCESS) return false;
-
-        pCurrentRDN = RDN.Content.pData;
-
-        while (pCurrentRDN < RDN.Content.pData + RDN.Content.usLen)
-        {
-            AVA.Asn1.pData = pCurrentRDN;
-            rv = ExtractContent(&AVA);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeTypePart.Asn1.pData = AVA.Content.pData;
-            rv = ExtractContent(&AttributeTypePart);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeValuePart.Asn1.pData = AttributeTypePart.Content.pData
-                                                    + AttributeTypePart.Content.usLen;
-            rv = ExtractContent(&AttributeValuePart);
-            if (rv != RV_SUCCESS) return false;
-
-            // Search 'OrganisationName'
-            if (!memcmp("\x55\x04\x0A",
-                            AttributeTypePart.Content.pData,
-                            AttributeTypePart.Content.usLen)
-                )
-            {
-                OrganizationName = AttributeValuePart.Content;
-            }
-
-            pCurrentRDN = AVA.Content.pData + AVA.Content.usLen;
-        }
-
-        pCurrent = RDN.Content.pData + RDN.Content.usLen;
-   }
-
-   // If no 'OrganizationName' is 'Issuer' search for 'CommonName' in 'Subject'
-   if (OrganizationName.usLen == 0)
-   {
-      pCurrent = issuerPart.Content.pData;
-
-      while (pCurrent < issuerPart.Content.pData + issuerPart.Content.usLen)
-      {
-         RDN.Asn1.pData = pCurrent;
-         rv = ExtractContent(&RDN);
-         if (rv != RV_SUCCESS) return false;
-
-         pCurrentRDN = RDN.Content.pData;
-
-         while (pCurrentRDN < RDN.Content.pData + RDN.Content.usLen)
-         {
-               AVA.Asn1.pData = pCurrentRDN;
-               rv = ExtractContent(&AVA);
-               if (rv != RV_SUCCESS) return false;
-
-               AttributeTypePart.Asn1.pData = AVA.Content.pData;
-               rv = ExtractContent(&AttributeTypePart);
-               if (rv != RV_SUCCESS) return false;
-
-               AttributeValuePart.Asn1.pData = AttributeTypePart.Content.pData
-                                                      + AttributeTypePart.Content.usLen;
-               rv = ExtractContent(&AttributeValuePart);
-               if (rv != RV_SUCCESS) return false;
-
-               // Search 'CommonName'
-               if (!memcmp("\x55\x04\x03",
-                              AttributeTypePart.Content.pData,
-                              AttributeTypePart.Content.usLen)
-                  )
-               {
-                  OrganizationName = AttributeValuePart.Content;
-               }
-
-               pCurrentRDN = AVA.Content.pData + AVA.Content.usLen;
-         }
-
-         pCurrent = RDN.Content.pData + RDN.Content.usLen;
-      }
-   }
-
-   // Search 'CommonName' in 'Subject'
-   pCurrent = subjectPart.Content.pData;
-
-   while (pCurrent < subjectPart.Content.pData + subjectPart.Content.usLen)
-   {
-      RDN.Asn1.pData = pCurrent;
-      rv = ExtractContent(&RDN);
-      if (rv != RV_SUCCESS) return false;
-
-        pCurrentRDN = RDN.Content.pData;
-
-        while (pCurrentRDN < RDN.Content.pData + RDN.Content.usLen)
-        {
-            AVA.Asn1.pData = pCurrentRDN;
-            rv = ExtractContent(&AVA);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeTypePart.Asn1.pData = AVA.Content.pData;
-            rv = ExtractContent(&AttributeTypePart);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeValuePart.Asn1.pData = AttributeTypePart.Content.pData
-                                                    + AttributeTypePart.Content.usLen;
-            rv = ExtractContent(&AttributeValuePart);
-            if (rv != RV_SUCCESS) return false;
-
-            // Search 'CommonName'
-            if (!memcmp("\x55\x04\x03",
-                            AttributeTypePart.Content.pData,
-                            AttributeTypePart.Content.usLen)
-                )
-            {
-                CommonName = AttributeValuePart.Content;
-            }
-
-            pCurrentRDN = AVA.Content.pData + AVA.Content.usLen;
-        }
-
-        pCurrent = RDN.Content.pData + RDN.Content.usLen;
+      return false;
    }
 
     if (bValuesToBeReturned)
@@ -604,213 +450,40 @@ bool CCertUtils::MakeCertificateLabel(BYTE  *pCert,
 // ------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------
 bool CCertUtils::MakeCertificateLabelEx(BYTE  *pCert,
-                                        DWORD  /*dwCertLen*/,
+                                        DWORD  dwCertLen,
                                         BYTE  *pLabel,
                                         DWORD *pdwLabelLen
                                        )
 {
-   ASN1
-        AttributeTypePart,
-        AttributeValuePart,
-        AVA,
-        RDN,
-      Value,
-      tbsCert,
-      serialNumberPart,
-      signaturePart,
-      issuerPart,
-      validityPart,
-      subjectPart;
+   BERView
+      serialNumberPart;
     BLOC
         OrganizationName,
         CommonName;
    bool
       bValuesToBeReturned;
    BYTE
-      *pCurrentRDN,
-      *pCurrent,
       szSerialNumber[256] = "";
-   int
-      rv;
-
-    OrganizationName.pData = NULL;
-    OrganizationName.usLen = 0;
-    CommonName.pData = NULL;
-    CommonName.usLen = 0;
 
     bValuesToBeReturned =   (pLabel != NULL);
 
-   Value.Asn1.pData = pCert;
-   rv = ExtractContent(&Value);
-   if (rv != RV_SUCCESS) return false;
-
-   tbsCert.Asn1.pData = Value.Content.pData;
-   rv = ExtractContent(&tbsCert);
-   if (rv != RV_SUCCESS) return false;
-
-
-   pCurrent = tbsCert.Content.pData;
-   if (pCurrent[0] == TAG_OPTION_VERSION)
+   try
    {
-      /* We have A0 03 02 01 vv  where vv is the version                      */
-      pCurrent += 5;
+      LocateLabelParts(pCert, dwCertLen, &serialNumberPart, &OrganizationName, &CommonName);
    }
-
-   serialNumberPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&serialNumberPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = serialNumberPart.Content.pData + serialNumberPart.Content.usLen;
-
-   memset(szSerialNumber, 0x00, sizeof(szSerialNumber));
-
-   ConvAscii(serialNumberPart.Asn1.pData, serialNumberPart.Asn1.usLen, szSerialNumber);
-
-   signaturePart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&signaturePart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = signaturePart.Content.pData + signaturePart.Content.usLen;
-
-   issuerPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&issuerPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = issuerPart.Content.pData + issuerPart.Content.usLen;
-
-   validityPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&validityPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = validityPart.Content.pData + validityPart.Content.usLen;
-
-   subjectPart.Asn1.pData = pCurrent;
-   rv = ExtractContent(&subjectPart);
-   if (rv != RV_SUCCESS) return false;
-   pCurrent = subjectPart.Content.pData + subjectPart.Content.usLen;
-
-
-    // Search field 'OrganizationName' in 'Issuer'
-   pCurrent = issuerPart.Content.pData;
-
-   while (pCurrent < issuerPart.Content.pData + issuerPart.Content.usLen)
+   catch (std::exception &)
    {
-      RDN.Asn1.pData = pCurrent;
-      rv = ExtractContent(&RDN);
-      if (rv != RV_SUCCESS) return false;
-
-        pCurrentRDN = RDN.Content.pData;
-
-        while (pCurrentRDN < RDN.Content.pData + RDN.Content.usLen)
-        {
-            AVA.Asn1.pData = pCurrentRDN;
-            rv = ExtractContent(&AVA);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeTypePart.Asn1.pData = AVA.Content.pData;
-            rv = ExtractContent(&AttributeTypePart);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeValuePart.Asn1.pData = AttributeTypePart.Content.pData
-                                                    + AttributeTypePart.Content.usLen;
-            rv = ExtractContent(&AttributeValuePart);
-            if (rv != RV_SUCCESS) return false;
-
-            // Search 'OrganisationName'
-            if (!memcmp("\x55\x04\x0A",
-                            AttributeTypePart.Content.pData,
-                            AttributeTypePart.Content.usLen)
-                )
-            {
-                OrganizationName = AttributeValuePart.Content;
-            }
-
-            pCurrentRDN = AVA.Content.pData + AVA.Content.usLen;
-        }
-
-        pCurrent = RDN.Content.pData + RDN.Content.usLen;
+      return false;
    }
 
-   // If no 'OrganizationName' is 'Issuer' search for 'CommonName' in 'Subject'
-   if (OrganizationName.usLen == 0)
+   if (serialNumberPart.OctetSize() * 2 >= sizeof(szSerialNumber))
    {
-      pCurrent = issuerPart.Content.pData;
-
-      while (pCurrent < issuerPart.Content.pData + issuerPart.Content.usLen)
-      {
-         RDN.Asn1.pData = pCurrent;
-         rv = ExtractContent(&RDN);
-         if (rv != RV_SUCCESS) return false;
-
-         pCurrentRDN = RDN.Content.pData;
-
-         while (pCurrentRDN < RDN.Content.pData + RDN.Content.usLen)
-         {
-               AVA.Asn1.pData = pCurrentRDN;
-               rv = ExtractContent(&AVA);
-               if (rv != RV_SUCCESS) return false;
-
-               AttributeTypePart.Asn1.pData = AVA.Content.pData;
-               rv = ExtractContent(&AttributeTypePart);
-               if (rv != RV_SUCCESS) return false;
-
-               AttributeValuePart.Asn1.pData = AttributeTypePart.Content.pData
-                                                      + AttributeTypePart.Content.usLen;
-               rv = ExtractContent(&AttributeValuePart);
-               if (rv != RV_SUCCESS) return false;
-
-               // Search 'CommonName'
-               if (!memcmp("\x55\x04\x03",
-                              AttributeTypePart.Content.pData,
-                              AttributeTypePart.Content.usLen)
-                  )
-               {
-                  OrganizationName = AttributeValuePart.Content;
-               }
-
-               pCurrentRDN = AVA.Content.pData + AVA.Content.usLen;
-         }
-
-         pCurrent = RDN.Content.pData + RDN.Content.usLen;
-      }
+      return false;
    }
 
-   // Search 'CommonName' in 'Subject'
-   pCurrent = subjectPart.Content.pData;
-
-   while (pCurrent < subjectPart.Content.pData + subjectPart.Content.usLen)
-   {
-      RDN.Asn1.pData = pCurrent;
-      rv = ExtractContent(&RDN);
-      if (rv != RV_SUCCESS) return false;
-
-        pCurrentRDN = RDN.Content.pData;
-
-        while (pCurrentRDN < RDN.Content.pData + RDN.Content.usLen)
-        {
-            AVA.Asn1.pData = pCurrentRDN;
-            rv = ExtractContent(&AVA);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeTypePart.Asn1.pData = AVA.Content.pData;
-            rv = ExtractContent(&AttributeTypePart);
-            if (rv != RV_SUCCESS) return false;
-
-            AttributeValuePart.Asn1.pData = AttributeTypePart.Content.pData
-                                                    + AttributeTypePart.Content.usLen;
-            rv = ExtractContent(&AttributeValuePart);
-            if (rv != RV_SUCCESS) return false;
-
-            // Search 'CommonName'
-            if (!memcmp("\x55\x04\x03",
-                            AttributeTypePart.Content.pData,
-                            AttributeTypePart.Content.usLen)
-                )
-            {
-                CommonName = AttributeValuePart.Content;
-            }
-
-            pCurrentRDN = AVA.Content.pData + AVA.Content.usLen;
-        }
+   memset(szSerialNumber, 0x00, sizeof(szSerialNumber));
 
-        pCurrent = RDN.Content.pData + RDN.Content.usLen;
-   }
+   ConvAscii(const_cast<BYTE_PTR>(serialNumberPart.Octet()), ( DWORD )serialNumberPart.OctetSize(), szSerialNumber);
 
     if (bValuesToBeReturned)
     {
@@ -30,6 +30,8 @@
 #endif
 #endif
 
+#include "beroctet.h"
+
 #define CERT_TYPE_UNKNOWN     (0)
 #define CERT_TYPE_USER        (1)
 #define CERT_TYPE_CA_ROOT     (2)
@@ -120,7 +122,24 @@ bool MakeCertificateLabelEx     (BYTE                   *pCert,
 
 
 private:
-int ExtractContent       (ASN1 *pAsn1);
+void LocateNames         (BYTE    *pCert,
+                          DWORD    dwCertLen,
+                          BERView *pSerialNumber,
+                          BERView *pIssuer,
+                          BERView *pSubject
+                         );
+
+void LocateLabelParts    (BYTE    *pCert,
+                          DWORD    dwCertLen,
+                          BERView *pSerialNumber,
+                          BLOC    *pOrganizationName,
+                          BLOC    *pCommonName
+                         );
+
+void FindAttribute       (const BERView        &name,
+                          const BEROctet::Blob &blbOID,
+                          BLOC                 *pValue
+                         );
 
 bool IsSequence          (BYTE *content);
 
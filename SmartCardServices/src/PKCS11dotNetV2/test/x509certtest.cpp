@@ -0,0 +1,357 @@
+/*
+ *  PKCS#11 library for .Net smart cards
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+// Checks of the BER decoder (BERView, BEROctet) and of X509Cert on
+// malformed octets and on two certificates made with OpenSSL:
+//
+//    s_RootCert   O=Example CA, CN=Example Root, serial 0x1001,
+//                 CA:TRUE, keyCertSign and cRLSign
+//    s_UserCert   O=Example Org, CN=Test Signer, serial 0x2002, issued
+//                 by s_RootCert, digitalSignature and keyEncipherment,
+//                 clientAuth and smartCardLogin
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "beroctet.h"
+#include "x509cert.h"
+
+static int s_Failures = 0;
+
+#define CHECK(cond) \
+   do { \
+      if( !(cond) ) { \
+         fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+         s_Failures++; \
+      } \
+   } while (0)
+
+// Decoding must throw std::runtime_error, and only that
+#define CHECK_THROWS(expr) \
+   do { \
+      bool bThrown = false; \
+      try { expr; } \
+      catch( std::runtime_error & ) { bThrown = true; } \
+      CHECK(bThrown && #expr); \
+   } while (0)
+
+static const unsigned char s_UserCert[] = {
+   0x30, 0x82, 0x02, 0x42, 0x30, 0x82, 0x01, 0xAB, 0xA0, 0x03, 0x02, 0x01,
+   0x02, 0x02, 0x02, 0x20, 0x02, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48,
+   0x86, 0xF7, 0x0D, 0x01, 0x01, 0x0B, 0x05, 0x00, 0x30, 0x2C, 0x31, 0x13,
+   0x30, 0x11, 0x06, 0x03, 0x55, 0x04, 0x0A, 0x0C, 0x0A, 0x45, 0x78, 0x61,
+   0x6D, 0x70, 0x6C, 0x65, 0x20, 0x43, 0x41, 0x31, 0x15, 0x30, 0x13, 0x06,
+   0x03, 0x55, 0x04, 0x03, 0x0C, 0x0C, 0x45, 0x78, 0x61, 0x6D, 0x70, 0x6C,
+   0x65, 0x20, 0x52, 0x6F, 0x6F, 0x74, 0x30, 0x1E, 0x17, 0x0D, 0x32, 0x36,
+   0x31, 0x30, 0x31, 0x39, 0x31, 0x31, 0x30, 0x38, 0x33, 0x35, 0x5A, 0x17,
+   0x0D, 0x33, 0x36, 0x31, 0x30, 0x31, 0x36, 0x31, 0x31, 0x30, 0x38, 0x33,
+   0x35, 0x5A, 0x30, 0x2C, 0x31, 0x14, 0x30, 0x12, 0x06, 0x03, 0x55, 0x04,
+   0x0A, 0x0C, 0x0B, 0x45, 0x78, 0x61, 0x6D, 0x70, 0x6C, 0x65, 0x20, 0x4F,
+   0x72, 0x67, 0x31, 0x14, 0x30, 0x12, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0C,
+   0x0B, 0x54, 0x65, 0x73, 0x74, 0x20, 0x53, 0x69, 0x67, 0x6E, 0x65, 0x72,
+   0x30, 0x81, 0x9F, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7,
+   0x0D, 0x01, 0x01, 0x01, 0x05, 0x00, 0x03, 0x81, 0x8D, 0x00, 0x30, 0x81,
+   0x89, 0x02, 0x81, 0x81, 0x00, 0xB0, 0x73, 0x40, 0x66, 0x13, 0x34, 0x70,
+   0xB5, 0xDC, 0xF5, 0x91, 0x30, 0x00, 0x7F, 0xEB, 0x37, 0x75, 0x82, 0xCE,
+   0xAD, 0x22, 0xEC, 0xBC, 0x5A, 0x3C, 0x82, 0xD8, 0x68, 0xBB, 0x82, 0x25,
+   0xCF, 0x5A, 0xD5, 0x45, 0xDD, 0x54, 0xF0, 0xC1, 0x11, 0xFB, 0xD6, 0x29,
+   0x95, 0x56, 0x23, 0x20, 0xD7, 0xCC, 0x04, 0xBD, 0x1A, 0x1C, 0x0C, 0xA6,
+   0x50, 0xCD, 0xAA, 0xA6, 0xB8, 0xA4, 0x4B, 0x1C, 0xFE, 0x67, 0x5C, 0xA9,
+   0x6C, 0xD1, 0xE6, 0x97, 0x10, 0xCE, 0x22, 0x24, 0xFC, 0x6F, 0x3B, 0x60,
+   0x6B, 0x4A, 0xEF, 0x35, 0xD7, 0x61, 0x44, 0x58, 0x5D, 0xBF, 0xC7, 0xC7,
+   0x4E, 0xAB, 0x37, 0x78, 0xF2, 0x08, 0x29, 0x6C, 0x43, 0x0D, 0xCA, 0xA1,
+   0xF9, 0xD9, 0x5F, 0xD8, 0x70, 0x05, 0x70, 0xF4, 0x08, 0x8A, 0x58, 0x35,
+   0xA2, 0x2B, 0xDA, 0xAB, 0xEA, 0x9B, 0xB2, 0xF9, 0x9C, 0xF5, 0x63, 0xED,
+   0x39, 0x02, 0x03, 0x01, 0x00, 0x01, 0xA3, 0x73, 0x30, 0x71, 0x30, 0x0E,
+   0x06, 0x03, 0x55, 0x1D, 0x0F, 0x01, 0x01, 0xFF, 0x04, 0x04, 0x03, 0x02,
+   0x05, 0xA0, 0x30, 0x1F, 0x06, 0x03, 0x55, 0x1D, 0x25, 0x04, 0x18, 0x30,
+   0x16, 0x06, 0x08, 0x2B, 0x06, 0x01, 0x05, 0x05, 0x07, 0x03, 0x02, 0x06,
+   0x0A, 0x2B, 0x06, 0x01, 0x04, 0x01, 0x82, 0x37, 0x14, 0x02, 0x02, 0x30,
+   0x1D, 0x06, 0x03, 0x55, 0x1D, 0x0E, 0x04, 0x16, 0x04, 0x14, 0xCC, 0x8B,
+   0x8A, 0x5C, 0x4C, 0x7D, 0x4C, 0x63, 0x8D, 0x04, 0x55, 0xD6, 0x84, 0xE1,
+   0x2A, 0x09, 0x48, 0x7A, 0x62, 0x63, 0x30, 0x1F, 0x06, 0x03, 0x55, 0x1D,
+   0x23, 0x04, 0x18, 0x30, 0x16, 0x80, 0x14, 0x7F, 0x67, 0x67, 0x48, 0x46,
+   0x08, 0x9B, 0x3D, 0x3A, 0x5F, 0x1F, 0x41, 0x7F, 0x84, 0xD0, 0x71, 0x9A,
+   0xA6, 0xC4, 0xEB, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7,
+   0x0D, 0x01, 0x01, 0x0B, 0x05, 0x00, 0x03, 0x81, 0x81, 0x00, 0x3F, 0x1E,
+   0x17, 0xC0, 0xCD, 0xE0, 0xDE, 0x6F, 0xD3, 0xF4, 0x1E, 0xF8, 0x3B, 0x0B,
+   0x20, 0x64, 0x54, 0x35, 0x31, 0xEF, 0xC1, 0xB9, 0xF2, 0xD0, 0xC8, 0x0B,
+   0x3F, 0x88, 0x6F, 0x57, 0xD7, 0x31, 0xC8, 0x99, 0x71, 0x88, 0xB7, 0x99,
+   0x41, 0x49, 0xEF, 0x69, 0x77, 0xB6, 0x08, 0x94, 0x0E, 0x77, 0x93, 0xDD,
+   0xA3, 0x39, 0xA3, 0x49, 0x09, 0x0B, 0xF0, 0x06, 0xD6, 0x17, 0xD6, 0x93,
+   0xC7, 0x23, 0xC3, 0x3F, 0xF7, 0x33, 0x10, 0x27, 0xEF, 0x89, 0x96, 0x1A,
+   0x4F, 0x20, 0xCB, 0x55, 0xDF, 0xB3, 0xE6, 0xFB, 0xAC, 0x80, 0x51, 0x81,
+   0xD9, 0x8B, 0xFA, 0xD8, 0xB9, 0x7A, 0x45, 0x05, 0x0D, 0x60, 0x38, 0x5F,
+   0x73, 0x31, 0x21, 0xBF, 0x7F, 0x34, 0xD6, 0x08, 0x1C, 0xFF, 0xF3, 0x30,
+   0x24, 0xAF, 0x84, 0xB8, 0xBF, 0xEA, 0x6E, 0xFA, 0x08, 0xAE, 0x92, 0xD8,
+   0x95, 0x9E, 0xE5, 0xE7, 0xA1, 0x70
+};
+
+static const unsigned char s_RootCert[] = {
+   0x30, 0x82, 0x02, 0x11, 0x30, 0x82, 0x01, 0x7A, 0xA0, 0x03, 0x02, 0x01,
+   0x02, 0x02, 0x02, 0x10, 0x01, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48,
+   0x86, 0xF7, 0x0D, 0x01, 0x01, 0x0B, 0x05, 0x00, 0x30, 0x2C, 0x31, 0x13,
+   0x30, 0x11, 0x06, 0x03, 0x55, 0x04, 0x0A, 0x0C, 0x0A, 0x45, 0x78, 0x61,
+   0x6D, 0x70, 0x6C, 0x65, 0x20, 0x43, 0x41, 0x31, 0x15, 0x30, 0x13, 0x06,
+   0x03, 0x55, 0x04, 0x03, 0x0C, 0x0C, 0x45, 0x78, 0x61, 0x6D, 0x70, 0x6C,
+   0x65, 0x20, 0x52, 0x6F, 0x6F, 0x74, 0x30, 0x1E, 0x17, 0x0D, 0x32, 0x36,
+   0x31, 0x30, 0x31, 0x39, 0x31, 0x31, 0x30, 0x38, 0x33, 0x35, 0x5A, 0x17,
+   0x0D, 0x33, 0x36, 0x31, 0x30, 0x31, 0x36, 0x31, 0x31, 0x30, 0x38, 0x33,
+   0x35, 0x5A, 0x30, 0x2C, 0x31, 0x13, 0x30, 0x11, 0x06, 0x03, 0x55, 0x04,
+   0x0A, 0x0C, 0x0A, 0x45, 0x78, 0x61, 0x6D, 0x70, 0x6C, 0x65, 0x20, 0x43,
+   0x41, 0x31, 0x15, 0x30, 0x13, 0x06, 0x03, 0x55, 0x04, 0x03, 0x0C, 0x0C,
+   0x45, 0x78, 0x61, 0x6D, 0x70, 0x6C, 0x65, 0x20, 0x52, 0x6F, 0x6F, 0x74,
+   0x30, 0x81, 0x9F, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7,
+   0x0D, 0x01, 0x01, 0x01, 0x05, 0x00, 0x03, 0x81, 0x8D, 0x00, 0x30, 0x81,
+   0x89, 0x02, 0x81, 0x81, 0x00, 0xAA, 0x71, 0x3F, 0x35, 0x7E, 0x05, 0x87,
+   0x82, 0xDF, 0x20, 0x5E, 0xDC, 0x00, 0xB8, 0x45, 0xE4, 0x01, 0xA9, 0x97,
+   0x90, 0x4B, 0x6F, 0x7E, 0x1A, 0x7E, 0x08, 0xBA, 0x96, 0x73, 0xDA, 0xCB,
+   0x32, 0xA5, 0xFE, 0x37, 0xB9, 0x0A, 0x6F, 0x5E, 0x3E, 0xE5, 0x03, 0x2D,
+   0x99, 0x9E, 0xFD, 0xA1, 0xAF, 0x49, 0x25, 0x99, 0x40, 0xF2, 0xB4, 0x38,
+   0x7D, 0xBC, 0x62, 0x03, 0x91, 0x73, 0xC5, 0x28, 0x42, 0xE7, 0xB3, 0x8A,
+   0x0F, 0x22, 0x99, 0xF8, 0x2B, 0xEF, 0xF1, 0xF3, 0x62, 0x66, 0x4C, 0x39,
+   0x74, 0x2E, 0xAC, 0x88, 0x2C, 0xB2, 0xFA, 0xE0, 0x54, 0xF4, 0x5B, 0xE6,
+   0xA7, 0x95, 0x01, 0x8E, 0x33, 0x53, 0xB6, 0x71, 0x33, 0xEB, 0x23, 0x5D,
+   0x69, 0xF1, 0x10, 0x01, 0x89, 0x75, 0xC0, 0x6A, 0x33, 0x7E, 0x3D, 0xA6,
+   0x0D, 0xE1, 0xDF, 0x07, 0x29, 0x3C, 0x35, 0x6F, 0x27, 0x81, 0x04, 0xE2,
+   0x0F, 0x02, 0x03, 0x01, 0x00, 0x01, 0xA3, 0x42, 0x30, 0x40, 0x30, 0x0F,
+   0x06, 0x03, 0x55, 0x1D, 0x13, 0x01, 0x01, 0xFF, 0x04, 0x05, 0x30, 0x03,
+   0x01, 0x01, 0xFF, 0x30, 0x0E, 0x06, 0x03, 0x55, 0x1D, 0x0F, 0x01, 0x01,
+   0xFF, 0x04, 0x04, 0x03, 0x02, 0x01, 0x06, 0x30, 0x1D, 0x06, 0x03, 0x55,
+   0x1D, 0x0E, 0x04, 0x16, 0x04, 0x14, 0x7F, 0x67, 0x67, 0x48, 0x46, 0x08,
+   0x9B, 0x3D, 0x3A, 0x5F, 0x1F, 0x41, 0x7F, 0x84, 0xD0, 0x71, 0x9A, 0xA6,
+   0xC4, 0xEB, 0x30, 0x0D, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D,
+   0x01, 0x01, 0x0B, 0x05, 0x00, 0x03, 0x81, 0x81, 0x00, 0x5F, 0x8F, 0x1B,
+   0x83, 0x97, 0x8B, 0x86, 0xC3, 0xBC, 0xF8, 0xD2, 0x75, 0x95, 0x7D, 0x54,
+   0xC6, 0x3C, 0x40, 0x65, 0x20, 0x37, 0xDC, 0x52, 0x85, 0x8D, 0xC6, 0x63,
+   0xB7, 0x9F, 0x9B, 0x60, 0x53, 0xE2, 0xE2, 0x3F, 0x3F, 0x2F, 0xAD, 0xA3,
+   0xD7, 0xBF, 0x85, 0x8A, 0x13, 0x21, 0xC8, 0x2F, 0x01, 0xE5, 0xD2, 0x60,
+   0xDA, 0x11, 0x5F, 0xF7, 0xD2, 0x94, 0x27, 0xBE, 0x70, 0x03, 0xCF, 0x45,
+   0x2F, 0x5C, 0x48, 0x0A, 0x96, 0x69, 0xBA, 0xF4, 0xD4, 0x0E, 0x25, 0xE5,
+   0x91, 0xB0, 0xDF, 0x23, 0xE1, 0x6F, 0x47, 0x35, 0xC0, 0x94, 0xE4, 0xAE,
+   0xF3, 0x6B, 0xE7, 0xEE, 0xCA, 0x34, 0xBB, 0x71, 0x80, 0x2C, 0xC2, 0x95,
+   0xFA, 0xE0, 0x54, 0x95, 0xAF, 0x59, 0x61, 0xCB, 0x0A, 0x6F, 0x28, 0x7D,
+   0x4C, 0x1B, 0xA1, 0x70, 0x2C, 0xE6, 0x4D, 0x71, 0x7C, 0x09, 0xEC, 0x4F,
+   0x86, 0xEC, 0x6B, 0x3D, 0x4A
+};
+
+static BEROctet::Blob MakeBlob( const unsigned char *pbData, size_t cbData )
+{
+   return BEROctet::Blob( pbData, cbData );
+}
+
+#define BLOB(a) MakeBlob( a, sizeof(a) )
+
+static std::string AsString( const BEROctet::Blob &blb )
+{
+   return std::string( (const char*)blb.data( ), blb.size( ) );
+}
+
+
+// Length octets: short and long form, truncated, larger than the data
+// and too large to be a length at all
+
+static void TestLengthOctets( )
+{
+   // OCTET STRING of 2 bytes, short and (non minimal) long form
+   const unsigned char shortForm[] = { 0x04, 0x02, 0xAA, 0xBB };
+   const unsigned char longForm[] = { 0x04, 0x82, 0x00, 0x02, 0xAA, 0xBB };
+   BERView v1( shortForm, sizeof(shortForm) );
+   BERView v2( longForm, sizeof(longForm) );
+   CHECK( v1.Tag( ) == dwBerUnivOctetString && v1.DataSize( ) == 2 && v1.Data( )[ 1 ] == 0xBB );
+   CHECK( v2.DataSize( ) == 2 && v2.OctetSize( ) == sizeof(longForm) && v2.Data( ) == longForm + 4 );
+   CHECK( BEROctet( BLOB(longForm) ).Data( ) == MakeBlob( shortForm + 2, 2 ) );
+
+   // Identifier only, and long form cut in the middle of its length octets
+   const unsigned char noLength[] = { 0x04 };
+   const unsigned char cutLength[] = { 0x04, 0x82, 0x01 };
+   CHECK_THROWS( BERView( noLength, sizeof(noLength) ) );
+   CHECK_THROWS( BERView( cutLength, sizeof(cutLength) ) );
+   CHECK_THROWS( BEROctet( BLOB(cutLength) ) );
+
+   // Announces more data than there is
+   const unsigned char shortData[] = { 0x04, 0x03, 0xAA, 0xBB };
+   const unsigned char longData[] = { 0x04, 0x81, 0x80, 0xAA, 0xBB };
+   CHECK_THROWS( BERView( shortData, sizeof(shortData) ) );
+   CHECK_THROWS( BERView( longData, sizeof(longData) ) );
+   CHECK_THROWS( BEROctet( BLOB(longData) ) );
+
+   // 16 MB announced in four length octets, and five length octets
+   const unsigned char hugeLength[] = { 0x04, 0x84, 0x01, 0x00, 0x00, 0x00, 0xAA };
+   const unsigned char overlongLength[] = { 0x04, 0x85, 0x01, 0x00, 0x00, 0x00, 0x00, 0xAA };
+   CHECK_THROWS( BERView( hugeLength, sizeof(hugeLength) ) );
+   CHECK_THROWS( BERView( overlongLength, sizeof(overlongLength) ) );
+   CHECK_THROWS( BEROctet( BLOB(overlongLength) ) );
+
+   // A sub-octet must fit in its enclosing octet, not only in the buffer
+   const unsigned char escaping[] = { 0x30, 0x03, 0x04, 0x03, 0xAA, 0xBB, 0xCC };
+   BERView seq( escaping, sizeof(escaping) );
+   CHECK_THROWS( seq.FirstSubOctet( ) );
+   CHECK_THROWS( BEROctet( MakeBlob( escaping, 5 ) ) );
+
+   CHECK_THROWS( BERView( shortForm, 0 ) );
+}
+
+// DER certificates never use the indefinite form; it is rejected for
+// primitive and constructed octets, also inside a definite one
+
+static void TestIndefiniteLength( )
+{
+   const unsigned char constructed[] = { 0x30, 0x80, 0x04, 0x01, 0xAA, 0x00, 0x00 };
+   const unsigned char primitive[] = { 0x04, 0x80, 0xAA, 0x00, 0x00 };
+   const unsigned char nested[] = { 0x30, 0x06, 0x30, 0x80, 0x05, 0x00, 0x00, 0x00 };
+
+   CHECK_THROWS( BERView( constructed, sizeof(constructed) ) );
+   CHECK_THROWS( BERView( primitive, sizeof(primitive) ) );
+   CHECK_THROWS( BEROctet( BLOB(constructed) ) );
+   CHECK_THROWS( BEROctet( BLOB(nested) ) );
+
+   BERView outer( nested, sizeof(nested) );
+   CHECK_THROWS( outer.FirstSubOctet( ) );
+   CHECK_THROWS( X509Cert( nested, sizeof(nested) ) );
+}
+
+// OIDs are found at any depth. SearchOID returns the constructed octets
+// holding a match, SearchOIDNext the octet after each match, which for an
+// attribute is its value
+
+static void TestSearchOID( )
+{
+   BERView cert( s_UserCert, sizeof(s_UserCert) );
+   std::vector<BERView> result;
+
+   cert.SearchOID( OID_id_at_commonName, result );
+   CHECK( result.size( ) == 2 );   // Issuer and subject
+   CHECK( result.size( ) == 2 && result[ 0 ].Tag( ) == dwBerUnivSequence
+          && result[ 0 ].FirstSubOctet( ).ObjectID( ) == OID_id_at_commonName );
+
+   result.clear( );
+   cert.SearchOIDNext( OID_id_at_commonName, result );
+   CHECK( result.size( ) == 2 );
+   if( result.size( ) == 2 ) {
+      CHECK( result[ 0 ].Tag( ) == dwBerUnivUTF8String );
+      CHECK( std::string( (const char*)result[ 0 ].Data( ), result[ 0 ].DataSize( ) ) == "Example Root" );
+      CHECK( std::string( (const char*)result[ 1 ].Data( ), result[ 1 ].DataSize( ) ) == "Test Signer" );
+   }
+
+   result.clear( );
+   cert.SearchOID( OID_id_ce_keyUsage, result );
+   CHECK( result.size( ) == 1 );
+   // Extension values are OCTET STRINGs, which are not searched
+   result.clear( );
+   cert.SearchOID( OID_ms_smartCardLogin, result );
+   CHECK( result.empty( ) );
+   result.clear( );
+   cert.SearchOID( OID_id_ce_basicConstraints, result );
+   CHECK( result.empty( ) );
+
+   // Same answers from the owning decoder
+   BEROctet oct( BLOB(s_UserCert) );
+   std::vector<BEROctet const*> octResult;
+   oct.SearchOIDNext( OID_id_at_commonName, octResult );
+   CHECK( octResult.size( ) == 2 && AsString( octResult[ 1 ]->Data( ) ) == "Test Signer" );
+   CHECK( oct.Octet( ) == BLOB(s_UserCert) );
+
+   // Encoding of a sub-identifier above 127, and a malformed OID string
+   const unsigned char rsa[] = { 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x01, 0x01 };
+   CHECK( BERView::EncodeOID( OID_pkcs1_rsaEncryption ) == BLOB(rsa) );
+   CHECK_THROWS( BERView::EncodeOID( "1" ) );
+}
+
+static void TestKeyUsage( )
+{
+   X509Cert user( s_UserCert, sizeof(s_UserCert) );
+   X509Cert root( s_RootCert, sizeof(s_RootCert) );
+
+   CHECK( user.KeyUsage( ) == ( digitalSignature | keyEncipherment ) );
+   CHECK( root.KeyUsage( ) == ( keyCertSign | cRLSign ) );
+
+   CHECK( user.ExtendedKeyUsage( OID_id_kp_clientAuth ) );
+   CHECK( !user.ExtendedKeyUsage( OID_id_kp_serverAuth ) );
+   CHECK( user.isSmartCardLogon( ) );
+   CHECK( !root.isSmartCardLogon( ) );
+
+   CHECK( !user.IsCACert( ) && !user.IsRootCert( ) );
+   CHECK( root.IsCACert( ) && root.IsRootCert( ) );
+
+   // The key usage BIT STRING with a top bit set and no unused bits, then
+   // with only the unused bits count; lengths outside it are unchanged
+   BEROctet::Blob blbCert = BLOB(s_UserCert);
+   const unsigned char keyUsage[] = { 0x04, 0x04, 0x03, 0x02, 0x05, 0xA0 };
+   size_t pos = blbCert.find( BLOB(keyUsage) );
+   CHECK( pos != BEROctet::Blob::npos );
+   if( pos != BEROctet::Blob::npos ) {
+      blbCert[ pos + 4 ] = 0x00;
+      CHECK( X509Cert( blbCert ).KeyUsage( ) == 0xA0000000 );
+      blbCert[ pos + 3 ] = 0x01;
+      CHECK( X509Cert( blbCert ).KeyUsage( ) == 0 );
+   }
+}
+
+// The copy has its own buffer: what it returns must not change when the
+// original is reassigned or destroyed
+
+static void TestCopy( )
+{
+   X509Cert *pUser = new X509Cert( s_UserCert, sizeof(s_UserCert) );
+   X509Cert copy( *pUser );
+   X509Cert assigned;
+   assigned = *pUser;
+
+   *pUser = BLOB(s_RootCert);
+   CHECK( pUser->IsRootCert( ) );
+   delete pUser;
+
+   const unsigned char serial[] = { 0x02, 0x02, 0x20, 0x02 };
+   CHECK( copy.SerialNumber( ) == BLOB(serial) );
+   CHECK( assigned.SerialNumber( ) == BLOB(serial) );
+   CHECK( copy.SubjectCommonName( ).size( ) == 1 && copy.SubjectCommonName( )[ 0 ] == "Test Signer" );
+   CHECK( assigned.IssuerOrg( ).size( ) == 1 && assigned.IssuerOrg( )[ 0 ] == "Example CA" );
+   CHECK( copy.KeyUsage( ) == ( digitalSignature | keyEncipherment ) );
+   CHECK( assigned.ValidityNotBefore( ) == "20261019110835" );
+   CHECK( copy.Modulus( ).size( ) == 128 && copy.PublicExponent( ) == MakeBlob( (const unsigned char*)"\x01\x00\x01", 3 ) );
+
+   // Assigning a certificate to itself keeps it usable
+   assigned = assigned;
+   CHECK( assigned.SubjectCommonName( ).size( ) == 1 );
+
+   // Reassigning the copy rebuilds all of its views
+   copy = BLOB(s_RootCert);
+   CHECK( copy.IsCACert( ) && copy.SubjectCommonName( )[ 0 ] == "Example Root" );
+
+   // A failed decode throws rather than leaving views into nothing
+   CHECK_THROWS( X509Cert( s_UserCert, sizeof(s_UserCert) - 1 ) );
+}
+
+int main( int argc, char *argv[] )
+{
+   TestLengthOctets( );
+   TestIndefiniteLength( );
+   TestSearchOID( );
+   TestKeyUsage( );
+   TestCopy( );
+
+   if( s_Failures ) {
+      fprintf(stderr, "%d check(s) failed\n", s_Failures);
+      return 1;
+   }
+   printf("BER and X509Cert checks passed\n");
+   return 0;
+}
@@ -21,10 +21,12 @@
 // This implementation is based on RFC 2459 which can be fetched from http://www.ietf.org.
 
 
+#include <cstring>
+
 #include "x509cert.h"
 
 
-X509Cert::X509Cert()
+X509Cert::X509Cert() : m_bCACert(false), m_bRootCert(false)
 {
 }
 
@@ -40,16 +42,13 @@ X509Cert::X509Cert(const BEROctet::Blob &buffer)
 
 X509Cert::X509Cert(const unsigned char *buffer, const unsigned long size)
 {
-   m_Cert = BEROctet(BEROctet::Blob(buffer,size));
-   if(size != m_Cert.Octet().size())
-      throw std::runtime_error("X509CertFormatError");
-
+   m_blbCert.assign(buffer,size);
    Decode();
 }
 
 X509Cert& X509Cert::operator=(const X509Cert &cert)
 {
-   m_Cert = cert.m_Cert;
+   m_blbCert = cert.m_blbCert;
    Decode();
 
    return *this;
@@ -57,9 +56,7 @@ X509Cert& X509Cert::operator=(const X509Cert &cert)
 
 X509Cert& X509Cert::operator=(const BEROctet::Blob &buffer)
 {
-   m_Cert = BEROctet(buffer);
-   if(buffer.size() != m_Cert.Octet().size())
-      throw std::runtime_error("X509CertFormatError");
+   m_blbCert = buffer;
    Decode();
 
    return *this;
@@ -69,21 +66,21 @@ X509Cert& X509Cert::operator=(const BEROctet::Blob &buffer)
 
 BEROctet::Blob X509Cert::SerialNumber() const
 {
-   return m_SerialNumber.Octet();
+   return m_SerialNumber.OctetBlob();
 }
 
 // Returns whole DER std::string of Issuer
 
 BEROctet::Blob X509Cert::Issuer() const
 {
-   return m_Issuer.Octet();
+   return m_Issuer.OctetBlob();
 }
 
 // Returns whole std::string of Issuer in UTF8.
 
 BEROctet::Blob X509Cert::UTF8Issuer() const
 {
-   return ToUTF8(m_Issuer.Tag(), m_Issuer.Octet() );
+   return ToUTF8(m_Issuer.Tag(), m_Issuer.Octet(), m_Issuer.OctetSize() );
 }
 
 
@@ -94,14 +91,14 @@ std::vector<std::string> X509Cert::IssuerOrg() const
 {
 
    std::vector<std::string> orgNames;
-   std::vector<BEROctet const*> orgOcts;
+   std::vector<BERView> orgOcts;
 
    m_Issuer.SearchOIDNext(OID_id_at_organizationName,orgOcts);
 
    size_t l = orgOcts.size( );
    for( unsigned long i = 0; i < l ; ++i ) {
 
-      orgNames.push_back(std::string((char*)orgOcts[i]->Data().data(),orgOcts[i]->Data().size()));
+      orgNames.push_back(std::string((char*)orgOcts[i].Data(),orgOcts[i].DataSize()));
    }
    return orgNames;
 
@@ -115,14 +112,14 @@ std::vector<std::string> X509Cert::UTF8IssuerOrg() const
 {
 
    std::vector<std::string> orgNames;
-   std::vector<BEROctet const*> orgOcts;
+   std::vector<BERView> orgOcts;
 
    m_Issuer.SearchOIDNext(OID_id_at_organizationName,orgOcts);
 
    size_t l = orgOcts.size( );
    for( unsigned long i = 0; i < l ; ++i ) {
 
-       BEROctet::Blob blbData = ToUTF8(orgOcts[i]->Tag(), orgOcts[i]->Data());
+       BEROctet::Blob blbData = ToUTF8(orgOcts[i].Tag(), orgOcts[i].Data(), orgOcts[i].DataSize());
       
        orgNames.push_back(std::string((char*)blbData.data(),blbData.size()));
    }
@@ -136,10 +133,10 @@ std::vector<std::string> X509Cert::UTF8IssuerOrg() const
 std::string X509Cert::ValidityNotBefore() const
 {
 
-   if(m_Validity.SubOctetList().size()!=2)
+   if(m_Validity.SubOctetCount()!=2)
       throw std::runtime_error("X509CertFormatError");
 
-   return m_Validity.SubOctetList()[0]->Time();
+   return m_Validity.SubOctet(0).Time();
 
 }
 
@@ -148,10 +145,10 @@ std::string X509Cert::ValidityNotBefore() const
 std::string X509Cert::ValidityNotAfter() const
 {
 
-   if(m_Validity.SubOctetList().size()!=2)
+   if(m_Validity.SubOctetCount()!=2)
       throw std::runtime_error("X509CertFormatError");
 
-   return m_Validity.SubOctetList()[1]->Time();
+   return m_Validity.SubOctet(1).Time();
 
 }
 
@@ -160,14 +157,14 @@ std::string X509Cert::ValidityNotAfter() const
 
 BEROctet::Blob X509Cert::Subject() const
 {
-   return m_Subject.Octet();
+   return m_Subject.OctetBlob();
 }
 
 // Returns Subject in UTF8 format.
 
 BEROctet::Blob X509Cert::UTF8Subject() const
 {
-   return ToUTF8(m_Subject.Tag(), m_Subject.Octet());
+   return ToUTF8(m_Subject.Tag(), m_Subject.Octet(), m_Subject.OctetSize());
 }
 
 // Returns list of attributes in Subject matching id-at-commonName
@@ -177,15 +174,15 @@ std::vector<std::string> X509Cert::SubjectCommonName() const
 {
 
    std::vector<std::string> cnNames;
-   std::vector<BEROctet const*> cnOcts;
+   std::vector<BERView> cnOcts;
 
    m_Subject.SearchOIDNext(OID_id_at_commonName,cnOcts);
 
-   std::vector<BEROctet const*>::size_type l = cnOcts.size( );
+   std::vector<BERView>::size_type l = cnOcts.size( );
 
-   for( std::vector<BEROctet const*>::size_type i = 0; i< l; ++i ) {
+   for( std::vector<BERView>::size_type i = 0; i< l; ++i ) {
        
-       cnNames.push_back(std::string((char*)cnOcts[i]->Data().data(),cnOcts[i]->Data().size()));
+       cnNames.push_back(std::string((char*)cnOcts[i].Data(),cnOcts[i].DataSize()));
    }
    return cnNames;
 
@@ -199,15 +196,15 @@ std::vector<std::string> X509Cert::UTF8SubjectCommonName() const
 {
 
    std::vector<std::string> cnNames;
-   std::vector<BEROctet const*> cnOcts;
+   std::vector<BERView> cnOcts;
 
    m_Subject.SearchOIDNext(OID_id_at_commonName,cnOcts);
 
-   std::vector<BEROctet const*>::size_type l = cnOcts.size( );
+   std::vector<BERView>::size_type l = cnOcts.size( );
 
-   for( std::vector<BEROctet const*>::size_type i = 0; i< l; ++i ) {
+   for( std::vector<BERView>::size_type i = 0; i< l; ++i ) {
 
-       BEROctet::Blob blbData = ToUTF8(cnOcts[i]->Tag(), cnOcts[i]->Data());
+       BEROctet::Blob blbData = ToUTF8(cnOcts[i].Tag(), cnOcts[i].Data(), cnOcts[i].DataSize());
       
        cnNames.push_back(std::string((char*)blbData.data(),blbData.size()));
    }
@@ -221,38 +218,21 @@ std::vector<std::string> X509Cert::UTF8SubjectCommonName() const
 BEROctet::Blob X509Cert::Modulus() const
 {
 
-   BEROctet::Blob RawMod = RawModulus();
+   BERView RawMod = PublicKeyPart(0);
 
-   unsigned long i = 0;
-   while(!RawMod[i] && i<RawMod.size()) i++; // Skip leading zero(s).
+   const unsigned char *pbMod = RawMod.Data();
+   size_t cbMod = RawMod.DataSize();
+   while(cbMod && !*pbMod) { pbMod++; cbMod--; } // Skip leading zero(s).
 
-   return BEROctet::Blob(&RawMod[i],RawMod.size()-i);
+   return BEROctet::Blob(pbMod,cbMod);
 
 }
 
-// Returns public exponent from SubjectPublicKeyInfo, possibly with leading zero(s).
+// Returns modulus from SubjectPublicKeyInfo, possibly with leading zero(s).
 
 BEROctet::Blob X509Cert::RawModulus() const
 {
-
-   if(m_SubjectPublicKeyInfo.SubOctetList().size()!=2)
-      throw std::runtime_error("X509CertFormatError");
-
-   BEROctet PubKeyString = *(m_SubjectPublicKeyInfo.SubOctetList()[1]);
-
-   BEROctet::Blob KeyBlob = PubKeyString.Data();
-
-   if(KeyBlob[0])                                 // Expect number of unused bits in
-      throw std::runtime_error("X509CertFormatError");    // last octet to be zero.
-
-
-
-   BEROctet PubKeyOct(KeyBlob.substr(1,BEROctet::Blob::npos));
-
-   if(PubKeyOct.SubOctetList().size()!=2) throw std::runtime_error("X509CertFormatError");
-
-   return PubKeyOct.SubOctetList()[0]->Data();
-
+   return PublicKeyPart(0).DataBlob();
 }
 
 // Returns public exponent from SubjectPublicKeyInfo, stripped for any leading zero(s).
@@ -260,35 +240,59 @@ BEROctet::Blob X509Cert::RawModulus() const
 BEROctet::Blob X509Cert::PublicExponent() const
 {
 
-   BEROctet::Blob RawPubExp = RawPublicExponent();
+   BERView RawPubExp = PublicKeyPart(1);
 
-   unsigned long i = 0;
-   while(!RawPubExp[i] && i<RawPubExp.size()) i++; // Skip leading zero(s).
+   const unsigned char *pbExp = RawPubExp.Data();
+   size_t cbExp = RawPubExp.DataSize();
+   while(cbExp && !*pbExp) { pbExp++; cbExp--; } // Skip leading zero(s).
 
-   return BEROctet::Blob(&RawPubExp[i],RawPubExp.size()-i);
+   return BEROctet::Blob(pbExp,cbExp);
 
 }
 // Returns public exponent from SubjectPublicKeyInfo, possibly with leading zero(s).
 
 BEROctet::Blob X509Cert::RawPublicExponent() const
+{
+   return PublicKeyPart(1).DataBlob();
+}
+
+// Returns the modulus (index 0) or the public exponent (index 1) of the
+// RSAPublicKey in the subjectPublicKey BIT STRING.
+
+BERView X509Cert::PublicKeyPart(size_t index) const
 {
 
-   if(m_SubjectPublicKeyInfo.SubOctetList().size()!=2)
+   if(m_SubjectPublicKeyInfo.SubOctetCount()!=2)
       throw std::runtime_error("X509CertFormatError");
 
-   BEROctet PubKeyString = *(m_SubjectPublicKeyInfo.SubOctetList()[1]);
+   BERView PubKeyString = m_SubjectPublicKeyInfo.SubOctet(1);
+
+   if(!PubKeyString.DataSize() || PubKeyString.Data()[0])  // Expect number of unused bits in
+      throw std::runtime_error("X509CertFormatError");     // last octet to be zero.
+
+   BERView PubKeyOct(PubKeyString.Data()+1,PubKeyString.DataSize()-1);
+
+   if(PubKeyOct.SubOctetCount()!=2) throw std::runtime_error("X509CertFormatError");
+
+   return PubKeyOct.SubOctet(index);
 
-   BEROctet::Blob KeyBlob = PubKeyString.Data();
+}
+
+// Returns the extnValue OCTET STRING of an Extension, or an empty view
+// when the Extension has neither 2 nor 3 octets.
 
-   if(KeyBlob[0])                                  // Expect number of unused bits
-      throw std::runtime_error("X509CertFormatError");     // in last octet to be zero.
+BERView X509Cert::ExtensionValue(const BERView &extension)
+{
 
+   size_t n = extension.SubOctetCount();
 
-   BEROctet PubKeyOct(KeyBlob.substr(1,BEROctet::Blob::npos));
+   if(n==2)
+      return extension.SubOctet(1);  // No "critical" attribute present
 
-   if(PubKeyOct.SubOctetList().size()!=2) throw std::runtime_error("X509CertFormatError");
+   else if(n==3)
+      return extension.SubOctet(2);  // A "critical" attribute present
 
-   return PubKeyOct.SubOctetList()[1]->Data();
+   return BERView();
 
 }
 
@@ -297,36 +301,34 @@ BEROctet::Blob X509Cert::RawPublicExponent() const
 unsigned long X509Cert::KeyUsage() const
 {
 
-   if(!m_Extensions.Data().size())
+   if(!m_Extensions.DataSize())
       throw std::runtime_error("X509CertExtensionNotPresent");
 
    unsigned long ReturnKeyUsage = 0;
 
    const unsigned char UnusedBitsMask[]  = {0xFF,0xFE, 0xFC, 0xF8, 0xF0, 0xE0, 0xC0, 0x80};
 
-   std::vector<BEROctet const*> ExtensionList;
+   std::vector<BERView> ExtensionList;
 
    m_Extensions.SearchOID(OID_id_ce_keyUsage,ExtensionList);
 
    if(ExtensionList.size()!=1)
       throw std::runtime_error("X509CertExtensionNotPresent"); // One and only one instance
 
-   BEROctet const* Extension = ExtensionList[0];
-   BEROctet* extnValue = 0;
-   if(Extension->SubOctetList().size()==2)
-      extnValue = Extension->SubOctetList()[1];  // No "critical" attribute present
-
-   else if(Extension->SubOctetList().size()==3)
-      extnValue = Extension->SubOctetList()[2];  // A "critical" attribute present
-
-   else
+   BERView extnValue = ExtensionValue(ExtensionList[0]);
+   if(extnValue.Empty())
       throw std::runtime_error("X509CertFormatError");    // "Extensions" must contain either 2 or 3 octets
 
-   BEROctet v_KeyUsage(extnValue->Data());
-   BEROctet::Blob KeyUsageBitString = v_KeyUsage.Data();
+   BERView v_KeyUsage(extnValue.Data(),extnValue.DataSize());
+   const unsigned char *KeyUsageBitString = v_KeyUsage.Data();
+
+   if(!v_KeyUsage.DataSize() || KeyUsageBitString[0]>7)
+      throw std::runtime_error("X509CertFormatError");
 
    unsigned char UnusedBits = KeyUsageBitString[0];
-   size_t NumBytes = KeyUsageBitString.size()-1;
+   size_t NumBytes = v_KeyUsage.DataSize()-1;
+   if(!NumBytes)
+      return 0;
    if(NumBytes>4)
    {
       NumBytes = 4; // Truncate to fit the ulong, should be plenty though
@@ -342,7 +344,7 @@ unsigned long X509Cert::KeyUsage() const
       Shift -= 8;
    }
 
-   ReturnKeyUsage |= ( (KeyUsageBitString[NumBytes] & UnusedBitsMask[UnusedBits]) << Shift );
+   ReturnKeyUsage |= ( ((unsigned long)(KeyUsageBitString[NumBytes] & UnusedBitsMask[UnusedBits])) << Shift );
 
    return ReturnKeyUsage;
 
@@ -350,10 +352,10 @@ unsigned long X509Cert::KeyUsage() const
 
 bool X509Cert::ExtendedKeyUsage(std::string const &strOID) const
 {
-   if(!m_Extensions.Data().size())
+   if(!m_Extensions.DataSize())
       return false;
 
-   std::vector<BEROctet const*> veku;
+   std::vector<BERView> veku;
 
    m_Extensions.SearchOIDNext(OID_id_ce_extKeyUsage, veku);
    if(veku.size() != 1)
@@ -361,8 +363,8 @@ bool X509Cert::ExtendedKeyUsage(std::string const &strOID) const
 
    try
    {
-      BEROctet berEKU(veku[0]->Data());
-      std::vector<BEROctet const*> ekuOcts;
+      BERView berEKU(veku[0].Data(),veku[0].DataSize());
+      std::vector<BERView> ekuOcts;
       berEKU.SearchOID(strOID,ekuOcts);
       if(ekuOcts.size() > 0)
          return true;
@@ -385,6 +387,9 @@ bool X509Cert::IsRootCert() const
    return m_bRootCert;
 }
 
+// Locates the fields of the certificate in m_blbCert. Only the octets on
+// the way are decoded; the rest is decoded when an accessor needs it.
+
 void X509Cert::Decode()
 {
 
@@ -393,73 +398,74 @@ void X509Cert::Decode()
    //const unsigned int dwTagSubjectUniqueID = 2;
    const unsigned int dwTagExtensions      = 3;
 
-   if(m_Cert.SubOctetList().size()!=3)  throw std::runtime_error("X509CertFormatError");
+   m_Cert = BERView(m_blbCert);
+   if(m_blbCert.size() != m_Cert.OctetSize())
+      throw std::runtime_error("X509CertFormatError");
 
-   BEROctet *tbsCert = m_Cert.SubOctetList()[0];
-   size_t Size = tbsCert->SubOctetList().size();
-   if(!Size) throw std::runtime_error("X509CertFormatError");
+   if(m_Cert.SubOctetCount()!=3)  throw std::runtime_error("X509CertFormatError");
 
-   std::vector<BEROctet const*>::size_type  i = 0;
-   BEROctet *first = tbsCert->SubOctetList()[i];
-   if((first->Class()==tcContext) && (first->Tag()==dwTagVersion)) i++; // Version
+   BERView tbsCert = m_Cert.FirstSubOctet();
+   BERView oct = tbsCert.FirstSubOctet();
+   if(oct.Empty()) throw std::runtime_error("X509CertFormatError");
 
-   if(Size < static_cast<unsigned long>(6+i))
-      throw std::runtime_error("X509CertFormatError");
+   if((oct.Class()==tcContext) && (oct.Tag()==dwTagVersion)) oct = oct.NextOctet(); // Version
 
-   m_SerialNumber = *(tbsCert->SubOctetList()[i]); i++;            // SerialNumber
-   i++;                                                            // Signature (algorithm)
-   m_Issuer = *(tbsCert->SubOctetList()[i]); i++;                  // Issuer
-   m_Validity = *(tbsCert->SubOctetList()[i]); i++;                // Validity
-   m_Subject = *(tbsCert->SubOctetList()[i]); i++;                 // Subject
-   m_SubjectPublicKeyInfo = *(tbsCert->SubOctetList()[i]);    i++; // SubjectPublicKeyInfo
-
-   m_Extensions = BEROctet();
-   while(i<Size) {
-      BEROctet *oct = tbsCert->SubOctetList()[i];
-      if((oct->Class()==tcContext) && (oct->Tag()==dwTagExtensions)) {
-         m_Extensions = *oct;
+   BERView fields[6];
+   for( int i = 0; i < 6; ++i ) {
+
+      if(oct.Empty())
+         throw std::runtime_error("X509CertFormatError");
+      fields[i] = oct;
+      oct = oct.NextOctet();
+   }
+
+   m_SerialNumber = fields[0];                        // SerialNumber
+                                                      // Signature (algorithm)
+   m_Issuer = fields[2];                              // Issuer
+   m_Validity = fields[3];                            // Validity
+   m_Subject = fields[4];                             // Subject
+   m_SubjectPublicKeyInfo = fields[5];                // SubjectPublicKeyInfo
+
+   m_Extensions = BERView();
+   while(!oct.Empty()) {
+      if((oct.Class()==tcContext) && (oct.Tag()==dwTagExtensions)) {
+         m_Extensions = oct;
          break;
       }
-      i++;
+      oct = oct.NextOctet();
    }
 
    m_bCACert = false;
-   std::vector<BEROctet const*> ExtensionList;
+   std::vector<BERView> ExtensionList;
    m_Extensions.SearchOID(OID_id_ce_basicConstraints, ExtensionList);
 
 
    if(1 == ExtensionList.size())
    {
-      BEROctet const* Extension = ExtensionList[0];
-      BEROctet* extnValue = 0;
-      if(Extension->SubOctetList().size()==2)
-         extnValue = Extension->SubOctetList()[1];  // No "critical" attribute present
-
-      else if(Extension->SubOctetList().size()==3)
-         extnValue = Extension->SubOctetList()[2];  // A "critical" attribute present
+      BERView extnValue = ExtensionValue(ExtensionList[0]);
 
-      if (extnValue)
+      if (!extnValue.Empty())
       {
-         BEROctet BasicContrainsts(extnValue->Data());
-         std::vector<BEROctet*> bcMembers(BasicContrainsts.SubOctetList());
-         if(bcMembers.size()>0 && bcMembers[0]->Tag() == dwBerUnivBool)
+         BERView BasicContrainsts(extnValue.Data(),extnValue.DataSize());
+         BERView cA = BasicContrainsts.FirstSubOctet();
+         if(!cA.Empty() && cA.Tag() == dwBerUnivBool)
          {
-            BEROctet::Blob flag(bcMembers[0]->Data());
-            if(flag.size()==1)
-               m_bCACert = flag[0] ? true : false;
+            if(cA.DataSize()==1)
+               m_bCACert = cA.Data()[0] ? true : false;
          }
       }
    }
 
    m_bRootCert = false;
-   if (Issuer() == Subject())
+   if (m_Issuer.OctetSize() == m_Subject.OctetSize() &&
+       !memcmp(m_Issuer.Octet(), m_Subject.Octet(), m_Issuer.OctetSize()))
    {
       m_bRootCert = true;
    }
 }
 
 
-BEROctet::Blob X509Cert::ToUTF8( unsigned int dwTag, const BEROctet::Blob &blbData ) const
+BEROctet::Blob X509Cert::ToUTF8( unsigned int dwTag, const unsigned char *pbData, size_t cbData ) const
 {
    BEROctet::Blob blbReturn;
    size_t cUnicode = 0;
@@ -480,13 +486,13 @@ BEROctet::Blob X509Cert::ToUTF8( unsigned int dwTag, const BEROctet::Blob &blbDa
       break;
    default:
       //return as is.
-      blbReturn = blbData;
+      blbReturn.assign(pbData, cbData);
    }
 
    if(bConvert)
    {                                                                                                                                                                                                    
       unsigned char bAppend = 0;                                                                                                                                                                                                                                                                                                                                                                                                                                                                                
-      size_t l = blbData.size() / cUnicode;
+      size_t l = cbData / cUnicode;
       for(size_t i = 0; i < l; ++i ) {
 
          unsigned int dwUnicode = 0;
@@ -496,7 +502,7 @@ BEROctet::Blob X509Cert::ToUTF8( unsigned int dwTag, const BEROctet::Blob &blbDa
          //first get the Unicode unsigned int from BIG ENDIAN BYTES.
          for(size_t j = 0; j < cUnicode; j++)
          {
-            dwTemp = blbData.at(i*cUnicode + j);
+            dwTemp = pbData[i*cUnicode + j];
             dwUnicode += dwTemp << (8*(cUnicode-(j+1)));
          }
 
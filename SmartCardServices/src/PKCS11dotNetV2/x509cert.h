@@ -63,16 +63,22 @@ public:
 private:
    void Decode();
 
-   BEROctet::Blob ToUTF8( unsigned int dwTag, const BEROctet::Blob &blbData ) const;
+   BERView PublicKeyPart( size_t index ) const;
+   static BERView ExtensionValue( const BERView &extension );
+
+   BEROctet::Blob ToUTF8( unsigned int dwTag, const unsigned char *pbData, size_t cbData ) const;
 
 private:
-   BEROctet m_Cert;
-   BEROctet m_SerialNumber;
-   BEROctet m_Issuer;
-   BEROctet m_Validity;
-   BEROctet m_Subject;
-   BEROctet m_SubjectPublicKeyInfo;
-   BEROctet m_Extensions;
+   // The certificate is copied once; the views below point into m_blbCert
+   // and are set again by Decode() whenever it changes.
+   BEROctet::Blob m_blbCert;
+   BERView  m_Cert;
+   BERView  m_SerialNumber;
+   BERView  m_Issuer;
+   BERView  m_Validity;
+   BERView  m_Subject;
+   BERView  m_SubjectPublicKeyInfo;
+   BERView  m_Extensions;
    bool     m_bCACert;
    bool     m_bRootCert;
 
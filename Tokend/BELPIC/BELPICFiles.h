@@ -0,0 +1,394 @@
+/*
+ *  Copyright (c) 2004,2007 Apple Inc. All Rights Reserved.
+ * 
+ *  @APPLE_LICENSE_HEADER_START@
+ *  
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *  
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *  
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  BELPICFiles.h
+ *  Tokend
+ */
+
+#ifndef _BELPICFILES_H_
+#define _BELPICFILES_H_
+
+#include "BELPICError.h"
+
+#include <security_utilities/pcsc++.h>
+#include <security_utilities/utilities.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <string.h>
+
+#define BELPIC_MAX_DATA_SIZE           (6*1024L)		// plus some extra
+
+#define BELPIC_READ_BLOCK_SIZE  0xF4
+// Largest read done with one extended length Read Binary
+#define BELPIC_READ_EXTENDED_BLOCK_SIZE  BELPIC_MAX_DATA_SIZE
+
+/*
+	Returns the number of data bytes of an EF (tag 80) from its FCI, or 0 if
+	the FCI does not say.
+*/
+inline size_t fciFileSize(const uint8_t *fci, size_t fciLength)
+{
+	if (fciLength < 2 || (fci[0] != 0x62 && fci[0] != 0x6F) || fci[1] > 0x7F)
+		return 0;
+
+	size_t end = 2 + fci[1];
+	if (end > fciLength)
+		return 0;
+
+	for (size_t ix = 2; ix + 2 <= end; ix += 2 + fci[ix + 1])
+	{
+		size_t length = fci[ix + 1];
+		if (ix + 2 + length > end)
+			break;
+		if (fci[ix] != 0x80 || length == 0 || length > 4)
+			continue;
+
+		size_t size = 0;
+		for (size_t jx = 0; jx < length; ++jx)
+			size = (size << 8) | fci[ix + 2 + jx];
+		return size;
+	}
+
+	return 0;
+}
+
+/*
+	Returns true if the historical bytes of the ATR hold a card capabilities
+	object (compact TLV, tag 7) announcing extended Lc and Le fields.
+	See ISO 7816-3 8.2 and ISO 7816-4 8.1.1.2.7.
+*/
+inline bool atrAllowsExtendedLength(const uint8_t *atr, size_t atrLength)
+{
+	if (atrLength < 2)
+		return false;
+
+	size_t historicalLength = atr[1] & 0x0F;
+	uint8_t y = atr[1] >> 4;
+	size_t ix = 2;
+	for (;;)
+	{
+		// Skip TA, TB and TC
+		ix += (y & 1) + ((y >> 1) & 1) + ((y >> 2) & 1);
+		if (!(y & 0x08))
+			break;
+		if (ix >= atrLength)
+			return false;
+		y = atr[ix++] >> 4;
+	}
+
+	if (historicalLength == 0 || ix + historicalLength > atrLength)
+		return false;
+
+	const uint8_t *historical = atr + ix;
+	size_t end = historicalLength;
+	if (historical[0] == 0x00 && historicalLength >= 4)
+		end -= 3;		// the status indicator ends the historical bytes
+	else if (historical[0] != 0x80)
+		return false;
+
+	for (ix = 1; ix < end; ix += 1 + (historical[ix] & 0x0F))
+	{
+		size_t length = historical[ix] & 0x0F;
+		if (ix + 1 + length > end)
+			break;
+		if ((historical[ix] >> 4) == 0x07 && length >= 3)
+			return (historical[ix + 3] & 0x40) != 0;
+	}
+
+	return false;
+}
+
+//
+// Selection and reading of the files of a BELPIC card. The sizes of the EFs
+// are learned from their FCI, or from reading them to the end, so they are
+// read with as few Read Binary commands as possible. Card is the BELPICToken,
+// or a simulated card in tests: it provides isInTransaction(), exchangeAPDU()
+// and ISO7816Token's transmitAPDU(). The caller holds the transaction.
+//
+template<class Card>
+class BELPICFiles
+{
+	NOCOPY(BELPICFiles)
+public:
+	BELPICFiles(Card &card) : mCard(card), mCurrentDF(NULL), mCurrentEF(NULL),
+		mSelectedFile(0), mSelectedEFSize(0), mSelectFCI(true),
+		mExtendedLength(false) {}
+
+	void select(const uint8_t *df, const uint8_t *ef);
+	void readBinary(uint8_t *result, size_t &resultLength);
+
+	// The selection is lost when the transaction ends or the card goes away
+	void reset() { mCurrentDF = NULL; mCurrentEF = NULL; }
+
+	// From the ATR, see atrAllowsExtendedLength()
+	void extendedLength(bool extendedLength)
+		{ mExtendedLength = extendedLength; }
+	bool extendedLength() const { return mExtendedLength; }
+
+private:
+	void selectFile(uint8_t *command, size_t commandLength,
+		const uint8_t *df, const uint8_t *ef);
+
+	Card &mCard;
+	const uint8_t *mCurrentDF;
+	const uint8_t *mCurrentEF;
+
+	// Size of the selected EF (0 if unknown) and the sizes of the EFs seen
+	// so far, by DF and EF, learned from their FCI or from reading them to
+	// the end
+	typedef std::map<uint32_t, size_t> EFSizeMap;
+	uint32_t mSelectedFile;
+	size_t mSelectedEFSize;
+	EFSizeMap mEFSizes;
+	// Cleared when the card refuses to return an FCI on select
+	bool mSelectFCI;
+	// Set when the card announces extended Lc/Le support in its ATR, cleared
+	// when the card or the reader turns an extended Read Binary down
+	bool mExtendedLength;
+};
+
+template<class Card>
+void BELPICFiles<Card>::select(const uint8_t *df, const uint8_t *ef)
+{
+	if (mCard.isInTransaction() && mCurrentDF == df)
+	{
+		if (mCurrentEF == ef)
+			return;
+
+		uint8_t command[] =
+			{ 0x00, 0xA4, 0x02, 0x0C, 0x02, ef[0], ef[1], 0x00 };
+		selectFile(command, sizeof(command), df, ef);
+		mCurrentEF = ef;
+	}
+	else
+	{
+		uint8_t command[] =
+			{ 0x00, 0xA4, 0x08, 0x0C, 0x04, df[0], df[1], ef[0], ef[1], 0x00 };
+		selectFile(command, sizeof(command), df, ef);
+		if (mCard.isInTransaction())
+		{
+			mCurrentDF = df;
+			mCurrentEF = ef;
+		}
+	}
+}
+
+/*
+	command is a select (P2 0x0C, no FCI) followed by a spare Le byte.  The
+	first time an EF is selected its FCI is asked for instead, so readBinary()
+	knows how much to read; cards that refuse this are not asked again.
+	EFs of different DFs may have the same identifier, so sizes are kept by
+	DF and EF.
+*/
+template<class Card>
+void BELPICFiles<Card>::selectFile(uint8_t *command, size_t commandLength,
+	const uint8_t *df, const uint8_t *ef)
+{
+	unsigned char result[MAX_BUFFER_SIZE];
+	size_t resultLength = sizeof(result);
+	mSelectedFile = ((uint32_t)df[0] << 24) | (df[1] << 16) | (ef[0] << 8) | ef[1];
+	EFSizeMap::const_iterator it = mEFSizes.find(mSelectedFile);
+	if (it == mEFSizes.end() && mSelectFCI)
+	{
+		command[3] = 0x00;		// P2: return the FCI
+		uint32_t rx = mCard.exchangeAPDU(command, commandLength, result,
+			resultLength);
+		if (rx == SCARD_SUCCESS)
+		{
+			mSelectedEFSize = fciFileSize(result, resultLength - 2);
+			mEFSizes[mSelectedFile] = mSelectedEFSize;
+			secdebug("token", "select: EF %08X has %ld bytes", mSelectedFile,
+				mSelectedEFSize);
+			return;
+		}
+
+		if (rx != SCARD_INCORRECT_P1_P2 && rx != SCARD_LC_INCONSISTENT_P1_P2
+			&& rx != SCARD_LENGTH_INCORRECT && rx != SCARD_FUNCTION_NOT_SUPPORTED)
+			BELPICError::throwMe(rx);
+
+		secdebug("token", "select: no FCI (0x%04X), not asking again", rx);
+		mSelectFCI = false;
+		command[3] = 0x0C;
+		resultLength = sizeof(result);
+	}
+
+	// Without the Le byte
+	BELPICError::check(mCard.exchangeAPDU(command, commandLength - 1, result,
+		resultLength));
+	mSelectedEFSize = (it == mEFSizes.end()) ? 0 : it->second;
+}
+
+/*
+	A full transaction for the readBinary command seems to be the following:
+	
+	- Select the appropriate file [ref INS_SELECT_FILE]; if its FCI gave the
+	  size of the file, only read that much
+	- Issue read binary commands (0xB0) for BELPIC_READ_BLOCK_SIZE (0xF4) bytes, or
+	  for the whole file with an extended Le if the card supports it
+	- usually, the last one will come back with a response of "6C xx", where
+	  xx is the actual number of bytes available
+	- Issue a new read binary command with correct size
+	
+*/
+
+/*
+	See NIST IR 6887, 5.1.1.2 Read Binary APDU
+
+	Function Code 0x02
+	
+	CLA			0x00 
+	INS			0xB0 
+	P1			High-order byte of 2-byte offset 
+	P2			Low-order byte of 2-byte offset 
+	Lc			Empty 
+	Data Field	Empty 
+	Le			Number of bytes to read
+
+
+	Processing State returned in the Response Message 
+
+	SW1 SW2		Meaning
+	---	---	-----------------------------------------------------
+	62	81	Part of returned data may be corrupted 
+	62	82	End of file reached before reading Le bytes 
+	67	00	Wrong length (wrong Le field) 
+	69	81	Command incompatible with file structure 
+	69	82	Security status not satisfied 
+	69	86	Command not allowed (no current EF) 
+	6A	81	Function not supported 
+	6A	82	File not found 
+	6B	00	Wrong parameters (offset outside the EF) 
+	6C	XX	Wrong length (wrong Le field; XX indicates the exact length) 
+	90	00	Successful execution
+	
+	Non-fatal errors:
+	62	82	End of file reached before reading Le bytes 
+	6B	00	Wrong parameters (offset outside the EF) 
+	6C	XX	Wrong length (wrong Le field; XX indicates the exact length) 
+	90	00	Successful execution
+*/
+
+template<class Card>
+void BELPICFiles<Card>::readBinary(uint8_t *result, size_t &resultLength)
+{
+	size_t returnedDataLength = 0;
+	size_t fileSize = mSelectedEFSize;
+	bool endOfFile = false;
+
+	std::vector<uint8_t> block;
+	block.reserve((mExtendedLength ? BELPIC_READ_EXTENDED_BLOCK_SIZE : BELPIC_READ_BLOCK_SIZE)
+		+ 2);
+
+	// Talk to token here to get data
+	{
+		size_t exactLength = 0;		// from a "6C xx" answer
+		while (!endOfFile)
+		{
+			size_t offset = returnedDataLength;
+			size_t length = exactLength;
+			if (!length)
+			{
+				length = mExtendedLength ? BELPIC_READ_EXTENDED_BLOCK_SIZE
+					: BELPIC_READ_BLOCK_SIZE;
+				if (fileSize)
+					length = std::min(length, fileSize - offset);
+			}
+			// Don't ask for more than fits in result
+			length = std::min(length, resultLength - offset);
+			if (!length)
+			{
+				endOfFile = (fileSize && offset == fileSize);
+				break;
+			}
+
+			secdebug("token", "readBinary: attempting read of %ld bytes at offset: %ld",
+				length, offset);
+			block.clear();
+			uint16_t rx;
+			try
+			{
+				rx = mCard.transmitAPDU(0x00, 0xB0, offset >> 8, offset & 0xFF,
+					0, NULL, length, &block);
+			}
+			catch (const PCSC::Error &)
+			{
+				if (length < 0x100)
+					throw;
+				// The reader can't carry extended length APDUs
+				secdebug("token", "readBinary: extended read failed, using short reads");
+				mExtendedLength = false;
+				continue;
+			}
+			secdebug("tokend", "readBinary result 0x%02X (masked: 0x%02X)", rx, rx & 0xFF00);
+
+			// The data up to the end of the file came back
+			if (rx == SCARD_END_OF_FILE_REACHED)
+				rx = SCARD_SUCCESS;
+
+			switch (rx & 0xFF00)
+			{
+			case SCARD_BYTES_LEFT_IN_SW2:		// 0x6100
+			case SCARD_LE_IN_SW2:				// 0x6C00
+				secdebug("token", "readBinary should only have read: %d bytes", rx & 0x00FF);
+				if (exactLength || !(rx & 0xFF))
+					BELPICError::throwMe(rx);
+				// Re-read from same offset with new, shorter length
+				exactLength = rx & 0xFF;
+				break;
+			case SCARD_LENGTH_INCORRECT:		// 0x6700
+				if (length < 0x100)
+					BELPICError::throwMe(rx);
+				// The card doesn't take an extended Le after all
+				secdebug("token", "readBinary: extended read refused, using short reads");
+				mExtendedLength = false;
+				break;
+			case SCARD_WRONG_PARAMETER_P1_P2:	// we read past the end, (probably) non-fatal
+				endOfFile = true;
+				break;
+			case SCARD_SUCCESS:
+				if (!block.empty())
+					memcpy(result + returnedDataLength, &block[0], block.size());
+				returnedDataLength += block.size();
+				// A short answer means there is nothing more to read
+				if (block.size() < length || length == exactLength)
+					endOfFile = true;
+				break;
+			case SCARD_EXECUTION_WARNING:	// No way to recover from corrupted data, so fall through
+			default:
+				BELPICError::check(rx);
+				return;						// will actually throw above
+			}
+		}
+	}
+
+	// Read up to the end this time, so next time the exact size is known
+	if (endOfFile && !fileSize)
+		mEFSizes[mSelectedFile] = returnedDataLength;
+
+	secdebug("token", "readBinary read a total of %ld bytes", returnedDataLength);
+	resultLength = returnedDataLength;
+}
+
+#endif /* !_BELPICFILES_H_ */
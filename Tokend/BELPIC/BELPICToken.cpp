@@ -58,8 +58,6 @@ using CssmClient::AclFactory;
 #define SELECT_APPLET \
 	CLA_STANDARD, INS_SELECT_FILE, P1_SELECT_APPLET, P2_SELECT_APPLET
 
-#define BELPIC_MAX_DATA_SIZE           (6*1024L)		// plus some extra
-
 //static const unsigned char kBELPICPKCS15Applet[] =
 //	{ 0xA0, 0x00, 0x00, 0x01, 0x77, 0x50, 0x4B, 0x43, 0x53, 0x2D, 0x31, 0x35 };
 
@@ -101,8 +99,7 @@ static const unsigned char kPuK7_Id[] =             { 0x87 };
 
 
 BELPICToken::BELPICToken() :
-	mCurrentDF(NULL),
-	mCurrentEF(NULL),
+	mFiles(*this),
 	mReturnedData(NULL),
 	mPinStatus(0)
 {
@@ -118,30 +115,7 @@ BELPICToken::~BELPICToken()
 
 void BELPICToken::select(const uint8_t *df, const uint8_t *ef)
 {
-	unsigned char result[MAX_BUFFER_SIZE];
-	size_t resultLength = sizeof(result);
-	if (isInTransaction() && mCurrentDF == df)
-	{
-		if (mCurrentEF == ef)
-			return;
-
-		uint8_t command[] = { 0x00, 0xA4, 0x02, 0x0C, 0x02, ef[0], ef[1] };
-		BELPICError::check(exchangeAPDU(command, sizeof(command), result,
-			resultLength));
-		mCurrentEF = ef;
-	}
-	else
-	{
-		uint8_t command[] =
-			{ 0x00, 0xA4, 0x08, 0x0C, 0x04, df[0], df[1], ef[0], ef[1] };
-		BELPICError::check(exchangeAPDU(command, sizeof(command), result,
-			resultLength));
-		if (isInTransaction())
-		{
-			mCurrentDF = df;
-			mCurrentEF = ef;
-		}
-	}
+	mFiles.select(df, ef);
 }
 
 void BELPICToken::selectKeyForSign(const uint8_t *keyId)
@@ -179,125 +153,10 @@ int BELPICToken::usleep(int iTimeVal)
 	return nanosleep(&mrqtp, NULL);
 }
 
-#define READ_BLOCK_SIZE  0xF4
-
-/*
-	A full transaction for the readBinary command seems to be the following:
-	
-	- Select the appropriate file [ref INS_SELECT_FILE]
-	- Issue read binary command (0xB0) for READ_BLOCK_SIZE (0xF4) bytes
-	- usually, it will come back with a response of "6C xx", where xx is the 
-	  actual number of bytes available
-	- Issue a new read binary command with correct size
-	
-*/
-
-/*
-	See NIST IR 6887, 5.1.1.2 Read Binary APDU
-
-	Function Code 0x02
-	
-	CLA			0x00 
-	INS			0xB0 
-	P1			High-order byte of 2-byte offset 
-	P2			Low-order byte of 2-byte offset 
-	Lc			Empty 
-	Data Field	Empty 
-	Le			Number of bytes to read
-
-
-	Processing State returned in the Response Message 
-
-	SW1 SW2		Meaning
-	---	---	-----------------------------------------------------
-	62	81	Part of returned data may be corrupted 
-	62	82	End of file reached before reading Le bytes 
-	67	00	Wrong length (wrong Le field) 
-	69	81	Command incompatible with file structure 
-	69	82	Security status not satisfied 
-	69	86	Command not allowed (no current EF) 
-	6A	81	Function not supported 
-	6A	82	File not found 
-	6B	00	Wrong parameters (offset outside the EF) 
-	6C	XX	Wrong length (wrong Le field; XX indicates the exact length) 
-	90	00	Successful execution
-	
-	Non-fatal errors:
-	62	82	End of file reached before reading Le bytes 
-	6B	00	Wrong parameters (offset outside the EF) 
-	6C	XX	Wrong length (wrong Le field; XX indicates the exact length) 
-	90	00	Successful execution
-*/
-
 void BELPICToken::readBinary(uint8_t *result, size_t &resultLength)
 {
-	// Attempt to read READ_BLOCK_SIZE bytes
-
-	unsigned char rcvBuffer[MAX_BUFFER_SIZE];		// N.B. Must be > READ_BLOCK_SIZE
-	size_t bytesReceived = sizeof(rcvBuffer);
-	size_t returnedDataLength = 0;
-
-	// The initial "Read Binary" command, with offset 0 and length READ_BLOCK_SIZE
-	unsigned char apdu[] = { 0x00, 0xB0, 0x00, 0x00, READ_BLOCK_SIZE };
-	size_t apduSize = sizeof(apdu);
-
-	// Talk to token here to get data
-	{
-		PCSC::Transaction _(*this);
-
-		uint16_t rx;
-		uint32_t offset = 0;
-		bool requestedTooMuch = false;
-		
-		for (bool done = false; !done; )
-		{
-			bytesReceived = sizeof(rcvBuffer);	// must reset each time
-			secdebug("token", "readBinary: attempting read of %d bytes at offset: %d", 
-				apdu[OFF_LC], (apdu[OFF_P1] << 8 | apdu[OFF_P2]));
-			transmit(apdu, apduSize, rcvBuffer, bytesReceived);
-			if (bytesReceived < 2)
-				break;
-			rx = (rcvBuffer[bytesReceived - 2] << 8) + rcvBuffer[bytesReceived - 1];
-			secdebug("tokend", "readBinary result 0x%02X (masked: 0x%02X)", rx, rx & 0xFF00);
-
-			switch (rx & 0xFF00)
-			{
-			case SCARD_BYTES_LEFT_IN_SW2:		// 0x6100
-			case SCARD_LE_IN_SW2:				// 0x6C00
-				secdebug("token", "readBinary should only have read: %d bytes", rx & 0x00FF);
-				// Re-read from same offset with new, shorter length
-				apdu[OFF_LC] = (uint8_t)(rx & 0xFF);
-				requestedTooMuch = true;				// signal that we are almost done
-				break;
-			case SCARD_WRONG_PARAMETER_P1_P2:			// we read past the end, (probably) non-fatal
-				done = true;
-				break;
-			case SCARD_SUCCESS:
-				offset += (bytesReceived - 2);
-				apdu[OFF_P1] = offset >> 8;
-				apdu[OFF_P2] = offset & 0xFF;
-				apdu[OFF_LC] = READ_BLOCK_SIZE & 0xFF;
-				if (requestedTooMuch)
-					done = true;
-				if (resultLength >= (returnedDataLength + bytesReceived - 2))
-				{
-					memcpy(result + returnedDataLength, rcvBuffer, bytesReceived - 2);
-					returnedDataLength += bytesReceived - 2;
-				}
-				else
-					done = true;
-				break;
-			case SCARD_EXECUTION_WARNING:	// No way to recover from SCARD_END_OF_FILE_REACHED, so fall through
-			default:
-				BELPICError::check(rx);
-				return;						// will actually throw above
-			}
-
-		}
-	}
-
-	secdebug("token", "readBinary read a total of %ld bytes", returnedDataLength);
-	resultLength = returnedDataLength;
+	PCSC::Transaction _(*this);
+	mFiles.readBinary(result, resultLength);
 }
 
 uint32_t BELPICToken::exchangeAPDU(const uint8_t *apdu, size_t apduLength,
@@ -334,16 +193,14 @@ uint32_t BELPICToken::exchangeAPDU(const uint8_t *apdu, size_t apduLength,
 void BELPICToken::didDisconnect()
 {
 	PCSC::Card::didDisconnect();
-	mCurrentDF = NULL;
-	mCurrentEF = NULL;
+	mFiles.reset();
 	mPinStatus = 0;
 }
 
 void BELPICToken::didEnd()
 {
 	PCSC::Card::didEnd();
-	mCurrentDF = NULL;
-	mCurrentEF = NULL;
+	mFiles.reset();
 	mPinStatus = 0;
 }
 
@@ -491,6 +348,8 @@ uint32 BELPICToken::probe(SecTokendProbeFlags flags,
 //SCARD_PROTOCOL_T0
 	const SCARD_READERSTATE &readerState = *(*startupReaderInfo)();
 	connect(mSession, readerState.szReader);
+	mFiles.extendedLength(atrAllowsExtendedLength(readerState.rgbAtr,
+		readerState.cbAtr));
 	uint32 score = 0;
 	
 	bool doDisconnect = false; /*!(flags & kSecTokendProbeKeepToken); */
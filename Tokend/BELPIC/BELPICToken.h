@@ -30,6 +30,7 @@
 #define _BELPICTOKEN_H_
 
 #include <Token.h>
+#include "BELPICFiles.h"
 
 #include <security_utilities/pcsc++.h>
 
@@ -81,8 +82,7 @@ protected:
 	void populate();
 
 public:
-	const uint8_t *mCurrentDF;
-	const uint8_t *mCurrentEF;
+	BELPICFiles<BELPICToken> mFiles;
 	unsigned char *mReturnedData;
 	uint32_t mPinStatus;
 
@@ -0,0 +1,76 @@
+/*
+ *  Copyright (c) 2004,2007 Apple Inc. All Rights Reserved.
+ *
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  CACContent.h
+ *  Tokend
+ */
+
+#ifndef _CACCONTENT_H_
+#define _CACCONTENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define CAC_CERTIFICATE_HEAD_SIZE	0x64
+
+//
+// Appends data identifying the certificates of the given PKI applets to
+// content: the status and the first GET CERTIFICATE block of each one.
+// That block holds the certificate serial number, which changes when the
+// card is reissued. Card is the CACToken, or a simulated card in tests.
+// The applets are left in the middle of a read and must be selected again.
+//
+template<class Card>
+void cacCertificateContent(Card &card, const unsigned char *const *applets,
+	size_t count, std::vector<unsigned char> &content)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned char command[] = { 0x80, 0x36, 0x00, 0x00, CAC_CERTIFICATE_HEAD_SIZE };
+		unsigned char result[CAC_CERTIFICATE_HEAD_SIZE + 2];
+		size_t resultLength = sizeof(result);
+		uint32_t sw;
+		try
+		{
+			card.select(applets[i]);
+			sw = card.exchangeAPDU(command, sizeof(command), result,
+				resultLength);
+		}
+		catch (...)
+		{
+			// A missing applet is recorded as such
+			sw = 0;
+			resultLength = 2;
+		}
+
+		content.push_back(static_cast<unsigned char>(i));
+		content.push_back(static_cast<unsigned char>(sw >> 8));
+		content.push_back(static_cast<unsigned char>(sw));
+		if (resultLength > 2 && resultLength <= sizeof(result))
+			content.insert(content.end(), result, result + resultLength - 2);
+	}
+}
+
+#endif /* !_CACCONTENT_H_ */
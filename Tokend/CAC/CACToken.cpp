@@ -33,6 +33,7 @@
 #include "CACError.h"
 #include "CACRecord.h"
 #include "CACSchema.h"
+#include "CACContent.h"
 #include <security_cdsa_client/aclclient.h>
 #include <map>
 #include <vector>
@@ -71,6 +72,9 @@ static const unsigned char kSelectCACAppletOB[]      =
 static const unsigned char kSelectCACAppletPIN[]     =
 	{ SELECT_CAC_APPLET_PIN, 0x00 };
 
+static const unsigned char *const kCertificateApplets[] =
+	{ kSelectCACAppletPKIID, kSelectCACAppletPKIESig, kSelectCACAppletPKIECry };
+
 
 CACToken::CACToken() :
 	mCurrentApplet(NULL),
@@ -112,6 +116,8 @@ void CACToken::select(const unsigned char *applet)
 	unsigned char result[MAX_BUFFER_SIZE];
 	size_t resultLength = sizeof(result);
 
+	// Until this select succeeds no applet is known to be selected.
+	mCurrentApplet = NULL;
 	transmit(applet, applet_length, result, resultLength);
 	// If the select command failed this isn't a cac card, so we are done.
 	if (resultLength < 2 || result[resultLength - 2] != 0x90 &&
@@ -136,6 +142,7 @@ uint32_t CACToken::exchangeAPDU(const unsigned char *apdu, size_t apduLength,
 		transmit(getResult, sizeof(getResult), result, resultLength);
 		if (resultLength - 2 != expectedLength)
         {
+			mCurrentApplet = NULL;
             if (resultLength < 2)
                 PCSC::Error::throwMe(SCARD_E_PROTO_MISMATCH);
             else
@@ -145,9 +152,19 @@ uint32_t CACToken::exchangeAPDU(const unsigned char *apdu, size_t apduLength,
 	}
 
 	if (resultLength < 2)
+	{
+		mCurrentApplet = NULL;
 		PCSC::Error::throwMe(SCARD_E_PROTO_MISMATCH);
+	}
 
-    return (result[resultLength - 2] << 8) + result[resultLength - 1];
+	uint32_t sw = (result[resultLength - 2] << 8) + result[resultLength - 1];
+	// After an error the card may be in any state, so don't assume the
+	// applet is still selected.  Warnings (62xx, 63xx such as PIN tries
+	// left) keep the selection.
+	if (sw != SCARD_SUCCESS && (sw >> 8) != 0x62 && (sw >> 8) != 0x63)
+		mCurrentApplet = NULL;
+
+    return sw;
 }
 
 void CACToken::didDisconnect()
@@ -501,6 +518,25 @@ void CACToken::establish(const CSSM_GUID *guid, uint32 subserviceId,
 	Tokend::ISO7816Token::establish(guid, subserviceId, flags,
 		cacheDirectory, workDirectory, mdsDirectory, printName);
 
+	// Key the object cache on the certificates themselves, so that those
+	// of a reissued card are read again
+	try
+	{
+		std::vector<unsigned char> content;
+		PCSC::Transaction _(*this);
+		cacCertificateContent(*this, kCertificateApplets,
+			sizeof(kCertificateApplets) / sizeof(kCertificateApplets[0]),
+			content);
+		// Certificates are read from their start again
+		mCurrentApplet = NULL;
+		cacheFingerprint(CssmData(&content[0], content.size()));
+	}
+	catch (...)
+	{
+		mCurrentApplet = NULL;
+		secdebug("cactoken", "no certificate data, object cache not bound to the card");
+	}
+
 	mSchema = new CACSchema();
 	mSchema->create();
 
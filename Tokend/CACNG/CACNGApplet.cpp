@@ -43,14 +43,9 @@ CACNGCacApplet::CACNGCacApplet(CACNGToken &token, const byte_string &applet, con
 
 void CACNGCacApplet::select()
 {
-	byte_string result;
-	uint32_t code = token.exchangeAPDU(applet, result);
-	CACNGError::check(code);
-	if (!object.empty()) {
-		result.resize(0);
-		code = token.exchangeAPDU(object, result);
-		CACNGError::check(code);
-	}
+	token.selectApplet(applet);
+	if (!object.empty())
+		token.selectObject(object);
 }
 
 CACNGIDObject::CACNGIDObject(CACNGToken &token, shared_ptr<CACNGSelectable> applet, const std::string &description)
@@ -223,9 +218,7 @@ CACNGPivApplet::CACNGPivApplet(CACNGToken &token, const byte_string &applet)
 
 void CACNGPivApplet::select()
 {
-	byte_string result;
-	uint32_t code = token.exchangeAPDU(applet, result);
-	CACNGError::check(code);
+	token.selectApplet(applet);
 }
 
 CACNGPivIDObject::CACNGPivIDObject(CACNGToken &token, shared_ptr<CACNGSelectable> applet, const std::string &description, const byte_string &oid, uint8_t keyRef)
@@ -289,6 +282,7 @@ byte_string CACNGPivIDObject::read()
 	/* Decode/decompress the certificate */
 	bool hasCertificateData = false;
 	bool isCompressed = false;
+	byte_span certificate;
 	
 	// 00000000  53 82 04 84 70 82 04 78  78 da 33 68 62 db 61 d0 
 	TLV_ref tlv;
@@ -301,14 +295,15 @@ byte_string CACNGPivIDObject::read()
 	}
 
 	for(TLVList::const_iterator iter = list.begin(); iter != list.end(); ++iter) {
-		const byte_string &tagString = (*iter)->getTag();
-		const byte_string &value = (*iter)->getValue();
+		const byte_span &tagString = (*iter)->getTag();
+		byte_span value = (*iter)->getValue();
 		if(tagString.size() != 1)
 			CACNGError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
 		uint8_t tag = tagString[0];
 		switch (tag) {
 		case PIV_GETDATA_TAG_CERTIFICATE:			// 0x70
-			result = value;
+			/* References result, copied out once the parsing is over */
+			certificate = value;
 			hasCertificateData = true;
 			break;
 		case PIV_GETDATA_TAG_CERTINFO:				// 0x71
@@ -333,6 +328,7 @@ byte_string CACNGPivIDObject::read()
 	/* No cert data ? */
 	if(!hasCertificateData)
 		CACNGError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
+	byte_string(certificate.begin(), certificate.end()).swap(result);
 	if (isCompressed) {
 		return CompressionTool::zlib_decompress(result);
 	}
@@ -391,18 +387,22 @@ byte_string CACNGPivIDObject::crypt(const byte_string &input)
 		secure_zero(result);
 		CACNGError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
 	}
-	secure_zero(result);
 	if(tlv->getTag() != (unsigned char*)"\x7C") {
+		secure_zero(result);
 		PCSC::Error::throwMe(SCARD_E_PROTO_MISMATCH);
 	}
 	byte_string tagData;
 	try {
 		TLVList list = tlv->getInnerValues();
 		TLVList::const_iterator iter = find_if(list.begin(), list.end(), TagPredicate(0x82));
-		if(iter != list.end())
-			tagData = (*iter)->getValue();
+		if(iter != list.end()) {
+			byte_span value = (*iter)->getValue();
+			tagData.assign(value.begin(), value.end());
+		}
 	} catch(...) {
 	}
+	/* The parsed TLVs reference result, only wipe it once copied out */
+	secure_zero(result);
 	if(tagData.size() == 0) {
 		PCSC::Error::throwMe(SCARD_E_PROTO_MISMATCH);
 	}
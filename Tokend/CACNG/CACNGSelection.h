@@ -0,0 +1,100 @@
+/*
+ *  Copyright (c) 2004,2007 Apple Inc. All Rights Reserved.
+ * 
+ *  @APPLE_LICENSE_HEADER_START@
+ *  
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *  
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *  
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  CACNGSelection.h
+ *  Tokend
+ */
+
+#ifndef _CACNGSELECTION_H_
+#define _CACNGSELECTION_H_
+
+#include "CACNGError.h"
+#include "byte_string.h"
+
+#include <security_utilities/utilities.h>
+
+/* A failing command may leave the card in any state, so after an error
+ * status nothing is assumed selected.  More data (61xx) and warnings
+ * (62xx, 63xx such as PIN tries left) keep the selection. */
+inline bool statusKeepsSelection(const unsigned char *result, size_t resultLength)
+{
+	unsigned char sw1 = resultLength < 2 ? 0 : result[resultLength - 2];
+	if (sw1 == 0x61 || sw1 == 0x62 || sw1 == 0x63)
+		return true;
+	return sw1 == 0x90 && result[resultLength - 1] == 0x00;
+}
+
+/* The SELECT apdus of the applet and CAC object current on the card, so
+ * objects of the same applet share its SELECT.  Only trusted inside a
+ * transaction; Card is the CACNGToken, or a simulated card in tests, and
+ * provides isInTransaction() and exchangeAPDU(). */
+template<class Card>
+class CACNGSelection
+{
+	NOCOPY(CACNGSelection)
+public:
+	CACNGSelection(Card &card) : mCard(card) {}
+
+	void selectApplet(const byte_string &apdu);
+	void selectObject(const byte_string &apdu);
+
+	/* Forget what is selected, the next select talks to the card again */
+	void invalidate() { mApplet.resize(0); mObject.resize(0); }
+
+	const byte_string &applet() const { return mApplet; }
+	const byte_string &object() const { return mObject; }
+
+private:
+	Card &mCard;
+	byte_string mApplet;
+	byte_string mObject;
+};
+
+/* Only sent if another applet is current */
+template<class Card>
+void CACNGSelection<Card>::selectApplet(const byte_string &apdu)
+{
+	if (mCard.isInTransaction() && mApplet == apdu)
+		return;
+	invalidate();
+	byte_string result;
+	CACNGError::check(mCard.exchangeAPDU(apdu, result));
+	if (mCard.isInTransaction())
+		mApplet = apdu;
+}
+
+/* Only sent if another object of the current applet is current */
+template<class Card>
+void CACNGSelection<Card>::selectObject(const byte_string &apdu)
+{
+	if (mCard.isInTransaction() && mObject == apdu)
+		return;
+	mObject.resize(0);
+	byte_string result;
+	CACNGError::check(mCard.exchangeAPDU(apdu, result));
+	if (mCard.isInTransaction())
+		mObject = apdu;
+}
+
+#endif /* !_CACNGSELECTION_H_ */
@@ -95,7 +95,7 @@ static const unsigned char oidX509CertificatePIVAuthentication[] = { PIV_OBJECT_
 #define PIV_KEYREF_PIV_AUTHENTICATION      0x9A
 
 CACNGToken::CACNGToken() :
-	mCacPinStatus(0),mPivPinStatus(0)
+	selection(*this), mCacPinStatus(0),mPivPinStatus(0)
 {
 	mTokenContext = this;
 	mSession.open();
@@ -150,18 +150,44 @@ void CACNGToken::select(shared_ptr<CACNGSelectable> &selectable)
 	 /* XXX: Resets PIV pin status to match card behavior */
 //	if (selectable != pivApplet)
 		mPivPinStatus = 0;
+	/* Until the select succeeds nothing is known to be current */
+	currentSelectable.reset();
 	selectable->select();
 	if (isInTransaction()) {
 		currentSelectable = selectable;
 	}
 }
 
+void CACNGToken::selectApplet(const byte_string &apdu)
+{
+	selection.selectApplet(apdu);
+}
+
+void CACNGToken::selectObject(const byte_string &apdu)
+{
+	selection.selectObject(apdu);
+}
+
+/* Forget what is selected, the next select() talks to the card again */
+void CACNGToken::invalidateSelection()
+{
+	currentSelectable.reset();
+	selection.invalidate();
+}
+
+void CACNGToken::checkSelection(const unsigned char *result, size_t resultLength)
+{
+	if (!statusKeepsSelection(result, resultLength))
+		invalidateSelection();
+}
+
 uint32_t CACNGToken::exchangeAPDU(const unsigned char *apdu, size_t apduLength,
 	unsigned char *result, size_t &resultLength)
 {
 	size_t savedLength = resultLength;
 
 	ISO7816Token::transmit(apdu, apduLength, result, resultLength);
+	checkSelection(result, resultLength);
 	if (resultLength == 2 && result[0] == 0x61)
 	{
 		resultLength = savedLength;
@@ -169,6 +195,7 @@ uint32_t CACNGToken::exchangeAPDU(const unsigned char *apdu, size_t apduLength,
 		unsigned char getResult[] = { 0x00, 0xC0, 0x00, 0x00, expectedLength };
 		if (expectedLength == 0) expectedLength = 256;
 		ISO7816Token::transmit(getResult, sizeof(getResult), result, resultLength);
+		checkSelection(result, resultLength);
 		if (resultLength - 2 != expectedLength)
         {
             if (resultLength < 2)
@@ -188,7 +215,7 @@ uint32_t CACNGToken::exchangeAPDU(const unsigned char *apdu, size_t apduLength,
 void CACNGToken::didDisconnect()
 {
 	PCSC::Card::didDisconnect();
-	currentSelectable.reset();
+	invalidateSelection();
 	mCacPinStatus = 0;
 	mPivPinStatus = 0;
 	/* XXX: Wipe out cached pin */
@@ -198,7 +225,7 @@ void CACNGToken::didDisconnect()
 void CACNGToken::didEnd()
 {
 	PCSC::Card::didEnd();
-	currentSelectable.reset();
+	invalidateSelection();
 	mCacPinStatus = 0;
 	mPivPinStatus = 0;
 	/* XXX: Wipe out cached pin */
@@ -594,6 +621,7 @@ size_t CACNGToken::transmit(const byte_string::const_iterator &apduBegin, const
 	/* To prevent data leaking, secure byte_string resize takes place */
 	secure_resize(result, result.size() + BUFFER_SIZE);
 	ISO7816Token::transmit(&(*apduBegin), (size_t)(apduEnd - apduBegin), &result[0]+ index, resultLength);
+	checkSelection(&result[0] + index, resultLength);
 	/* Trims the data, no expansion occurs */
 	result.resize(index + resultLength);
 	return resultLength;
@@ -37,6 +37,7 @@
 #include "byte_string.h"
 
 #include "CACNGApplet.h"
+#include "CACNGSelection.h"
 
 class CACNGSchema;
 
@@ -74,6 +75,9 @@ public:
 
 	bool identify();
 	void select(shared_ptr<CACNGSelectable> &obj);
+	void selectApplet(const byte_string &apdu);
+	void selectObject(const byte_string &apdu);
+	void invalidateSelection();
 
 	uint32_t exchangeAPDU(const unsigned char *apdu, size_t apduLength,
                           unsigned char *result, size_t &resultLength);
@@ -93,9 +97,11 @@ protected:
 		return transmit(apdu.begin(), apdu.end(), result);
 	}
 	size_t transmit(const byte_string::const_iterator &apduBegin, const byte_string::const_iterator &apduEnd, byte_string &result);
+	void checkSelection(const unsigned char *result, size_t resultLength);
 	
 public:
 	shared_ptr<CACNGSelectable> currentSelectable;
+	CACNGSelection<CACNGToken> selection;
 	uint32_t mCacPinStatus;
 	uint32_t mPivPinStatus;
 	shared_ptr<CACNGSelectable> cacPinApplet;
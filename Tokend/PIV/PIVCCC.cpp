@@ -73,10 +73,13 @@ void PIVCCC::parse(const byte_string &data) throw(PIVError)
 		{
 		case PIV_CCC_TAG_CARD_IDENTIFIER:			// 0xF0
 			// Store the card identifier value persistently
-			mIdentifier_content = (*iter)->getValue();
+		{
+			byte_span value = (*iter)->getValue();
+			mIdentifier_content.assign(value.begin(), value.end());
 			mIdentifier.Data = &mIdentifier_content[0];
 			mIdentifier.Length = mIdentifier_content.size();
 			break;
+		}
 		case PIV_CCC_TAG_CARD_CONTAINER_VERS:		// 0xF1
 		case PIV_CCC_TAG_CARD_GRAMMAR_VERS:			// 0xF2
 		case PIV_CCC_TAG_APPS_URL:					// 0xF3
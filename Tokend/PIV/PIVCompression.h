@@ -0,0 +1,148 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  PIVCompression.h
+ *  TokendPIV
+ */
+
+#ifndef _PIVCOMPRESSION_H_
+#define _PIVCOMPRESSION_H_
+
+#include "PIVDefines.h"
+#include "PIVExchange.h"
+#include "PIVUtilities.h"
+#include "byte_string.h"
+
+#include <security_cdsa_utilities/cssmerrors.h>
+#include <zlib.h>
+
+/* How a certificate on the card is compressed */
+enum			//arbitrary values
+{
+	kCompressionNone = 0,
+	kCompressionZlib = 1,
+	kCompressionGzip = 2,
+	kCompressionUnknown = 9
+};
+
+inline int compressionType(const byte_string &data)
+{
+	// Some ad-hoc stuff to guess at compression type
+	if (data.size() > 2 && data[0] == 0x1F && data[1] == 0x8B)
+		return kCompressionGzip;
+	if (data.size() > 1 /*&& (data[0] & 0x10) == Z_DEFLATED*/)
+		return kCompressionZlib;
+	else
+		return kCompressionUnknown;
+}
+
+/*
+	Returns the uncompressed size declared by the ISIZE trailer of a gzip
+	stream (size modulo 2^32, little endian), or 0 if there is none.
+*/
+inline size_t gzipDeclaredSize(const byte_string &compressedData)
+{
+	/* 10 bytes header + 8 bytes trailer at least */
+	if (compressedData.size() < 18)
+		return 0;
+	byte_string::const_iterator trailer = compressedData.end() - 4;
+	return trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((size_t)trailer[3] << 24);
+}
+
+/*
+	Inflates compressedData into uncompressedData, allocated once with the
+	size the stream declares: the gzip ISIZE trailer, or else the length
+	in the DER header of the certificate, inflated first on its own.
+	The largest PIV object size is only used when neither can be trusted.
+*/
+inline int uncompressData(byte_string &uncompressedData, const byte_string &compressedData, int compressionType)
+{
+	const size_t DER_HEADER_SIZE = 6;	// tag, 0x84 and 4 length bytes at most
+    z_stream dstream;					// decompression stream
+	int windowSize = 15;
+	switch(compressionType) {
+	case kCompressionGzip:
+		windowSize += 0x20;
+		break;
+	case kCompressionZlib:
+		break;
+	default:
+		CssmError::throwMe(CSSMERR_DL_DATABASE_CORRUPT);
+	}
+    dstream.zalloc = (alloc_func)0;
+    dstream.zfree = (free_func)0;
+    dstream.opaque = (voidpf)0;
+	/* Input not altered , so de-const-casting ok*/
+    dstream.next_in  = (Bytef*)&compressedData[0];
+    dstream.avail_in = compressedData.size();
+    int err = inflateInit2(&dstream, windowSize);
+    if (err)
+		return err;
+
+	size_t sizeHint = 0;
+	if (compressionType == kCompressionGzip)
+		sizeHint = gzipDeclaredSize(compressedData);
+
+	/* Without ISIZE, stream the DER header out first to read its length */
+	byte_string header;
+	if (sizeHint == 0)
+	{
+		header.resize(DER_HEADER_SIZE);
+		dstream.next_out = &header[0];
+		dstream.avail_out = header.size();
+		err = inflate(&dstream, Z_SYNC_FLUSH);
+		if (err != Z_OK && err != Z_STREAM_END)
+		{
+			inflateEnd(&dstream);
+			return err;
+		}
+		header.resize(dstream.total_out);
+		sizeHint = berEncodedLength(header, 0);
+	}
+	if (sizeHint < header.size() || sizeHint > PIV_MAX_DATA_SIZE)
+		sizeHint = PIV_MAX_DATA_SIZE;
+
+	uncompressedData.resize(sizeHint);
+	copy(header.begin(), header.end(), uncompressedData.begin());
+	while (err != Z_STREAM_END)
+	{
+		dstream.next_out = &uncompressedData[0] + dstream.total_out;
+		dstream.avail_out = uncompressedData.size() - dstream.total_out;
+		err = inflate(&dstream, Z_FINISH);
+		if (err == Z_STREAM_END)
+			break;
+		/* The declared size was short, retry once with the largest one */
+		if ((err == Z_OK || err == Z_BUF_ERROR) && dstream.avail_out == 0
+			&& uncompressedData.size() < PIV_MAX_DATA_SIZE)
+		{
+			secure_resize(uncompressedData, PIV_MAX_DATA_SIZE);
+			continue;
+		}
+		inflateEnd(&dstream);
+		return (err == Z_OK) ? Z_BUF_ERROR : err;
+	}
+	uncompressedData.resize(dstream.total_out);
+	err = inflateEnd(&dstream);
+	return err;
+}
+
+#endif /* !_PIVCOMPRESSION_H_ */
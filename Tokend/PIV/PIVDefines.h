@@ -81,6 +81,17 @@
 
 #define PIV_MAX_DATA_SIZE           (12704+1024)		// plus some extra
 
+// Room given to a response when its size is not known beforehand
+#define PIV_RESPONSE_BUFFER_SIZE    1024
+// Number of pooled buffers that GET DATA responses are gathered in
+#define PIV_RESPONSE_BUFFERS        2
+
+// Result codes [Ref NISTIR6887 5.1.1.1 Get Response APDU]
+
+#define PIV_RESULT_SUCCESS_SW1		0x90	//[ref SCARD_SUCCESS]
+#define PIV_RESULT_SUCCESS_SW2		(unsigned char )0x00
+#define PIV_RESULT_CONTINUATION_SW1	(unsigned char )0x61
+
 #pragma mark ---------- Object IDs on Token ----------
 
 /*
@@ -196,6 +207,9 @@
 //	X.509 Certificate for Key Management History 20 - 2.16.840.1.101.3.7.2.16.20 '5FC120' O
 #define  PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H20	0x5F, 0xC1, 0x20
 
+//	Key History Object 2.16.840.1.101.3.7.2.96.96 '5FC10C' O
+#define PIV_OBJECT_ID_KEY_HISTORY							0x5F, 0xC1, 0x0C
+
 // ----------------------------------------------------------------------------
 /*
 	Verify APDU	[NISTIR6887 5.1.2.4]
@@ -378,6 +392,21 @@ Status Tuples (STs) 0xFC Fixed 0
 
 #define PIV_CCC_SZ_CARD_IDENTIFIER		21
 
+/*
+	Key History Object [SP800-73-3 Part 1, Appendix A]
+
+	keysWithOnCardCerts 0xC1 Fixed 1
+	keysWithOffCardCerts 0xC2 Fixed 1
+	offCardCertURL 0xF3 Variable 118
+
+	The retired keys with an on-card certificate use the first
+	Key Management History slots.
+*/
+
+#define PIV_KEY_HISTORY_TAG_ON_CARD_CERTS	0xC1
+#define PIV_KEY_HISTORY_TAG_OFF_CARD_CERTS	0xC2
+#define PIV_KEY_HISTORY_TAG_OFF_CARD_URL	0xF3
+
 // ----------------------------------------------------------------------------
 
 /*
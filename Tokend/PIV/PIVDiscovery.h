@@ -0,0 +1,125 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  PIVDiscovery.h
+ *  TokendPIV
+ */
+
+#ifndef _PIVDISCOVERY_H_
+#define _PIVDISCOVERY_H_
+
+#include "PIVDefines.h"
+#include "PIVError.h"
+#include "TLV.h"
+#include "byte_string.h"
+
+#include <security_utilities/utilities.h>
+#include <algorithm>
+
+// The PIV Authentication, Digital Signature, Key Management and Card
+// Authentication certificates, ahead of the 20 retired key certificates
+#define PIV_STANDARD_CERTIFICATES	4
+
+/* Which certificate objects populate() has to ask the card for.  Card is
+ * the PIVToken, or a simulated card in tests, and provides getDataCore(). */
+template<class Card>
+class PIVDiscovery
+{
+	NOCOPY(PIVDiscovery)
+public:
+	PIVDiscovery(Card &card) : mCard(card) {}
+
+	int keyHistoryOnCardCertificates();
+	unsigned int certificateCount(unsigned int slotCount);
+	bool readCertificate(const unsigned char *oid, const char *description, byte_string &certData);
+
+private:
+	Card &mCard;
+};
+
+/*
+	Returns the number of retired key management keys having their certificate
+	on the card, read from the Key History object. Returns 0 if the card has no
+	Key History object and -1 if it could not be read, in which case every
+	retired key slot has to be probed.
+*/
+template<class Card>
+int PIVDiscovery<Card>::keyHistoryOnCardCertificates()
+{
+	static const unsigned char oidKeyHistory[] = { PIV_OBJECT_ID_KEY_HISTORY };
+	byte_string data;
+	try {
+		mCard.getDataCore(byte_string(oidKeyHistory, oidKeyHistory + sizeof(oidKeyHistory)), "KEYHISTORY", false, true, data);
+	} catch(PIVError &e) {
+		if (e.statusWord == SCARD_FILE_NOT_FOUND)
+			return 0;
+		return -1;
+	} catch(...) {
+		return -1;
+	}
+
+	try {
+		TLV_ref tlv = TLV::parse(data);
+		TLVList list = tlv->getInnerValues();
+		for(TLVList::const_iterator iter = list.begin(); iter != list.end(); ++iter) {
+			const byte_span &tag = (*iter)->getTag();
+			if (tag.size() != 1 || tag[0] != PIV_KEY_HISTORY_TAG_ON_CARD_CERTS)
+				continue;
+			byte_span value = (*iter)->getValue();
+			if (value.size() != 1)
+				return -1;
+			return value[0];
+		}
+	} catch(...) {
+	}
+	return -1;
+}
+
+/*
+	Returns how many of the slotCount certificate slots, standard ones first,
+	are worth reading: the standard ones, and the retired ones only as far
+	as the Key History object says they are on the card.
+*/
+template<class Card>
+unsigned int PIVDiscovery<Card>::certificateCount(unsigned int slotCount)
+{
+	int historyCount = keyHistoryOnCardCertificates();
+	secdebug("populate", "Key History: %d on-card certificates", historyCount);
+	if (historyCount < 0)
+		return slotCount;
+	return std::min(slotCount, PIV_STANDARD_CERTIFICATES + (unsigned int)historyCount);
+}
+
+/* Reads a certificate, returns false if the card does not have it */
+template<class Card>
+bool PIVDiscovery<Card>::readCertificate(const unsigned char *oid, const char *description, byte_string &certData)
+{
+	// Since every object ID is 3 bytes long, this works
+	try {
+		mCard.getDataCore(byte_string(oid, oid + 3), description, true, true, certData);
+	} catch(PIVError &e) {
+		return false;
+	}
+	return true;
+}
+
+#endif /* !_PIVDISCOVERY_H_ */
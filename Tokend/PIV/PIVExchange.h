@@ -0,0 +1,102 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  PIVExchange.h
+ *  TokendPIV
+ */
+
+#ifndef _PIVEXCHANGE_H_
+#define _PIVEXCHANGE_H_
+
+#include "PIVDefines.h"
+#include "PIVUtilities.h"
+#include "byte_string.h"
+
+/*
+	Returns the full size (tag, length and value) of the BER-TLV object
+	starting at offset, or 0 if its header is not complete in data.
+*/
+inline size_t berEncodedLength(const byte_string &data, size_t offset)
+{
+	size_t index = offset;
+	if (index >= data.size())
+		return 0;
+	/* Multi-byte tags */
+	if ((data[index++] & 0x1F) == 0x1F) {
+		while (index < data.size() && (data[index] & 0x80))
+			index++;
+		index++;
+	}
+	if (index >= data.size())
+		return 0;
+	size_t length = data[index++];
+	if (length & 0x80) {
+		size_t lengthBytes = length & 0x7F;
+		if (lengthBytes == 0 || lengthBytes > 3 || index + lengthBytes > data.size())
+			return 0;
+		length = 0;
+		while (lengthBytes--)
+			length = (length << 8) | data[index++];
+	}
+	return (index - offset) + length;
+}
+
+/*
+	Exchanges apdu, appending to result the data of the response and of the
+	GET RESPONSE commands its 61xx status asks for.  Card is the PIVToken,
+	or a simulated card in tests, and provides simpleExchangeAPDU().
+*/
+template<class Card>
+uint16_t pivExchangeAPDU(Card &card, const byte_string &apdu, byte_string &result)
+{
+	static const uint8_t GET_RESULT_TEMPLATE [] = { 0x00, 0xC0, 0x00, 0x00, 0xFF };
+	byte_string getResult(GET_RESULT_TEMPLATE, GET_RESULT_TEMPLATE + sizeof(GET_RESULT_TEMPLATE));
+	const int SIZE_INDEX = 4;
+
+	const size_t start = result.size();
+	size_t fragmentRoom = PIV_RESPONSE_BUFFER_SIZE;
+	uint16_t ret = card.simpleExchangeAPDU(apdu, result, PIV_RESPONSE_BUFFER_SIZE);
+	/* Size the buffer once for the whole response from its BER-TLV header so
+	 * that the fragments below are written in place */
+	if ((ret >> 8) == PIV_RESULT_CONTINUATION_SW1)
+	{
+		size_t announcedLength = berEncodedLength(result, start);
+		if(announcedLength > 0 && announcedLength <= PIV_MAX_DATA_SIZE) {
+			secure_reserve(result, start + announcedLength + 256 + 2);
+			fragmentRoom = 0;
+		}
+	}
+	/* Keep pulling more data */
+	while ((ret >> 8) == PIV_RESULT_CONTINUATION_SW1)
+	{
+		size_t expectedLength = ret & 0xFF;
+		if(expectedLength == 0) /* 256-byte case .. */
+			expectedLength = 256;
+		getResult[SIZE_INDEX] = expectedLength & 0xFF;
+		/* Only the announced fragment and status bytes can come back; without
+		 * a reservation keep the wide margin to limit reallocations */
+		ret = card.simpleExchangeAPDU(getResult, result, fragmentRoom ? fragmentRoom : expectedLength + 2);
+	}
+	return ret;
+}
+
+#endif /* !_PIVEXCHANGE_H_ */
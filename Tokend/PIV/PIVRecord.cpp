@@ -212,8 +212,8 @@ void PIVKeyRecord::computeCrypt(PIVToken &pivToken, bool sign,	// MODIFY
 		secure_zero(output);
 		PIVError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
 	}
-	secure_zero(output);
 	if(tlv->getTag() != (unsigned char*)"\x7C") {
+		secure_zero(output);
 		secdebug("piv", " %s: computeCrypt: missing response tag: 0x%.2X",
 				 description(), 0x7C);
 		PCSC::Error::throwMe(SCARD_E_PROTO_MISMATCH);
@@ -222,10 +222,14 @@ void PIVKeyRecord::computeCrypt(PIVToken &pivToken, bool sign,	// MODIFY
 	try {
 		TLVList list = tlv->getInnerValues();
 		TLVList::const_iterator iter = find_if(list.begin(), list.end(), TagPredicate(0x82));
-		if(iter != list.end())
-			tagData = (*iter)->getValue();
+		if(iter != list.end()) {
+			byte_span value = (*iter)->getValue();
+			tagData.assign(value.begin(), value.end());
+		}
 	} catch(...) {
 	}
+	/* The parsed TLVs reference output, only wipe it once copied out */
+	secure_zero(output);
 	if(tagData.size() == 0) {
 		secdebug("piv", " %s: computeCrypt: missing response value tag: 0x%.2X",
 				 description(), 0x82);
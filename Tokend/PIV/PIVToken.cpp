@@ -35,10 +35,12 @@
 #include "PIVError.h"
 #include "PIVRecord.h"
 #include "PIVSchema.h"
+#include "PIVDiscovery.h"
+#include "PIVExchange.h"
+#include "PIVCompression.h"
 #include <security_cdsa_client/aclclient.h>
 #include <map>
 #include <vector>
-#include <zlib.h>
 #include <CoreFoundation/CFString.h>
 /* FOR KEYSIZE RETREIVAL */
 #include <Security/Security.h>
@@ -56,13 +58,6 @@ using CssmClient::AclFactory;
 
 #pragma mark ---------- PIV defines ----------
 
-
-// Result codes [Ref NISTIR6887 5.1.1.1 Get Response APDU]
-
-#define PIV_RESULT_SUCCESS_SW1		0x90	//[ref SCARD_SUCCESS]
-#define PIV_RESULT_SUCCESS_SW2		(unsigned char )0x00
-#define PIV_RESULT_CONTINUATION_SW1	(unsigned char )0x61
-
 /*
 	00 A4 04 00 07 A0 00 00 01 51 00 00		[A0000001510000]
 	00 A4 04 00 06 A0 00 00 00 01 01 
@@ -132,7 +127,7 @@ static const unsigned char oidX509CertificateKeyManagementHistory20[] = { PIV_OB
 #pragma mark ---------- NO/MINOR MODIFICATION NEEDED ----------
 
 PIVToken::PIVToken() :
-	mCurrentApplet(NULL), mPinStatus(0)
+	mCurrentApplet(NULL), mPinStatus(0), mExchangeCount(0)
 {
 	mTokenContext = this;
 	mSession.open();
@@ -174,6 +169,21 @@ void PIVToken::establish(const CSSM_GUID *guid, uint32 subserviceId,
 	Tokend::ISO7816Token::establish(guid, subserviceId, flags,
 		cacheDirectory, workDirectory, mdsDirectory, printName);
 
+	// The CHUID changes whenever the card is reissued: reading it is the one
+	// exchange needed to trust the objects cached for this card
+	try
+	{
+		byte_string chuid;
+		getDataCore(byte_string(oidCardHolderUniqueIdentifier, oidCardHolderUniqueIdentifier + sizeof(oidCardHolderUniqueIdentifier)),
+			sDescripCardHolderUniqueIdentifier, false, false, chuid);
+		if (!chuid.empty())
+			cacheFingerprint(CssmData(&chuid[0], chuid.size()));
+	}
+	catch (...)
+	{
+		secdebug("pivtoken", "no CHUID, object cache not bound to the card content");
+	}
+
 #ifdef _USECERTIFICATECOMMONNAME
 	std::string commonName = authCertCommonName();
 	::snprintf(printName, 40, "PIV-%s", commonName.c_str());
@@ -347,9 +357,9 @@ done:
 void PIVToken::populate()
 {
 	/*
-		@@@ To do:
-		read and parse CCC record to find out if the card has all of the optional records
-		before adding them
+		The CCC (already read by establish) and the Key History object are
+		read first. Only the retired key certificates that the Key History
+		object announces are then requested from the card.
 	*/
 	
 	secdebug("populate", "PIVToken::populate() begin");
@@ -381,10 +391,21 @@ void PIVToken::populate()
 
 	// Since every object ID is 3 bytes long, this works
 	const size_t sz = sizeof(oidCardCapabilityContainer);
+
+	// Keep the card for the whole discovery: the applet is selected once and
+	// all the probes and reads below share this transaction
+	PCSC::Transaction _(*this);
+	selectDefault();
+	const uint32_t exchangeCount = mExchangeCount;
 	
 	//	Card Capability Container 2.16.840.1.101.3.7.1.219.0 '5FC107' [Mandatory]
-	if (getDataExists(oidCardCapabilityContainer, sz, sDescripCardCapabilityContainer))
+	//	establish() has already read it, so this comes from the cache
+	try {
+		byte_string cccData;
+		getDataCore(byte_string(oidCardCapabilityContainer, oidCardCapabilityContainer + sz), sDescripCardCapabilityContainer, false, true, cccData);
 		dataRelation.insertRecord(new PIVDataRecord(oidCardCapabilityContainer, sz, sDescripCardCapabilityContainer));
+	} catch(PIVError &e) {
+	}
 
 	//	Card Holder Unique Identifier 2.16.840.1.101.3.7.2.48.0 '5FC102'  [Mandatory] [CHUID]
 	if (getDataExists(oidCardHolderUniqueIdentifier, sz, sDescripCardHolderUniqueIdentifier))
@@ -526,14 +547,16 @@ void PIVToken::populate()
 		// ======================= key history support ================================
 	};
 
-	for (unsigned int ix=0;ix<sizeof(certids)/sizeof(certids[0]);++ix)
+	// The four standard certificates are always looked for, the retired
+	// ones only as far as the Key History object says they are on the card
+	PIVDiscovery<PIVToken> discovery(*this);
+	const unsigned int certCount = discovery.certificateCount(sizeof(certids)/sizeof(certids[0]));
+
+	for (unsigned int ix=0;ix<certCount;++ix)
 	{
 		byte_string certData;
-		try {
-			getDataCore(byte_string(certids[ix], certids[ix] + sz), certNames[ix], true, true, certData);
-		} catch(PIVError &e) {
+		if (!discovery.readCertificate(certids[ix], certNames[ix], certData))
 			continue;
-		}
 		int keySize = getKeySize(certData);
 		if(keySize == 0) continue;
 
@@ -549,7 +572,7 @@ void PIVToken::populate()
 							new Tokend::LinkedRecordAdornment(cert));
 	}
 
-	secdebug("populate", "PIVToken::populate() end");
+	secdebug("populate", "PIVToken::populate() end [%u APDU exchanges]", mExchangeCount - exchangeCount);
 }
 
 bool PIVToken::identify()
@@ -776,8 +799,8 @@ void PIVToken::selectDefault()
 	select(kSelectPIVApplet, sizeof(kSelectPIVApplet));
 }
 
-uint16_t PIVToken::simpleExchangeAPDU(const byte_string &apdu, byte_string &result) {
-	transmit(apdu, result);
+uint16_t PIVToken::simpleExchangeAPDU(const byte_string &apdu, byte_string &result, size_t maxLength /* = PIV_RESPONSE_BUFFER_SIZE */) {
+	transmit(apdu, result, maxLength);
 	if (result.size() < 2)
 		PCSC::Error::throwMe(SCARD_E_PROTO_MISMATCH);
 	uint16_t ret = (result[result.size() - 2] << 8) + result[result.size() - 1];
@@ -788,21 +811,7 @@ uint16_t PIVToken::simpleExchangeAPDU(const byte_string &apdu, byte_string &resu
 
 uint16_t PIVToken::exchangeAPDU(const byte_string &apdu, byte_string &result)
 {
-	static const uint8_t GET_RESULT_TEMPLATE [] = { 0x00, 0xC0, 0x00, 0x00, 0xFF };
-	byte_string getResult(GET_RESULT_TEMPLATE, GET_RESULT_TEMPLATE + sizeof(GET_RESULT_TEMPLATE));
-	const int SIZE_INDEX = 4;
-
-	uint16_t ret = simpleExchangeAPDU(apdu, result);
-	/* Keep pulling more data */
-	while ((ret >> 8) == PIV_RESULT_CONTINUATION_SW1)
-	{
-		size_t expectedLength = ret & 0xFF;
-		if(expectedLength == 0) /* 256-byte case .. */
-			expectedLength = 256;
-		getResult[SIZE_INDEX] = expectedLength & 0xFF;
-		ret = simpleExchangeAPDU(getResult, result);
-	}
-	return ret;
+	return pivExchangeAPDU(*this, apdu, result);
 }
 
 uint16_t PIVToken::exchangeChainedAPDU(unsigned char cla, unsigned char ins,
@@ -894,15 +903,19 @@ void PIVToken::getDataCore(const byte_string &oid, const char *description, bool
 	// Talk to token here to get data
 	{
 		byte_string getDataApdu = buildGetData(oid);
+		/* Gathered in a pooled buffer, wiped when reused, and handed over without copying */
+		byte_string &response = mResponseBuffers.getBuffer();
 		PCSC::Transaction _(*this);
 		selectDefault();
 		/* Continuation handled by exchangeAPDU */
-		uint16_t rx = exchangeAPDU(getDataApdu, data);
+		uint16_t rx = exchangeAPDU(getDataApdu, response);
 		secdebug("pivtokend", "exchangeAPDU result %02X", rx);
 		PIVError::check(rx);
-		if(data.size() > PIV_MAX_DATA_SIZE) {
+		if(response.size() > PIV_MAX_DATA_SIZE) {
 			PIVError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
 		}
+		secure_zero(data);
+		data.swap(response);
 	}
 	dumpDataRecord(data, oid);
 
@@ -929,6 +942,7 @@ void PIVToken::processCertificateRecord(byte_string &data, const byte_string &oi
 {
 	bool hasCertificateData = false;
 	bool isCompressed = false;
+	byte_span certificate;
 
 	// 00000000  53 82 04 84 70 82 04 78  78 da 33 68 62 db 61 d0 
 	TLV_ref tlv;
@@ -941,15 +955,16 @@ void PIVToken::processCertificateRecord(byte_string &data, const byte_string &oi
 	}
 
 	for(TLVList::const_iterator iter = list.begin(); iter != list.end(); ++iter) {
-		const byte_string &tagString = (*iter)->getTag();
-		const byte_string &value = (*iter)->getValue();
+		const byte_span &tagString = (*iter)->getTag();
+		byte_span value = (*iter)->getValue();
 		if(tagString.size() != 1)
 			PIVError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
 		uint8_t tag = tagString[0];
 		switch (tag)
 		{
 		case PIV_GETDATA_TAG_CERTIFICATE:			// 0x70
-			data = value;
+			/* References data, which is trimmed once the parsing is over */
+			certificate = value;
 			hasCertificateData = true;
 			break;
 		case PIV_GETDATA_TAG_CERTINFO:				// 0x71
@@ -974,6 +989,14 @@ void PIVToken::processCertificateRecord(byte_string &data, const byte_string &oi
 	/* No cert data ? */
 	if(!hasCertificateData)
 		PIVError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
+	/* Keep only the certificate, in place */
+	if(certificate.empty())
+		data.clear();
+	else {
+		size_t certificateOffset = certificate.begin() - &data[0];
+		data.erase(data.begin() + certificateOffset + certificate.size(), data.end());
+		data.erase(data.begin(), data.begin() + certificateOffset);
+	}
 	if (isCompressed)
 	{
 		/* The certificate is compressed */
@@ -981,16 +1004,16 @@ void PIVToken::processCertificateRecord(byte_string &data, const byte_string &oi
 		dumpDataRecord(data, oid, "-compressedcert");
 
 		byte_string uncompressedData;
-		uncompressedData.resize(PIV_MAX_DATA_SIZE);
 		int rv = Z_ERRNO;
 		int compTyp = compressionType(data);
-		rv = PIVToken::uncompressData(uncompressedData, data, compTyp);
+		rv = uncompressData(uncompressedData, data, compTyp);
 		if (rv != Z_OK)
 		{
 			secdebug("zlib", "uncompressing %s failed: %d [type=%d]", description, rv, compTyp);
 			CssmError::throwMe(CSSMERR_DL_DATABASE_CORRUPT);
 		}
-		data = uncompressedData;
+		/* getDataCore caches the DER form, later reads do not inflate again */
+		data.swap(uncompressedData);
 	}
 	else
 	{
@@ -998,53 +1021,6 @@ void PIVToken::processCertificateRecord(byte_string &data, const byte_string &oi
 	dumpDataRecord(data, oid, "-rawcert");
 }
 
-int PIVToken::compressionType(const byte_string &data)
-{
-	// Some ad-hoc stuff to guess at compression type
-	if (data.size() > 2 && data[0] == 0x1F && data[1] == 0x8B)
-		return kCompressionGzip;
-	if (data.size() > 1 /*&& (data[0] & 0x10) == Z_DEFLATED*/)
-		return kCompressionZlib;
-	else
-		return kCompressionUnknown;
-}
-
-int PIVToken::uncompressData(byte_string &uncompressedData, const byte_string &compressedData, int compressionType)
-{
-    z_stream dstream;					// decompression stream
-	int windowSize = 15;
-	switch(compressionType) {
-	case kCompressionGzip:
-		windowSize += 0x20;
-		break;
-	case kCompressionZlib:
-		break;
-	default:
-		CssmError::throwMe(CSSMERR_DL_DATABASE_CORRUPT);
-	}
-    dstream.zalloc = (alloc_func)0;
-    dstream.zfree = (free_func)0;
-    dstream.opaque = (voidpf)0;
-	/* Input not altered , so de-const-casting ok*/
-    dstream.next_in  = (Bytef*)&compressedData[0];
-    dstream.avail_in = compressedData.size();
-	dstream.next_out = &uncompressedData[0];
-	dstream.avail_out = uncompressedData.size();
-    int err = inflateInit2(&dstream, windowSize);
-    if (err)
-		return err;
-	
-	err = inflate(&dstream, Z_FINISH);
-	if (err != Z_STREAM_END)
-	{
-		inflateEnd(&dstream);
-		return err;
-	}
-	uncompressedData.resize(dstream.total_out);
-	err = inflateEnd(&dstream);
-	return err;
-}
-
 void PIVToken::dumpDataRecord(const byte_string &data, const byte_string &oid, const char *extraSuffix)
 {
 #if !defined(NDEBUG)
@@ -1096,12 +1072,13 @@ std::string PIVToken::authCertCommonName()
 	return std::string(cn?cn:"--unknown--");
 }
 
-size_t PIVToken::transmit(const byte_string::const_iterator &apduBegin, const byte_string::const_iterator &apduEnd, byte_string &result) {
-	const size_t BUFFER_SIZE = 1024;
-	size_t resultLength = BUFFER_SIZE;
+size_t PIVToken::transmit(const byte_string::const_iterator &apduBegin, const byte_string::const_iterator &apduEnd, byte_string &result, size_t maxLength /* = PIV_RESPONSE_BUFFER_SIZE */) {
+	size_t resultLength = maxLength;
 	size_t index = result.size();
-	/* To prevent data leaking, secure byte_string resize takes place */
-	secure_resize(result, result.size() + BUFFER_SIZE);
+	/* To prevent data leaking, secure byte_string resize takes place.
+	 * No reallocation occurs when the response size was reserved beforehand */
+	secure_resize(result, result.size() + maxLength);
+	++mExchangeCount;
 	ISO7816Token::transmit(&(*apduBegin), (size_t)(apduEnd - apduBegin), &result[0]+ index, resultLength);
 	/* Trims the data, no expansion occurs */
 	result.resize(index + resultLength);
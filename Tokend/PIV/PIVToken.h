@@ -38,6 +38,7 @@
 #include <security_utilities/pcsc++.h>
 
 #include "byte_string.h"
+#include "SecureBufferAllocator.h"
 
 #pragma mark ---------- PIV defines ----------
 
@@ -220,8 +221,8 @@ public:
 	/* NOTE: Using pointers for applet selection rather than byte_strings to permit simple selection detection */
 	void select(const unsigned char *applet, size_t appletLength);
 	void selectDefault();
-	/* Exchanges APDU without performing data continuation */
-	uint16_t simpleExchangeAPDU(const byte_string &apdu, byte_string &result);
+	/* Exchanges APDU without performing data continuation, expecting at most maxLength bytes back */
+	uint16_t simpleExchangeAPDU(const byte_string &apdu, byte_string &result, size_t maxLength = PIV_RESPONSE_BUFFER_SIZE);
 	/* Exchanges APDU, performing data retreival continuation as needed */
 	uint16_t exchangeAPDU(const byte_string& apdu, byte_string &result);
 	uint16_t exchangeChainedAPDU(unsigned char cla, unsigned char ins,
@@ -243,24 +244,18 @@ protected:
 	size_t getKeySize(const byte_string &cert) const;
 	void processCertificateRecord(byte_string &data, const byte_string &oid, const char *description);
 	void dumpDataRecord(const byte_string &data, const byte_string &oid, const char *extraSuffix = NULL);
-	static int compressionType(const byte_string &data);
-	static int uncompressData(byte_string &uncompressedData, const byte_string &compressedData, int compressionType);
-	
-	enum			//arbitrary values
-	{
-		kCompressionNone = 0,
-		kCompressionZlib = 1,
-		kCompressionGzip = 2,
-		kCompressionUnknown = 9
-	};
-
-	size_t transmit(const byte_string &apdu, byte_string &result) {
-		return transmit(apdu.begin(), apdu.end(), result);
+
+	size_t transmit(const byte_string &apdu, byte_string &result, size_t maxLength = PIV_RESPONSE_BUFFER_SIZE) {
+		return transmit(apdu.begin(), apdu.end(), result, maxLength);
 	}
-	size_t transmit(const byte_string::const_iterator &apduBegin, const byte_string::const_iterator &apduEnd, byte_string &result);
+	size_t transmit(const byte_string::const_iterator &apduBegin, const byte_string::const_iterator &apduEnd, byte_string &result, size_t maxLength = PIV_RESPONSE_BUFFER_SIZE);
 public:
 	const unsigned char *mCurrentApplet;
 	uint32_t mPinStatus;
+	/* Number of APDUs sent to the card, to measure the round trips of an operation */
+	uint32_t mExchangeCount;
+	/* Wiped buffers the GET DATA responses are gathered in before being handed over */
+	SecureBufferAllocator<PIV_RESPONSE_BUFFERS> mResponseBuffers;
 	
 	// temporary ACL cache hack - to be removed
 	AutoAclOwnerPrototype mAclOwner;
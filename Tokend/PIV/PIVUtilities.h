@@ -55,5 +55,17 @@ inline void secure_resize(T &data, const size_t newSize) {
 	copy(temporary.begin(), temporary.end(), data.begin());
 	secure_zero(temporary);
 }
+
+template<typename T>
+inline void secure_reserve(T &data, const size_t newCapacity) {
+	if(data.capacity() >= newCapacity)
+		return;
+	// Re-allocation will occur, wipe the old storage once moved
+	T temporary;
+	temporary.reserve(newCapacity);
+	temporary.assign(data.begin(), data.end());
+	secure_zero(data);
+	data.swap(temporary);
+}
 	
 #endif
@@ -26,35 +26,51 @@
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <new>
 
 using namespace std;
 
 TLV::TLV() throw()
-:tag(), value(NULL), innerValues(NULL) {
+:tagBytes(), valueBytes(NULL), tag(), value(), hasValue(false),
+ encodedValue(NULL), innerValues(NULL), arena(NULL), ownedArena(NULL) {
 }
 
 TLV::TLV(unsigned char tag) throw()
-:tag(1, tag), value(NULL), innerValues(NULL) {
+:tagBytes(1, tag), valueBytes(NULL), tag(tagBytes), value(), hasValue(false),
+ encodedValue(NULL), innerValues(NULL), arena(NULL), ownedArena(NULL) {
 }
 
 TLV::TLV(const byte_string& tag) throw()
-:tag(tag), value(NULL), innerValues(NULL) {
+:tagBytes(tag), valueBytes(NULL), tag(tagBytes), value(), hasValue(false),
+ encodedValue(NULL), innerValues(NULL), arena(NULL), ownedArena(NULL) {
 }
 
 TLV::TLV(unsigned char tag, const byte_string& value) throw()
-:tag(1, tag), value(new byte_string(value)), innerValues(NULL) {
+:tagBytes(1, tag), valueBytes(new byte_string(value)), tag(tagBytes), value(*valueBytes), hasValue(true),
+ encodedValue(NULL), innerValues(NULL), arena(NULL), ownedArena(NULL) {
 }
 
 TLV::TLV(const byte_string& tag, const byte_string& value) throw()
-:tag(tag), value(new byte_string(value)), innerValues(NULL) {
+:tagBytes(tag), valueBytes(new byte_string(value)), tag(tagBytes), value(*valueBytes), hasValue(true),
+ encodedValue(NULL), innerValues(NULL), arena(NULL), ownedArena(NULL) {
 }
 
 TLV::TLV(uint8_t tag, const TLVList &tlv) throw()
-:tag(1, tag), value(NULL), innerValues(new TLVList(tlv)) {
+:tagBytes(1, tag), valueBytes(NULL), tag(tagBytes), value(), hasValue(false),
+ encodedValue(NULL), innerValues(new TLVList(tlv)), arena(NULL), ownedArena(NULL) {
 }
 
 TLV::TLV(const byte_string &tag, const TLVList &tlv) throw()
-:tag(tag), value(NULL), innerValues(new TLVList(tlv)) {
+:tagBytes(tag), valueBytes(NULL), tag(tagBytes), value(), hasValue(false),
+ encodedValue(NULL), innerValues(new TLVList(tlv)), arena(NULL), ownedArena(NULL) {
+}
+
+TLV::TLV(const byte_span &tag, const byte_span &value, TLVArena *arena) throw()
+:tagBytes(), valueBytes(NULL), tag(tag), value(value), hasValue(true),
+ encodedValue(NULL), innerValues(NULL), arena(arena), ownedArena(NULL) {
+}
+
+TLV::~TLV() throw() {
 }
 
 TLV_ref TLV::parse(const byte_string &in) throw(std::runtime_error) {
@@ -62,6 +78,90 @@ TLV_ref TLV::parse(const byte_string &in) throw(std::runtime_error) {
 	return parse(begin, in.end());
 }
 
+TLV_ref TLV::parse(const uint8_t *&iter, const uint8_t *end) throw(std::runtime_error) {
+	byte_span tag, value;
+	parseOne(iter, end, tag, value);
+	/* The root owns the arena its inner values are parsed into */
+	return TLV_ref(new TLV(tag, value, NULL));
+}
+
+void TLV::parseSequence(const uint8_t *&iter, const uint8_t *end, TLVList &tlv, TLVArena &arena) throw(std::runtime_error) {
+	byte_span tag, value;
+	/* While there is still data inbetween the iterators */
+	while(iter < end) {
+		/* parse TLV structures and append them to the list */
+		parseOne(iter, end, tag, value);
+		tlv.push_back(arena.allocate(tag, value));
+	}
+}
+
+void TLV::parseOne(const uint8_t *&iter, const uint8_t *end, byte_span &tag, byte_span &value) throw(std::runtime_error) {
+	uint8_t ch;
+	if(iter >= end) throw std::runtime_error("Invalid TLV-encoding");
+	const uint8_t *tagBegin = iter;
+	/* Read the first byte as the tag */
+	ch = *iter++;
+	if(iter >= end) throw std::runtime_error("Invalid TLV-encoding");
+	/* If the tag is flagged as a multibyte tag */
+	if((ch & 0x1F) == 0x1F) { /* Multibyte tag */
+		do {
+			ch = *iter++;
+			if(iter >= end) throw std::runtime_error("Invalid TLV-encoding");
+			/* Read more until there are no more bytes w/o the high-bit set */
+		} while((ch & 0x80) != 0);
+	}
+	tag = byte_span(tagBegin, iter);
+	/* Parse the length of the contained value */
+	size_t length = parseLength(iter, end);
+	/* The value is permitted to end at the very end of the data */
+	if(length > (size_t)(end - iter)) throw std::runtime_error("Invalid TLV-encoding");
+	value = byte_span(iter, iter + length);
+	iter += length;
+}
+
+/*
+	BER-TLV
+	Reference: http://www.cardwerk.com/smartcards/smartcard_standard_ISO7816-4_annex-d.aspx
+
+	In short form, the length field consists of a single byte where the bit B8 shall be set to 0 and
+	the bits B7-B1 shall encode an integer equal to the number of bytes in the value field. Any length
+	from 0-127 can thus be encoded by 1 byte.
+
+	In long form, the length field consists of a leading byte where the bit B8 shall be set to 1 and
+	the B7-B1 shall not be all equal, thus encoding a positive integer equal to the number of subsequent
+	bytes in the length field. Those subsequent bytes shall encode an integer equal to the number of bytes
+	in the value field. Any length within the APDU limit (up to 65535) can thus be encoded by 3 bytes.
+
+	NOTE - ISO/IEC 7816 does not use the indefinite lengths specified by the basic encoding rules of
+	ASN.1 (see ISO/IEC 8825).
+
+	Sample data (from a certficate GET DATA):
+
+	00000000  53 82 04 84 70 82 04 78  78 da 33 68 62 db 61 d0
+	00000010  c4 ba 60 01 33 13 23 13  13 97 e2 dc 88 f7 0c 40
+	00000020  20 da 63 c0 cb c6 a9 d5  e6 d1 f6 9d 97 91 91 95
+	....
+	00000460  1f 22 27 83 ef fe ed 5e  7a f3 e8 b6 dc 6b 3f dc
+	00000470  4c be bc f5 bf f2 70 7e  6b d0 4c 00 80 0d 3f 1f
+	00000480  71 01 80 72 03 49 44 41
+
+*/
+size_t TLV::parseLength(const uint8_t *&iter, const uint8_t *end) throw(std::runtime_error) {
+	// Parse a BER length field. Returns the value of the length
+	uint8_t ch = *iter++;
+	if (!(ch & 0x80))	// single byte
+		return static_cast<uint32_t>(ch);
+	size_t result = 0;
+	uint8_t byteLen = ch & 0x7F;
+	for(;byteLen > 0; byteLen--) {
+		if(iter == end)
+			throw std::runtime_error("Invalid BER-encoded length");
+		ch = *iter++;
+		result = (result << 8) | static_cast<uint8_t>(ch);
+	}
+	return result;
+}
+
 byte_string TLV::encode() const throw() {
 	byte_string out;
 	encode(out);
@@ -69,64 +169,56 @@ byte_string TLV::encode() const throw() {
 }
 
 void TLV::encode(byte_string &out) const throw() {
-	const byte_string &tag = getTag();
 	// Puts the tag
 	out += tag;
 	// Puts the length
 	encodeLength(valueLength(), out);
 
-#if 1
-	// Non-caching version since the TLV is expected to be
-	// thrown away after encoding
 	// If there is a value, put that
-	if(value.get()) {
-		out += *value;
+	if(hasValue) {
+		out += value;
 		return;
 	}
 	if(!innerValues.get())
 		return;
 	// Else if there are innerValues, encode those out
 	encodeSequence(*innerValues, out);
-#else
-	// Obtain the value in a cached manner
-	const byte_string &value = getValue();
-	out += value;
-#endif
 }
 
 const TLVList &TLV::getInnerValues() const throw(std::runtime_error) {
 	/* If there is a cached innervalues version, output it
 	 * else parse any existing TLV data and use that */
 	if(innerValues.get()) return *innerValues;
-	if(!value.get()) {
-		innerValues.reset(new TLVList());
-		return *innerValues;
+	std::auto_ptr<TLVList> values(new TLVList());
+	if(hasValue) {
+		/* The root of a tree creates the arena shared by all its TLVs */
+		if(!arena) {
+			ownedArena.reset(new TLVArena());
+			arena = ownedArena.get();
+		}
+		const uint8_t *begin = value.begin();
+		parseSequence(begin, value.end(), *values, *arena);
 	}
-	innerValues.reset(new TLVList());
-	byte_string::const_iterator begin = value->begin();
-	parseSequence(begin, (byte_string::const_iterator)value->end(), *innerValues);
-
+	innerValues = values;
 	return *innerValues;
 }
 
-const byte_string &TLV::getValue() const throw() {
-	/* If there is a cached value version, output it
-	 * else encode any existing TLV data and use that */
-	if(value.get()) return *value;
-	if(!innerValues.get()) {
-		value.reset(new byte_string());
-		return *value;
+byte_span TLV::getValue() const throw() {
+	/* If there is a value, output it
+	 * else encode any existing TLV data once and use that */
+	if(hasValue) return value;
+	if(!innerValues.get()) return byte_span();
+	if(!encodedValue.get()) {
+		encodedValue.reset(new byte_string());
+		encodeSequence(*innerValues, *encodedValue);
 	}
-	value.reset(new byte_string());
-	encodeSequence(*innerValues, *value);
-	return *value;
+	return byte_span(*encodedValue);
 }
 
 size_t TLV::length() const throw() {
 	size_t innerLength = valueLength();
 	return tag.size() + encodedLength(innerLength) + innerLength;
 }
-
 void TLV::encodeLength(size_t value, byte_string &out) throw() {
 	/* Encode and output the length according to BER-TLV encoding rules */
 	static const size_t MAX_VALUE = std::numeric_limits<size_t>::max();
@@ -176,10 +268,36 @@ void TLV::encodeSequence(const TLVList &tlv, byte_string &out) throw() {
 size_t TLV::valueLength() const throw() {
 	/* Calculate the length of a value, either by its actual value length
 	 * or calculated length based on contained TLV values */
-	if(value.get()) return value->size();
+	if(hasValue) return value.size();
 	if(!innerValues.get()) return 0;
 	size_t retValue = 0;
 	for(TLVList::const_iterator iter = innerValues->begin(); iter < innerValues->end(); iter++)
 		retValue += (*iter)->length();
 	return retValue;
 }
+
+TLVArena::TLVArena() throw()
+:blocks(), used(0) {
+}
+
+TLVArena::~TLVArena() throw() {
+	/* Only the last block is partially used */
+	for(size_t i = 0; i < blocks.size(); i++) {
+		TLV *tlv = static_cast<TLV *>(blocks[i]);
+		size_t count = (i + 1 == blocks.size()) ? used : BLOCK_SIZE;
+		for(size_t j = 0; j < count; j++)
+			tlv[j].~TLV();
+		::operator delete(blocks[i]);
+	}
+}
+
+TLV_ref TLVArena::allocate(const byte_span &tag, const byte_span &value) {
+	if(blocks.empty() || used == BLOCK_SIZE) {
+		blocks.reserve(blocks.size() + 1);
+		blocks.push_back(::operator new(BLOCK_SIZE * sizeof(TLV)));
+		used = 0;
+	}
+	TLV *tlv = new(static_cast<TLV *>(blocks.back()) + used) TLV(tag, value, this);
+	used++;
+	return TLV_ref(tlv, NoDelete());
+}
@@ -26,10 +26,14 @@
 
 #include <tr1/memory>
 
+#include <stdint.h>
+
 #include <stdexcept>
 
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 
 #ifndef NOCOPY
 #define NOCOPY(Type)    private: Type(const Type &); void operator = (const Type &);
@@ -38,13 +42,63 @@
 #include "byte_string.h"
 
 class TLV;
+class TLVArena;
 typedef std::tr1::shared_ptr<TLV> TLV_ref;
 typedef std::vector<TLV_ref> TLVList;
 
+/** Read-only range of bytes owned by someone else (a parsed buffer or a TLV) */
+class byte_span {
+public:
+	typedef const uint8_t *const_iterator;
+
+	byte_span() throw()
+	:first(NULL), last(NULL) {
+	}
+	byte_span(const uint8_t *first, const uint8_t *last) throw()
+	:first(first), last(last) {
+	}
+	explicit byte_span(const byte_string &data) throw()
+	:first(data.empty() ? NULL : &data[0]), last(first + data.size()) {
+	}
+
+	const_iterator begin() const throw() { return first; }
+	const_iterator end() const throw() { return last; }
+	size_t size() const throw() { return last - first; }
+	bool empty() const throw() { return first == last; }
+	const uint8_t &operator[](size_t index) const throw() { return first[index]; }
+private:
+	const uint8_t *first;
+	const uint8_t *last;
+};
+
+inline bool operator==(const byte_span &l, const byte_string::value_type &value) {
+	return l.size() == 1 && l[0] == value;
+}
+
+inline bool operator==(const byte_span &l, const byte_string &r) {
+	return l.size() == r.size() && std::equal(l.begin(), l.end(), r.begin());
+}
+
+inline bool operator==(const byte_span &l, const byte_string::value_type *r) {
+	size_t rSize = strlen((const char*)r);
+	return l.size() == rSize && std::equal(l.begin(), l.end(), r);
+}
+
+inline bool operator!=(const byte_span &l, const byte_string::value_type *r) {
+	return !(l == r);
+}
+
+inline byte_string &operator+=(byte_string &l, const byte_span &r) {
+	l.insert(l.end(), r.begin(), r.end());
+	return l;
+}
+
 /** Utility class to simplify TLV parsing and encoding
- *  Condition of proper behavior (assume sizeof(size_t) => ptr size):
- *  32-bit: Total data < 4GB
- *  64-bit: Total data < 4GB * 4GB
+ *
+ * Parsing does not copy any data: parsed TLVs reference the tag and value
+ * bytes of the parsed buffer and are allocated from an arena owned by the
+ * TLV returned by parse(). The buffer and that TLV must outlive every TLV
+ * and span obtained from them.
  */
 class TLV {
 	NOCOPY(TLV);
@@ -56,6 +110,7 @@ public:
 	TLV(const byte_string &tag, const byte_string &value) throw();
 	TLV(const byte_string &tag, const TLVList &tlv) throw();
 	TLV(uint8_t tag, const TLVList &tlv) throw();
+	~TLV() throw();
 
 	/* Parses a byte_string as a TLV value - ignores trailing bytes
 	 * Throws an error if the encoding is invalid
@@ -64,15 +119,16 @@ public:
 
 	/* Parses an entire sequence of bytes as a TLV value
 	 * - ignores trailing bytes, iter points to byte after TLV
-	 * Can accept forward iterators to bytes or pointers to bytes for the range
+	 * Accepts iterators over contiguous bytes or pointers to bytes for the range
 	 * Ex: byte_string::iterator, unsigned char *
 	 * Throws an error if the encoding is invalid
 	 */
 	template<typename ForwardIterator>
 	static TLV_ref parse(ForwardIterator &iter, const ForwardIterator &end) throw(std::runtime_error);
+	static TLV_ref parse(const uint8_t *&iter, const uint8_t *end) throw(std::runtime_error);
 
 	/* Obtains the tag of this TLV */
-	const byte_string &getTag() const throw() { return tag; }
+	const byte_span &getTag() const throw() { return tag; }
 
 	/* Encodes this TLV into a new byte_string */
 	byte_string encode() const throw();
@@ -81,33 +137,40 @@ public:
 	/* Decodes the value of this TLV as a sequence of TLVs */
 	const TLVList &getInnerValues() const throw(std::runtime_error);
 	/* Obtains the value of this TLV */
-	const byte_string &getValue() const throw();
+	byte_span getValue() const throw();
 
 	/* Calculates the length of this TLV */
 	size_t length() const throw();
 
 private:
-	byte_string tag;
-	/* cached/assigned value as a string */
-	mutable std::auto_ptr<byte_string> value;
+	friend class TLVArena;
+	/* Parsed TLV, referencing tag and value in the parsed buffer */
+	TLV(const byte_span &tag, const byte_span &value, TLVArena *arena) throw();
+
+	/* tag and value bytes of a TLV built by the caller */
+	byte_string tagBytes;
+	std::auto_ptr<byte_string> valueBytes;
+	byte_span tag;
+	byte_span value;
+	bool hasValue;
+	/* cached value encoded from innerValues */
+	mutable std::auto_ptr<byte_string> encodedValue;
 	/* cached/assigned value as a TLV sequence */
 	mutable std::auto_ptr<TLVList> innerValues;
+	/* arena of the parsed tree this TLV belongs to, created on first use by its root */
+	mutable TLVArena *arena;
+	mutable std::auto_ptr<TLVArena> ownedArena;
 
-	/* Parses an entire sequence of bytes as a sequence of TLV values, appending them to tlv
-	 * Can accept forward iterators to bytes or pointers to bytes for the range
-	 * Ex: byte_string::iterator, unsigned char *
-	 * Throws an error if the encoding is invalid
-	 */
-	template<typename ForwardIterator>
-	static void parseSequence(ForwardIterator &iter, const ForwardIterator &end, TLVList &tlv) throw(std::runtime_error);
+	/* Parses an entire sequence of bytes as a sequence of TLV values, appending them to tlv */
+	static void parseSequence(const uint8_t *&iter, const uint8_t *end, TLVList &tlv, TLVArena &arena) throw(std::runtime_error);
+
+	/* Parses one TLV, returning its tag and value spans */
+	static void parseOne(const uint8_t *&iter, const uint8_t *end, byte_span &tag, byte_span &value) throw(std::runtime_error);
 
 	/* Parses the ber-encoded length from a sequence of bytes
-	 * Can accept forward iterators to bytes or pointers to bytes for the range
-	 * Ex: byte_string::iterator, unsigned char *
 	 * Throws an error if the encoding is invalid
 	 */
-	template<typename ForwardIterator>
-	static size_t parseLength(ForwardIterator &iter, const ForwardIterator &end) throw(std::runtime_error);
+	static size_t parseLength(const uint8_t *&iter, const uint8_t *end) throw(std::runtime_error);
 
 	/* ber-encodes an integer and writes it's output to 'out' */
 	static void encodeLength(size_t value, byte_string &out) throw();
@@ -122,6 +185,30 @@ private:
 	size_t valueLength() const throw();
 };
 
+/** Block allocator for the TLVs of one parsed tree, freed all at once */
+class TLVArena {
+	NOCOPY(TLVArena);
+public:
+	TLVArena() throw();
+	~TLVArena() throw();
+
+	/* Creates a parsed TLV living as long as the arena
+	 * The returned reference still allocates its own shared_ptr count: the
+	 * tr1 shared_ptr has neither an allocator nor an aliasing constructor
+	 * that would let it share the count of the root TLV
+	 */
+	TLV_ref allocate(const byte_span &tag, const byte_span &value);
+private:
+	static const size_t BLOCK_SIZE = 16;
+	std::vector<void *> blocks;
+	size_t used;
+
+	/* Arena TLVs are released by the arena, not by their references */
+	struct NoDelete {
+		void operator() (TLV *) const throw() {}
+	};
+};
+
 class TagPredicate {
 public:
 	TagPredicate(uint8_t tag) throw()
@@ -131,7 +218,7 @@ public:
 	:tag(tag) {
 	}
 	bool operator() (const TLV_ref &tlv) throw() {
-		return this->tag == tlv->getTag();
+		return tlv->getTag() == this->tag;
 	}
 private:
 	byte_string tag;
@@ -59,7 +59,7 @@ Record &LinkedRecordAdornment::record()
 // SecCertificateAdornment
 //
 SecCertificateAdornment::SecCertificateAdornment(TokenContext *tokenContext,
-	const MetaAttribute &metaAttribute, Record &record)
+	const MetaAttribute &metaAttribute, Record &record) : mBatchFailed(false)
 {
 	// Get the data for record (the actual certificate).
 	const MetaAttribute &dma =
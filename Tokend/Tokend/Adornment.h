@@ -67,8 +67,13 @@ public:
 	SecCertificateRef certificate();
 	SecKeychainItemRef certificateItem();
 
+	// Set once reading several attributes of the item together failed
+	bool batchFailed() const { return mBatchFailed; }
+	void batchFailed(bool failed) { mBatchFailed = failed; }
+
 private:
 	SecCertificateRef mCertificate;
+	bool mBatchFailed;
 };
 
 } // end namespace Tokend
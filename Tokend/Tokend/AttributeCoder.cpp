@@ -69,22 +69,72 @@ void CertificateAttributeCoder::decode(TokenContext *tokenContext,
 
 	// Get the keychain item for the certificate from the record's adornment.
 	SecKeychainItemRef certificate = sca.certificateItem();
-	// Read the attribute with the requested attributeId from the item.
-	SecKeychainAttribute ska = { metaAttribute.attributeId() };
-	SecKeychainAttributeList skal = { 1, &ska };
+
+	// Decoding an attribute makes the certificate item parse the certificate,
+	// so read every attribute this coder provides for the record in one go.
+	// The other attributes are then already present on the record and never
+	// come back here.
+	std::vector<const MetaAttribute *> metaAttributes;
+	metaAttribute.metaRecord().attributesWithCoder(this, metaAttributes);
+	std::vector<const MetaAttribute *> pending;
+	for (std::vector<const MetaAttribute *>::const_iterator it =
+		metaAttributes.begin(); it != metaAttributes.end(); ++it)
+	{
+		if (*it == &metaAttribute
+			|| !record.hasAttributeAtIndex((*it)->attributeIndex()))
+			pending.push_back(*it);
+	}
+
+	if (pending.size() > 1 && !sca.batchFailed())
+	{
+		if (!copyAttributes(certificate, pending, record))
+			return;
+
+		// Some attribute is not available from this certificate, reading
+		// them together would fail again for every other attribute.
+		sca.batchFailed(true);
+	}
+
+	// Read the attribute with the requested attributeId on its own so only
+	// its own failure is reported.
+	pending.assign(1, &metaAttribute);
+	OSStatus status = copyAttributes(certificate, pending, record);
+	if (status)
+		MacOSError::throwMe(status);
+
+	// @@@ The code above only returns one email address.  Fix this.
+}
+
+OSStatus CertificateAttributeCoder::copyAttributes(
+	SecKeychainItemRef certificate,
+	const std::vector<const MetaAttribute *> &metaAttributes, Record &record)
+{
+	std::vector<SecKeychainAttribute> skas(metaAttributes.size());
+	for (size_t ix = 0; ix < metaAttributes.size(); ++ix)
+	{
+		skas[ix].tag = metaAttributes[ix]->attributeId();
+		skas[ix].length = 0;
+		skas[ix].data = NULL;
+	}
+
+	SecKeychainAttributeList skal =
+		{ static_cast<UInt32>(skas.size()), &skas[0] };
 	OSStatus status = SecKeychainItemCopyContent(certificate, NULL, &skal,
 		NULL, NULL);
 	if (status)
-		MacOSError::throwMe(status);
-	// Add the retrieved attribute as an attribute to the record.
-	record.attributeAtIndex(metaAttribute.attributeIndex(),
-		new Attribute(ska.data, ska.length));
-	// Free the retrieved attribute.
+		return status;
+
+	// Add the retrieved attributes as attributes to the record.
+	for (size_t ix = 0; ix < metaAttributes.size(); ++ix)
+		record.attributeAtIndex(metaAttributes[ix]->attributeIndex(),
+			new Attribute(skas[ix].data, skas[ix].length));
+
+	// Free the retrieved attributes.
 	status = SecKeychainItemFreeContent(&skal, NULL);
 	if (status)
 		MacOSError::throwMe(status);
 
-	// @@@ The code above only returns one email address.  Fix this.
+	return noErr;
 }
 
 
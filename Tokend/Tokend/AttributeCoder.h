@@ -31,6 +31,8 @@
 
 #include <security_utilities/utilities.h>
 #include <Security/cssmtype.h>
+#include <Security/SecBase.h>
+#include <vector>
 
 namespace Tokend
 {
@@ -65,6 +67,10 @@ public:
 	virtual void decode(TokenContext *tokenContext,
 		const MetaAttribute &metaAttribute, Record &record);
 private:
+	// Reads all of metaAttributes from certificate into record
+	OSStatus copyAttributes(SecKeychainItemRef certificate,
+		const std::vector<const MetaAttribute *> &metaAttributes,
+		Record &record);
 };
 
 //
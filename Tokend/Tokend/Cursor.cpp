@@ -56,8 +56,11 @@ Cursor::~Cursor()
 //
 LinearCursor::LinearCursor(const CSSM_QUERY *inQuery,
 	const Relation &inRelation) :
+	mRelation(inRelation),
 	mIterator(inRelation.begin()),
 	mEnd(inRelation.end()),
+	mPlanned(false),
+	mIndexed(false),
     mMetaRecord(inRelation.metaRecord())
 {
 	mConjunctive = inQuery->Conjunctive;
@@ -87,12 +90,51 @@ LinearCursor::~LinearCursor()
 	for_each_delete(mPredicates.begin(), mPredicates.end());
 }
 
+// Picks the records to evaluate. The index is only usable when every
+// predicate has to hold, all predicates are still evaluated on its records.
+void LinearCursor::plan(TokenContext *tokenContext)
+{
+	mPlanned = true;
+	if (mConjunctive != CSSM_DB_AND && mConjunctive != CSSM_DB_NONE)
+		return;
+
+	for (PredicateVector::const_iterator anIt = mPredicates.begin();
+		anIt != mPredicates.end(); ++anIt)
+	{
+		if ((*anIt)->dbOperator() != CSSM_DB_EQUAL)
+			continue;
+		if (mRelation.findEqual(tokenContext, (*anIt)->metaAttribute(),
+			(*anIt)->data(), mCandidates))
+		{
+			mIndexed = true;
+			mCandidate = mCandidates.begin();
+			return;
+		}
+	}
+}
+
 RecordHandle *LinearCursor::next(TokenContext *tokenContext)
 {
-	while (mIterator != mEnd)
+	if (!mPlanned)
+		plan(tokenContext);
+
+	for (;;)
 	{
-		RefPointer<Record> rec = *mIterator;
-		++mIterator;
+		RefPointer<Record> rec;
+		if (mIndexed)
+		{
+			if (mCandidate == mCandidates.end())
+				break;
+			rec = mRelation[*mCandidate];
+			++mCandidate;
+		}
+		else
+		{
+			if (mIterator == mEnd)
+				break;
+			rec = *mIterator;
+			++mIterator;
+		}
 
         PredicateVector::const_iterator anIt = mPredicates.begin();
         PredicateVector::const_iterator anEnd = mPredicates.end();
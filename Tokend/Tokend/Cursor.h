@@ -60,9 +60,19 @@ public:
     virtual RecordHandle *next(TokenContext *tokenContext);
 
 private:
+	void plan(TokenContext *tokenContext);
+
+	const Relation &mRelation;
 	Relation::const_iterator mIterator;
 	Relation::const_iterator mEnd;
 
+	// When an equality predicate can use an index of the relation only
+	// the records it yields are evaluated
+	bool mPlanned;
+	bool mIndexed;
+	Relation::Positions mCandidates;
+	Relation::Positions::const_iterator mCandidate;
+
     const MetaRecord &mMetaRecord;
 
     CSSM_DB_CONJUNCTIVE mConjunctive;
@@ -58,6 +58,7 @@ public:
 		uint32 attributeIndex, uint32 attributeId);
 
 	void attributeCoder(AttributeCoder *coder) { mCoder = coder; }
+	AttributeCoder *attributeCoder() const { return mCoder; }
 
 	Format attributeFormat() const { return mFormat; }
 	uint32 attributeIndex() const { return mAttributeIndex; }
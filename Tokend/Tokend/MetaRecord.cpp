@@ -206,6 +206,17 @@ void MetaRecord::attributeCoderForData(AttributeCoder *coder)
 	const_cast<MetaAttribute &>(metaAttributeForData()).attributeCoder(coder);
 }
 
+void MetaRecord::attributesWithCoder(const AttributeCoder *coder,
+	std::vector<const MetaAttribute *> &attributes) const
+{
+	for (ConstAttributeIterator it = mAttributeVector.begin();
+		it != mAttributeVector.end(); ++it)
+	{
+		if (*it && (*it)->attributeCoder() == coder)
+			attributes.push_back(*it);
+	}
+}
+
 void
 MetaRecord::get(TokenContext *tokenContext, Record &record,
 	TOKEND_RETURN_DATA &data) const
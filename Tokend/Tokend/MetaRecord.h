@@ -93,6 +93,9 @@ public:
 	void attributeCoder(uint32 name, AttributeCoder *coder);
 	void attributeCoder(const std::string &name, AttributeCoder *coder);
 	void attributeCoderForData(AttributeCoder *coder);
+	// Append every meta attribute decoded by coder to attributes
+	void attributesWithCoder(const AttributeCoder *coder,
+		std::vector<const MetaAttribute *> &attributes) const;
 
 	RelationId relationId() const { return mRelationId; }
 
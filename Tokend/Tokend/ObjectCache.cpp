@@ -0,0 +1,255 @@
+/*
+ *  Copyright (c) 2004,2007 Apple Inc. All Rights Reserved.
+ *
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ObjectCache.cpp
+ *  Tokend
+ */
+
+#include "ObjectCache.h"
+
+#include <CommonCrypto/CommonDigest.h>
+#include <CommonCrypto/CommonHMAC.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iomanip>
+#include <sstream>
+
+namespace Tokend
+{
+
+const char ObjectCache::kSecretName[] = "cachesecret";
+
+static bool readAll(int fd, void *data, size_t length)
+{
+	unsigned char *p = reinterpret_cast<unsigned char *>(data);
+	while (length)
+	{
+		ssize_t n = ::read(fd, p, length);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		length -= n;
+	}
+	return true;
+}
+
+static bool writeAll(int fd, const void *data, size_t length)
+{
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+	while (length)
+	{
+		ssize_t n = ::write(fd, p, length);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		length -= n;
+	}
+	return true;
+}
+
+ObjectCache::ObjectCache()
+{
+}
+
+ObjectCache::~ObjectCache()
+{
+	if (!mSecret.empty())
+		memset(&mSecret[0], 0, mSecret.size());
+}
+
+void ObjectCache::open(const std::string &cacheDirectory,
+	const std::string &workDirectory)
+{
+	mDirectory = cacheDirectory;
+	mSecretPath = workDirectory + "/" + kSecretName;
+}
+
+void ObjectCache::fingerprint(const void *data, size_t length)
+{
+	unsigned char md[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1(data, length, md);
+	mFingerprint.assign(reinterpret_cast<const char *>(md), sizeof(md));
+}
+
+ObjectCache::Result ObjectCache::get(uint32_t relationId,
+	const std::string &name, unsigned char *&data, size_t &length) const
+{
+	data = NULL;
+	length = 0;
+	if (!loadSecret())
+		return kMissing;
+
+	std::string file(path(relationId, name));
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return kMissing;
+
+	unsigned char stored[CC_SHA1_DIGEST_LENGTH];
+	unsigned char md[CC_SHA1_DIGEST_LENGTH];
+	struct stat st;
+	bool valid = !::fstat(fd, &st) && st.st_size >= (off_t)sizeof(stored)
+		&& readAll(fd, stored, sizeof(stored));
+	if (valid)
+	{
+		length = st.st_size - sizeof(stored);
+		data = reinterpret_cast<unsigned char *>(malloc(length ? length : 1));
+		valid = data && readAll(fd, data, length);
+	}
+	::close(fd);
+
+	if (valid)
+	{
+		mac(relationId, name, data, length, md);
+		valid = !memcmp(md, stored, sizeof(md));
+	}
+	if (!valid)
+	{
+		// Truncated, altered, or sealed with another secret: read the card
+		free(data);
+		data = NULL;
+		length = 0;
+		::unlink(file.c_str());
+		return kDiscarded;
+	}
+
+	return kFound;
+}
+
+bool ObjectCache::put(uint32_t relationId, const std::string &name,
+	const void *data, size_t length) const
+{
+	// Without a secret the objects are only read from the card
+	if (!loadSecret())
+		return true;
+
+	std::string file(path(relationId, name));
+	unsigned char md[CC_SHA1_DIGEST_LENGTH];
+	mac(relationId, name, data, length, md);
+
+	// Written aside and renamed over the cache file, so that a reader never
+	// sees it half written
+	std::string temp(file + ".XXXXXX");
+	int fd = ::mkstemp(&temp[0]);
+	if (fd < 0)
+		return false;
+	bool written = writeAll(fd, md, sizeof(md)) && writeAll(fd, data, length);
+	if (::close(fd))
+		written = false;
+	if (written && ::rename(temp.c_str(), file.c_str()))
+		written = false;
+	if (!written)
+		::unlink(temp.c_str());
+	return written;
+}
+
+std::string ObjectCache::path(uint32_t relationId,
+	const std::string &name) const
+{
+    // The name is typically the friendlyname of the on-card objects
+    // like certificates.  To avoid attacks of calculated nasty filesystem
+    // paths, process the names with SHA1.
+    unsigned char md[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1_CTX ctx;
+    CC_SHA1_Init(&ctx);
+    CC_SHA1_Update(&ctx, &relationId, sizeof(relationId));
+    CC_SHA1_Update(&ctx, name.c_str(), name.length());
+    // Objects cached for other card content are not found
+    CC_SHA1_Update(&ctx, mFingerprint.data(), mFingerprint.length());
+    CC_SHA1_Final(md, &ctx);
+
+    std::ostringstream out;
+    out << mDirectory << "/" << std::hex << std::setfill('0');
+    for (std::size_t i=0; i < sizeof(md); i++)
+        out << std::setw(2) << unsigned(md[i]);
+
+    return out.str();
+}
+
+// The secret is created on first use. Without one nothing is cached.
+bool ObjectCache::loadSecret() const
+{
+	if (!mSecret.empty())
+		return true;
+	if (mSecretPath.empty())
+		return false;
+
+	unsigned char secret[kSecretSize];
+	bool loaded = false;
+	int fd = ::open(mSecretPath.c_str(), O_WRONLY|O_CREAT|O_EXCL, 0600);
+	if (fd >= 0)
+	{
+		int random = ::open("/dev/random", O_RDONLY);
+		loaded = random >= 0 && readAll(random, secret, sizeof(secret))
+			&& writeAll(fd, secret, sizeof(secret));
+		if (random >= 0)
+			::close(random);
+		if (::close(fd))
+			loaded = false;
+		if (!loaded)
+			::unlink(mSecretPath.c_str());
+	}
+	else if (errno == EEXIST)
+	{
+		fd = ::open(mSecretPath.c_str(), O_RDONLY);
+		struct stat st;
+		// A secret others can read or replace does not authenticate anything
+		loaded = fd >= 0 && !::fstat(fd, &st) && st.st_uid == ::geteuid()
+			&& !(st.st_mode & (S_IRWXG | S_IRWXO))
+			&& st.st_size == (off_t)sizeof(secret)
+			&& readAll(fd, secret, sizeof(secret));
+		if (fd >= 0)
+			::close(fd);
+	}
+
+	if (loaded)
+		mSecret.assign(reinterpret_cast<const char *>(secret), sizeof(secret));
+	memset(secret, 0, sizeof(secret));
+	return loaded;
+}
+
+void ObjectCache::mac(uint32_t relationId, const std::string &name,
+	const void *data, size_t length, unsigned char *md) const
+{
+	CCHmacContext ctx;
+	CCHmacInit(&ctx, kCCHmacAlgSHA1, mSecret.data(), mSecret.length());
+	uint32_t nameLength = name.length();
+	CCHmacUpdate(&ctx, &relationId, sizeof(relationId));
+	CCHmacUpdate(&ctx, &nameLength, sizeof(nameLength));
+	CCHmacUpdate(&ctx, name.c_str(), name.length());
+	CCHmacUpdate(&ctx, mFingerprint.data(), mFingerprint.length());
+	CCHmacUpdate(&ctx, data, length);
+	CCHmacFinal(&ctx, md);
+	memset(&ctx, 0, sizeof(ctx));
+}
+
+} // end namespace Tokend
@@ -0,0 +1,83 @@
+/*
+ *  Copyright (c) 2004,2007 Apple Inc. All Rights Reserved.
+ *
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  ObjectCache.h
+ *  Tokend
+ */
+
+#ifndef _TOKEND_OBJECTCACHE_H_
+#define _TOKEND_OBJECTCACHE_H_
+
+#include <security_utilities/utilities.h>
+#include <stdint.h>
+#include <string>
+
+namespace Tokend
+{
+
+//
+// On-disk cache of objects read from a card. Each file starts with an
+// HMAC-SHA1 of its key and content under a random secret kept in the
+// work directory of the token, outside the cache directory.
+//
+class ObjectCache
+{
+	NOCOPY(ObjectCache)
+public:
+	enum Result { kMissing, kFound, kDiscarded };
+
+	ObjectCache();
+	~ObjectCache();
+
+	void open(const std::string &cacheDirectory, const std::string &workDirectory);
+	// Keys the cache on data describing the card content (e.g. the CHUID)
+	void fingerprint(const void *data, size_t length);
+
+	// The object returned in data must be released with free().
+	// A file that does not authenticate is removed and kDiscarded returned.
+	Result get(uint32_t relationId, const std::string &name,
+		unsigned char *&data, size_t &length) const;
+	// Returns false if the object could not be written
+	bool put(uint32_t relationId, const std::string &name,
+		const void *data, size_t length) const;
+
+	std::string path(uint32_t relationId, const std::string &name) const;
+
+	static const size_t kSecretSize = 32;
+	static const char kSecretName[];
+
+private:
+	bool loadSecret() const;
+	void mac(uint32_t relationId, const std::string &name,
+		const void *data, size_t length, unsigned char *md) const;
+
+	std::string mDirectory;
+	std::string mSecretPath;
+	std::string mFingerprint;
+	mutable std::string mSecret;
+};
+
+} // end namespace Tokend
+
+#endif /* !_TOKEND_OBJECTCACHE_H_ */
@@ -27,6 +27,9 @@
  */
 
 #include "Relation.h"
+#include "MetaAttribute.h"
+#include "DbValue.h"
+#include <security_utilities/debugging.h>
 
 namespace Tokend
 {
@@ -44,6 +47,7 @@ Relation::~Relation()
 void Relation::insertRecord(const RefPointer<Record> &record)
 {
 	push_back(record);
+	mIndexes.clear();
 }
 
 bool Relation::matchesId(RelationId inRelationId) const
@@ -61,6 +65,99 @@ bool Relation::matchesId(RelationId inRelationId) const
 	return inRelationId == anId; // Only if exact match.
 }
 
+bool Relation::findEqual(TokenContext *tokenContext,
+	const MetaAttribute &metaAttribute, const CSSM_DATA &value,
+	Positions &positions) const
+{
+	std::string key;
+	if (!indexKey(metaAttribute.attributeFormat(), value, key))
+		return false;
+
+	uint32 attributeIndex = metaAttribute.attributeIndex();
+	AttributeIndexes::const_iterator it = mIndexes.find(attributeIndex);
+	if (it == mIndexes.end())
+	{
+		// Getting the attributes may involve their coders, if one of them
+		// fails leave it to the scan to report it
+		AttributeIndex index;
+		try
+		{
+			for (size_type position = 0; position < size(); ++position)
+			{
+				const Attribute &attribute =
+					metaAttribute.attribute(tokenContext, *at(position));
+				for (uint32 ix = 0; ix < attribute.size(); ++ix)
+				{
+					std::string valueKey;
+					if (!indexKey(metaAttribute.attributeFormat(),
+						attribute[ix], valueKey))
+						return false;
+					Positions &valuePositions = index[valueKey];
+					if (valuePositions.empty()
+						|| valuePositions.back() != position)
+						valuePositions.push_back(position);
+				}
+			}
+		}
+		catch (...)
+		{
+			return false;
+		}
+
+		secdebug("index", "indexed rid: 0x%08X aix: %u: %lu values",
+			mMetaRecord->relationId(), attributeIndex, index.size());
+		it = mIndexes.insert(AttributeIndexes::value_type(attributeIndex,
+			index)).first;
+	}
+
+	AttributeIndex::const_iterator values = it->second.find(key);
+	if (values == it->second.end())
+		positions.clear();
+	else
+		positions = values->second;
+
+	return true;
+}
+
+// Builds a key that is the same for two values iff CSSM_DB_EQUAL holds
+// between them (see DbValue.cpp).
+bool Relation::indexKey(CSSM_DB_ATTRIBUTE_FORMAT format,
+	const CSSM_DATA &value, std::string &key)
+{
+	const char *data = reinterpret_cast<const char *>(value.Data);
+	switch (format)
+	{
+	case kAF_BLOB:
+		key.assign(data, value.Length);
+		return true;
+	case kAF_STRING:
+	{
+		// Strings of the same length compare with strncmp (memcmp as long
+		// as StringValue slices its comparator), values equal under either
+		// have the same key
+		uint32 length = value.Length;
+		key.assign(reinterpret_cast<const char *>(&length), sizeof(length));
+		key.append(data, strnlen(data, length));
+		return true;
+	}
+	case kAF_UINT32:
+	{
+		// 1, 2 and 4 byte encodings of a number are equal
+		UInt32Value number(value);
+		key.assign(reinterpret_cast<const char *>(number.bytes()), number.size());
+		return true;
+	}
+	case kAF_SINT32:
+	{
+		SInt32Value number(value);
+		key.assign(reinterpret_cast<const char *>(number.bytes()), number.size());
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
 
 } // end namespace Tokend
 
@@ -31,12 +31,16 @@
 
 #include "Record.h"
 #include <vector>
+#include <map>
+#include <string>
 
 namespace Tokend
 {	
 
+class MetaAttribute;
 class MetaRecord;
 class Record;
+class TokenContext;
 
 class Relation : public std::vector< RefPointer<Record> >
 {
@@ -51,8 +55,26 @@ public:
 	void insertRecord(const RefPointer<Record> &record);
 	bool matchesId(RelationId inRelationId) const;
 
+	// Positions of the records having an attribute value equal to value.
+	// Returns false if the attribute can't be indexed, then the relation
+	// must be scanned.
+	typedef std::vector<size_type> Positions;
+	bool findEqual(TokenContext *tokenContext,
+		const MetaAttribute &metaAttribute, const CSSM_DATA &value,
+		Positions &positions) const;
+
 protected:
 	MetaRecord *mMetaRecord;
+
+private:
+	// Per attribute index from value to record positions, built on the
+	// first equality query on that attribute
+	typedef std::map<std::string, Positions> AttributeIndex;
+	typedef std::map<uint32, AttributeIndex> AttributeIndexes;
+	mutable AttributeIndexes mIndexes;
+
+	static bool indexKey(CSSM_DB_ATTRIBUTE_FORMAT format,
+		const CSSM_DATA &value, std::string &key);
 };
 
 } // end namespace Tokend
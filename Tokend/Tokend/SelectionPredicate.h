@@ -50,6 +50,10 @@ public:
 	
 	bool evaluate(TokenContext *tokenContext, Record& record) const;
 
+	const MetaAttribute &metaAttribute() const { return mMetaAttribute; }
+	CSSM_DB_OPERATOR dbOperator() const { return mDbOperator; }
+	const CssmData &data() const { return mData; }
+
 private:
     const MetaAttribute &mMetaAttribute;
     CSSM_DB_OPERATOR mDbOperator;
@@ -35,7 +35,6 @@
 #include <memory>
 #include <sstream>
 #include <iomanip>
-#include <CommonCrypto/CommonDigest.h>
 #include <security_cdsa_utilities/cssmaclpod.h>
 #include <security_utilities/unix++.h>
 #include <security_utilities/logging.h>
@@ -760,64 +759,41 @@ void Token::establish(const CSSM_GUID *guid, uint32 subserviceId,
 	secdebug("establish", "cacheDirectory %s", cacheDirectory);
 	mGuid = *guid;
 	mSubserviceId = subserviceId;
-	mCacheDirectory = cacheDirectory;
+	mObjectCache.open(cacheDirectory, workDirectory);
 }
 
 
+void Token::cacheFingerprint(const CssmData &cardContent)
+{
+	mObjectCache.fingerprint(cardContent.Data, cardContent.Length);
+}
+
 bool Token::cachedObject(CSSM_DB_RECORDTYPE relationId,
 	const std::string &name, CssmData &object) const
 {
-	try
-	{
-		UnixPlusPlus::AutoFileDesc fd(cachedObjectPath(relationId, name));
-		object.Length = fd.fileSize();
-		object.Data = reinterpret_cast<uint8 *>(malloc(object.Length));
-		object.Length = fd.readAll(object.Data, object.Length);
-	}
-	catch (const UnixError &error)
+	unsigned char *data;
+	size_t length;
+	switch (mObjectCache.get(relationId, name, data, length))
 	{
+	case ObjectCache::kFound:
+		object.Data = data;
+		object.Length = length;
+		return true;
+	case ObjectCache::kDiscarded:
+		Syslog::error("discarding corrupted cache file: %s\n",
+			mObjectCache.path(relationId, name).c_str());
 		return false;
- 	}
-
-	return true;
+	default:
+		return false;
+	}
 }
 
 void Token::cacheObject(CSSM_DB_RECORDTYPE relationId, const std::string &name,
 	const CssmData &object) const
 {
-	std::string path(cachedObjectPath(relationId, name));
-	try
-	{
-		UnixPlusPlus::AutoFileDesc fd(path, O_WRONLY|O_CREAT|O_TRUNC);
-		fd.writeAll(object.Data, object.Length);
-	}
-	catch (const UnixError &e)
-	{
-		Syslog::error("error writing cache file: %s: %s\n", path.c_str(),
-			strerror(e.unixError()));
-		::unlink(path.c_str());
-	}
-}
-
-std::string Token::cachedObjectPath(CSSM_DB_RECORDTYPE relationId,
-	const std::string &name) const
-{
-    // The name is typically the friendlyname of the on-card objects
-    // like certificates.  To avoid attacks of calculated nasty filesystem
-    // paths, process the names with SHA1.
-    unsigned char md[CC_SHA1_DIGEST_LENGTH];
-    CC_SHA1_CTX ctx;
-    CC_SHA1_Init(&ctx);
-    CC_SHA1_Update(&ctx, &relationId, sizeof(relationId));
-    CC_SHA1_Update(&ctx, name.c_str(), name.length());
-    CC_SHA1_Final(md, &ctx);
-
-    std::ostringstream out;
-    out << mCacheDirectory << "/" << std::hex << std::setfill('0');
-    for (std::size_t i=0; i < sizeof(md); i++)
-        out << std::setw(2) << unsigned(md[i]);
-
-    return out.str();
+	if (!mObjectCache.put(relationId, name, object.Data, object.Length))
+		Syslog::error("error writing cache file: %s: %s\n",
+			mObjectCache.path(relationId, name).c_str(), strerror(errno));
 }
 
 Cursor *Token::createCursor(const CSSM_QUERY *inQuery)
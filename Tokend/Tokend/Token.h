@@ -42,6 +42,7 @@
 #include <string>
 
 #include "TokenContext.h"
+#include "ObjectCache.h"
 
 namespace Tokend
 {
@@ -64,6 +65,9 @@ public:
 		CssmData &data) const;
 	void cacheObject(CSSM_DB_RECORDTYPE relationId, const std::string &name,
 		const CssmData &object) const;
+	// Keys the object cache on data identifying the card content (e.g. the
+	// CHUID), so a reissued card does not see the objects of the previous one
+	void cacheFingerprint(const CssmData &cardContent);
 
 	virtual const SecTokendCallbacks *callbacks();
 	virtual SecTokendSupport *support();
@@ -107,9 +111,6 @@ public:
 	TokenContext *tokenContext() { return mTokenContext; }
 
 protected:
-	std::string cachedObjectPath(CSSM_DB_RECORDTYPE relationId,
-		const std::string &name) const;
-
 	static CSSM_RETURN _initial();
     static CSSM_RETURN _probe(SecTokendProbeFlags flags, uint32 *score,
 		char tokenUid[TOKEND_MAX_UID]);
@@ -186,7 +187,7 @@ protected:
 		const CSSM_ACCESS_CREDENTIALS *cred, 
 		const CSSM_ACL_ENTRY_PROTOTYPE *access, CSSM_DATA *parameters,
 		CSSM_KEYUSE usage, CSSM_KEYATTR_FLAGS attributes,
-		CSSM_HANDLE *hKey, CSSM_KEY *hKey);
+		CSSM_HANDLE *hKey, CSSM_KEY *key);
 
 	static CSSM_RETURN _getObjectOwner(CSSM_HANDLE hKey,
 		CSSM_ACL_OWNER_PROTOTYPE *owner);
@@ -244,7 +245,7 @@ protected:
 
 	Guid mGuid;
 	uint32 mSubserviceId;
-	std::string mCacheDirectory;
+	ObjectCache mObjectCache;
 };
 
 
@@ -0,0 +1,247 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  attributecodertest.cpp
+ *
+ *  Checks of the certificate attribute coder (Tokend/AttributeCoder.cpp)
+ *  over a mock of the keychain item functions: a record's attributes are
+ *  read from its certificate in one call, and when some attribute is not
+ *  available that failed call is not repeated for the other attributes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <string>
+
+#include "Attribute.h"
+#include "AttributeCoder.h"
+#include "MetaAttribute.h"
+#include "MetaRecord.h"
+#include "Record.h"
+#include <Security/SecCertificate.h>
+#include <Security/SecKeychainItem.h>
+
+using namespace Tokend;
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+enum { errSecNoSuchAttr = -25303 };
+
+/* Attribute ids of the certificate relation */
+enum { kSubject = 1, kIssuer, kSerialNumber, kEmail };
+
+/*
+ * The mock certificate item: every attribute's value is the certificate
+ * data followed by the attribute id, a certificate lacks the attributes
+ * whose ids it lists.
+ */
+struct OpaqueSecCertificateRef
+{
+	std::string data;
+	std::set<uint32> missing;
+};
+
+static unsigned int sCertificates = 0;
+static unsigned int sCopyContent = 0;
+
+OSStatus SecCertificateCreateFromData(const CSSM_DATA *data,
+	CSSM_CERT_TYPE type, CSSM_CERT_ENCODING encoding,
+	SecCertificateRef *certificate)
+{
+	CHECK(type == CSSM_CERT_X_509v3 && encoding == CSSM_CERT_ENCODING_BER);
+	sCertificates++;
+	*certificate = new OpaqueSecCertificateRef;
+	(*certificate)->data.assign(reinterpret_cast<const char *>(data->Data),
+		data->Length);
+	if ((*certificate)->data.find("without-email") != std::string::npos)
+		(*certificate)->missing.insert(kEmail);
+	return noErr;
+}
+
+void CFRelease(const void *object)
+{
+	delete static_cast<const OpaqueSecCertificateRef *>(object);
+}
+
+static std::string valueOf(const std::string &data, uint32 tag)
+{
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "/%u", tag);
+	return data + suffix;
+}
+
+OSStatus SecKeychainItemCopyContent(SecKeychainItemRef item,
+	SecItemClass *itemClass, SecKeychainAttributeList *attrList,
+	UInt32 *length, void **outData)
+{
+	sCopyContent++;
+	const OpaqueSecCertificateRef *certificate =
+		reinterpret_cast<const OpaqueSecCertificateRef *>(item);
+	for (UInt32 ix = 0; ix < attrList->count; ix++)
+		if (certificate->missing.count(attrList->attr[ix].tag))
+			return errSecNoSuchAttr;
+
+	for (UInt32 ix = 0; ix < attrList->count; ix++)
+	{
+		std::string value = valueOf(certificate->data, attrList->attr[ix].tag);
+		attrList->attr[ix].length = value.size();
+		attrList->attr[ix].data = malloc(value.size());
+		memcpy(attrList->attr[ix].data, value.data(), value.size());
+	}
+	return noErr;
+}
+
+OSStatus SecKeychainItemFreeContent(SecKeychainAttributeList *attrList,
+	void *data)
+{
+	for (UInt32 ix = 0; ix < attrList->count; ix++)
+		free(attrList->attr[ix].data);
+	return noErr;
+}
+
+class CertificateRecord : public Record
+{
+public:
+	CertificateRecord(const std::string &certificate)
+	{
+		attributeAtIndex(0, new Attribute(certificate));
+	}
+};
+
+class CertificateRelation
+{
+public:
+	CertificateRelation() : mMetaRecord(CSSM_DL_DB_RECORD_CERT)
+	{
+		const std::string subject("Subject"), issuer("Issuer"),
+			serialNumber("SerialNumber"), email("Email");
+		mMetaRecord.createAttribute(&subject, NULL, kSubject, kAF_BLOB);
+		mMetaRecord.createAttribute(&issuer, NULL, kIssuer, kAF_BLOB);
+		mMetaRecord.createAttribute(&serialNumber, NULL, kSerialNumber, kAF_BLOB);
+		mMetaRecord.createAttribute(&email, NULL, kEmail, kAF_STRING);
+		for (uint32 id = kSubject; id <= kEmail; id++)
+			mMetaRecord.attributeCoder(id, &mCoder);
+	}
+
+	std::string attribute(Record &record, uint32 id)
+	{
+		const Attribute &attribute =
+			mMetaRecord.metaAttribute(id).attribute(NULL, record);
+		if (attribute.size() != 1)
+			return std::string();
+		return std::string(reinterpret_cast<const char *>(attribute[0].Data),
+			attribute[0].Length);
+	}
+
+	/* Reads an attribute and returns the error it fails with */
+	OSStatus error(Record &record, uint32 id)
+	{
+		try
+		{
+			attribute(record, id);
+		}
+		catch (const MacOSError &error)
+		{
+			return error.error;
+		}
+		return noErr;
+	}
+
+private:
+	MetaRecord mMetaRecord;
+	CertificateAttributeCoder mCoder;
+};
+
+static void testOneRead()
+{
+	CertificateRelation relation;
+	RefPointer<Record> record(new CertificateRecord("cert-1"));
+	sCertificates = sCopyContent = 0;
+
+	/* The first attribute read brings the others with it */
+	CHECK(relation.attribute(*record, kIssuer) == valueOf("cert-1", kIssuer));
+	CHECK(sCertificates == 1);
+	CHECK(sCopyContent == 1);
+	CHECK(record->hasAttributeAtIndex(kSubject));
+	CHECK(record->hasAttributeAtIndex(kEmail));
+
+	CHECK(relation.attribute(*record, kSubject) == valueOf("cert-1", kSubject));
+	CHECK(relation.attribute(*record, kSerialNumber)
+		== valueOf("cert-1", kSerialNumber));
+	CHECK(relation.attribute(*record, kEmail) == valueOf("cert-1", kEmail));
+	CHECK(sCertificates == 1);
+	CHECK(sCopyContent == 1);
+}
+
+static void testMissingAttribute()
+{
+	CertificateRelation relation;
+	RefPointer<Record> record(new CertificateRecord("cert-without-email"));
+	sCertificates = sCopyContent = 0;
+
+	/* Reading all attributes together fails, the subject is read alone */
+	CHECK(relation.attribute(*record, kSubject)
+		== valueOf("cert-without-email", kSubject));
+	CHECK(sCopyContent == 2);
+	CHECK(!record->hasAttributeAtIndex(kIssuer));
+
+	/* The failed batch is not tried again for the other attributes */
+	CHECK(relation.attribute(*record, kIssuer)
+		== valueOf("cert-without-email", kIssuer));
+	CHECK(sCopyContent == 3);
+	CHECK(relation.attribute(*record, kSerialNumber)
+		== valueOf("cert-without-email", kSerialNumber));
+	CHECK(sCopyContent == 4);
+
+	/* The missing attribute reports its own error, every time */
+	CHECK(relation.error(*record, kEmail) == errSecNoSuchAttr);
+	CHECK(sCopyContent == 5);
+	CHECK(relation.error(*record, kEmail) == errSecNoSuchAttr);
+	CHECK(sCopyContent == 6);
+	CHECK(sCertificates == 1);
+
+	/* The failure belongs to that record only */
+	RefPointer<Record> other(new CertificateRecord("cert-2"));
+	CHECK(relation.attribute(*other, kEmail) == valueOf("cert-2", kEmail));
+	CHECK(sCopyContent == 7);
+	CHECK(relation.attribute(*other, kIssuer) == valueOf("cert-2", kIssuer));
+	CHECK(sCopyContent == 7);
+	CHECK(sCertificates == 2);
+}
+
+int main()
+{
+	testOneRead();
+	testMissingAttribute();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("attribute coder checks passed\n");
+	return 0;
+}
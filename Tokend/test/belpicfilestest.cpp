@@ -0,0 +1,397 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  belpicfilestest.cpp
+ *
+ *  Checks of the BELPIC file selection and reading (BELPIC/BELPICFiles.h)
+ *  against a simulated card: the EF sizes it learns, the number of APDUs it
+ *  needs with and without FCI and extended length support, and the end of
+ *  file answers it has to cope with.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+#include "BELPICFiles.h"
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+static const uint8_t kDF_BELPIC[] = { 0xDF, 0x00 };
+static const uint8_t kDF_ID[] = { 0xDF, 0x01 };
+static const uint8_t kEF_Cert[] = { 0x50, 0x38 };
+static const uint8_t kEF_Photo[] = { 0x40, 0x35 };
+
+static uint16_t fileId(const uint8_t *id)
+{
+	return (id[0] << 8) | id[1];
+}
+
+/*
+	A card with a two level file system.  It answers the selects and Read
+	Binary commands BELPICFiles sends and counts them.
+*/
+class VirtualBELPIC
+{
+public:
+	VirtualBELPIC() : fci(true), extendedCard(false), extendedReader(false),
+		endOfFileWarning(false), inTransaction(true), selects(0), reads(0),
+		mDF(0), mEF(0), mSelected(NULL) {}
+
+	void addFile(const uint8_t *df, const uint8_t *ef, size_t size)
+	{
+		std::vector<uint8_t> &data = mFiles[key(fileId(df), fileId(ef))];
+		data.resize(size);
+		for (size_t ix = 0; ix < size; ++ix)
+			data[ix] = (uint8_t)(ix * 7 + ef[1] + df[1]);
+	}
+
+	const std::vector<uint8_t> &file(const uint8_t *df, const uint8_t *ef)
+		{ return mFiles[key(fileId(df), fileId(ef))]; }
+
+	void resetCounts() { selects = reads = 0; }
+
+	// BELPICToken's interface
+	bool isInTransaction() const { return inTransaction; }
+	uint32_t exchangeAPDU(const uint8_t *apdu, size_t apduLength,
+		uint8_t *result, size_t &resultLength);
+	uint16_t transmitAPDU(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2,
+		size_t dataSize, const uint8_t *data, size_t outputLength,
+		std::vector<uint8_t> *output);
+
+	bool fci;				// returns an FCI when P2 is 00
+	bool extendedCard;		// takes an extended Le
+	bool extendedReader;	// carries extended length APDUs
+	bool endOfFileWarning;	// answers 6282 instead of 6Cxx or 6B00
+	bool inTransaction;
+	unsigned int selects;
+	unsigned int reads;
+
+private:
+	static uint32_t key(uint16_t df, uint16_t ef) { return (df << 16) | ef; }
+
+	static uint32_t status(uint8_t *result, size_t &resultLength, size_t length,
+		uint16_t sw)
+	{
+		result[length] = sw >> 8;
+		result[length + 1] = sw & 0xFF;
+		resultLength = length + 2;
+		return sw;
+	}
+
+	typedef std::map<uint32_t, std::vector<uint8_t> > FileMap;
+	FileMap mFiles;
+	uint16_t mDF;
+	uint16_t mEF;
+	const std::vector<uint8_t> *mSelected;
+};
+
+uint32_t VirtualBELPIC::exchangeAPDU(const uint8_t *apdu, size_t apduLength,
+	uint8_t *result, size_t &resultLength)
+{
+	selects++;
+	CHECK(apduLength >= 5 && apdu[0] == 0x00 && apdu[1] == 0xA4);
+	if (apduLength < 5)
+		return status(result, resultLength, 0, SCARD_LENGTH_INCORRECT);
+
+	// Le is there only when the FCI is asked for
+	uint8_t p1 = apdu[2], p2 = apdu[3], lc = apdu[4];
+	CHECK(apduLength == 5U + lc + (p2 == 0x00 ? 1 : 0));
+	if (p2 != 0x00 && p2 != 0x0C)
+		return status(result, resultLength, 0, SCARD_INCORRECT_P1_P2);
+	if (p2 == 0x00 && !fci)
+		return status(result, resultLength, 0, SCARD_INCORRECT_P1_P2);
+
+	uint16_t df = mDF, ef;
+	if (p1 == 0x08 && lc == 4)
+	{
+		df = (apdu[5] << 8) | apdu[6];
+		ef = (apdu[7] << 8) | apdu[8];
+	}
+	else if (p1 == 0x02 && lc == 2 && mSelected)
+		ef = (apdu[5] << 8) | apdu[6];
+	else
+		return status(result, resultLength, 0, SCARD_INCORRECT_P1_P2);
+
+	FileMap::const_iterator it = mFiles.find(key(df, ef));
+	if (it == mFiles.end())
+		return status(result, resultLength, 0, SCARD_FILE_NOT_FOUND);
+
+	mDF = df;
+	mEF = ef;
+	mSelected = &it->second;
+	if (p2 == 0x0C)
+		return status(result, resultLength, 0, SCARD_SUCCESS);
+
+	size_t size = mSelected->size();
+	const uint8_t fciData[] =
+		{ 0x62, 0x07, 0x82, 0x01, 0x01, 0x80, 0x02, (uint8_t)(size >> 8), (uint8_t)size };
+	memcpy(result, fciData, sizeof(fciData));
+	return status(result, resultLength, sizeof(fciData), SCARD_SUCCESS);
+}
+
+uint16_t VirtualBELPIC::transmitAPDU(uint8_t cla, uint8_t ins, uint8_t p1,
+	uint8_t p2, size_t dataSize, const uint8_t *data, size_t outputLength,
+	std::vector<uint8_t> *output)
+{
+	CHECK(cla == 0x00 && ins == 0xB0 && !data && output && outputLength);
+	if (outputLength >= 0x100 && !extendedReader)
+		PCSC::Error::throwMe(SCARD_E_PROTO_MISMATCH);
+
+	reads++;
+	if (!mSelected)
+		return SCARD_NO_CURRENT_EF;
+	if (outputLength >= 0x100 && !extendedCard)
+		return SCARD_LENGTH_INCORRECT;
+
+	size_t offset = (p1 << 8) | p2;
+	size_t size = mSelected->size();
+	if (offset > size || (offset == size && !endOfFileWarning))
+		return SCARD_WRONG_PARAMETER_P1_P2;
+
+	size_t length = outputLength;
+	uint16_t sw = SCARD_SUCCESS;
+	if (length > size - offset)
+	{
+		length = size - offset;
+		if (!endOfFileWarning && length < 0x100)
+			return SCARD_LE_IN_SW2 | length;
+		sw = SCARD_END_OF_FILE_REACHED;
+	}
+
+	output->insert(output->end(), mSelected->begin() + offset,
+		mSelected->begin() + offset + length);
+	return sw;
+}
+
+/* Selects an EF and reads it all, checking what came back */
+static size_t readFile(VirtualBELPIC &card, BELPICFiles<VirtualBELPIC> &files,
+	const uint8_t *df, const uint8_t *ef)
+{
+	uint8_t buffer[BELPIC_MAX_DATA_SIZE];
+	size_t length = sizeof(buffer);
+	files.select(df, ef);
+	files.readBinary(buffer, length);
+
+	const std::vector<uint8_t> &expected = card.file(df, ef);
+	CHECK(length == expected.size());
+	CHECK(length == expected.size() && !memcmp(buffer, &expected[0], length));
+	return length;
+}
+
+static VirtualBELPIC *makeCard()
+{
+	VirtualBELPIC *card = new VirtualBELPIC();
+	// Two EFs with the same identifier in different DFs, the smaller first
+	card->addFile(kDF_BELPIC, kEF_Cert, 300);
+	card->addFile(kDF_ID, kEF_Cert, 900);
+	card->addFile(kDF_ID, kEF_Photo, 3000);
+	return card;
+}
+
+static void readAll(VirtualBELPIC &card, BELPICFiles<VirtualBELPIC> &files)
+{
+	CHECK(readFile(card, files, kDF_BELPIC, kEF_Cert) == 300);
+	CHECK(readFile(card, files, kDF_ID, kEF_Cert) == 900);
+	CHECK(readFile(card, files, kDF_ID, kEF_Photo) == 3000);
+}
+
+static void testFileSizes()
+{
+	static const uint8_t fci[] = { 0x62, 0x04, 0x80, 0x02, 0x03, 0xE8 };
+	static const uint8_t fciLater[] = { 0x6F, 0x07, 0x82, 0x01, 0x01, 0x80, 0x02, 0x01, 0x2C };
+	static const uint8_t noSize[] = { 0x62, 0x03, 0x82, 0x01, 0x01 };
+	static const uint8_t truncated[] = { 0x62, 0x06, 0x80, 0x02, 0x03, 0xE8 };
+	static const uint8_t overrun[] = { 0x62, 0x04, 0x80, 0x03, 0x03, 0xE8 };
+	static const uint8_t notFCI[] = { 0x90, 0x04, 0x80, 0x02, 0x03, 0xE8 };
+	CHECK(fciFileSize(fci, sizeof(fci)) == 1000);
+	CHECK(fciFileSize(fciLater, sizeof(fciLater)) == 300);
+	CHECK(fciFileSize(noSize, sizeof(noSize)) == 0);
+	CHECK(fciFileSize(truncated, sizeof(truncated)) == 0);
+	CHECK(fciFileSize(overrun, sizeof(overrun)) == 0);
+	CHECK(fciFileSize(notFCI, sizeof(notFCI)) == 0);
+	CHECK(fciFileSize(fci, 1) == 0);
+
+	// Card capabilities 73 00 00 40: extended Lc and Le
+	static const uint8_t extended[] = { 0x3B, 0x05, 0x80, 0x73, 0x00, 0x00, 0x40 };
+	static const uint8_t shortOnly[] = { 0x3B, 0x05, 0x80, 0x73, 0x00, 0x00, 0x00 };
+	// TD1 and TD2 before the historical bytes, TCK after them
+	static const uint8_t interfaceBytes[] =
+		{ 0x3B, 0x85, 0x80, 0x01, 0x80, 0x73, 0x00, 0x00, 0x40, 0x00 };
+	// Historical bytes ending with a status indicator
+	static const uint8_t statusIndicator[] =
+		{ 0x3B, 0x08, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x90, 0x00 };
+	static const uint8_t noCapabilities[] = { 0x3B, 0x03, 0x80, 0x31, 0xC0 };
+	static const uint8_t cut[] = { 0x3B, 0x05, 0x80, 0x73, 0x00 };
+	CHECK(atrAllowsExtendedLength(extended, sizeof(extended)));
+	CHECK(!atrAllowsExtendedLength(shortOnly, sizeof(shortOnly)));
+	CHECK(atrAllowsExtendedLength(interfaceBytes, sizeof(interfaceBytes)));
+	CHECK(atrAllowsExtendedLength(statusIndicator, sizeof(statusIndicator)));
+	CHECK(!atrAllowsExtendedLength(noCapabilities, sizeof(noCapabilities)));
+	CHECK(!atrAllowsExtendedLength(cut, sizeof(cut)));
+}
+
+/* The FCI gives the sizes, so no read goes past the end of a file */
+static void testFCI()
+{
+	VirtualBELPIC *card = makeCard();
+	BELPICFiles<VirtualBELPIC> files(*card);
+	readAll(*card, files);
+	// One select each; 2 + 4 + 13 reads of up to 0xF4 bytes
+	CHECK(card->selects == 3);
+	CHECK(card->reads == 19);
+
+	// The sizes are known, so the FCI is not asked for again
+	card->resetCounts();
+	card->fci = false;
+	files.reset();
+	readAll(*card, files);
+	CHECK(card->selects == 3);
+	CHECK(card->reads == 19);
+	delete card;
+}
+
+/* Without an FCI the sizes are learned by reading to the end */
+static void testNoFCI()
+{
+	VirtualBELPIC *card = makeCard();
+	card->fci = false;
+	BELPICFiles<VirtualBELPIC> files(*card);
+	readAll(*card, files);
+	// Only the first select asks for the FCI; each file takes a 6Cxx and
+	// a read of the rest
+	CHECK(card->selects == 4);
+	CHECK(card->reads == 19 + 3);
+
+	card->resetCounts();
+	files.reset();
+	readAll(*card, files);
+	CHECK(card->selects == 3);
+	CHECK(card->reads == 19);
+	delete card;
+}
+
+/* Cards that say so in their ATR get each file with one read */
+static void testExtendedLength()
+{
+	VirtualBELPIC *card = makeCard();
+	card->extendedCard = card->extendedReader = true;
+	BELPICFiles<VirtualBELPIC> files(*card);
+	files.extendedLength(true);
+	readAll(*card, files);
+	CHECK(card->selects == 3);
+	CHECK(card->reads == 3);
+	CHECK(files.extendedLength());
+
+	// Without the FCI the file sizes don't matter either
+	VirtualBELPIC *noFCI = makeCard();
+	noFCI->extendedCard = noFCI->extendedReader = true;
+	noFCI->fci = false;
+	BELPICFiles<VirtualBELPIC> noFCIFiles(*noFCI);
+	noFCIFiles.extendedLength(true);
+	readAll(*noFCI, noFCIFiles);
+	CHECK(noFCI->selects == 4);
+	CHECK(noFCI->reads == 3);
+	delete noFCI;
+
+	// The card turns the extended Le down: short reads from then on
+	card->resetCounts();
+	card->extendedCard = false;
+	BELPICFiles<VirtualBELPIC> refused(*card);
+	refused.extendedLength(true);
+	readAll(*card, refused);
+	CHECK(!refused.extendedLength());
+	CHECK(card->reads == 1 + 19);
+
+	// The reader can't send it
+	card->resetCounts();
+	card->extendedReader = false;
+	BELPICFiles<VirtualBELPIC> noReader(*card);
+	noReader.extendedLength(true);
+	readAll(*card, noReader);
+	CHECK(!noReader.extendedLength());
+	CHECK(card->reads == 19);
+	delete card;
+}
+
+/* 6282 with no data at all when a file ends on a block boundary */
+static void testEndOfFileWarning()
+{
+	VirtualBELPIC card;
+	card.fci = false;
+	card.endOfFileWarning = true;
+	card.addFile(kDF_ID, kEF_Photo, 2 * BELPIC_READ_BLOCK_SIZE);
+	card.addFile(kDF_ID, kEF_Cert, 300);
+	BELPICFiles<VirtualBELPIC> files(card);
+	CHECK(readFile(card, files, kDF_ID, kEF_Photo) == 2 * BELPIC_READ_BLOCK_SIZE);
+	CHECK(card.reads == 3);
+	CHECK(readFile(card, files, kDF_ID, kEF_Cert) == 300);
+	CHECK(card.reads == 3 + 2);
+}
+
+/* Outside a transaction every select names the DF */
+static void testNoTransaction()
+{
+	VirtualBELPIC *card = makeCard();
+	card->inTransaction = false;
+	BELPICFiles<VirtualBELPIC> files(*card);
+	readAll(*card, files);
+	readAll(*card, files);
+	CHECK(card->selects == 6);
+
+	// An unknown file is an error
+	static const uint8_t kEF_Missing[] = { 0x50, 0x3F };
+	bool thrown = false;
+	try
+	{
+		files.select(kDF_ID, kEF_Missing);
+	}
+	catch (const Tokend::SCardError &error)
+	{
+		thrown = (error.statusWord == SCARD_FILE_NOT_FOUND);
+	}
+	CHECK(thrown);
+	delete card;
+}
+
+int main(int argc, char *argv[])
+{
+	testFileSizes();
+	testFCI();
+	testNoFCI();
+	testExtendedLength();
+	testEndOfFileWarning();
+	testNoTransaction();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("BELPIC file checks passed\n");
+	return 0;
+}
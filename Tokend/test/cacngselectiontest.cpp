@@ -0,0 +1,255 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  cacngselectiontest.cpp
+ *
+ *  Checks of the CACNG applet and object selection tracking
+ *  (CACNG/CACNGSelection.h) against a simulated card that counts the
+ *  SELECTs it gets: which ones are skipped, that the card always ends up
+ *  with the requested object, and what makes the selection be forgotten.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CACNGSelection.h"
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+/* The SELECT apdus of CACNGToken.cpp */
+static const unsigned char kSelectCACNGAppletPKI[] =
+	{ 0x00, 0xA4, 0x04, 0x00, 0x07, 0xA0, 0x00, 0x00, 0x00, 0x79, 0x01, 0x00 };
+static const unsigned char kSelectPIVApplet[] =
+	{ 0x00, 0xA4, 0x04, 0x00, 0x0B, 0xA0, 0x00, 0x00, 0x03, 0x08, 0x00, 0x00, 0x10, 0x00, 0x01, 0x00 };
+static const unsigned char kSelectCACNGObjectPKIID[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x01, 0x00 };
+static const unsigned char kSelectCACNGObjectPKIESig[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x01, 0x01 };
+static const unsigned char kSelectCACNGObjectPKIECry[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x01, 0x02 };
+static const unsigned char kSelectCACNGObjectPN[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x02, 0x00 };
+static const unsigned char kSelectCACNGObjectPL[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x02, 0x01 };
+static const unsigned char kSelectCACNGObjectBS[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x02, 0x02 };
+static const unsigned char kSelectCACNGObjectOB[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x02, 0x03 };
+static const unsigned char kSelectMissingObject[] = { 0x00, 0xA4, 0x02, 0x00, 0x02, 0x0F, 0x0F };
+/* CAC READ BUFFER of the value buffer */
+static const unsigned char kReadBuffer[] = { 0x80, 0x52, 0x00, 0x00, 0x02, 0x02, 0x10 };
+
+#define APDU(bytes)	byte_string(bytes, bytes + sizeof(bytes))
+
+/*
+	A card with the CAC PKI applet and its objects, and the PIV applet.  Like
+	CACNGToken, it forgets the selection after an error status.
+*/
+class VirtualCACNG
+{
+public:
+	VirtualCACNG() : selection(*this), inTransaction(true), nextStatus(SCARD_SUCCESS),
+		selects(0), commands(0) {}
+
+	bool isInTransaction() const { return inTransaction; }
+	uint32_t exchangeAPDU(const byte_string &apdu, byte_string &result);
+
+	void resetCounts() { selects = commands = 0; }
+
+	CACNGSelection<VirtualCACNG> selection;
+	bool inTransaction;
+	uint16_t nextStatus;	// status of the next command that isn't a SELECT
+	unsigned int selects;
+	unsigned int commands;
+	// What the card has selected
+	byte_string applet;
+	byte_string object;
+};
+
+uint32_t VirtualCACNG::exchangeAPDU(const byte_string &apdu, byte_string &result)
+{
+	uint16_t sw = SCARD_SUCCESS;
+	if (apdu.size() >= 5 && apdu[1] == 0xA4)
+	{
+		selects++;
+		if (apdu[2] == 0x04 && (apdu == APDU(kSelectCACNGAppletPKI) || apdu == APDU(kSelectPIVApplet)))
+		{
+			applet = apdu;
+			object.resize(0);
+		}
+		else if (apdu[2] == 0x02 && applet == APDU(kSelectCACNGAppletPKI)
+			&& apdu != APDU(kSelectMissingObject))
+			object = apdu;
+		else
+			sw = SCARD_FILE_NOT_FOUND;
+	}
+	else
+	{
+		commands++;
+		sw = nextStatus;
+		nextStatus = SCARD_SUCCESS;
+	}
+
+	result.push_back(sw >> 8);
+	result.push_back(sw & 0xFF);
+	if (!statusKeepsSelection(&result[0], result.size()))
+		selection.invalidate();
+	return sw;
+}
+
+/* What CACNGCacApplet::select() does */
+static void selectCacObject(VirtualCACNG &card, const byte_string &object)
+{
+	card.selection.selectApplet(APDU(kSelectCACNGAppletPKI));
+	card.selection.selectObject(object);
+	CHECK(card.applet == APDU(kSelectCACNGAppletPKI));
+	CHECK(card.object == object);
+}
+
+static void selectPiv(VirtualCACNG &card)
+{
+	card.selection.selectApplet(APDU(kSelectPIVApplet));
+	CHECK(card.applet == APDU(kSelectPIVApplet));
+}
+
+/* Reads the three certificates, the four data objects, the PIV
+   certificate, then signs with the identity key */
+static void populateAndSign(VirtualCACNG &card)
+{
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIID));
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIESig));
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIECry));
+	selectCacObject(card, APDU(kSelectCACNGObjectPN));
+	selectCacObject(card, APDU(kSelectCACNGObjectPL));
+	selectCacObject(card, APDU(kSelectCACNGObjectBS));
+	selectCacObject(card, APDU(kSelectCACNGObjectOB));
+	selectPiv(card);
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIID));
+}
+
+static void testStatusKeepsSelection()
+{
+	static const unsigned char ok[] = { 0x90, 0x00 };
+	static const unsigned char moreData[] = { 0x61, 0x10 };
+	static const unsigned char endOfFile[] = { 0x01, 0x62, 0x82 };
+	static const unsigned char triesLeft[] = { 0x63, 0xC2 };
+	static const unsigned char denied[] = { 0x69, 0x82 };
+	static const unsigned char notFound[] = { 0x6A, 0x82 };
+	static const unsigned char odd[] = { 0x90, 0x01 };
+	CHECK(statusKeepsSelection(ok, sizeof(ok)));
+	CHECK(statusKeepsSelection(moreData, sizeof(moreData)));
+	CHECK(statusKeepsSelection(endOfFile, sizeof(endOfFile)));
+	CHECK(statusKeepsSelection(triesLeft, sizeof(triesLeft)));
+	CHECK(!statusKeepsSelection(denied, sizeof(denied)));
+	CHECK(!statusKeepsSelection(notFound, sizeof(notFound)));
+	CHECK(!statusKeepsSelection(odd, sizeof(odd)));
+	CHECK(!statusKeepsSelection(ok, 1));
+	CHECK(!statusKeepsSelection(ok, 0));
+}
+
+/* Objects of the PKI applet share its SELECT */
+static void testTransaction()
+{
+	VirtualCACNG card;
+	populateAndSign(card);
+	// PKI, 7 objects, PIV, PKI and the identity object again; sending both
+	// SELECTs for every CAC object takes 8 * 2 + 1 = 17
+	CHECK(card.selects == 11);
+
+	// The identity object is still current
+	card.resetCounts();
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIID));
+	CHECK(card.selects == 0);
+
+	// Selecting an applet deselects the object on the card
+	selectPiv(card);
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIID));
+	CHECK(card.selects == 3);
+}
+
+/* Outside a transaction another process may change the selection */
+static void testNoTransaction()
+{
+	VirtualCACNG card;
+	card.inTransaction = false;
+	populateAndSign(card);
+	CHECK(card.selects == 17);
+	CHECK(card.selection.applet().empty());
+	CHECK(card.selection.object().empty());
+}
+
+/* Error statuses, failed selects and the end of a transaction */
+static void testInvalidation()
+{
+	VirtualCACNG card;
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIESig));
+
+	// A warning keeps the selection
+	card.resetCounts();
+	byte_string result;
+	card.nextStatus = 0x63C2;
+	card.exchangeAPDU(APDU(kReadBuffer), result);
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIESig));
+	CHECK(card.selects == 0);
+
+	// An error does not
+	card.nextStatus = SCARD_NOT_AUTHORIZED;
+	card.exchangeAPDU(APDU(kReadBuffer), result);
+	CHECK(card.selection.applet().empty());
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIESig));
+	CHECK(card.selects == 2);
+
+	// Neither does a failed select
+	card.resetCounts();
+	bool thrown = false;
+	try
+	{
+		card.selection.selectObject(APDU(kSelectMissingObject));
+	}
+	catch (const CACNGError &error)
+	{
+		thrown = (error.statusWord == SCARD_FILE_NOT_FOUND);
+	}
+	CHECK(thrown);
+	CHECK(card.selection.object().empty());
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIESig));
+	CHECK(card.selects == 1 + 2);
+
+	// Nor the end of the transaction, CACNGToken::didEnd()
+	card.resetCounts();
+	card.selection.invalidate();
+	selectCacObject(card, APDU(kSelectCACNGObjectPKIESig));
+	CHECK(card.selects == 2);
+}
+
+int main(int argc, char *argv[])
+{
+	testStatusKeepsSelection();
+	testTransaction();
+	testNoTransaction();
+	testInvalidation();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("CACNG selection checks passed\n");
+	return 0;
+}
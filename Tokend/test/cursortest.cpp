@@ -0,0 +1,420 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  cursortest.cpp
+ *
+ *  Checks of the tokend search cursors (Tokend/Cursor.cpp) and of the
+ *  per-attribute equality indexes they use (Tokend/Relation.cpp): indexed
+ *  queries return the records a scan returns, in the same order. With
+ *  -bench, times an equality query through the index and through a scan
+ *  of the relation.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+
+#include "Attribute.h"
+#include "Cursor.h"
+#include "MetaAttribute.h"
+#include "MetaRecord.h"
+#include "Record.h"
+#include "RecordHandle.h"
+#include "Relation.h"
+
+using namespace Tokend;
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Attribute indexes in the order createRelation creates them, 0 is the data */
+enum { kLabel = 1, kClass, kHash, kSerial };
+
+static Relation *createRelation()
+{
+	MetaRecord *metaRecord = new MetaRecord(CSSM_DL_DB_RECORD_CERT);
+	const std::string label("Label"), cls("Class"), hash("Hash"), serial("Serial");
+	metaRecord->createAttribute(&label, NULL, 1, kAF_STRING);
+	metaRecord->createAttribute(&cls, NULL, 2, kAF_UINT32);
+	metaRecord->createAttribute(&hash, NULL, 3, kAF_BLOB);
+	metaRecord->createAttribute(&serial, NULL, 4, kAF_SINT32);
+	return new Relation(metaRecord);
+}
+
+static std::string labelOf(unsigned int ix)
+{
+	char label[32];
+	snprintf(label, sizeof(label), "label-%u", ix);
+	return label;
+}
+
+/* Records 2n and 2n + 1 share a hash */
+static std::string hashOf(unsigned int ix)
+{
+	std::string hash(20, 0);
+	for (size_t i = 0; i < hash.size(); i++)
+		hash[i] = (char)((ix / 2) * 31 + i);
+	return hash;
+}
+
+class TestRecord : public Record
+{
+public:
+	TestRecord(const std::string &label, uint32 cls, const std::string &hash,
+		sint32 serial)
+	{
+		attributeAtIndex(kLabel, new Attribute(label));
+		attributeAtIndex(kClass, new Attribute(cls));
+		attributeAtIndex(kHash, new Attribute(hash.data(), hash.size()));
+		attributeAtIndex(kSerial, new Attribute(serial));
+	}
+
+	TestRecord(const CSSM_DATA *labels, uint32 count)
+	{
+		attributeAtIndex(kLabel, new Attribute(labels, count));
+		attributeAtIndex(kClass, new Attribute((uint32)0));
+		attributeAtIndex(kHash, new Attribute(std::string()));
+		attributeAtIndex(kSerial, new Attribute((sint32)0));
+	}
+};
+
+/* Record ix has class ix % 4 and serial -ix */
+static void fill(Relation &relation, unsigned int count)
+{
+	for (unsigned int ix = 0; ix < count; ix++)
+		relation.insertRecord(new TestRecord(labelOf(ix), ix % 4, hashOf(ix),
+			-(sint32)ix));
+}
+
+struct Predicate
+{
+	const char *name;
+	CSSM_DB_ATTRIBUTE_FORMAT format;
+	CSSM_DB_OPERATOR op;
+	const void *data;
+	size_t length;
+};
+
+static std::string label(RecordHandle &handle)
+{
+	CSSM_DB_ATTRIBUTE_DATA attribute;
+	memset(&attribute, 0, sizeof(attribute));
+	attribute.Info.AttributeNameFormat = CSSM_DB_ATTRIBUTE_NAME_AS_STRING;
+	attribute.Info.Label.AttributeName = const_cast<char *>("Label");
+	CSSM_DB_RECORD_ATTRIBUTE_DATA attributes = { 0, 0, 1, &attribute };
+	TOKEND_RETURN_DATA data = { &attributes, NULL, 0, 0 };
+	handle.get(NULL, data);
+	std::string result;
+	for (uint32 ix = 0; ix < attribute.NumberOfValues; ix++)
+		result += (ix ? "|" : "") + std::string(
+			reinterpret_cast<const char *>(attribute.Value[ix].Data),
+			attribute.Value[ix].Length);
+	return result;
+}
+
+/* Labels of the records matching the query, in the order the cursor returns them */
+static std::string find(const Relation &relation,
+	CSSM_DB_CONJUNCTIVE conjunctive, const Predicate *predicates, size_t count)
+{
+	std::vector<CSSM_DATA> values(count);
+	std::vector<CSSM_SELECTION_PREDICATE> selection(count);
+	for (size_t ix = 0; ix < count; ix++)
+	{
+		values[ix].Data = (uint8 *)predicates[ix].data;
+		values[ix].Length = predicates[ix].length;
+		memset(&selection[ix], 0, sizeof(selection[ix]));
+		selection[ix].DbOperator = predicates[ix].op;
+		selection[ix].Attribute.Info.AttributeNameFormat =
+			CSSM_DB_ATTRIBUTE_NAME_AS_STRING;
+		selection[ix].Attribute.Info.Label.AttributeName =
+			const_cast<char *>(predicates[ix].name);
+		selection[ix].Attribute.Info.AttributeFormat = predicates[ix].format;
+		selection[ix].Attribute.NumberOfValues = 1;
+		selection[ix].Attribute.Value = &values[ix];
+	}
+
+	CSSM_QUERY query;
+	memset(&query, 0, sizeof(query));
+	query.RecordType = CSSM_DL_DB_RECORD_CERT;
+	query.Conjunctive = conjunctive;
+	query.NumSelectionPredicates = count;
+	query.SelectionPredicate = count ? &selection[0] : NULL;
+
+	std::string result;
+	LinearCursor cursor(&query, relation);
+	while (RecordHandle *handle = cursor.next(NULL))
+	{
+		result += (result.empty() ? "" : ",") + label(*handle);
+		delete handle;
+	}
+	return result;
+}
+
+static std::string find(const Relation &relation,
+	CSSM_DB_CONJUNCTIVE conjunctive, const Predicate &predicate)
+{
+	return find(relation, conjunctive, &predicate, 1);
+}
+
+static Predicate equal(const char *name, CSSM_DB_ATTRIBUTE_FORMAT format,
+	const void *data, size_t length)
+{
+	Predicate predicate = { name, format, CSSM_DB_EQUAL, data, length };
+	return predicate;
+}
+
+static void testEqualityLookups()
+{
+	Relation *relation = createRelation();
+	fill(*relation, 8);
+
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Label", kAF_STRING, "label-3", 7)) == "label-3");
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Label", kAF_STRING, "label-9", 7)) == "");
+
+	/* 1, 2 and 4 byte encodings of a number are equal */
+	uint32 cls4 = 1;
+	uint16 cls2 = 1;
+	uint8 cls1 = 1;
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Class", kAF_UINT32, &cls4, 4)) == "label-1,label-5");
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Class", kAF_UINT32, &cls2, 2)) == "label-1,label-5");
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Class", kAF_UINT32, &cls1, 1)) == "label-1,label-5");
+	CHECK(find(*relation, CSSM_DB_NONE,
+		equal("Class", kAF_UINT32, &cls4, 4)) == "label-1,label-5");
+
+	sint32 serial4 = -6;
+	sint8 serial1 = -6;
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Serial", kAF_SINT32, &serial4, 4)) == "label-6");
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Serial", kAF_SINT32, &serial1, 1)) == "label-6");
+
+	std::string hash = hashOf(4);
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Hash", kAF_BLOB, hash.data(), hash.size())) == "label-4,label-5");
+	/* A prefix of a blob is not equal to it */
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Hash", kAF_BLOB, hash.data(), hash.size() - 1)) == "");
+
+	/* All predicates hold on the records the index returns */
+	Predicate both[] = {
+		equal("Class", kAF_UINT32, &cls4, 4),
+		equal("Label", kAF_STRING, "label-5", 7)
+	};
+	CHECK(find(*relation, CSSM_DB_AND, both, 2) == "label-5");
+	Predicate neither[] = {
+		equal("Class", kAF_UINT32, &cls4, 4),
+		equal("Label", kAF_STRING, "label-4", 7)
+	};
+	CHECK(find(*relation, CSSM_DB_AND, neither, 2) == "");
+
+	delete relation;
+}
+
+static void testStrings()
+{
+	Relation *relation = createRelation();
+	relation->insertRecord(new TestRecord(std::string("abc\0def", 7), 0,
+		std::string(), 0));
+	relation->insertRecord(new TestRecord(std::string("abc"), 0,
+		std::string(), 0));
+
+	/*
+	 * StringValue passes its strncmp comparator by value as a BlobValue one,
+	 * so strings compare with memcmp. The index must not return fewer
+	 * records than that.
+	 */
+	Predicate nul = equal("Label", kAF_STRING, "abc\0xyz", 7);
+	CHECK(find(*relation, CSSM_DB_AND, nul) == find(*relation, CSSM_DB_OR, nul));
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Label", kAF_STRING, "abc\0def", 7)) == std::string("abc\0def", 7));
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Label", kAF_STRING, "abc", 3)) == "abc");
+	CHECK(find(*relation, CSSM_DB_AND,
+		equal("Label", kAF_STRING, "abc\0", 4)) == "");
+
+	delete relation;
+}
+
+static void testMultipleValues()
+{
+	Relation *relation = createRelation();
+	fill(*relation, 2);
+	CSSM_DATA labels[] = {
+		{ 1, (uint8 *)"x" }, { 1, (uint8 *)"y" }, { 1, (uint8 *)"x" }
+	};
+	relation->insertRecord(new TestRecord(labels, 3));
+
+	/* A record having the value more than once is returned once */
+	CHECK(find(*relation, CSSM_DB_AND, equal("Label", kAF_STRING, "x", 1))
+		== "x|y|x");
+	CHECK(find(*relation, CSSM_DB_AND, equal("Label", kAF_STRING, "y", 1))
+		== "x|y|x");
+
+	delete relation;
+}
+
+static void testScans()
+{
+	Relation *relation = createRelation();
+	fill(*relation, 8);
+
+	/* OR queries scan the relation, records come in relation order */
+	uint32 cls = 1;
+	Predicate either[] = {
+		equal("Label", kAF_STRING, "label-6", 7),
+		equal("Class", kAF_UINT32, &cls, 4)
+	};
+	CHECK(find(*relation, CSSM_DB_OR, either, 2) == "label-1,label-5,label-6");
+
+	/* Operators other than equality scan, the query value is on the left */
+	uint32 two = 2;
+	Predicate less = { "Class", kAF_UINT32, CSSM_DB_LESS_THAN, &two, 4 };
+	CHECK(find(*relation, CSSM_DB_AND, less) == "label-3,label-7");
+	Predicate prefix = { "Label", kAF_STRING,
+		CSSM_DB_CONTAINS_INITIAL_SUBSTRING, "label-", 6 };
+	CHECK(find(*relation, CSSM_DB_AND, prefix)
+		== "label-0,label-1,label-2,label-3,label-4,label-5,label-6,label-7");
+
+	/* The first equality predicate is used even when it is not the first one */
+	Predicate mixed[] = { less, equal("Label", kAF_STRING, "label-7", 7) };
+	CHECK(find(*relation, CSSM_DB_AND, mixed, 2) == "label-7");
+	mixed[1] = equal("Label", kAF_STRING, "label-6", 7);
+	CHECK(find(*relation, CSSM_DB_AND, mixed, 2) == "");
+
+	/* No predicates match every record */
+	CHECK(find(*relation, CSSM_DB_AND, NULL, 0)
+		== "label-0,label-1,label-2,label-3,label-4,label-5,label-6,label-7");
+
+	delete relation;
+}
+
+static void testInsertRecord()
+{
+	Relation *relation = createRelation();
+	fill(*relation, 4);
+
+	uint32 cls = 1;
+	Predicate predicate = equal("Class", kAF_UINT32, &cls, 4);
+	CHECK(find(*relation, CSSM_DB_AND, predicate) == "label-1");
+
+	/* Inserting drops the index built by the query above */
+	relation->insertRecord(new TestRecord("new", 1, std::string(), 0));
+	CHECK(find(*relation, CSSM_DB_AND, predicate) == "label-1,new");
+
+	delete relation;
+}
+
+/* The index returns what a scan returns for every value of the relation */
+static void testIndexMatchesScan()
+{
+	const unsigned int count = 200;
+	Relation *relation = createRelation();
+	fill(*relation, count);
+
+	for (unsigned int ix = 0; ix < count; ix++)
+	{
+		std::string label = labelOf(ix), hash = hashOf(ix);
+		uint32 cls = ix % 4;
+		sint32 serial = -(sint32)ix;
+		Predicate predicates[] = {
+			equal("Label", kAF_STRING, label.data(), label.size()),
+			equal("Class", kAF_UINT32, &cls, sizeof(cls)),
+			equal("Hash", kAF_BLOB, hash.data(), hash.size()),
+			equal("Serial", kAF_SINT32, &serial, sizeof(serial))
+		};
+		for (size_t p = 0; p < sizeof(predicates) / sizeof(predicates[0]); p++)
+		{
+			/* A single predicate OR query has the same result through a scan */
+			std::string indexed = find(*relation, CSSM_DB_AND, predicates[p]);
+			std::string scanned = find(*relation, CSSM_DB_OR, predicates[p]);
+			CHECK(!indexed.empty());
+			CHECK(indexed == scanned);
+		}
+	}
+
+	delete relation;
+}
+
+static void bench(unsigned int count)
+{
+	Relation *relation = createRelation();
+	fill(*relation, count);
+	std::string label = labelOf(count / 2);
+	Predicate predicate = equal("Label", kAF_STRING, label.data(), label.size());
+
+	/* Builds the index */
+	find(*relation, CSSM_DB_AND, predicate);
+
+	unsigned int iterations = 2000000 / count + 1000;
+	double start = now();
+	for (unsigned int i = 0; i < iterations; i++)
+		find(*relation, CSSM_DB_AND, predicate);
+	double indexed = (now() - start) * 1e6 / iterations;
+
+	start = now();
+	for (unsigned int i = 0; i < iterations; i++)
+		find(*relation, CSSM_DB_OR, predicate);
+	double scanned = (now() - start) * 1e6 / iterations;
+
+	printf("%5u records  %8.3f us/query indexed  %8.3f us/query scanned\n",
+		count, indexed, scanned);
+	delete relation;
+}
+
+int main(int argc, char *argv[])
+{
+	testEqualityLookups();
+	testStrings();
+	testMultipleValues();
+	testScans();
+	testInsertRecord();
+	testIndexMatchesScan();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("Cursor checks passed\n");
+
+	if (argc > 1 && !strcmp(argv[1], "-bench")) {
+		bench(8);
+		bench(64);
+		bench(512);
+	}
+	return 0;
+}
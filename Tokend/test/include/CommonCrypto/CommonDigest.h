@@ -0,0 +1,36 @@
+/*
+ *  Host build stand-in for <CommonCrypto/CommonDigest.h> over OpenSSL.
+ */
+
+#ifndef _TEST_COMMONDIGEST_H_
+#define _TEST_COMMONDIGEST_H_
+
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/sha.h>
+#include <stdint.h>
+
+#define CC_SHA1_DIGEST_LENGTH	SHA_DIGEST_LENGTH
+
+typedef SHA_CTX CC_SHA1_CTX;
+
+static inline int CC_SHA1_Init(CC_SHA1_CTX *c)
+{
+	return SHA1_Init(c);
+}
+
+static inline int CC_SHA1_Update(CC_SHA1_CTX *c, const void *data, uint32_t len)
+{
+	return SHA1_Update(c, data, len);
+}
+
+static inline int CC_SHA1_Final(unsigned char *md, CC_SHA1_CTX *c)
+{
+	return SHA1_Final(md, c);
+}
+
+static inline unsigned char *CC_SHA1(const void *data, uint32_t len, unsigned char *md)
+{
+	return SHA1(static_cast<const unsigned char *>(data), len, md);
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ *  Host build stand-in for <CommonCrypto/CommonHMAC.h> over OpenSSL,
+ *  SHA-1 only.
+ */
+
+#ifndef _TEST_COMMONHMAC_H_
+#define _TEST_COMMONHMAC_H_
+
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/hmac.h>
+#include <stddef.h>
+
+enum { kCCHmacAlgSHA1 };
+typedef int CCHmacAlgorithm;
+
+typedef struct {
+	HMAC_CTX *ctx;
+} CCHmacContext;
+
+static inline void CCHmacInit(CCHmacContext *c, CCHmacAlgorithm, const void *key, size_t keyLength)
+{
+	c->ctx = HMAC_CTX_new();
+	HMAC_Init_ex(c->ctx, key, (int)keyLength, EVP_sha1(), NULL);
+}
+
+static inline void CCHmacUpdate(CCHmacContext *c, const void *data, size_t dataLength)
+{
+	HMAC_Update(c->ctx, static_cast<const unsigned char *>(data), dataLength);
+}
+
+static inline void CCHmacFinal(CCHmacContext *c, void *macOut)
+{
+	HMAC_Final(c->ctx, static_cast<unsigned char *>(macOut), NULL);
+	HMAC_CTX_free(c->ctx);
+	c->ctx = NULL;
+}
+
+#endif
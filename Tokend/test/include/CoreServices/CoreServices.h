@@ -0,0 +1,11 @@
+/*
+ *  Host build stand-in for <CoreServices/CoreServices.h>; also makes
+ *  <CoreServices/../Frameworks/...> paths resolve to include/Frameworks.
+ */
+
+#ifndef _TEST_CORESERVICES_H_
+#define _TEST_CORESERVICES_H_
+
+#include <Frameworks/CarbonCore.framework/Headers/MacTypes.h>
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ *  Host build stand-in for CarbonCore's <MacTypes.h>: byte_string.h only
+ *  relies on it for the C library.
+ */
+
+#ifndef _TEST_MACTYPES_H_
+#define _TEST_MACTYPES_H_
+
+#include <Security/cssmtype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#endif
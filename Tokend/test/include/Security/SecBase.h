@@ -0,0 +1,14 @@
+/*
+ *  Host build stand-in for <Security/SecBase.h>.
+ */
+
+#ifndef _TEST_SECBASE_H_
+#define _TEST_SECBASE_H_
+
+#include <Security/cssmtype.h>
+
+typedef struct OpaqueSecKeychainItemRef *SecKeychainItemRef;
+
+enum { noErr = 0 };
+
+#endif
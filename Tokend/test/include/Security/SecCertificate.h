@@ -0,0 +1,23 @@
+/*
+ *  Host build stand-in for <Security/SecCertificate.h>. The functions are
+ *  defined by the test that links the certificate code.
+ */
+
+#ifndef _TEST_SECCERTIFICATE_H_
+#define _TEST_SECCERTIFICATE_H_
+
+#include <Security/SecBase.h>
+
+typedef struct OpaqueSecCertificateRef *SecCertificateRef;
+
+typedef uint32 CSSM_CERT_TYPE;
+typedef uint32 CSSM_CERT_ENCODING;
+enum { CSSM_CERT_X_509v3 = 3 };
+enum { CSSM_CERT_ENCODING_BER = 1 };
+
+OSStatus SecCertificateCreateFromData(const CSSM_DATA *data,
+	CSSM_CERT_TYPE type, CSSM_CERT_ENCODING encoding,
+	SecCertificateRef *certificate);
+void CFRelease(const void *object);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ *  Host build stand-in for <Security/SecKey.h>: the key attribute ids and
+ *  the CSSM key constants the tokend sources use.
+ */
+
+#ifndef _TEST_SECKEY_H_
+#define _TEST_SECKEY_H_
+
+#include <Security/SecBase.h>
+
+enum {
+	kSecKeyKeyClass = 0,
+	kSecKeyPrintName,
+	kSecKeyAlias,
+	kSecKeyPermanent,
+	kSecKeyPrivate,
+	kSecKeyModifiable,
+	kSecKeyLabel,
+	kSecKeyApplicationTag,
+	kSecKeyKeyCreator,
+	kSecKeyKeyType,
+	kSecKeyKeySizeInBits,
+	kSecKeyEffectiveKeySize,
+	kSecKeyStartDate,
+	kSecKeyEndDate,
+	kSecKeySensitive,
+	kSecKeyAlwaysSensitive,
+	kSecKeyExtractable,
+	kSecKeyNeverExtractable,
+	kSecKeyEncrypt,
+	kSecKeyDecrypt,
+	kSecKeyDerive,
+	kSecKeySign,
+	kSecKeyVerify,
+	kSecKeySignRecover,
+	kSecKeyVerifyRecover,
+	kSecKeyWrap,
+	kSecKeyUnwrap
+};
+
+enum {
+	CSSM_KEYBLOB_REFERENCE = 2,
+	CSSM_KEYBLOB_REF_FORMAT_INTEGER = 0
+};
+
+enum {
+	CSSM_KEYATTR_PERMANENT = 0x00000001,
+	CSSM_KEYATTR_PRIVATE = 0x00000002,
+	CSSM_KEYATTR_MODIFIABLE = 0x00000004,
+	CSSM_KEYATTR_SENSITIVE = 0x00000008,
+	CSSM_KEYATTR_EXTRACTABLE = 0x00000020,
+	CSSM_KEYATTR_ALWAYS_SENSITIVE = 0x00000010,
+	CSSM_KEYATTR_NEVER_EXTRACTABLE = 0x00000040
+};
+
+enum {
+	CSSM_KEYUSE_ANY = 0x80000000,
+	CSSM_KEYUSE_ENCRYPT = 0x00000001,
+	CSSM_KEYUSE_DECRYPT = 0x00000002,
+	CSSM_KEYUSE_SIGN = 0x00000004,
+	CSSM_KEYUSE_VERIFY = 0x00000008,
+	CSSM_KEYUSE_SIGN_RECOVER = 0x00000010,
+	CSSM_KEYUSE_VERIFY_RECOVER = 0x00000020,
+	CSSM_KEYUSE_WRAP = 0x00000040,
+	CSSM_KEYUSE_UNWRAP = 0x00000080,
+	CSSM_KEYUSE_DERIVE = 0x00000100
+};
+
+static const CSSM_GUID gGuidAppleSdCSPDL =
+	{ 0x87191ca3, 0x0fc9, 0x11d4, { 0x84, 0x9a, 0x00, 0x05, 0x02, 0xb5, 0x21, 0x22 } };
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ *  Host build stand-in for <Security/SecKeychainItem.h>. The functions are
+ *  defined by the test that links the certificate code.
+ */
+
+#ifndef _TEST_SECKEYCHAINITEM_H_
+#define _TEST_SECKEYCHAINITEM_H_
+
+#include <Security/SecBase.h>
+
+typedef uint32 UInt32;
+typedef uint32 SecItemClass;
+typedef uint32 SecKeychainAttrType;
+
+typedef struct SecKeychainAttribute {
+	SecKeychainAttrType tag;
+	UInt32 length;
+	void *data;
+} SecKeychainAttribute;
+
+typedef struct SecKeychainAttributeList {
+	UInt32 count;
+	SecKeychainAttribute *attr;
+} SecKeychainAttributeList;
+
+OSStatus SecKeychainItemCopyContent(SecKeychainItemRef item,
+	SecItemClass *itemClass, SecKeychainAttributeList *attrList,
+	UInt32 *length, void **outData);
+OSStatus SecKeychainItemFreeContent(SecKeychainAttributeList *attrList,
+	void *data);
+
+#endif
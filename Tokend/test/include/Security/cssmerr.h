@@ -0,0 +1,29 @@
+/*
+ *  Host build stand-in for <Security/cssmerr.h>: the error codes the
+ *  tokend framework sources use.
+ */
+
+#ifndef _TEST_CSSMERR_H_
+#define _TEST_CSSMERR_H_
+
+enum {
+	CSSM_ERRCODE_INTERNAL_ERROR = 0x0001,
+	CSSM_ERRCODE_MEMORY_ERROR = 0x0002,
+	CSSM_ERRCODE_FUNCTION_NOT_IMPLEMENTED = 0x0007,
+	CSSM_ERRCODE_OPERATION_AUTH_DENIED = 0x0020,
+	CSSM_ERRCODE_OBJECT_USE_AUTH_DENIED = 0x0021,
+	CSSM_ERRCODE_OBJECT_MANIP_AUTH_DENIED = 0x80010014,
+	CSSMERR_DL_INTERNAL_ERROR = 0x80013001,
+	CSSMERR_DL_DATABASE_CORRUPT = 0x8001301A,
+	CSSMERR_DL_INVALID_QUERY = 0x80013036,
+	CSSMERR_DL_RECORD_NOT_FOUND = 0x8001303A,
+	CSSMERR_DL_INVALID_FIELD_NAME = 0x80013045,
+	CSSMERR_DL_INCOMPATIBLE_FIELD_FORMAT = 0x80013047,
+	CSSMERR_DL_UNSUPPORTED_FIELD_FORMAT = 0x80013048,
+	CSSMERR_DL_FIELD_SPECIFIED_MULTIPLE = 0x8001304B,
+	CSSMERR_DL_INVALID_VALUE = 0x80013050,
+	CSSMERR_DL_MISSING_VALUE = 0x80013051,
+	CSSMERR_DL_UNSUPPORTED_QUERY = 0x80013053
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ *  Host build stand-in for <Security/cssmtype.h>: the CSSM types and
+ *  constants the tokend framework sources use. Values follow the
+ *  framework where they are visible to callers.
+ */
+
+#ifndef _TEST_CSSMTYPE_H_
+#define _TEST_CSSMTYPE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int8_t sint8;
+typedef int16_t sint16;
+typedef int32_t sint32;
+
+typedef int32_t OSStatus;
+typedef sint32 CSSM_RETURN;
+typedef sint32 CSSM_BOOL;
+typedef uintptr_t CSSM_HANDLE;
+typedef uint32 CSSM_ALGORITHMS;
+typedef uint32 CSSM_KEYUSE;
+typedef uint32 CSSM_KEYATTR_FLAGS;
+typedef uint32 CSSM_DB_ACCESS_TYPE;
+typedef uint32 CSSM_DB_MODIFY_MODE;
+
+typedef struct cssm_data {
+	size_t Length;
+	uint8 *Data;
+} CSSM_DATA, *CSSM_DATA_PTR;
+
+typedef CSSM_DATA CSSM_OID;
+
+typedef struct cssm_guid {
+	uint32 Data1;
+	uint16 Data2;
+	uint16 Data3;
+	uint8 Data4[8];
+} CSSM_GUID;
+
+typedef struct cssm_date {
+	uint8 Year[4];
+	uint8 Month[2];
+	uint8 Day[2];
+} CSSM_DATE;
+
+typedef struct cssm_key_size {
+	uint32 LogicalKeySizeInBits;
+	uint32 EffectiveKeySizeInBits;
+} CSSM_KEY_SIZE;
+
+typedef uint32 CSSM_DB_RECORDTYPE;
+enum {
+	CSSM_DB_RECORDTYPE_SCHEMA_START = 0x00000000,
+	CSSM_DB_RECORDTYPE_SCHEMA_END = 0x00000004,
+	CSSM_DL_DB_RECORD_ANY = 0x0000000A,
+	CSSM_DL_DB_RECORD_CERT = 0x0000000B,
+	CSSM_DL_DB_RECORD_PUBLIC_KEY = 0x0000000F,
+	CSSM_DL_DB_RECORD_PRIVATE_KEY = 0x00000010,
+	CSSM_DL_DB_RECORD_SYMMETRIC_KEY = 0x00000011,
+	CSSM_DL_DB_RECORD_ALL_KEYS = 0x00000012
+};
+
+typedef uint32 CSSM_DB_ATTRIBUTE_FORMAT;
+enum {
+	CSSM_DB_ATTRIBUTE_FORMAT_STRING = 0,
+	CSSM_DB_ATTRIBUTE_FORMAT_SINT32 = 1,
+	CSSM_DB_ATTRIBUTE_FORMAT_UINT32 = 2,
+	CSSM_DB_ATTRIBUTE_FORMAT_BIG_NUM = 3,
+	CSSM_DB_ATTRIBUTE_FORMAT_REAL = 4,
+	CSSM_DB_ATTRIBUTE_FORMAT_TIME_DATE = 5,
+	CSSM_DB_ATTRIBUTE_FORMAT_BLOB = 6,
+	CSSM_DB_ATTRIBUTE_FORMAT_MULTI_UINT32 = 7,
+	CSSM_DB_ATTRIBUTE_FORMAT_COMPLEX = 8
+};
+
+typedef uint32 CSSM_DB_ATTRIBUTE_NAME_FORMAT;
+enum {
+	CSSM_DB_ATTRIBUTE_NAME_AS_STRING = 0,
+	CSSM_DB_ATTRIBUTE_NAME_AS_OID = 1,
+	CSSM_DB_ATTRIBUTE_NAME_AS_INTEGER = 2
+};
+
+typedef struct cssm_db_attribute_info {
+	CSSM_DB_ATTRIBUTE_NAME_FORMAT AttributeNameFormat;
+	union {
+		char *AttributeName;
+		CSSM_OID AttributeOID;
+		uint32 AttributeID;
+	} Label;
+	CSSM_DB_ATTRIBUTE_FORMAT AttributeFormat;
+} CSSM_DB_ATTRIBUTE_INFO;
+
+typedef struct cssm_db_attribute_data {
+	CSSM_DB_ATTRIBUTE_INFO Info;
+	uint32 NumberOfValues;
+	CSSM_DATA_PTR Value;
+} CSSM_DB_ATTRIBUTE_DATA;
+
+typedef struct cssm_db_record_attribute_data {
+	CSSM_DB_RECORDTYPE DataRecordType;
+	uint32 SemanticInformation;
+	uint32 NumberOfAttributes;
+	CSSM_DB_ATTRIBUTE_DATA *AttributeData;
+} CSSM_DB_RECORD_ATTRIBUTE_DATA;
+
+typedef uint32 CSSM_DB_OPERATOR;
+enum {
+	CSSM_DB_EQUAL = 0,
+	CSSM_DB_NOT_EQUAL = 1,
+	CSSM_DB_LESS_THAN = 2,
+	CSSM_DB_GREATER_THAN = 3,
+	CSSM_DB_CONTAINS = 4,
+	CSSM_DB_CONTAINS_INITIAL_SUBSTRING = 5,
+	CSSM_DB_CONTAINS_FINAL_SUBSTRING = 6
+};
+
+typedef uint32 CSSM_DB_CONJUNCTIVE;
+enum {
+	CSSM_DB_NONE = 0,
+	CSSM_DB_AND = 1,
+	CSSM_DB_OR = 2
+};
+
+typedef struct cssm_selection_predicate {
+	CSSM_DB_OPERATOR DbOperator;
+	CSSM_DB_ATTRIBUTE_DATA Attribute;
+} CSSM_SELECTION_PREDICATE;
+
+typedef struct cssm_query_limits {
+	uint32 TimeLimit;
+	uint32 SizeLimit;
+} CSSM_QUERY_LIMITS;
+
+typedef uint32 CSSM_QUERY_FLAGS;
+
+typedef struct cssm_query {
+	CSSM_DB_RECORDTYPE RecordType;
+	CSSM_DB_CONJUNCTIVE Conjunctive;
+	uint32 NumSelectionPredicates;
+	CSSM_SELECTION_PREDICATE *SelectionPredicate;
+	CSSM_QUERY_LIMITS QueryLimits;
+	CSSM_QUERY_FLAGS QueryFlags;
+} CSSM_QUERY;
+
+/* Only passed around by pointer or reference in the tested sources */
+struct cssm_context;
+typedef struct cssm_context CSSM_CONTEXT;
+struct cssm_key;
+typedef struct cssm_key CSSM_KEY;
+struct cssm_access_credentials;
+typedef struct cssm_access_credentials CSSM_ACCESS_CREDENTIALS;
+struct cssm_acl_entry_prototype;
+typedef struct cssm_acl_entry_prototype CSSM_ACL_ENTRY_PROTOTYPE;
+struct cssm_acl_owner_prototype;
+typedef struct cssm_acl_owner_prototype CSSM_ACL_OWNER_PROTOTYPE;
+struct cssm_acl_entry_info;
+typedef struct cssm_acl_entry_info CSSM_ACL_ENTRY_INFO;
+struct cssm_acl_edit;
+typedef struct cssm_acl_edit CSSM_ACL_EDIT;
+struct cssm_csp_operational_statistics;
+typedef struct cssm_csp_operational_statistics CSSM_CSP_OPERATIONAL_STATISTICS;
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ *  Host build stand-in for <SecurityTokend/SecTokend.h>.
+ */
+
+#ifndef _TEST_SECTOKEND_H_
+#define _TEST_SECTOKEND_H_
+
+#include <Security/cssmtype.h>
+#include <limits.h>
+
+#define TOKEND_MAX_UID 128
+
+typedef uint32 SecTokendProbeFlags;
+typedef uint32 SecTokendEstablishFlags;
+
+typedef struct {
+	CSSM_DB_RECORD_ATTRIBUTE_DATA *attributes;
+	CSSM_DATA *data;
+	CSSM_HANDLE record;
+	CSSM_HANDLE keyhandle;
+} TOKEND_RETURN_DATA;
+
+typedef struct SecTokendCallbacks SecTokendCallbacks;
+
+class SecTokendSupport
+{
+public:
+	virtual ~SecTokendSupport() {}
+};
+
+#endif
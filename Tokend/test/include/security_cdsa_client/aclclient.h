@@ -0,0 +1,22 @@
+/*
+ *  Host build stand-in for <security_cdsa_client/aclclient.h>.
+ */
+
+#ifndef _TEST_ACLCLIENT_H_
+#define _TEST_ACLCLIENT_H_
+
+#include <security_cdsa_utilities/cssmaclpod.h>
+
+namespace CssmClient
+{
+
+class AclFactory
+{
+public:
+	static AclSubject NobodySubject(Allocator &) { return AclSubject(); }
+	static AclSubject AnySubject(Allocator &) { return AclSubject(); }
+};
+
+}
+
+#endif
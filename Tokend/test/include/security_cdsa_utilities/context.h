@@ -0,0 +1,13 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/context.h>.
+ */
+
+#ifndef _TEST_CONTEXT_H_
+#define _TEST_CONTEXT_H_
+
+#include <security_cdsa_utilities/cssmdata.h>
+
+class Context;
+class CssmKey;
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmaclpod.h>: ACLs are
+ *  not exercised by the host tests, these only let the sources compile.
+ */
+
+#ifndef _TEST_CSSMACLPOD_H_
+#define _TEST_CSSMACLPOD_H_
+
+#include <Security/cssmtype.h>
+
+enum { CSSM_ACL_AUTHORIZATION_DB_READ = 20 };
+
+class Allocator
+{
+public:
+	static Allocator &standard() { static Allocator allocator; return allocator; }
+};
+
+struct AclSubject
+{
+};
+
+class AclAuthorizationSet
+{
+public:
+	AclAuthorizationSet(uint32, ...) {}
+};
+
+class AclOwnerPrototype
+{
+};
+
+class AutoAclOwnerPrototype : public AclOwnerPrototype
+{
+public:
+	AutoAclOwnerPrototype() : mSet(false) {}
+	bool operator ! () const { return !mSet; }
+	void allocator(Allocator &) {}
+	AutoAclOwnerPrototype &operator = (const AclSubject &)
+		{ mSet = true; return *this; }
+
+private:
+	bool mSet;
+};
+
+class AclEntryInfo
+{
+};
+
+class AutoAclEntryInfoList
+{
+public:
+	AutoAclEntryInfoList() : mCount(0) {}
+	bool operator ! () const { return mCount == 0; }
+	void allocator(Allocator &) {}
+	Allocator &allocator() const { return Allocator::standard(); }
+	void add(const AclSubject &, const AclAuthorizationSet &) { mCount = 1; }
+	uint32 size() const { return mCount; }
+	AclEntryInfo *entries() { return &mEntry; }
+
+private:
+	uint32 mCount;
+	AclEntryInfo mEntry;
+};
+
+class AclEntryPrototype;
+class AclEdit;
+
+#endif
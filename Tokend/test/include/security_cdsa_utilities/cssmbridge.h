@@ -0,0 +1,9 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmbridge.h>: nothing the
+ *  tested sources use.
+ */
+
+#ifndef _TEST_CSSMBRIDGE_H_
+#define _TEST_CSSMBRIDGE_H_
+
+#endif
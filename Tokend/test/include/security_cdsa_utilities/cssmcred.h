@@ -0,0 +1,10 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmcred.h>.
+ */
+
+#ifndef _TEST_CSSMCRED_H_
+#define _TEST_CSSMCRED_H_
+
+class AccessCredentials;
+
+#endif
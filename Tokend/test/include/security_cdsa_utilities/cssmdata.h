@@ -0,0 +1,76 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmdata.h>.
+ */
+
+#ifndef _TEST_CSSMDATA_H_
+#define _TEST_CSSMDATA_H_
+
+#include <security_utilities/utilities.h>
+#include <security_cdsa_utilities/cssmerrors.h>
+#include <stdlib.h>
+#include <string.h>
+
+class CssmData : public CSSM_DATA
+{
+public:
+	CssmData() { Length = 0; Data = NULL; }
+	CssmData(void *data, size_t length)
+		{ Length = length; Data = static_cast<uint8 *>(data); }
+
+	static CssmData &overlay(CSSM_DATA &data)
+		{ return static_cast<CssmData &>(data); }
+	static const CssmData &overlay(const CSSM_DATA &data)
+		{ return static_cast<const CssmData &>(data); }
+
+	size_t length() const { return Length; }
+	uint8 *data() const { return Data; }
+};
+
+// Owns a malloc'ed copy of the data it is assigned
+class CssmDataContainer : public CssmData
+{
+public:
+	CssmDataContainer() {}
+	~CssmDataContainer() { free(Data); }
+
+	CssmDataContainer &operator = (const CSSM_DATA &data)
+	{
+		uint8 *copy = static_cast<uint8 *>(malloc(data.Length ? data.Length : 1));
+		memcpy(copy, data.Data, data.Length);
+		free(Data);
+		Data = copy;
+		Length = data.Length;
+		return *this;
+	}
+
+private:
+	CssmDataContainer(const CssmDataContainer &);
+	void operator = (const CssmDataContainer &);
+};
+
+class CssmOid : public CssmData
+{
+public:
+	static const CssmOid &overlay(const CSSM_OID &oid)
+		{ return static_cast<const CssmOid &>(oid); }
+};
+
+class CssmOidContainer : public CssmOid
+{
+};
+
+// Value copy of a CSSM_DATA usable as a map key
+template <class Base>
+class CssmBuffer
+{
+public:
+	CssmBuffer(const CSSM_DATA &data)
+		: mBytes(data.Data, data.Data + data.Length) {}
+	bool operator < (const CssmBuffer &other) const
+		{ return mBytes < other.mBytes; }
+
+private:
+	std::vector<uint8> mBytes;
+};
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmdb.h>.
+ */
+
+#ifndef _TEST_CSSMDB_H_
+#define _TEST_CSSMDB_H_
+
+#include <security_cdsa_utilities/cssmdata.h>
+
+// Unlike the framework class this does not copy the selection predicates,
+// they must outlive it
+class CssmAutoQuery : public CSSM_QUERY
+{
+public:
+	CssmAutoQuery() { memset(static_cast<CSSM_QUERY *>(this), 0, sizeof(CSSM_QUERY)); }
+	CssmAutoQuery(const CSSM_QUERY &query) : CSSM_QUERY(query) {}
+
+	CSSM_DB_RECORDTYPE recordType() const { return RecordType; }
+	void recordType(CSSM_DB_RECORDTYPE recordType) { RecordType = recordType; }
+};
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmerrors.h>.
+ */
+
+#ifndef _TEST_CSSMERRORS_H_
+#define _TEST_CSSMERRORS_H_
+
+#include <Security/cssmtype.h>
+#include <Security/cssmerr.h>
+#include <exception>
+
+class CssmError : public std::exception
+{
+public:
+	explicit CssmError(CSSM_RETURN err) : error(err) {}
+	const char *what() const throw() { return "CSSM error"; }
+
+	static void throwMe(CSSM_RETURN err) __attribute__((noreturn))
+		{ throw CssmError(err); }
+
+	const CSSM_RETURN error;
+};
+
+class MacOSError : public std::exception
+{
+public:
+	explicit MacOSError(OSStatus err) : error(err) {}
+	const char *what() const throw() { return "Mac OS error"; }
+
+	static void throwMe(OSStatus err) __attribute__((noreturn))
+		{ throw MacOSError(err); }
+
+	const OSStatus error;
+};
+
+#endif
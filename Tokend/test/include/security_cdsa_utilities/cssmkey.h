@@ -0,0 +1,42 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmkey.h>.
+ */
+
+#ifndef _TEST_CSSMKEY_H_
+#define _TEST_CSSMKEY_H_
+
+#include <security_cdsa_utilities/cssmpods.h>
+#include <Security/SecKey.h>
+
+class CssmKey
+{
+public:
+	struct Header
+	{
+		void cspGuid(const Guid &guid) { CspId = guid; }
+
+		CSSM_GUID CspId;
+		uint32 BlobType;
+		uint32 Format;
+		CSSM_ALGORITHMS AlgorithmId;
+		uint32 KeyClass;
+		uint32 LogicalKeySizeInBits;
+		CSSM_KEYATTR_FLAGS KeyAttr;
+		CSSM_KEYUSE KeyUsage;
+		CSSM_DATE StartDate;
+		CSSM_DATE EndDate;
+	};
+
+	CssmKey() { memset(&mHeader, 0, sizeof(mHeader)); }
+
+	Header &header() { return mHeader; }
+	void blobType(uint32 blobType) { mHeader.BlobType = blobType; }
+	void blobFormat(uint32 format) { mHeader.Format = format; }
+	void algorithm(CSSM_ALGORITHMS algorithm) { mHeader.AlgorithmId = algorithm; }
+	void keyClass(uint32 keyClass) { mHeader.KeyClass = keyClass; }
+
+private:
+	Header mHeader;
+};
+
+#endif
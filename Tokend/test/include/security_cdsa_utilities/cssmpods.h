@@ -0,0 +1,17 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/cssmpods.h>.
+ */
+
+#ifndef _TEST_CSSMPODS_H_
+#define _TEST_CSSMPODS_H_
+
+#include <Security/cssmtype.h>
+
+class Guid : public CSSM_GUID
+{
+public:
+	static const Guid &overlay(const CSSM_GUID &guid)
+		{ return static_cast<const Guid &>(guid); }
+};
+
+#endif
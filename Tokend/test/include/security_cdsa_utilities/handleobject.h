@@ -0,0 +1,21 @@
+/*
+ *  Host build stand-in for <security_cdsa_utilities/handleobject.h>: the
+ *  handle is the object address.
+ */
+
+#ifndef _TEST_HANDLEOBJECT_H_
+#define _TEST_HANDLEOBJECT_H_
+
+#include <Security/cssmtype.h>
+#include <security_utilities/utilities.h>
+
+class HandleObject
+{
+public:
+	HandleObject() {}
+	virtual ~HandleObject() {}
+
+	CSSM_HANDLE handle() const { return reinterpret_cast<CSSM_HANDLE>(this); }
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ *  Host build stand-in for <security_utilities/adornments.h>: adornments
+ *  kept in a map by key, created on first use.
+ */
+
+#ifndef _TEST_ADORNMENTS_H_
+#define _TEST_ADORNMENTS_H_
+
+#include <security_utilities/utilities.h>
+#include <map>
+
+namespace Security
+{
+
+class Adornment
+{
+public:
+	virtual ~Adornment() {}
+};
+
+class Adornable
+{
+public:
+	typedef const void *Key;
+
+	Adornable() {}
+	~Adornable()
+	{
+		for (Map::iterator it = mAdornments.begin(); it != mAdornments.end(); ++it)
+			delete it->second;
+	}
+
+	template <class Ad>
+	Ad *getAdornment(Key key) const
+	{
+		Map::const_iterator it = mAdornments.find(key);
+		return it == mAdornments.end() ? NULL : dynamic_cast<Ad *>(it->second);
+	}
+
+	template <class Ad>
+	void setAdornment(Key key, Ad *ad)
+	{
+		delete mAdornments[key];
+		mAdornments[key] = ad;
+	}
+
+	template <class Ad, class A1, class A2, class A3>
+	Ad &adornment(Key key, A1 &a1, A2 &a2, A3 &a3)
+	{
+		Adornment *&ad = mAdornments[key];
+		if (!ad)
+			ad = new Ad(a1, a2, a3);
+		return dynamic_cast<Ad &>(*ad);
+	}
+
+private:
+	Adornable(const Adornable &);
+	void operator = (const Adornable &);
+
+	typedef std::map<Key, Adornment *> Map;
+	Map mAdornments;
+};
+
+}
+
+using namespace Security;
+
+#endif
@@ -0,0 +1,11 @@
+/*
+ *  Host build stand-in for <security_utilities/debugging.h>: debug logging
+ *  is compiled out.
+ */
+
+#ifndef _TEST_DEBUGGING_H_
+#define _TEST_DEBUGGING_H_
+
+static inline void secdebug(const char *, const char *, ...) {}
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ *  Host build stand-in for <security_utilities/errors.h>.
+ */
+
+#ifndef _TEST_ERRORS_H_
+#define _TEST_ERRORS_H_
+
+#include <Security/cssmtype.h>
+#include <exception>
+
+#if !defined(NDEBUG)
+# define IFDEBUG(it)	it
+#else
+# define IFDEBUG(it)	/* do nothing */
+#endif
+
+namespace Security
+{
+
+class CommonError : public std::exception
+{
+public:
+	virtual ~CommonError() throw () {}
+	virtual OSStatus osStatus() const = 0;
+	virtual int unixError() const = 0;
+};
+
+}
+
+using namespace Security;
+
+#endif
@@ -0,0 +1,9 @@
+/*
+ *  Host build stand-in for <security_utilities/osxcode.h>: nothing the
+ *  tested sources use.
+ */
+
+#ifndef _TEST_OSXCODE_H_
+#define _TEST_OSXCODE_H_
+
+#endif
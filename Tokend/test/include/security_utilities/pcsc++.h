@@ -0,0 +1,44 @@
+/*
+ *  Host build stand-in for <security_utilities/pcsc++.h>.
+ */
+
+#ifndef _TEST_PCSCPP_H_
+#define _TEST_PCSCPP_H_
+
+#include <security_utilities/errors.h>
+#include <stdint.h>
+
+// From <PCSC/pcsclite.h>
+#define MAX_BUFFER_SIZE			264
+#define SCARD_E_PROTO_MISMATCH	0x8010000F
+
+namespace PCSC
+{
+
+class Error : public CommonError
+{
+public:
+	explicit Error(int32_t err) : error(err) {}
+	OSStatus osStatus() const { return error; }
+	int unixError() const { return -1; }
+	const char *what() const throw () { return "PCSC error"; }
+
+	static void throwMe(int32_t err) __attribute__((noreturn))
+		{ throw Error(err); }
+
+	const int32_t error;
+};
+
+class Session
+{
+};
+
+class Card
+{
+public:
+	virtual ~Card() {}
+};
+
+}
+
+#endif
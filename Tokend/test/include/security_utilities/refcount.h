@@ -0,0 +1,52 @@
+/*
+ *  Host build stand-in for <security_utilities/refcount.h>, single threaded.
+ */
+
+#ifndef _TEST_REFCOUNT_H_
+#define _TEST_REFCOUNT_H_
+
+#include <security_utilities/utilities.h>
+#include <stddef.h>
+
+class RefCount
+{
+public:
+	RefCount() : mRefCount(0) {}
+
+	void ref() const { ++mRefCount; }
+	unsigned int unref() const { return --mRefCount; }
+
+private:
+	mutable unsigned int mRefCount;
+};
+
+template <class T>
+class RefPointer
+{
+public:
+	RefPointer() : ptr(NULL) {}
+	RefPointer(T *p) : ptr(p) { if (ptr) ptr->ref(); }
+	RefPointer(const RefPointer &other) : ptr(other.ptr) { if (ptr) ptr->ref(); }
+	~RefPointer() { release(); }
+
+	RefPointer &operator = (const RefPointer &other)
+	{
+		if (other.ptr)
+			other.ptr->ref();
+		release();
+		ptr = other.ptr;
+		return *this;
+	}
+
+	T *get() const { return ptr; }
+	T *operator -> () const { return ptr; }
+	T &operator * () const { return *ptr; }
+	operator T * () const { return ptr; }
+
+private:
+	void release() { if (ptr && ptr->unref() == 0) delete ptr; }
+
+	T *ptr;
+};
+
+#endif
@@ -0,0 +1,9 @@
+/*
+ *  Host build stand-in for <security_utilities/trackingallocator.h>: nothing the
+ *  tested sources use.
+ */
+
+#ifndef _TEST_TRACKINGALLOCATOR_H_
+#define _TEST_TRACKINGALLOCATOR_H_
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ *  Host build stand-in for <security_utilities/utilities.h>: only what the
+ *  portable tokend sources use.
+ */
+
+#ifndef _TEST_SECURITY_UTILITIES_H_
+#define _TEST_SECURITY_UTILITIES_H_
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <security_utilities/debugging.h>
+
+#define NOCOPY(Type)    private: Type(const Type &); void operator = (const Type &);
+
+template <class Iterator>
+inline void for_each_delete(Iterator begin, Iterator end)
+{
+	while (begin != end)
+		delete *begin++;
+}
+
+// The framework headers make the std names visible to the tokend sources
+using namespace std;
+
+#endif
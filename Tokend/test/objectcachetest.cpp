@@ -0,0 +1,500 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  objectcachetest.cpp
+ *
+ *  Checks of the tokend object cache (Tokend/ObjectCache.cpp) keyed by the
+ *  content of a simulated CAC card (CAC/CACContent.h): reissued cards do
+ *  not see the objects of their predecessor, and files that were altered,
+ *  truncated, sealed without the secret or with another one are discarded.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ObjectCache.h"
+#include "CACContent.h"
+#include <CommonCrypto/CommonDigest.h>
+
+using Tokend::ObjectCache;
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+#define SELECT_CAC_APPLET_PKI	0x00, 0xA4, 0x04, 0x00, 0x07, 0xA0, 0x00, 0x00, 0x00, 0x79, 0x01
+
+static const unsigned char kSelectPKIID[]   = { SELECT_CAC_APPLET_PKI, 0x00 };
+static const unsigned char kSelectPKIESig[] = { SELECT_CAC_APPLET_PKI, 0x01 };
+static const unsigned char kSelectPKIECry[] = { SELECT_CAC_APPLET_PKI, 0x02 };
+static const unsigned char *const kCertificateApplets[] =
+	{ kSelectPKIID, kSelectPKIESig, kSelectPKIECry };
+static const size_t kAppletCount = sizeof(kCertificateApplets) / sizeof(kCertificateApplets[0]);
+static const size_t kSelectSize = sizeof(kSelectPKIID);
+
+typedef std::vector<unsigned char> Bytes;
+
+//
+// CAC card answering SELECT and GET CERTIFICATE (80 36) like the PKI applets:
+// blocks of at most Le bytes, 63xx while data is left with xx the next size
+//
+class VirtualCAC
+{
+public:
+	VirtualCAC() : mSelects(0), mExchanges(0), mSelected(-1), mOffset(0) {}
+
+	void setCertificate(size_t applet, const Bytes &certificate)
+	{
+		mCertificates[applet] = certificate;
+	}
+
+	void select(const unsigned char *applet)
+	{
+		mSelects++;
+		mSelected = -1;
+		for (size_t i = 0; i < kAppletCount; i++)
+			if (!memcmp(applet, kCertificateApplets[i], kSelectSize)
+				&& mCertificates.count(i))
+				mSelected = i;
+		if (mSelected < 0)
+			throw 0x6A82;
+		mOffset = 0;
+	}
+
+	uint32_t exchangeAPDU(const unsigned char *apdu, size_t apduLength,
+		unsigned char *result, size_t &resultLength)
+	{
+		mExchanges++;
+		if (mSelected < 0 || apduLength != 5 || apdu[0] != 0x80 || apdu[1] != 0x36)
+			return reply(0x6D00, result, resultLength);
+
+		const Bytes &certificate = mCertificates[mSelected];
+		size_t count = std::min<size_t>(apdu[4], certificate.size() - mOffset);
+		if (count + 2 > resultLength)
+			return reply(0x6700, result, resultLength);
+		memcpy(result, &certificate[mOffset], count);
+		mOffset += count;
+		size_t left = certificate.size() - mOffset;
+		uint32_t sw = left ? 0x6300 | std::min<size_t>(left, CAC_CERTIFICATE_HEAD_SIZE) : 0x9000;
+		result[count] = sw >> 8;
+		result[count + 1] = sw & 0xFF;
+		resultLength = count + 2;
+		return sw;
+	}
+
+	/* Reads a whole certificate as CACCertificateRecord does */
+	Bytes readCertificate(size_t applet)
+	{
+		Bytes certificate;
+		unsigned char command[] = { 0x80, 0x36, 0x00, 0x00, 0x64 };
+		select(kCertificateApplets[applet]);
+		uint32_t sw;
+		do
+		{
+			unsigned char result[0x102];
+			size_t resultLength = sizeof(result);
+			sw = exchangeAPDU(command, sizeof(command), result, resultLength);
+			certificate.insert(certificate.end(), result, result + resultLength - 2);
+			command[4] = sw & 0xFF;
+		} while ((sw & 0xFF00) == 0x6300);
+		return certificate;
+	}
+
+	unsigned int mSelects;
+	unsigned int mExchanges;
+
+private:
+	uint32_t reply(uint32_t sw, unsigned char *result, size_t &resultLength)
+	{
+		result[0] = sw >> 8;
+		result[1] = sw & 0xFF;
+		resultLength = 2;
+		return sw;
+	}
+
+	std::map<size_t, Bytes> mCertificates;
+	int mSelected;
+	size_t mOffset;
+};
+
+/* DER certificate of the given size whose serial number is at its start */
+static Bytes makeCertificate(uint32_t serial, size_t size)
+{
+	Bytes certificate(size);
+	static const unsigned char head[] = {
+		0x30, 0x82, 0x00, 0x00, 0x30, 0x82, 0x00, 0x00,
+		0xA0, 0x03, 0x02, 0x01, 0x02, 0x02, 0x04 };
+	memcpy(&certificate[0], head, sizeof(head));
+	certificate[sizeof(head)] = serial >> 24;
+	certificate[sizeof(head) + 1] = serial >> 16;
+	certificate[sizeof(head) + 2] = serial >> 8;
+	certificate[sizeof(head) + 3] = serial;
+	for (size_t i = sizeof(head) + 4; i < size; i++)
+		certificate[i] = (unsigned char)(i * 13);
+	return certificate;
+}
+
+/* A card with three certificates, as issued with the given serial numbers */
+static void issue(VirtualCAC &card, uint32_t serial)
+{
+	card.setCertificate(0, makeCertificate(serial, 1200));
+	card.setCertificate(1, makeCertificate(serial + 1, 1100));
+	card.setCertificate(2, makeCertificate(serial + 2, 1150));
+}
+
+static Bytes content(VirtualCAC &card)
+{
+	Bytes content;
+	cacCertificateContent(card, kCertificateApplets, kAppletCount, content);
+	return content;
+}
+
+static std::string sCacheDirectory;
+static std::string sWorkDirectory;
+
+static std::string makeDirectory(const char *name)
+{
+	char path[] = "/tmp/objectcachetest.XXXXXX";
+	if (!mkdtemp(path))
+	{
+		perror("mkdtemp");
+		exit(1);
+	}
+	std::string directory = std::string(path) + "/" + name;
+	if (mkdir(directory.c_str(), 0700))
+	{
+		perror("mkdir");
+		exit(1);
+	}
+	return directory;
+}
+
+static void removeDirectory(const std::string &directory)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (dir)
+	{
+		struct dirent *entry;
+		while ((entry = readdir(dir)))
+			if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+				unlink((directory + "/" + entry->d_name).c_str());
+		closedir(dir);
+	}
+	rmdir(directory.c_str());
+	rmdir(directory.substr(0, directory.rfind('/')).c_str());
+}
+
+static void openCache(ObjectCache &cache, VirtualCAC &card)
+{
+	Bytes data = content(card);
+	cache.open(sCacheDirectory, sWorkDirectory);
+	cache.fingerprint(&data[0], data.size());
+}
+
+static ObjectCache::Result lookup(const ObjectCache &cache, const std::string &name, Bytes *object = NULL)
+{
+	unsigned char *data;
+	size_t length;
+	ObjectCache::Result result = cache.get(0, name, data, length);
+	if (object && data)
+		object->assign(data, data + length);
+	free(data);
+	return result;
+}
+
+static Bytes readFile(const std::string &path)
+{
+	Bytes data;
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (fp)
+	{
+		int c;
+		while ((c = fgetc(fp)) != EOF)
+			data.push_back(c);
+		fclose(fp);
+	}
+	return data;
+}
+
+static void writeFile(const std::string &path, const Bytes &data)
+{
+	FILE *fp = fopen(path.c_str(), "wb");
+	if (fp)
+	{
+		if (!data.empty())
+			fwrite(&data[0], 1, data.size(), fp);
+		fclose(fp);
+	}
+}
+
+static bool exists(const std::string &path)
+{
+	struct stat st;
+	return !stat(path.c_str(), &st);
+}
+
+/* One GET CERTIFICATE block per applet, and the certificates still read whole */
+static void testContent()
+{
+	VirtualCAC card;
+	issue(card, 0x1000);
+	Bytes data = content(card);
+	CHECK(card.mSelects == kAppletCount);
+	CHECK(card.mExchanges == kAppletCount);
+	CHECK(data.size() == kAppletCount * (3 + CAC_CERTIFICATE_HEAD_SIZE));
+	CHECK(data[1] == 0x63 && data[2] == CAC_CERTIFICATE_HEAD_SIZE);
+
+	/* Reading after a new selection starts from the beginning */
+	CHECK(card.readCertificate(1) == makeCertificate(0x1001, 1100));
+
+	/* Same certificates, same content */
+	VirtualCAC same;
+	issue(same, 0x1000);
+	CHECK(content(same) == data);
+
+	/* A missing applet is part of the content */
+	VirtualCAC partial;
+	partial.setCertificate(0, makeCertificate(0x1000, 1200));
+	partial.setCertificate(1, makeCertificate(0x1001, 1100));
+	Bytes partialData = content(partial);
+	CHECK(partialData != data);
+	CHECK(partialData.size() == 2 * (3 + CAC_CERTIFICATE_HEAD_SIZE) + 3);
+}
+
+/* A reissued card does not see the certificates cached for the previous one */
+static void testReissuedCard()
+{
+	VirtualCAC card;
+	issue(card, 0x1000);
+	Bytes certificate = card.readCertificate(0);
+
+	ObjectCache first;
+	openCache(first, card);
+	CHECK(lookup(first, "Identity Certificate") == ObjectCache::kMissing);
+	CHECK(first.put(0, "Identity Certificate", &certificate[0], certificate.size()));
+
+	/* Same card inserted again */
+	ObjectCache again;
+	openCache(again, card);
+	Bytes cached;
+	CHECK(lookup(again, "Identity Certificate", &cached) == ObjectCache::kFound);
+	CHECK(cached == certificate);
+
+	/* Reissued: new certificates, the chip and its CPLC data unchanged */
+	VirtualCAC reissued;
+	issue(reissued, 0x2000);
+	ObjectCache other;
+	openCache(other, reissued);
+	CHECK(other.path(0, "Identity Certificate") != again.path(0, "Identity Certificate"));
+	CHECK(lookup(other, "Identity Certificate") == ObjectCache::kMissing);
+	/* The previous card's file is left alone */
+	CHECK(exists(again.path(0, "Identity Certificate")));
+}
+
+static void testDiscarded()
+{
+	VirtualCAC card;
+	issue(card, 0x3000);
+	Bytes certificate = card.readCertificate(2);
+	ObjectCache cache;
+	openCache(cache, card);
+	std::string name("Email Encryption Certificate");
+	std::string path(cache.path(0, name));
+
+	/* One altered byte */
+	CHECK(cache.put(0, name, &certificate[0], certificate.size()));
+	Bytes file = readFile(path);
+	CHECK(file.size() == CC_SHA1_DIGEST_LENGTH + certificate.size());
+	file[file.size() / 2] ^= 0x01;
+	writeFile(path, file);
+	CHECK(lookup(cache, name) == ObjectCache::kDiscarded);
+	CHECK(!exists(path));
+	CHECK(lookup(cache, name) == ObjectCache::kMissing);
+
+	/* Truncated to less than the MAC */
+	CHECK(cache.put(0, name, &certificate[0], certificate.size()));
+	writeFile(path, Bytes(10, 0));
+	CHECK(lookup(cache, name) == ObjectCache::kDiscarded);
+
+	/* Sealed with the unkeyed digest anyone can compute */
+	Bytes data = content(card);
+	unsigned char fingerprint[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1(&data[0], data.size(), fingerprint);
+	uint32_t relationId = 0;
+	unsigned char md[CC_SHA1_DIGEST_LENGTH];
+	CC_SHA1_CTX ctx;
+	CC_SHA1_Init(&ctx);
+	CC_SHA1_Update(&ctx, &relationId, sizeof(relationId));
+	CC_SHA1_Update(&ctx, name.c_str(), name.length());
+	CC_SHA1_Update(&ctx, fingerprint, sizeof(fingerprint));
+	CC_SHA1_Update(&ctx, &certificate[0], certificate.size());
+	CC_SHA1_Final(md, &ctx);
+	Bytes forged(md, md + sizeof(md));
+	forged.insert(forged.end(), certificate.begin(), certificate.end());
+	writeFile(path, forged);
+	CHECK(lookup(cache, name) == ObjectCache::kDiscarded);
+
+	/* Sealed under the secret of another work directory */
+	std::string otherWork = makeDirectory("work");
+	ObjectCache other;
+	other.open(sCacheDirectory, otherWork);
+	other.fingerprint(&data[0], data.size());
+	CHECK(other.path(0, name) == path);
+	CHECK(other.put(0, name, &certificate[0], certificate.size()));
+	CHECK(lookup(cache, name) == ObjectCache::kDiscarded);
+	removeDirectory(otherWork);
+}
+
+static size_t countFiles(const std::string &directory)
+{
+	size_t count = 0;
+	DIR *dir = opendir(directory.c_str());
+	if (dir)
+	{
+		struct dirent *entry;
+		while ((entry = readdir(dir)))
+			if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+				count++;
+		closedir(dir);
+	}
+	return count;
+}
+
+/* A rewritten cache file is replaced whole, never truncated under a reader */
+static void testReplaced()
+{
+	std::string cacheDirectory = makeDirectory("cache");
+	VirtualCAC card;
+	issue(card, 0x5000);
+	Bytes data = content(card);
+	Bytes first = card.readCertificate(0);
+	Bytes second = card.readCertificate(1);
+	ObjectCache cache;
+	cache.open(cacheDirectory, sWorkDirectory);
+	cache.fingerprint(&data[0], data.size());
+	std::string name("Identity Certificate");
+	std::string path(cache.path(0, name));
+
+	CHECK(cache.put(0, name, &first[0], first.size()));
+	Bytes before = readFile(path);
+	int reader = open(path.c_str(), O_RDONLY);
+	CHECK(reader >= 0);
+
+	CHECK(cache.put(0, name, &second[0], second.size()));
+	Bytes object;
+	CHECK(lookup(cache, name, &object) == ObjectCache::kFound);
+	CHECK(object == second);
+	// No temporary file is left behind
+	CHECK(countFiles(cacheDirectory) == 1);
+
+	// The file opened before still has the first object, all of it
+	Bytes held(before.size() + 1);
+	CHECK(read(reader, &held[0], held.size()) == (ssize_t)before.size());
+	held.resize(before.size());
+	CHECK(held == before);
+	close(reader);
+
+	/* A directory it cannot write to leaves the cache file as it was */
+	chmod(cacheDirectory.c_str(), 0500);
+	if (access(cacheDirectory.c_str(), W_OK))
+	{
+		CHECK(!cache.put(0, name, &first[0], first.size()));
+		CHECK(lookup(cache, name, &object) == ObjectCache::kFound);
+		CHECK(object == second);
+	}
+	chmod(cacheDirectory.c_str(), 0700);
+	CHECK(countFiles(cacheDirectory) == 1);
+
+	removeDirectory(cacheDirectory);
+}
+
+static void testSecret()
+{
+	std::string work = makeDirectory("work");
+	std::string secret = work + "/" + ObjectCache::kSecretName;
+	VirtualCAC card;
+	issue(card, 0x4000);
+	Bytes data = content(card);
+	Bytes certificate = card.readCertificate(0);
+
+	ObjectCache cache;
+	cache.open(sCacheDirectory, work);
+	cache.fingerprint(&data[0], data.size());
+	CHECK(!exists(secret));
+	CHECK(cache.put(0, "Identity Certificate", &certificate[0], certificate.size()));
+
+	/* Created on first use, owner only, outside the cache directory */
+	struct stat st;
+	CHECK(!stat(secret.c_str(), &st));
+	CHECK((st.st_mode & 0777) == 0600);
+	CHECK(st.st_size == (off_t)ObjectCache::kSecretSize);
+	CHECK(!exists(sCacheDirectory + "/" + ObjectCache::kSecretName));
+
+	/* A secret others can read is not used: nothing is read or written */
+	chmod(secret.c_str(), 0644);
+	ObjectCache exposed;
+	exposed.open(sCacheDirectory, work);
+	exposed.fingerprint(&data[0], data.size());
+	CHECK(lookup(exposed, "Identity Certificate") == ObjectCache::kMissing);
+	unlink(exposed.path(0, "Identity Certificate").c_str());
+	CHECK(exposed.put(0, "Identity Certificate", &certificate[0], certificate.size()));
+	CHECK(!exists(exposed.path(0, "Identity Certificate")));
+
+	/* No work directory, no cache */
+	ObjectCache unopened;
+	CHECK(lookup(unopened, "Identity Certificate") == ObjectCache::kMissing);
+
+	removeDirectory(work);
+}
+
+int main()
+{
+	sCacheDirectory = makeDirectory("cache");
+	sWorkDirectory = makeDirectory("work");
+
+	testContent();
+	testReissuedCard();
+	testDiscarded();
+	testReplaced();
+	testSecret();
+
+	removeDirectory(sCacheDirectory);
+	removeDirectory(sWorkDirectory);
+
+	if (sFailures)
+	{
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("object cache checks passed\n");
+	return 0;
+}
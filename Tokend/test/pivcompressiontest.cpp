@@ -0,0 +1,240 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  pivcompressiontest.cpp
+ *
+ *  Checks of the inflating of compressed PIV certificates
+ *  (PIV/PIVCompression.h): the output buffer sized from the gzip ISIZE
+ *  trailer or from the DER header, the single retry with the largest PIV
+ *  object size when the declared size is short, and corrupt input.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PIVCompression.h"
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+/* A DER SEQUENCE of valueLength bytes, about as compressible as a certificate */
+static byte_string makeCertificate(size_t valueLength)
+{
+	byte_string der(1, 0x30);
+	der.push_back(0x82);
+	der.push_back(valueLength >> 8);
+	der.push_back(valueLength & 0xFF);
+	uint32_t seed = 1;
+	for (size_t ix = 0; ix < valueLength; ++ix)
+	{
+		seed = seed * 1103515245 + 12345;
+		der.push_back(ix % 4 ? (unsigned char)(seed >> 24) : 0x02);
+	}
+	return der;
+}
+
+/* windowBits 15 for a zlib stream, 15 + 16 for a gzip one */
+static byte_string deflateData(const byte_string &data, int windowBits)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+	byte_string compressed(deflateBound(&stream, data.size()) + 32);
+	stream.next_in = (Bytef *)&data[0];
+	stream.avail_in = data.size();
+	stream.next_out = &compressed[0];
+	stream.avail_out = compressed.size();
+	CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+	compressed.resize(stream.total_out);
+	deflateEnd(&stream);
+	return compressed;
+}
+
+static void setISize(byte_string &gzip, uint32_t size)
+{
+	byte_string::iterator trailer = gzip.end() - 4;
+	trailer[0] = size & 0xFF;
+	trailer[1] = (size >> 8) & 0xFF;
+	trailer[2] = (size >> 16) & 0xFF;
+	trailer[3] = size >> 24;
+}
+
+static void testCompressionType()
+{
+	byte_string certificate = makeCertificate(1200);
+	CHECK(compressionType(deflateData(certificate, 15 + 16)) == kCompressionGzip);
+	CHECK(compressionType(deflateData(certificate, 15)) == kCompressionZlib);
+	CHECK(compressionType(byte_string(1, 0x78)) == kCompressionUnknown);
+}
+
+static void testGzipDeclaredSize()
+{
+	byte_string gzip = deflateData(makeCertificate(1200), 15 + 16);
+	CHECK(gzipDeclaredSize(gzip) == 4 + 1200);
+	setISize(gzip, 0x12345678);
+	CHECK(gzipDeclaredSize(gzip) == 0x12345678);
+	setISize(gzip, 0xFFFFFFFF);
+	CHECK(gzipDeclaredSize(gzip) == 0xFFFFFFFF);
+	// Shorter than an empty gzip stream
+	CHECK(gzipDeclaredSize(byte_string(17, 0xFF)) == 0);
+	CHECK(gzipDeclaredSize(byte_string()) == 0);
+}
+
+/* The buffer is allocated once with the size declared by ISIZE */
+static void testGzipSizing()
+{
+	byte_string certificate = makeCertificate(1500);
+	byte_string uncompressed;
+	CHECK(uncompressData(uncompressed, deflateData(certificate, 15 + 16), kCompressionGzip) == Z_OK);
+	CHECK(uncompressed == certificate);
+	CHECK(uncompressed.capacity() == certificate.size());
+
+	// Bytes after the certificate, which its DER header does not count
+	byte_string padded(certificate);
+	padded.resize(padded.size() + 300, 0xFF);
+	byte_string uncompressedPadded;
+	CHECK(uncompressData(uncompressedPadded, deflateData(padded, 15 + 16), kCompressionGzip) == Z_OK);
+	CHECK(uncompressedPadded == padded);
+	CHECK(uncompressedPadded.capacity() == padded.size());
+
+	// ISIZE over the largest PIV object is not trusted, the stream is still
+	// inflated, then its length check fails
+	byte_string gzip = deflateData(certificate, 15 + 16);
+	setISize(gzip, PIV_MAX_DATA_SIZE + 1);
+	CHECK(uncompressData(uncompressed, gzip, kCompressionGzip) == Z_DATA_ERROR);
+	CHECK(uncompressed.capacity() == PIV_MAX_DATA_SIZE);
+}
+
+/* Without ISIZE the length is read from the DER header, inflated first */
+static void testDerSizing()
+{
+	byte_string certificate = makeCertificate(1500);
+	byte_string uncompressed;
+	CHECK(uncompressData(uncompressed, deflateData(certificate, 15), kCompressionZlib) == Z_OK);
+	CHECK(uncompressed == certificate);
+	CHECK(uncompressed.capacity() == certificate.size());
+
+	// Short form length
+	byte_string small = makeCertificate(100);
+	small.erase(small.begin() + 1, small.begin() + 3);
+	small[1] = 100;
+	byte_string uncompressedSmall;
+	CHECK(uncompressData(uncompressedSmall, deflateData(small, 15), kCompressionZlib) == Z_OK);
+	CHECK(uncompressedSmall == small);
+	CHECK(uncompressedSmall.capacity() == small.size());
+
+	// Shorter than the DER header read ahead
+	const unsigned char tiny[] = { 0x05, 0x00 };
+	byte_string null(tiny, tiny + sizeof(tiny));
+	CHECK(uncompressData(uncompressed, deflateData(null, 15), kCompressionZlib) == Z_OK);
+	CHECK(uncompressed == null);
+}
+
+/*
+	A declared size short of the data gets one retry with the largest PIV
+	object size.  Data that does not fit that either is refused.
+*/
+static void testShortDeclaredSize()
+{
+	// A certificate followed by bytes its DER header does not count
+	byte_string padded = makeCertificate(1500);
+	padded.resize(padded.size() + 300, 0xFF);
+	byte_string uncompressed;
+	CHECK(uncompressData(uncompressed, deflateData(padded, 15), kCompressionZlib) == Z_OK);
+	CHECK(uncompressed == padded);
+	CHECK(uncompressed.capacity() == PIV_MAX_DATA_SIZE);
+
+	// ISIZE smaller than the data: the retry inflates it all, then the gzip
+	// length check fails
+	byte_string certificate = makeCertificate(1500);
+	byte_string gzip = deflateData(certificate, 15 + 16);
+	setISize(gzip, 1000);
+	CHECK(uncompressData(uncompressed, gzip, kCompressionGzip) == Z_DATA_ERROR);
+	CHECK(uncompressed.size() == PIV_MAX_DATA_SIZE);
+	CHECK(std::equal(certificate.begin(), certificate.end(), uncompressed.begin()));
+
+	// More than the largest PIV object, with ISIZE and with a DER header
+	byte_string huge = makeCertificate(PIV_MAX_DATA_SIZE + 100);
+	CHECK(uncompressData(uncompressed, deflateData(huge, 15 + 16), kCompressionGzip) == Z_BUF_ERROR);
+	CHECK(uncompressed.size() == PIV_MAX_DATA_SIZE);
+	huge[2] = 0x01;
+	CHECK(uncompressData(uncompressed, deflateData(huge, 15), kCompressionZlib) == Z_BUF_ERROR);
+	CHECK(uncompressed.size() == PIV_MAX_DATA_SIZE);
+}
+
+static void testCorruptInput()
+{
+	byte_string certificate = makeCertificate(1500);
+	byte_string zlib = deflateData(certificate, 15);
+	byte_string gzip = deflateData(certificate, 15 + 16);
+	byte_string uncompressed;
+
+	// Cut short
+	CHECK(uncompressData(uncompressed, byte_string(zlib.begin(), zlib.begin() + zlib.size() / 2), kCompressionZlib) != Z_OK);
+	CHECK(uncompressData(uncompressed, byte_string(zlib.begin(), zlib.begin() + 4), kCompressionZlib) != Z_OK);
+	CHECK(uncompressData(uncompressed, byte_string(gzip.begin(), gzip.begin() + gzip.size() / 2), kCompressionGzip) != Z_OK);
+	CHECK(uncompressData(uncompressed, byte_string(gzip.begin(), gzip.end() - 1), kCompressionGzip) != Z_OK);
+
+	// Altered
+	byte_string altered(zlib);
+	altered[altered.size() / 2] ^= 0x55;
+	CHECK(uncompressData(uncompressed, altered, kCompressionZlib) != Z_OK);
+	altered = gzip;
+	altered[altered.size() / 2] ^= 0x55;
+	CHECK(uncompressData(uncompressed, altered, kCompressionGzip) != Z_OK);
+	altered = gzip;
+	altered[gzip.size() - 6] ^= 0x01;	// CRC
+	CHECK(uncompressData(uncompressed, altered, kCompressionGzip) == Z_DATA_ERROR);
+
+	// Not compressed at all
+	CHECK(uncompressData(uncompressed, certificate, kCompressionZlib) == Z_DATA_ERROR);
+	CHECK(uncompressData(uncompressed, byte_string(32, 0xFF), kCompressionGzip) == Z_DATA_ERROR);
+
+	bool thrown = false;
+	try {
+		uncompressData(uncompressed, zlib, kCompressionUnknown);
+	} catch (const CssmError &e) {
+		thrown = e.error == (CSSM_RETURN)CSSMERR_DL_DATABASE_CORRUPT;
+	}
+	CHECK(thrown);
+}
+
+int main(int argc, char *argv[])
+{
+	testCompressionType();
+	testGzipDeclaredSize();
+	testGzipSizing();
+	testDerSizing();
+	testShortDeclaredSize();
+	testCorruptInput();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("PIV compression checks passed\n");
+	return 0;
+}
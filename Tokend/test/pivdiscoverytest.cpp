@@ -0,0 +1,300 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  pivdiscoverytest.cpp
+ *
+ *  Checks of the PIV certificate discovery (PIV/PIVDiscovery.h) against a
+ *  simulated card that counts the APDUs it gets: the certificates found
+ *  with and without a usable Key History object, and how many exchanges
+ *  each path takes.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+#include "PIVDiscovery.h"
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+/* The certificate objects in PIVToken::populate() order */
+static const unsigned char kCertificateOIDs[][3] =
+{
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_PIV_AUTHENTICATION },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_DIGITAL_SIGNATURE },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_CARD_AUTHENTICATION },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H1 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H2 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H3 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H4 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H5 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H6 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H7 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H8 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H9 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H10 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H11 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H12 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H13 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H14 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H15 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H16 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H17 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H18 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H19 },
+	{ PIV_OBJECT_ID_X509_CERTIFICATE_KEY_MANAGEMENT_H20 }
+};
+static const unsigned int kCertificateSlots = sizeof(kCertificateOIDs) / sizeof(kCertificateOIDs[0]);
+
+static const unsigned char kKeyHistoryOID[] = { PIV_OBJECT_ID_KEY_HISTORY };
+
+#define OID(bytes)	byte_string(bytes, bytes + 3)
+
+/*
+	A card with the PIV applet already selected.  A GET DATA answers at most
+	256 bytes and 61xx for the rest, which GET RESPONSE hands out.
+*/
+class VirtualPIV
+{
+public:
+	VirtualPIV() : exchanges(0) {}
+
+	uint16_t exchangeAPDU(const byte_string &apdu, byte_string &result);
+	void getDataCore(const byte_string &oid, const char *description, bool isCertificate,
+		bool allowCaching, byte_string &data);
+
+	void putObject(const byte_string &oid, const byte_string &value);
+	void putCertificate(unsigned int slot, size_t size);
+
+	unsigned int exchanges;
+	std::map<byte_string, byte_string> objects;	// 53 TLV by object ID
+	std::map<byte_string, uint16_t> failures;	// status returned instead
+	byte_string pending;						// what GET RESPONSE hands out
+};
+
+uint16_t VirtualPIV::exchangeAPDU(const byte_string &apdu, byte_string &result)
+{
+	exchanges++;
+	uint16_t sw = SCARD_SUCCESS;
+	size_t length = 0;
+	if (apdu.size() >= 10 && apdu[1] == 0xCB)
+	{
+		byte_string oid(apdu.begin() + PIV_GETDATA_APDU_INDEX_OID, apdu.begin() + PIV_GETDATA_APDU_INDEX_OID + 3);
+		pending.clear();
+		if (failures.count(oid))
+			sw = failures[oid];
+		else if (!objects.count(oid))
+			sw = SCARD_FILE_NOT_FOUND;
+		else
+			pending = objects[oid];
+		length = 256;
+	}
+	else if (apdu.size() == 5 && apdu[1] == 0xC0)
+		length = apdu[4] ? apdu[4] : 256;
+	else
+		sw = 0x6D00;
+
+	if (sw == SCARD_SUCCESS)
+	{
+		length = std::min(length, pending.size());
+		result.insert(result.end(), pending.begin(), pending.begin() + length);
+		pending.erase(pending.begin(), pending.begin() + length);
+		if (!pending.empty())
+			sw = 0x6100 | (pending.size() > 255 ? 0 : pending.size());
+	}
+	return sw;
+}
+
+/* What PIVToken::getDataCore() sends, without the cache and the certificate parsing */
+void VirtualPIV::getDataCore(const byte_string &oid, const char *, bool, bool, byte_string &data)
+{
+	static const unsigned char getDataTemplate[] = { PIV_GETDATA_APDU_TEMPLATE };
+	byte_string apdu(getDataTemplate, getDataTemplate + PIV_GETDATA_APDU_INDEX_OID);
+	apdu[PIV_GETDATA_APDU_INDEX_LEN] = 0x05;
+	apdu[PIV_GETDATA_APDU_INDEX_OIDLEN] = oid.size();
+	apdu.insert(apdu.end(), oid.begin(), oid.end());
+
+	data.clear();
+	uint16_t sw = exchangeAPDU(apdu, data);
+	while ((sw >> 8) == 0x61)
+	{
+		const unsigned char getResponse[] = { 0x00, 0xC0, 0x00, 0x00, (unsigned char)(sw & 0xFF) };
+		sw = exchangeAPDU(byte_string(getResponse, getResponse + sizeof(getResponse)), data);
+	}
+	PIVError::check(sw);
+	if (data.empty() || data[0] != PIV_GETDATA_RESPONSE_TAG)
+		PIVError::throwMe(SCARD_RETURNED_DATA_CORRUPTED);
+}
+
+/* Wraps value in the 53 tag of a data object */
+void VirtualPIV::putObject(const byte_string &oid, const byte_string &value)
+{
+	byte_string object(1, PIV_GETDATA_RESPONSE_TAG);
+	object.push_back(0x82);
+	object.push_back(value.size() >> 8);
+	object.push_back(value.size() & 0xFF);
+	object.insert(object.end(), value.begin(), value.end());
+	objects[oid] = object;
+}
+
+void VirtualPIV::putCertificate(unsigned int slot, size_t size)
+{
+	byte_string value(1, PIV_GETDATA_TAG_CERTIFICATE);
+	value.push_back(0x82);
+	value.push_back(size >> 8);
+	value.push_back(size & 0xFF);
+	value.resize(value.size() + size, (unsigned char)slot);
+	const unsigned char certInfo[] = { PIV_GETDATA_TAG_CERTINFO, 0x01, 0x00, PIV_GETDATA_TAG_ERRORDETECTION, 0x00 };
+	value.insert(value.end(), certInfo, certInfo + sizeof(certInfo));
+	putObject(OID(kCertificateOIDs[slot]), value);
+}
+
+static void putKeyHistory(VirtualPIV &card, unsigned char onCard, unsigned char offCard)
+{
+	const unsigned char value[] = { PIV_KEY_HISTORY_TAG_ON_CARD_CERTS, 0x01, onCard,
+		PIV_KEY_HISTORY_TAG_OFF_CARD_CERTS, 0x01, offCard, PIV_GETDATA_TAG_ERRORDETECTION, 0x00 };
+	card.putObject(OID(kKeyHistoryOID), byte_string(value, value + sizeof(value)));
+}
+
+/* The three standard certificates of a typical card, and retired ones in
+   the first historyCount slots */
+static void makeCard(VirtualPIV &card, unsigned int historyCount)
+{
+	card.putCertificate(0, 1200);
+	card.putCertificate(1, 1150);
+	card.putCertificate(2, 1100);
+	for (unsigned int ix = 0; ix < historyCount; ++ix)
+		card.putCertificate(PIV_STANDARD_CERTIFICATES + ix, 1100);
+}
+
+/* The certificate reads of PIVToken::populate(), returns the slots found */
+static std::vector<unsigned int> discover(VirtualPIV &card)
+{
+	std::vector<unsigned int> found;
+	PIVDiscovery<VirtualPIV> discovery(card);
+	const unsigned int certCount = discovery.certificateCount(kCertificateSlots);
+	for (unsigned int ix = 0; ix < certCount; ++ix)
+	{
+		byte_string certData;
+		if (!discovery.readCertificate(kCertificateOIDs[ix], "CERT", certData))
+			continue;
+		CHECK(certData == card.objects[OID(kCertificateOIDs[ix])]);
+		found.push_back(ix);
+	}
+	return found;
+}
+
+static std::vector<unsigned int> expectedSlots(unsigned int historyCount)
+{
+	std::vector<unsigned int> slots;
+	slots.push_back(0);
+	slots.push_back(1);
+	slots.push_back(2);
+	for (unsigned int ix = 0; ix < historyCount; ++ix)
+		slots.push_back(PIV_STANDARD_CERTIFICATES + ix);
+	return slots;
+}
+
+static void testKeyHistoryValues()
+{
+	VirtualPIV card;
+	PIVDiscovery<VirtualPIV> discovery(card);
+
+	// No Key History object
+	CHECK(discovery.keyHistoryOnCardCertificates() == 0);
+	CHECK(discovery.certificateCount(kCertificateSlots) == PIV_STANDARD_CERTIFICATES);
+
+	putKeyHistory(card, 3, 1);
+	CHECK(discovery.keyHistoryOnCardCertificates() == 3);
+	CHECK(discovery.certificateCount(kCertificateSlots) == PIV_STANDARD_CERTIFICATES + 3);
+
+	// More than the 20 retired slots
+	putKeyHistory(card, 40, 0);
+	CHECK(discovery.certificateCount(kCertificateSlots) == kCertificateSlots);
+
+	// A two byte count is not understood
+	const unsigned char wideCount[] = { PIV_KEY_HISTORY_TAG_ON_CARD_CERTS, 0x02, 0x00, 0x03 };
+	card.putObject(OID(kKeyHistoryOID), byte_string(wideCount, wideCount + sizeof(wideCount)));
+	CHECK(discovery.keyHistoryOnCardCertificates() == -1);
+
+	// Nor a Key History object without the on-card count
+	const unsigned char noCount[] = { PIV_KEY_HISTORY_TAG_OFF_CARD_CERTS, 0x01, 0x02 };
+	card.putObject(OID(kKeyHistoryOID), byte_string(noCount, noCount + sizeof(noCount)));
+	CHECK(discovery.keyHistoryOnCardCertificates() == -1);
+	CHECK(discovery.certificateCount(kCertificateSlots) == kCertificateSlots);
+
+	// Nor one the card refuses to hand out
+	card.failures[OID(kKeyHistoryOID)] = 0x6982;
+	CHECK(discovery.keyHistoryOnCardCertificates() == -1);
+}
+
+/*
+	The same card read through its Key History object, and probed slot by
+	slot as when the object can not be read.  Both find the same
+	certificates, the Key History path with fewer exchanges.
+*/
+static void testExchanges(unsigned int historyCount)
+{
+	VirtualPIV card;
+	makeCard(card, historyCount);
+	putKeyHistory(card, historyCount, 0);
+
+	card.exchanges = 0;
+	std::vector<unsigned int> found = discover(card);
+	const unsigned int keyHistoryExchanges = card.exchanges;
+	CHECK(found == expectedSlots(historyCount));
+
+	card.failures[OID(kKeyHistoryOID)] = 0x6F00;
+	card.exchanges = 0;
+	found = discover(card);
+	const unsigned int probingExchanges = card.exchanges;
+	CHECK(found == expectedSlots(historyCount));
+
+	// Each certificate takes 5 exchanges, each missing slot 1
+	const unsigned int readExchanges = (3 + historyCount) * 5;
+	CHECK(keyHistoryExchanges == 1 + readExchanges + 1 * 1);
+	CHECK(probingExchanges == 1 + readExchanges + (kCertificateSlots - 3 - historyCount) * 1);
+	CHECK(keyHistoryExchanges < probingExchanges);
+	printf("%2u retired certificates: %2u exchanges with the Key History, %2u probing\n",
+		historyCount, keyHistoryExchanges, probingExchanges);
+}
+
+int main(int argc, char *argv[])
+{
+	testKeyHistoryValues();
+	testExchanges(0);
+	testExchanges(2);
+	testExchanges(19);
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("PIV discovery checks passed\n");
+	return 0;
+}
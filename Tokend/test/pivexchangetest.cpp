@@ -0,0 +1,322 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  pivexchangetest.cpp
+ *
+ *  Checks of the PIV response gathering (PIV/PIVExchange.h) against a
+ *  simulated card: BER-TLV header lengths, responses chained over several
+ *  61xx statuses, headers announcing more or less than the card sends, and
+ *  the pooled buffers getDataCore() gathers responses in.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+
+#include "PIVExchange.h"
+#include "SCardError.h"
+#include <security_utilities/utilities.h>
+#include "SecureBufferAllocator.h"
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+#define BYTES(bytes)	byte_string(bytes, bytes + sizeof(bytes))
+
+static const unsigned char kGetData[] = { 0x00, 0xCB, 0x3F, 0xFF, 0x05, 0x5C, 0x03, 0x5F, 0xC1, 0x05 };
+
+/*
+	A card holding one object.  GET DATA answers at most firstChunk bytes
+	and 61xx for the rest, which GET RESPONSE hands out.  Like
+	PIVToken::transmit(), the room given for the response is added to
+	result before the card writes into it.
+*/
+class VirtualPIV
+{
+public:
+	VirtualPIV(const byte_string &data) : object(data), firstChunk(256), failAt(0),
+		exchanges(0), overflows(0), moves(0) {}
+
+	uint16_t simpleExchangeAPDU(const byte_string &apdu, byte_string &result, size_t maxLength);
+
+	void resetCounts() { exchanges = overflows = moves = 0; }
+
+	byte_string object;
+	size_t firstChunk;
+	unsigned int failAt;	// exchange answered 6F00 instead, 0 for none
+	byte_string pending;	// what GET RESPONSE hands out
+	unsigned int exchanges;
+	unsigned int overflows;	// responses longer than the room given, a reader fails these
+	unsigned int moves;		// GET RESPONSE fragments that moved the data received so far
+};
+
+uint16_t VirtualPIV::simpleExchangeAPDU(const byte_string &apdu, byte_string &result, size_t maxLength)
+{
+	exchanges++;
+	if (exchanges == failAt)
+	{
+		pending.clear();
+		return 0x6F00;
+	}
+	size_t length;
+	bool getResponse = apdu.size() == 5 && apdu[1] == 0xC0;
+	if (getResponse)
+		length = apdu[4] ? apdu[4] : 256;
+	else
+	{
+		pending = object;
+		length = firstChunk;
+	}
+	length = std::min(length, pending.size());
+	if (length + 2 > maxLength)
+	{
+		overflows++;
+		pending.clear();
+		return 0x6700;
+	}
+	uint16_t sw = SCARD_SUCCESS;
+	if (pending.size() > length)
+	{
+		size_t left = pending.size() - length;
+		sw = 0x6100 | (left > 255 ? 0 : left);
+	}
+
+	const size_t index = result.size();
+	const size_t capacity = result.capacity();
+	secure_resize(result, index + maxLength);
+	if (getResponse && result.capacity() != capacity)
+		moves++;
+	std::copy(pending.begin(), pending.begin() + length, result.begin() + index);
+	pending.erase(pending.begin(), pending.begin() + length);
+	result.resize(index + length);
+	return sw;
+}
+
+/* A 53 object of valueLength bytes whose header announces announcedLength */
+static byte_string makeObject(size_t announcedLength, size_t valueLength)
+{
+	byte_string object(1, PIV_GETDATA_RESPONSE_TAG);
+	if (announcedLength > 0xFFFF)
+	{
+		object.push_back(0x83);
+		object.push_back(announcedLength >> 16);
+	}
+	else
+		object.push_back(0x82);
+	object.push_back((announcedLength >> 8) & 0xFF);
+	object.push_back(announcedLength & 0xFF);
+	for (size_t ix = 0; ix < valueLength; ++ix)
+		object.push_back((unsigned char)(ix * 7 + 1));
+	return object;
+}
+
+static void testBerEncodedLength()
+{
+	const unsigned char shortForm[] = { 0x53, 0x05, 1, 2, 3, 4, 5 };
+	CHECK(berEncodedLength(BYTES(shortForm), 0) == 7);
+	// Only the header has to be there
+	CHECK(berEncodedLength(byte_string(shortForm, shortForm + 2), 0) == 7);
+
+	const unsigned char oneByte[] = { 0x53, 0x81, 0xC8 };
+	CHECK(berEncodedLength(BYTES(oneByte), 0) == 3 + 0xC8);
+	const unsigned char twoBytes[] = { 0x53, 0x82, 0x04, 0x84 };
+	CHECK(berEncodedLength(BYTES(twoBytes), 0) == 4 + 0x484);
+	const unsigned char threeBytes[] = { 0x53, 0x83, 0x01, 0x00, 0x00 };
+	CHECK(berEncodedLength(BYTES(threeBytes), 0) == 5 + 0x10000);
+
+	// Multi-byte tag, the Key History object ID as a tag
+	const unsigned char longTag[] = { 0x5F, 0xC1, 0x0C, 0x82, 0x01, 0x00 };
+	CHECK(berEncodedLength(BYTES(longTag), 0) == 6 + 0x100);
+
+	// After data already received
+	const unsigned char offset[] = { 0xAA, 0xBB, 0x53, 0x81, 0x80 };
+	CHECK(berEncodedLength(BYTES(offset), 2) == 3 + 0x80);
+
+	// Incomplete or unsupported headers
+	CHECK(berEncodedLength(byte_string(), 0) == 0);
+	CHECK(berEncodedLength(BYTES(shortForm), sizeof(shortForm)) == 0);
+	CHECK(berEncodedLength(byte_string(shortForm, shortForm + 1), 0) == 0);
+	CHECK(berEncodedLength(byte_string(twoBytes, twoBytes + 3), 0) == 0);
+	CHECK(berEncodedLength(byte_string(longTag, longTag + 2), 0) == 0);
+	const unsigned char indefinite[] = { 0x53, 0x80, 0x00 };
+	CHECK(berEncodedLength(BYTES(indefinite), 0) == 0);
+	const unsigned char fourBytes[] = { 0x53, 0x84, 0x00, 0x00, 0x01, 0x00 };
+	CHECK(berEncodedLength(BYTES(fourBytes), 0) == 0);
+}
+
+/* Reads the card's object after the bytes already in result */
+static uint16_t readObject(VirtualPIV &card, byte_string &result)
+{
+	card.resetCounts();
+	return pivExchangeAPDU(card, BYTES(kGetData), result);
+}
+
+static void testChainedResponse()
+{
+	// 4 + 1209 bytes: 256 with the GET DATA then 61 00, 61 00, 61 00, 61 BD
+	VirtualPIV card(makeObject(1209, 1209));
+	byte_string result;
+	CHECK(readObject(card, result) == SCARD_SUCCESS);
+	CHECK(result == card.object);
+	CHECK(card.exchanges == 5);
+	CHECK(card.overflows == 0);
+	// Sized once from the header, the fragments are written in place
+	CHECK(result.capacity() >= card.object.size());
+	CHECK(card.moves == 0);
+
+	// Appended to what is already there
+	const unsigned char prefix[] = { 0x01, 0x02, 0x03 };
+	result = BYTES(prefix);
+	CHECK(readObject(card, result) == SCARD_SUCCESS);
+	CHECK(result.size() == sizeof(prefix) + card.object.size());
+	CHECK(std::equal(prefix, prefix + sizeof(prefix), result.begin()));
+	CHECK(std::equal(card.object.begin(), card.object.end(), result.begin() + sizeof(prefix)));
+	CHECK(card.exchanges == 5);
+	CHECK(card.moves == 0);
+
+	// A card answering the GET DATA with 61 00 and no data: nothing to size
+	// the buffer from, so the fragments keep the wide margin
+	card.firstChunk = 0;
+	result.clear();
+	CHECK(readObject(card, result) == SCARD_SUCCESS);
+	CHECK(result == card.object);
+	CHECK(card.exchanges == 6);
+	CHECK(card.overflows == 0);
+
+	// An exact multiple of 256 ends on 61 00 then a full 256 byte fragment
+	VirtualPIV even(makeObject(1020, 1020));
+	result.clear();
+	CHECK(readObject(even, result) == SCARD_SUCCESS);
+	CHECK(result == even.object);
+	CHECK(even.exchanges == 4);
+	CHECK(even.overflows == 0);
+	CHECK(even.moves == 0);
+}
+
+static void testAnnouncedLength()
+{
+	// More announced than sent: the buffer is sized for the announced
+	// length, the response still ends where the card says
+	VirtualPIV longer(makeObject(12000, 600));
+	byte_string result;
+	CHECK(readObject(longer, result) == SCARD_SUCCESS);
+	CHECK(result == longer.object);
+	CHECK(longer.exchanges == 3);
+	CHECK(longer.overflows == 0);
+	CHECK(longer.moves == 0);
+	CHECK(result.capacity() >= 4 + 12000);
+
+	// More than any PIV object: not trusted, the fragments keep the margin
+	VirtualPIV huge(makeObject(0x100000, 700));
+	result.clear();
+	CHECK(readObject(huge, result) == SCARD_SUCCESS);
+	CHECK(result == huge.object);
+	CHECK(huge.exchanges == 3);
+	CHECK(huge.overflows == 0);
+	CHECK(result.capacity() < 0x100000);
+
+	// Less announced than sent: the buffer grows, the data is all there
+	VirtualPIV shorter(makeObject(256, 1000));
+	result.clear();
+	CHECK(readObject(shorter, result) == SCARD_SUCCESS);
+	CHECK(result == shorter.object);
+	CHECK(shorter.exchanges == 4);
+	CHECK(shorter.overflows == 0);
+}
+
+/* How PIVToken::getDataCore() gathers a response and hands it over */
+static uint16_t getData(VirtualPIV &card, SecureBufferAllocator<PIV_RESPONSE_BUFFERS> &buffers, byte_string &data)
+{
+	byte_string &response = buffers.getBuffer();
+	uint16_t sw = readObject(card, response);
+	secure_zero(data);
+	data.swap(response);
+	return sw;
+}
+
+static void testPooledBuffers()
+{
+	VirtualPIV card(makeObject(1500, 1500));
+	SecureBufferAllocator<PIV_RESPONSE_BUFFERS> buffers;
+	byte_string data;
+	std::set<const unsigned char *> storages;
+	for (int ix = 0; ix < 10; ++ix)
+	{
+		const unsigned char *previous = data.empty() ? NULL : &data[0];
+		const size_t previousSize = data.size();
+		CHECK(getData(card, buffers, data) == SCARD_SUCCESS);
+		CHECK(data == card.object);
+		CHECK(card.moves == 0);
+		// The previous response went back to the pool, wiped
+		if (previous)
+		{
+			CHECK(previous != &data[0]);
+			bool wiped = true;
+			for (size_t jx = 0; jx < previousSize; ++jx)
+				wiped = wiped && previous[jx] == 0;
+			CHECK(wiped);
+		}
+		// Once every buffer has been used, responses reuse their storage
+		if (ix >= PIV_RESPONSE_BUFFERS + 1)
+			storages.insert(&data[0]);
+	}
+	CHECK(storages.size() <= PIV_RESPONSE_BUFFERS + 1);
+
+	// A read failing half way leaves its response in the pool, getDataCore()
+	// throws before handing it over.  It is wiped once the buffer is handed
+	// out again.
+	card.failAt = 3;
+	byte_string &response = buffers.getBuffer();
+	CHECK(readObject(card, response) == 0x6F00);
+	const size_t partial = response.size();
+	CHECK(partial == 2 * 256);
+	const unsigned char *raw = response.data();
+	byte_string *buffer = NULL;
+	for (int ix = 0; ix < PIV_RESPONSE_BUFFERS; ++ix)
+		buffer = &buffers.getBuffer();
+	CHECK(buffer == &response);
+	CHECK(response.empty());
+	CHECK(response.data() == raw);
+	bool wiped = true;
+	for (size_t ix = 0; ix < partial; ++ix)
+		wiped = wiped && raw[ix] == 0;
+	CHECK(wiped);
+}
+
+int main(int argc, char *argv[])
+{
+	testBerEncodedLength();
+	testChainedResponse();
+	testAnnouncedLength();
+	testPooledBuffers();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("PIV exchange checks passed\n");
+	return 0;
+}
@@ -0,0 +1,319 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  tlvtest.cpp
+ *
+ *  Checks of the shared TLV parser (PIV/TLV.cpp) and, with -bench, the time
+ *  and the number of heap allocations needed to parse a CCC and a
+ *  certificate container and to walk their inner values.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <new>
+
+#include "TLV.h"
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+/* Counts the heap allocations of the code under test */
+static unsigned long sAllocations = 0;
+
+/* operator new is backed by malloc, which newer compilers cannot see through */
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) throw(std::bad_alloc)
+{
+	sAllocations++;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) throw()
+{
+	free(p);
+}
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Card Capability Container as returned by GET DATA 5FC107 */
+static byte_string makeCCC()
+{
+	static const uint8_t ccc[] = {
+		0x53, 0x33,
+		0xF0, 0x15, 0xA0, 0x00, 0x00, 0x01, 0x16, 0xFF, 0x02, 0x21, 0x52, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0xF1, 0x01, 0x21,
+		0xF2, 0x01, 0x21,
+		0xF3, 0x00,
+		0xF4, 0x01, 0x00,
+		0xF5, 0x01, 0x10,
+		0xF6, 0x00,
+		0xF7, 0x00,
+		0xFA, 0x00,
+		0xFB, 0x00,
+		0xFC, 0x00,
+		0xFD, 0x00,
+		0xFE, 0x00
+	};
+	return byte_string(ccc, ccc + sizeof(ccc));
+}
+
+/* Certificate container (5FC105): 53 { 70 cert, 71 info, FE LRC } */
+static byte_string makeCertificateContainer(size_t certSize)
+{
+	byte_string cert;
+	cert += (uint8_t)0x70;
+	cert += (uint8_t)0x82;
+	cert += (uint8_t)(certSize >> 8);
+	cert += (uint8_t)(certSize & 0xFF);
+	for (size_t i = 0; i < certSize; i++)
+		cert += (uint8_t)(i * 7);
+	static const uint8_t tail[] = { 0x71, 0x01, 0x00, 0xFE, 0x00 };
+	cert.insert(cert.end(), tail, tail + sizeof(tail));
+
+	byte_string data;
+	data += (uint8_t)0x53;
+	data += (uint8_t)0x82;
+	data += (uint8_t)(cert.size() >> 8);
+	data += (uint8_t)(cert.size() & 0xFF);
+	data += cert;
+	return data;
+}
+
+static void testCCC()
+{
+	byte_string data = makeCCC();
+	TLV_ref root = TLV::parse(data);
+	CHECK(root->getTag() == 0x53);
+	CHECK(root->getValue().size() == 0x33);
+	/* The value references the parsed buffer */
+	CHECK(root->getValue().begin() == &data[2]);
+
+	const TLVList &list = root->getInnerValues();
+	CHECK(list.size() == 13);
+	CHECK(list[0]->getTag() == 0xF0);
+	CHECK(list[0]->getValue().size() == 21);
+	CHECK(list[0]->getValue()[0] == 0xA0);
+	CHECK(list[6]->getTag() == 0xF6);
+	CHECK(list[6]->getValue().empty());
+	CHECK(list[12]->getTag() == 0xFE);
+
+	TLVList::const_iterator found = std::find_if(list.begin(), list.end(), TagPredicate(0xF5));
+	CHECK(found != list.end() && (*found)->getValue() == 0x10);
+
+	/* A second call returns the cached list */
+	CHECK(&root->getInnerValues() == &list);
+	CHECK(root->encode() == data);
+	CHECK(root->length() == data.size());
+}
+
+static void testLongFormAndMultiByteTags()
+{
+	byte_string data = makeCertificateContainer(1400);
+	TLV_ref root = TLV::parse(data);
+	const TLVList &list = root->getInnerValues();
+	CHECK(list.size() == 3);
+	CHECK(list[0]->getTag() == 0x70);
+	CHECK(list[0]->getValue().size() == 1400);
+	CHECK(list[0]->getValue()[1399] == (uint8_t)(1399 * 7));
+	CHECK(root->encode() == data);
+
+	static const uint8_t chuid[] = { 0x5C, 0x03, 0x5F, 0xC1, 0x02 };
+	byte_string request(chuid, chuid + sizeof(chuid));
+	TLV_ref tag = TLV::parse(request);
+	CHECK(tag->getTag() == 0x5C);
+	CHECK(tag->getValue().size() == 3);
+
+	static const uint8_t multi[] = { 0x5F, 0xC1, 0x02, 0x01, 0x42, 0xAA };
+	const uint8_t *iter = multi;
+	TLV_ref ref = TLV::parse(iter, multi + sizeof(multi));
+	CHECK(ref->getTag().size() == 3);
+	CHECK(ref->getValue() == 0x42);
+	/* Trailing bytes are left to the caller */
+	CHECK(iter == multi + 5);
+}
+
+static void testErrors()
+{
+	static const uint8_t truncatedLength[] = { 0x53, 0x82, 0x01 };
+	static const uint8_t valueOverrun[] = { 0x53, 0x05, 0x01, 0x02 };
+	static const uint8_t tagOnly[] = { 0x53 };
+	static const uint8_t truncatedTag[] = { 0x5F, 0xC1 };
+	static const uint8_t badInner[] = { 0x53, 0x03, 0x70, 0x05, 0x00 };
+	const struct {
+		const uint8_t *data;
+		size_t size;
+	} cases[] = {
+		{ truncatedLength, sizeof(truncatedLength) },
+		{ valueOverrun, sizeof(valueOverrun) },
+		{ tagOnly, sizeof(tagOnly) },
+		{ truncatedTag, sizeof(truncatedTag) },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		bool thrown = false;
+		try {
+			const uint8_t *iter = cases[i].data;
+			TLV::parse(iter, cases[i].data + cases[i].size);
+		} catch (const std::runtime_error &) {
+			thrown = true;
+		}
+		CHECK(thrown);
+	}
+
+	bool thrown = false;
+	try {
+		TLV::parse(byte_string());
+	} catch (const std::runtime_error &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	/* The outer TLV is valid, its value is not */
+	byte_string data(badInner, badInner + sizeof(badInner));
+	TLV_ref root = TLV::parse(data);
+	thrown = false;
+	try {
+		root->getInnerValues();
+	} catch (const std::runtime_error &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+static void testEncode()
+{
+	TLVList inner;
+	inner.push_back(TLV_ref(new TLV(0x80, byte_string(3, 0x11))));
+	inner.push_back(TLV_ref(new TLV(0x81, byte_string(200, 0x22))));
+	TLV outer(0x7C, inner);
+
+	byte_string encoded = outer.encode();
+	CHECK(encoded.size() == outer.length());
+	CHECK(encoded[0] == 0x7C);
+	CHECK(encoded[1] == 0x81);
+	CHECK(encoded[2] == 5 + 3 + 200);
+
+	/* Parsing the encoding gives the same tree back */
+	TLV_ref parsed = TLV::parse(encoded);
+	const TLVList &list = parsed->getInnerValues();
+	CHECK(list.size() == 2);
+	CHECK(list[1]->getTag() == 0x81);
+	CHECK(list[1]->getValue() == byte_string(200, 0x22));
+	CHECK(outer.getValue() == byte_string(parsed->getValue().begin(), parsed->getValue().end()));
+
+	CHECK(TLV::encodedLength(0x7F) == 1);
+	CHECK(TLV::encodedLength(0x80) == 2);
+	CHECK(TLV::encodedLength(0x100) == 3);
+}
+
+/* More inner values than fit in one arena block, each with its own inner values */
+static void testArenaGrowth()
+{
+	const size_t count = 40;
+	byte_string value;
+	for (size_t i = 0; i < count; i++) {
+		value += (uint8_t)0xA1;
+		value += (uint8_t)3;
+		value += (uint8_t)0x80;
+		value += (uint8_t)1;
+		value += (uint8_t)i;
+	}
+	byte_string data;
+	data += (uint8_t)0x53;
+	data += (uint8_t)0x81;
+	data += (uint8_t)value.size();
+	data += value;
+
+	TLV_ref root = TLV::parse(data);
+	const TLVList &list = root->getInnerValues();
+	CHECK(list.size() == count);
+	for (size_t i = 0; i < list.size(); i++) {
+		const TLVList &inner = list[i]->getInnerValues();
+		CHECK(inner.size() == 1);
+		CHECK(inner[0]->getTag() == 0x80);
+		CHECK(inner[0]->getValue() == (uint8_t)i);
+	}
+}
+
+/* Parses the data and walks its inner values */
+static size_t walk(const byte_string &data)
+{
+	size_t bytes = 0;
+	TLV_ref root = TLV::parse(data);
+	const TLVList &list = root->getInnerValues();
+	for (TLVList::const_iterator iter = list.begin(); iter != list.end(); ++iter)
+		bytes += (*iter)->getTag().size() + (*iter)->getValue().size();
+	return bytes;
+}
+
+static void bench(const char *name, const byte_string &data, unsigned int iterations)
+{
+	size_t bytes = 0;
+	walk(data);
+	unsigned long allocations = sAllocations;
+	double start = now();
+	for (unsigned int i = 0; i < iterations; i++)
+		bytes += walk(data);
+	double elapsed = now() - start;
+	allocations = sAllocations - allocations;
+	printf("%-24s %4u bytes  %7.3f us/parse  %5.1f allocations/parse  (%lu)\n",
+		name, (unsigned int)data.size(), elapsed * 1e6 / iterations,
+		(double)allocations / iterations, (unsigned long)(bytes / iterations));
+}
+
+int main(int argc, char *argv[])
+{
+	testCCC();
+	testLongFormAndMultiByteTags();
+	testErrors();
+	testEncode();
+	testArenaGrowth();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("TLV checks passed\n");
+
+	if (argc > 1 && !strcmp(argv[1], "-bench")) {
+		bench("CCC", makeCCC(), 200000);
+		bench("certificate container", makeCertificateContainer(1400), 200000);
+	}
+	return 0;
+}
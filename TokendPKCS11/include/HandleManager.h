@@ -93,6 +93,13 @@ public:
 
 /**
  * Class to handle (zero or custom)-based object-handles in a unified way
+ *
+ * Values live in slots; a handle is `base` plus the slot index in the low
+ * INDEX_BITS and the slot's generation above it.  Erased slots go on a free
+ * list and get a new generation when `add` reuses them, so add, find and
+ * erase are O(1) and stale handles to a reused slot are rejected.
+ * `fill_empty` keeps a slot's handle instead, for handles that must stay
+ * put (slot ids).
  */
 template<typename T>
 class HandleManager {
@@ -103,6 +110,13 @@ public:
 	typedef HandledObject<T> handled_type;
 	value_collection values;
 
+	enum {
+		INDEX_BITS = 16,
+		GENERATION_BITS = 11,
+		INDEX_MASK = (1 << INDEX_BITS) - 1,
+		GENERATION_MASK = (1 << GENERATION_BITS) - 1
+	};
+
 	typedef typename value_collection::reverse_iterator reverse_iterator;
 	typedef typename value_collection::iterator iterator;
 	typedef typename value_collection::const_iterator const_iterator;
@@ -116,11 +130,20 @@ public:
 	/**
 	 * Add a new reference value to the handle manager into an empty slot
 	 * @param ref New value to add
-	 * @param notEmpty Filter that returns success on a non-empty slot (negated during search)
+	 * @param notEmpty Filter that returns success on a non-empty slot (erased slots it passes are not reused)
 	 */
 	template<typename Filter>
 	iterator add(ref_type ref, Filter notEmpty);
 
+	/**
+	 * Add a new reference value into the first slot that is empty, keeping that slot's handle
+	 * Linear in the number of slots
+	 * @param ref New value to add
+	 * @param notEmpty Filter that returns success on a non-empty slot (negated during search)
+	 */
+	template<typename Filter>
+	iterator fill_empty(ref_type ref, Filter notEmpty);
+
 	/**
 	 * Replace a given iterator's value, updating the new value's handle ref
 	 * @param iter Location to update
@@ -159,13 +182,13 @@ public:
 	 * Find the given `handle` and return it or the `end` marker
 	 */
 	iterator find(int handle) {
-		return !valid_handle(handle) ? values.end() : values.begin() + (handle - base);
+		return !valid_handle(handle) ? values.end() : values.begin() + ((handle - base) & INDEX_MASK);
 	}
 	/**
 	 * Find the given `handle` and return it or the `end` marker
 	 */
 	const_iterator find(int handle) const {
-		return !valid_handle(handle) ? values.end() : values.begin() + (handle - base);
+		return !valid_handle(handle) ? values.end() : values.begin() + ((handle - base) & INDEX_MASK);
 	}
 	/**
 	 * Invalidate and release the reference at the given reference location
@@ -206,6 +229,25 @@ private:
 	 * @param iter Value reference to alter
 	 */
 	void refresh_active_reference(iterator iter);
+
+	/**
+	 * Calculates the handle of the value at `index` from its slot generation
+	 */
+	int make_handle(size_t index) const;
+
+	enum {
+		FREE_LIST_END = -1,
+		NOT_FREE = -2
+	};
+	/* Bookkeeping for each slot of `values`, kept even for trimmed slots so
+	 * that their generation survives */
+	struct slot_state {
+		slot_state() : generation(0), next_free(NOT_FREE) {}
+		int generation;
+		int next_free; /* Next erased slot, FREE_LIST_END or NOT_FREE */
+	};
+	std::vector<slot_state> slot_states;
+	int free_head;
 	
 	const int base;
 };
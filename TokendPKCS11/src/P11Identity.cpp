@@ -140,8 +140,8 @@ static void getCertData(SecIdentityRef identity, P11Attributes &certAttributes,
 					checkAssert(keyData->getTag() == 0x30);
 					const TLVList &values = keyData->getInnerValues();
 					checkAssert(values.size() == 2);
-					const byte_string &modulus = values[0]->getValue();
-					const byte_string &exponent = values[1]->getValue();
+					byte_span modulus = values[0]->getValue();
+					byte_span exponent = values[1]->getValue();
 					int modulusDataBegin = 0;
 					/* Trim off extra zeroes in modulus encoding */
 					while(!modulus[modulusDataBegin])
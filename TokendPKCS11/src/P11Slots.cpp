@@ -115,7 +115,8 @@ static void LoadIntoMap(const void *value, void *context) {
 }
 
 P11Slot_Ref P11Slots::loadEmptySlot(SecKeychainRef keychain) {
-	return *slots.add(P11SlotCreator::ActiveSlot(keychain), FilterKeepOccupiedSlot());
+	/* Slot ids stay put: the first dummy slot takes the keychain */
+	return *slots.fill_empty(P11SlotCreator::ActiveSlot(keychain), FilterKeepOccupiedSlot());
 }
 
 /* T EXPECTED TO BE OF PAIR TYPE */
@@ -0,0 +1,309 @@
+/*
+ *  @APPLE_LICENSE_HEADER_START@
+ *
+ *  This file contains Original Code and/or Modifications of Original Code
+ *  as defined in and that are subject to the Apple Public Source License
+ *  Version 2.0 (the 'License'). You may not use this file except in
+ *  compliance with the License. Please obtain a copy of the License at
+ *  http://opensource.apple.com/apsl and read it before using this
+ *  file.
+ *
+ *  The Original Code and all software distributed under the License are
+ *  distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ *  EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ *  INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ *  Please see the License for the specific language governing rights and
+ *  limitations under the License.
+ *
+ *  @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ *  handlemanagertest.cpp
+ *
+ *  Checks of HandleManager: slot ids that stay put as tokens come and go,
+ *  handle generations, and a multi-threaded run opening, looking up and
+ *  closing sessions under the pthread container lock the module uses.
+ *  With -bench, times add and erase with many live handles.
+ */
+
+#include "P11Mutexes.h"
+#include "HandleManager.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+static int sFailures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); sFailures++; } } while (0)
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static SystemMutexFactory mutexFactory;
+
+/* A slot as in P11Slots: dummy until a keychain is put in */
+class TestSlot : public LockableHandledObject<TestSlot> {
+	NOCOPY(TestSlot);
+public:
+	TestSlot(bool present) : LockableHandledObject<TestSlot>(mutexFactory.create()), present(present) {}
+	bool isPresent() const { return present; }
+private:
+	bool present;
+};
+typedef shared_ptr<TestSlot> TestSlot_Ref;
+
+class FilterKeepOccupiedSlot : public Filter<TestSlot_Ref> {
+public:
+	inline bool operator() (const TestSlot_Ref &slot) const {
+		return slot.get() && slot->isPresent();
+	}
+};
+
+class FilterKeepUsedSlot : public Filter<TestSlot_Ref> {
+public:
+	inline bool operator() (const TestSlot_Ref &slot) const {
+		return slot.get() && (!slot.unique() || slot->isPresent());
+	}
+};
+
+/* A session, owned by one thread */
+class TestSession : public LockableHandledObject<TestSession> {
+	NOCOPY(TestSession);
+public:
+	TestSession(int owner, unsigned serial) : LockableHandledObject<TestSession>(mutexFactory.create()), owner(owner), serial(serial) {}
+	const int owner;
+	const unsigned serial;
+};
+typedef shared_ptr<TestSession> TestSession_Ref;
+typedef HandleManager<TestSession> SessionHandleManager;
+
+/* Whether `handle` gets to a live session, as P11Sessions::handleToValue checks */
+static bool resolves(SessionHandleManager &sessions, int handle) {
+	SessionHandleManager::iterator iter = sessions.find(handle);
+	return iter != sessions.end() && iter->get();
+}
+
+/* The slot handling of P11Slots: 4 dummies, tokens filling them in place */
+static void testSlotIds() {
+	HandleManager<TestSlot> slots;
+	for(int i = 0; i < 4; i++)
+		slots.add(TestSlot_Ref(new TestSlot(false)), FilterKeepAll<TestSlot_Ref>());
+	for(int i = 0; i < 4; i++)
+		CHECK(slots.values[i]->getHandle() == i);
+
+	/* The first tokens take the first dummy slots */
+	TestSlot_Ref first = *slots.fill_empty(TestSlot_Ref(new TestSlot(true)), FilterKeepOccupiedSlot());
+	TestSlot_Ref second = *slots.fill_empty(TestSlot_Ref(new TestSlot(true)), FilterKeepOccupiedSlot());
+	CHECK(first->getHandle() == 0);
+	CHECK(second->getHandle() == 1);
+	CHECK(slots.values.size() == 4);
+
+	/* Removing a token puts a dummy back under the same id */
+	HandleManager<TestSlot>::iterator iter = slots.find(0);
+	CHECK(iter != slots.end() && *iter == first);
+	slots.kill_lockable_value(iter);
+	slots.replace_value(iter, TestSlot_Ref(new TestSlot(false)));
+	CHECK(!first->isValid());
+	CHECK(slots.values[0]->getHandle() == 0);
+
+	/* and the token comes back with it */
+	TestSlot_Ref again = *slots.fill_empty(TestSlot_Ref(new TestSlot(true)), FilterKeepOccupiedSlot());
+	CHECK(again->getHandle() == 0);
+	CHECK(slots.find(0) != slots.end() && *slots.find(0) == again);
+
+	/* More tokens than dummies add slots, idle ones beyond 4 are trimmed */
+	for(int i = 0; i < 3; i++)
+		slots.fill_empty(TestSlot_Ref(new TestSlot(true)), FilterKeepOccupiedSlot());
+	CHECK(slots.values.size() == 5);
+	iter = slots.find(4);
+	CHECK(iter != slots.end());
+	slots.kill_lockable_value(iter);
+	slots.replace_value(iter, TestSlot_Ref(new TestSlot(false)));
+	slots.remove_after_last_match(4, FilterKeepUsedSlot());
+	CHECK(slots.values.size() == 4);
+	CHECK(slots.find(4) == slots.end());
+	TestSlot_Ref fifth = *slots.fill_empty(TestSlot_Ref(new TestSlot(true)), FilterKeepOccupiedSlot());
+	CHECK(fifth->getHandle() == 4);
+}
+
+static void testGenerations() {
+	const int base = 0x08000000;
+	SessionHandleManager sessions(base);
+	TestSession_Ref one(new TestSession(0, 1));
+	TestSession_Ref two(new TestSession(0, 2));
+	sessions.add(one, FilterKeepValid<TestSession_Ref>());
+	sessions.add(two, FilterKeepValid<TestSession_Ref>());
+	CHECK(one->getHandle() == base);
+	CHECK(two->getHandle() == base + 1);
+
+	/* A reused slot gets a new handle, the old one finds nothing */
+	int stale = one->getHandle();
+	sessions.kill_lockable_value(sessions.find(stale));
+	CHECK(!one->isValid());
+	CHECK(!resolves(sessions, stale));
+	TestSession_Ref three(new TestSession(0, 3));
+	sessions.add(three, FilterKeepValid<TestSession_Ref>());
+	CHECK(three->getHandle() == base + (1 << SessionHandleManager::INDEX_BITS));
+	CHECK(sessions.find(stale) == sessions.end());
+	CHECK(resolves(sessions, three->getHandle()));
+	CHECK(*sessions.find(three->getHandle()) == three);
+
+	/* Handles of another pool or out of range */
+	CHECK(!sessions.valid_handle(INVALID_HANDLE_VALUE));
+	CHECK(!sessions.valid_handle(1));
+	CHECK(!sessions.valid_handle(base + 2));
+	CHECK(!sessions.valid_handle(base + (1 << (SessionHandleManager::INDEX_BITS + SessionHandleManager::GENERATION_BITS))));
+
+	/* Trimmed slots don't hand out their old handles again */
+	int trimmed = three->getHandle();
+	sessions.kill_lockable_value(sessions.find(two->getHandle()));
+	sessions.kill_lockable_value(sessions.find(trimmed));
+	sessions.remove_after_last_match(0, FilterKeepValid<TestSession_Ref>());
+	CHECK(sessions.values.empty());
+	TestSession_Ref four(new TestSession(0, 4));
+	sessions.add(four, FilterKeepValid<TestSession_Ref>());
+	CHECK((four->getHandle() & SessionHandleManager::INDEX_MASK) == 0);
+	CHECK(four->getHandle() != trimmed);
+	CHECK(sessions.find(trimmed) == sessions.end());
+}
+
+enum {
+	STRESS_THREADS = 16,
+	STRESS_OPERATIONS = 100000,
+	STRESS_SESSIONS = 32	/* Most sessions a thread keeps open */
+};
+
+/* Shared by the stress threads, as P11Sessions is */
+static SessionHandleManager stressSessions;
+static auto_ptr<UserMutex> stressLock;
+static unsigned stressAdds = 0;		/* Under the write lock */
+static unsigned stressStaleChecks[STRESS_THREADS];
+static unsigned stressFailures[STRESS_THREADS];
+
+static void *stressThread(void *arg) {
+	int me = (int)(intptr_t)arg;
+	unsigned seed = me + 1;
+	int live[STRESS_SESSIONS];
+	unsigned serials[STRESS_SESSIONS];
+	int count = 0;
+	int stale = INVALID_HANDLE_VALUE;
+	unsigned addsAtClose = 0;
+	unsigned serial = 0;
+
+	for(int op = 0; op < STRESS_OPERATIONS; op++) {
+		int choice = rand_r(&seed) % 4;
+		if(count == 0 || (choice == 0 && count < STRESS_SESSIONS)) {
+			/* Open, as P11Session::createSession */
+			TestSession_Ref session(new TestSession(me, ++serial));
+			StLock<UserMutex> sessionsLock(stressLock->writeMutex());
+			stressSessions.add(session, FilterKeepValid<TestSession_Ref>());
+			stressAdds++;
+			live[count] = session->getHandle();
+			serials[count++] = serial;
+		} else if(choice == 1) {
+			/* Close a random one, as closeSession */
+			int which = rand_r(&seed) % count;
+			StLock<UserMutex> sessionsLock(stressLock->writeMutex());
+			SessionHandleManager::iterator iter = stressSessions.find(live[which]);
+			if(iter == stressSessions.end() || (*iter)->serial != serials[which]) {
+				stressFailures[me]++;
+				continue;
+			}
+			stressSessions.kill_lockable_value(iter);
+			stale = live[which];
+			addsAtClose = stressAdds;
+			live[which] = live[--count];
+			serials[which] = serials[count];
+		} else {
+			/* Look one up, as LockedContainedObject */
+			int which = rand_r(&seed) % count;
+			StLock<UserMutex> sessionsLock(*stressLock);
+			SessionHandleManager::iterator iter = stressSessions.find(live[which]);
+			if(iter == stressSessions.end()) {
+				stressFailures[me]++;
+				continue;
+			}
+			TestSession_Ref session = *iter;
+			StLock<UserMutex> sessionLock(session->getLock());
+			if(session->owner != me || session->serial != serials[which] || session->getHandle() != live[which])
+				stressFailures[me]++;
+			/* The last closed handle finds nothing, unless its slot has
+			 * been reused often enough for the generation to wrap */
+			if(stale != INVALID_HANDLE_VALUE && stressAdds - addsAtClose <= SessionHandleManager::GENERATION_MASK) {
+				stressStaleChecks[me]++;
+				if(resolves(stressSessions, stale))
+					stressFailures[me]++;
+			}
+		}
+	}
+
+	/* Close what's left */
+	StLock<UserMutex> sessionsLock(stressLock->writeMutex());
+	for(int i = 0; i < count; i++)
+		stressSessions.kill_lockable_value(stressSessions.find(live[i]));
+	return NULL;
+}
+
+static void testStress() {
+	stressLock.reset(mutexFactory.create());
+	pthread_t threads[STRESS_THREADS];
+	double start = now();
+	for(int i = 0; i < STRESS_THREADS; i++)
+		CHECK(pthread_create(&threads[i], NULL, stressThread, (void *)(intptr_t)i) == 0);
+	unsigned staleChecks = 0;
+	for(int i = 0; i < STRESS_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		CHECK(stressFailures[i] == 0);
+		staleChecks += stressStaleChecks[i];
+	}
+	double elapsed = now() - start;
+
+	/* Every session was closed, every slot is free */
+	CHECK(find_if(stressSessions.begin(), stressSessions.end(), FilterKeepValid<TestSession_Ref>()) == stressSessions.end());
+	CHECK(stressSessions.values.size() <= STRESS_THREADS * STRESS_SESSIONS);
+	printf("%d threads, %d operations each: %u sessions opened, %u stale handle checks, %lu slots, %.2f s\n",
+		STRESS_THREADS, STRESS_OPERATIONS, stressAdds, staleChecks,
+		(unsigned long)stressSessions.values.size(), elapsed);
+}
+
+/* Closing and opening a session with many others open */
+static void bench(unsigned liveCount, unsigned iterations) {
+	SessionHandleManager sessions;
+	for(unsigned i = 0; i < liveCount; i++)
+		sessions.add(TestSession_Ref(new TestSession(0, i)), FilterKeepValid<TestSession_Ref>());
+	unsigned seed = 1;
+	double start = now();
+	for(unsigned i = 0; i < iterations; i++) {
+		int handle = sessions.values[rand_r(&seed) % liveCount]->getHandle();
+		sessions.kill_lockable_value(sessions.find(handle));
+		sessions.add(TestSession_Ref(new TestSession(0, i)), FilterKeepValid<TestSession_Ref>());
+	}
+	double elapsed = now() - start;
+	printf("%6u live sessions  %7.3f us per close and open\n", liveCount, elapsed * 1e6 / iterations);
+}
+
+int main(int argc, char *argv[]) {
+	testSlotIds();
+	testGenerations();
+	testStress();
+
+	if (sFailures) {
+		fprintf(stderr, "%d check(s) failed\n", sFailures);
+		return 1;
+	}
+	printf("HandleManager checks passed\n");
+
+	if (argc > 1 && !strcmp(argv[1], "-bench")) {
+		bench(100, 200000);
+		bench(50000, 200000);
+	}
+	return 0;
+}
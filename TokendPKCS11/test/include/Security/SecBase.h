@@ -0,0 +1,16 @@
+/*
+ *  Host build stand-in for <Security/SecBase.h>.
+ */
+
+#ifndef _TEST_SECBASE_H_
+#define _TEST_SECBASE_H_
+
+#include <stdint.h>
+
+typedef int32_t OSStatus;
+
+enum {
+	noErr = 0
+};
+
+#endif
@@ -0,0 +1,9 @@
+/*
+ *  Host build stand-in for <security_utilities/globalizer.h>: the handle
+ *  manager and the mutexes need nothing from it.
+ */
+
+#ifndef _TEST_GLOBALIZER_H_
+#define _TEST_GLOBALIZER_H_
+
+#endif
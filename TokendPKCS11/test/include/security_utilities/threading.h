@@ -0,0 +1,26 @@
+/*
+ *  Host build stand-in for <security_utilities/threading.h>: StLock only.
+ */
+
+#ifndef _TEST_THREADING_H_
+#define _TEST_THREADING_H_
+
+template <class Lock>
+class StLock {
+public:
+	StLock(Lock &lck) : me(lck) { me.lock(); mActive = true; }
+	~StLock() { if (mActive) me.unlock(); }
+
+	void lock() { me.lock(); mActive = true; }
+	void unlock() { if (mActive) { me.unlock(); mActive = false; } }
+	void release() { mActive = false; }
+
+private:
+	StLock(const StLock &);
+	void operator = (const StLock &);
+
+	Lock &me;
+	bool mActive;
+};
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ *  Host build stand-in for <security_utilities/utilities.h>.
+ */
+
+#ifndef _TEST_SECURITY_UTILITIES_H_
+#define _TEST_SECURITY_UTILITIES_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+#define NOCOPY(Type)    private: Type(const Type &); void operator = (const Type &);
+
+// The framework headers make the std names visible to the module sources
+using namespace std;
+
+#endif